@@ -7,6 +7,8 @@
 #define ENABLE_CALIBRATION 1
 #define ACCEL_SCALE 8192.0
 #define FILTER_COOEF 0.2
+#define OUTPUT_GYRO 0     //1 - 3 more columns, rate of turn in rad/s for the orientation fusion on the PC
+#define GYRO_SCALE 16.4   //LSB per deg/s, the DMP sets the +-2000 deg/s range
 
 MPU6050 mpu;
 volatile bool mpuFlag = false;  // mpu interaption flag
@@ -120,6 +122,10 @@ void loop() {
     mpu.dmpGetGravity(&gravity, &q);
     mpu.dmpGetYawPitchRoll(ypr, &q, &gravity);
     mpu.dmpGetAccel(&aa, fifoBuffer);
+    #if OUTPUT_GYRO
+    VectorInt16 gg;
+    mpu.dmpGetGyro(&gg, fifoBuffer);
+    #endif
 
     CompFilter(aa.x, aaFiltered.x);
     CompFilter(aa.y, aaFiltered.y);
@@ -136,7 +142,14 @@ void loop() {
 
     Serial.print(aaFiltered.x / ACCEL_SCALE, 4); Serial.print(',');
     Serial.print(aaFiltered.y / ACCEL_SCALE, 4); Serial.print(',');
-    Serial.print(aaFiltered.z / ACCEL_SCALE, 4); Serial.println();
+    Serial.print(aaFiltered.z / ACCEL_SCALE, 4);
+    #if OUTPUT_GYRO
+    Serial.print(',');
+    Serial.print(gg.x / GYRO_SCALE * DEG_TO_RAD, 4); Serial.print(',');
+    Serial.print(gg.y / GYRO_SCALE * DEG_TO_RAD, 4); Serial.print(',');
+    Serial.print(gg.z / GYRO_SCALE * DEG_TO_RAD, 4);
+    #endif
+    Serial.println();
 
 
     lastMeasurementTime = millis();
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+//uniform buffer binding point of the Camera block, the same in every program
+#define CAMERA_BINDING 0
+#define CAMERA_BLOCK_NAME "Camera"
+
+//GLSL declaration of the block, shaders put it instead of separate view and projection uniforms
+#define CAMERA_BLOCK_GLSL "layout (std140) uniform Camera {\n    mat4 view;\n    mat4 projection;\n};\n"
+
+/**
+* @class Camera
+* @brief View and projection in a uniform buffer shared by every program.
+* Matrices are uploaded in Upload() and only if they changed since the last upload.
+*/
+class Camera {
+public:
+    Camera() = default;
+    ~Camera();
+    Camera(const Camera&) = delete;
+    Camera& operator=(const Camera&) = delete;
+
+    /**
+    * @brief creates the buffer and binds it to CAMERA_BINDING
+    */
+    void Init();
+    void SetView(const glm::mat4& matrix);
+    void SetProjection(const glm::mat4& matrix);
+    /**
+    * @brief sends changed matrices to the GPU, call once per frame before drawing
+    */
+    void Upload();
+
+    const glm::mat4& GetView() const { return view; }
+    const glm::mat4& GetProjection() const { return projection; }
+    size_t GetUploadCount() const { return uploadCount; }
+    size_t GetFrameCount() const { return frameCount; }
+
+private:
+    unsigned int buffer = 0;
+    glm::mat4 view = glm::mat4(1.0f);
+    glm::mat4 projection = glm::mat4(1.0f);
+    bool viewChanged = true;
+    bool projectionChanged = true;
+    size_t uploadCount = 0;
+    size_t frameCount = 0;
+};
+
+#endif // CAMERA_H
@@ -0,0 +1,85 @@
+#pragma once
+#ifndef FRAMESCHEDULER_H
+#define FRAMESCHEDULER_H
+
+#include <chrono>
+#include <cstddef>
+
+struct GLFWwindow;
+
+/**
+* @class FrameScheduler
+* @brief Decides when the main loop draws and how long it sleeps.
+* Two clocks: the data clock runs Scene::Update() every data interval (COM port, camera keys), the display clock
+* presents a frame only after input, a redraw request or while the scene animates, at most displayRate per second.
+* In between the thread sleeps in glfwWaitEventsTimeout, so an idle window costs next to no CPU.
+* The fixed mode is the old loop (every iteration draws, sleeps to the frame rate) and is kept for comparison.
+*/
+class FrameScheduler {
+public:
+    struct Stats {
+        double framesPerSecond = 0.0;   // presented frames
+        double updatesPerSecond = 0.0;  // Scene::Update() calls
+        double cpuPercent = 0.0;        // process CPU time / wall time, 100% is one core, includes worker threads
+        double waitPercent = 0.0;       // wall time spent sleeping in the event wait
+    };
+
+    explicit FrameScheduler(double displayRate);
+
+    /**
+    * @brief window refresh (uncovered, expose) and framebuffer resize of window request a redraw,
+    * they come without any input, so nothing else would draw the stale contents again
+    */
+    void Attach(GLFWwindow* window);
+
+    void SetAdaptive(bool adaptive);
+    bool IsAdaptive() const { return adaptive; }
+
+    /**
+    * @brief processes window events, sleeping until the first of: an event, the next data tick, the next due frame
+    * @param dataInterval seconds between Update() calls without input, 0 - the scene needs none
+    * @param animating the scene changes by itself, a frame is due every display tick
+    */
+    void WaitForWork(double dataInterval, bool animating);
+    /**
+    * @brief the next frames have to be drawn, e.g. ImGui needs a couple of frames to settle after input
+    */
+    void RequestRedraw(int frames = 1);
+    /**
+    * @brief true if this iteration has to draw and present a frame
+    */
+    bool FrameDue(bool animating) const;
+    /**
+    * @brief true if the data clock ticked, Update() runs on data ticks and before every frame
+    */
+    bool DataDue(double dataInterval) const;
+    void FrameDrawn();
+    void Updated();
+
+    /**
+    * @brief rates over the last measurement window (about one second)
+    */
+    const Stats& GetStats() const { return stats; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void Measure(Clock::time_point now);
+    static double ProcessCpuSeconds();
+
+    bool adaptive = true;
+    double frameInterval;
+    int redrawFrames = 1;
+    Clock::time_point lastFrame;
+    Clock::time_point lastUpdate;
+
+    //measurement window
+    Clock::time_point windowStart;
+    double windowCpuStart = 0.0;
+    double windowWaitSeconds = 0.0;
+    size_t frames = 0;
+    size_t updates = 0;
+    Stats stats;
+};
+
+#endif // FRAMESCHEDULER_H
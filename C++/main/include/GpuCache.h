@@ -0,0 +1,94 @@
+#pragma once
+#ifndef GPUCACHE_H
+#define GPUCACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ShaderProgram.h"
+
+/**
+* @class Mesh
+* @brief Vertex array with one interleaved buffer of position xyz + color rgb per vertex
+*/
+class Mesh {
+public:
+    explicit Mesh(const std::vector<float>& vertices);
+    ~Mesh();
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+
+    void Draw(unsigned int mode) const;
+    unsigned int Vao() const { return vao; }
+    unsigned int Vbo() const { return vbo; }
+    int VertexCount() const { return vertexCount; }
+
+private:
+    unsigned int vao = 0, vbo = 0;
+    int vertexCount = 0;
+};
+
+/**
+* @class GpuCache
+* @brief Programs and meshes shared by every scene, built once per process instead of once per scene switch.
+* Users hold shared_ptr references; the cache keeps its own reference, so a resource survives switching to a
+* scene that does not need it. Linked programs can also be kept on disk between runs.
+*/
+class GpuCache {
+public:
+    struct Stats {
+        size_t programs = 0;            // cached now
+        size_t meshes = 0;
+        size_t inUse = 0;               // references held outside the cache
+        size_t requests = 0;
+        size_t hits = 0;
+        size_t programsCompiled = 0;
+        size_t programsFromDisk = 0;    // linked from a saved binary, no compiling
+        size_t meshesBuilt = 0;
+    };
+
+    static GpuCache& Get();
+
+    /**
+    * @brief program by name, compiled (or loaded from the binary folder) on the first request
+    */
+    std::shared_ptr<ShaderProgram> Program(const std::string& name, const char* vertexSource, const char* fragmentSource);
+    /**
+    * @brief mesh by name, build() gives its vertices and is called only on the first request
+    */
+    std::shared_ptr<Mesh> GetMesh(const std::string& name, const std::function<std::vector<float>()>& build);
+
+    //resources used by several scenes
+    std::shared_ptr<ShaderProgram> ColorProgram();  // position + color, Camera block, model matrix
+    std::shared_ptr<Mesh> BoardMesh();              // sensor board, 0.6 x 1.0 x 0.1, triangles
+    std::shared_ptr<Mesh> TriadMesh();              // unit axes x y z, lines
+
+    /**
+    * @brief keeps linked programs in folder, empty folder turns it off
+    */
+    void SetBinaryFolder(const std::string& folder);
+    /**
+    * @brief drops resources nobody but the cache holds
+    */
+    void Trim();
+    /**
+    * @brief drops everything, must be called while the GL context still exists
+    */
+    void Clear();
+    Stats GetStats() const;
+
+private:
+    GpuCache() = default;
+    bool LoadProgramBinary(ShaderProgram& program, const std::string& path, unsigned long long key);
+    void SaveProgramBinary(const ShaderProgram& program, const std::string& path, unsigned long long key);
+
+    std::map<std::string, std::shared_ptr<ShaderProgram>> programs;
+    std::map<std::string, std::shared_ptr<Mesh>> meshes;
+    std::string binaryFolder;
+    Stats stats;
+};
+
+#endif // GPUCACHE_H
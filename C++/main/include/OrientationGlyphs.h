@@ -0,0 +1,71 @@
+#pragma once
+#ifndef ORIENTATIONGLYPHS_H
+#define ORIENTATIONGLYPHS_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include "Engine.h"
+#include "GpuCache.h"
+
+//most triads along one trajectory
+#define GLYPH_MAX_INSTANCES 16384
+//floats per instance: position xyz, quaternion wxyz
+#define GLYPH_INSTANCE_SIZE 7
+
+/**
+* @class OrientationGlyphs
+* @brief Small axis triads along the trajectory, all of them drawn by one instanced call.
+* Instances are ordered coarse to fine (every 2^k-th picked sample first), so any prefix is spread evenly
+* along the path and the zoom only changes how many of them are drawn.
+*/
+class OrientationGlyphs {
+public:
+    OrientationGlyphs() = default;
+    ~OrientationGlyphs();
+    OrientationGlyphs(const OrientationGlyphs&) = delete;
+    OrientationGlyphs& operator=(const OrientationGlyphs&) = delete;
+
+    /**
+    * @brief compiles the program and creates the triad, needs the GL context
+    */
+    void Init();
+    /**
+    * @brief picks samples and fills the instance data, no GL calls, so it can run on the calculation thread
+    */
+    void Build(Trajectory::Span<float> positions, Trajectory::Span<float> quaternions);
+    /**
+    * @brief sends what Build() prepared to the GPU, the previous glyphs are drawn until then
+    */
+    void Upload();
+    void Clear() { drawLevels.clear(); }
+    /**
+    * @brief one instanced draw, the number of glyphs follows the screen length of the path
+    * @param model trajectory model matrix, glyph size is not affected by it
+    * @param pixelsPerUnit viewport height / (2 tan(fov / 2))
+    */
+    void Draw(const glm::mat4& model, const glm::mat4& view, float pixelsPerUnit);
+
+    size_t GetDrawnCount() const { return drawnCount; }
+
+private:
+    std::shared_ptr<ShaderProgram> program;
+    std::shared_ptr<Mesh> triad;        // shared vertex buffer, this class only adds its own VAO
+    int glyphSizeLocation = -1;
+    unsigned int vao = 0, instanceVBO = 0;
+
+    //filled by Build()
+    std::vector<float> instances;
+    std::vector<size_t> levels;         // instances up to and including every level, coarse to fine
+    glm::vec3 center = glm::vec3(0.0f);
+    float pathLength = 0.0f;
+
+    //what Upload() put on the GPU
+    std::vector<size_t> drawLevels;
+    glm::vec3 drawCenter = glm::vec3(0.0f);
+    float drawPathLength = 0.0f;
+    size_t drawnCount = 0;
+};
+
+#endif // ORIENTATIONGLYPHS_H
@@ -6,16 +6,22 @@
 #include <atomic>
 #include "UIStuff.h"
 #include <future>
+#include <chrono>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
-
-#define Q_SIZE 4
-#define A_SIZE 3
-#define R_SIZE 9
-#define T_SIZE 1
-#define INTEGRATION_SIZE 3
-#define ETAPS_COUNT 8.0f
-
+#include "AllanVariance.h"
+#include "Engine.h"
+#include "Ensemble.h"
+#include "PathLod.h"
+#include "PoseQuery.h"
+#include "Spectrum.h"
+#include "SpatialIndex.h"
+#include "StageExporter.h"
+#include "Tuner.h"
+#include "Camera.h"
+#include "GpuCache.h"
+#include "OrientationGlyphs.h"
+#include "SpectrogramView.h"
 
 
 class PlayScene : public Scene {
@@ -26,73 +32,148 @@ public:
 	void Update() override;
 	void RenderUI() override;
 	void InitRender() override;
+	double DataInterval() const override;
+	bool IsAnimating() const override;
 private:
 	
-	const float g = 9.81f;
-	const float gravityVector[3] = { 0.0f, 0.0f, 1.0f };
-	const double filterCutoff = 0.1;
-
-	void LoadData();
-	void AddRotationMatrix(float w, float x, float y, float z);
-	void TiltCompensateA(int i);
-	void CompensateGravity(int i);
-	void ConvertAtoV(int i);
-	void Integrate(int i, const std::vector<float>& input, std::vector<float>& output);
-	void HighPass3DFilter(std::vector<float>& data, float sample_rate, float cutoff);
-	void ConvertVtoPos(int i);
-	void SaveToSCV(const std::vector<float>& data, int s, const char* header, const char* name);
-	
-	//integration methods
-	void SquaresIntegration(int i, const std::vector<float>& input, std::vector<float>& output);
-	void TrapezoidIntegration(int i, const std::vector<float>& input, std::vector<float>& output);
-	void RungeKuttaIntegration(int i, const std::vector<float>& input, std::vector<float>& output);
-
 	void StartCalculation();
 	void Calculate();
 
 	
-	void InitCube();
-	void InitAxes();
-	void InitPoints();
 	void SetupCamera();
-	void CompileShaders();
+	void UpdateView();
+	void ShowPose(double time);
+	void Pick();
+	void StartEnsemble();
+	void StartTuning();
+	void StartAllan();
+	void RenderAllanPanel();
+	void StartSpectrum();
+	void RenderSpectrumPanel();
+	void BuildTube();
+
+	// Trajectory on the GPU: the final one, or the coarse preview shown while the calculation runs
+	struct PointsBuffer {
+		unsigned int vao = 0, vbo = 0, ebo = 0;
+		size_t capacityBytes = 0;		// vbo storage, reused while new positions fit
+		size_t totalBytes = 0;			// positions to upload
+		size_t uploadedBytes = 0;		// positions already on the GPU
+		size_t indexBytes = 0;
+		const float* source = nullptr;	// engine buffer the positions are read from
+		const Trajectory::PathLod* lod = nullptr;	// nullptr if there is nothing to draw
+		double uploadMilliseconds = 0.0;	// CPU time of all upload calls together
+		int uploadFrames = 0;
+		bool IsReady() const { return lod != nullptr && uploadedBytes == totalBytes; }
+	};
+	void InitPoints(PointsBuffer& points, Trajectory::Span<float> positions, const Trajectory::PathLod& lod);
+	void UploadPoints(PointsBuffer& points);
+	void DeletePoints(PointsBuffer& points);
+	void DrawTrajectory(const PointsBuffer& points, const glm::mat4& model, float pixelsPerUnit);
 	
 
 
-	std::atomic<int> dataSize = 1;
-	std::atomic<int> calculationProgress;
 	std::atomic<bool> isCalculating;
 	std::future<void> calculationFuture;
 
 	UIStuff::PopUp popUp;
-	std::vector<float> qs;
-	std::vector<float> as;
-	std::vector<float> Rs;
-	std::vector<float> ts;
-	std::vector<float> vs;
-	std::vector<float> pos;
+	Trajectory::Engine engine;
+	Trajectory::PathLod pathLod;
+	Trajectory::Engine previewEngine;
+	Trajectory::PathLod previewLod;
+	std::atomic<bool> previewReady{ false };
+	size_t previewFactor = 1;		// input rows per preview row of the last calculation
+	const char* previewFactors[6] = { "Auto", "2", "4", "8", "16", "32" };
+	int previewFactorIndex = 0;		// a power of two above Auto
 
 	std::string csvFilePath = "";
 	std::string outputPath = "";
 	bool saveCalculations = false;
+	StageExporter exporter;
+	const char* exportFormats[3] = { "CSV", "NPY", "CSV + NPY" };
+	int exportFormatIndex = 0;
 	
 	const char* integrationMethods[3] = {"Method of Squares", "Trapezoidal Rule", "Runge-Kutta Method"};
 	const int integrationMethodsCount = sizeof(integrationMethods) / sizeof(integrationMethods[0]);
 	int integrationMethodIndex = 0;
+	Trajectory::Settings pipelineSettings;	// cutoff, g, gravity and bias of the next calculation, the method is the index above
+	const char* interpolations[2] = { "Linear", "Cubic" };
+	const char* orientations[3] = { "Recorded (DMP)", "Madgwick", "Mahony" };
+	bool compareMethods = false;
+	bool methodsCompared = false;	// the last calculation ran every method, set before it starts
 
 	bool isPlaying = false;
 
 
 	// Graphics objects
-	unsigned int cubeVAO, cubeVBO;
-	unsigned int cubeAxesVAO, cubeAxesVBO;
-	unsigned int axesVAO, axesVBO;
-	unsigned int pointsVAO, pointsVBO;
-	unsigned int shaderProgram;
+	std::shared_ptr<Mesh> board;
+	std::shared_ptr<Mesh> boardAxes;
+	std::shared_ptr<Mesh> axes;
+	PointsBuffer finalPoints;
+	PointsBuffer previewPoints;
+	// Comparison mode: every method but the selected one, which is finalPoints
+	Trajectory::PathLod comparisonLods[METHOD_COUNT];
+	PointsBuffer comparisonPoints[METHOD_COUNT];
+	Trajectory::Divergence divergences[METHOD_COUNT];	// from the selected method
+	OrientationGlyphs glyphs;
+	bool showGlyphs = true;
+
+	// Picking and region queries over the final trajectory, in trajectory units (m)
+	Trajectory::SpatialIndex spatialIndex;
+	Trajectory::SpatialIndex::Hit picked;
+	float pickMicroseconds = 0.0f;
+	float boxLow[3] = { -0.1f, -0.1f, -0.1f };
+	float boxHigh[3] = { 0.1f, 0.1f, 0.1f };
+	std::vector<uint32_t> boxSamples;
+	float boxMicroseconds = 0.0f;
+
+	// Monte Carlo uncertainty of the final trajectory, drawn as a tube of one standard deviation around the ensemble mean
+	Trajectory::Ensemble ensemble;
+	Trajectory::EnsembleSettings ensembleSettings;
+	int ensembleMembers = 200;
+	std::future<void> ensembleFuture;
+	std::atomic<bool> isEnsembleRunning{ false };
+	std::vector<float> tubeVertices;	// built by the ensemble task, the mesh is made on the render thread
+	std::unique_ptr<Mesh> tube;
+	bool showTube = true;
+
+	// Search of the cutoff, bias and gravity magnitude over the final trajectory; its result is applied by recalculating
+	Trajectory::Tuner tuner;
+	Trajectory::TuningSettings tuningSettings;
+	const char* tuningObjectives[2] = { "Ends where it started", "Still at the start and the end" };
+	std::future<void> tunerFuture;
+	std::atomic<bool> isTuning{ false };
+
+	// Allan deviation of the accelerometer, plotted in its own window
+	Trajectory::AllanVariance allan;
+	std::future<void> allanFuture;
+	std::atomic<bool> isAllanRunning{ false };
+	bool showAllan = false;
+	std::string allanSaved = "";	// result of the last export
+
+	// Welch density and spectrogram of the world frame acceleration, in their own window
+	Trajectory::Spectrum spectrum;
+	Trajectory::SpectrumSettings spectrumSettings;
+	const char* spectrumSegments[5] = { "256", "512", "1024", "2048", "4096" };
+	int spectrumSegmentIndex = 2;
+	std::future<void> spectrumFuture;
+	std::atomic<bool> isSpectrumRunning{ false };
+	bool showSpectrum = false;
+	SpectrogramView spectrogramView;
+	float spectrogramStart = 0.0f;				// s, first column shown
+	float spectrogramLevels[2] = { -80.0f, 0.0f };	// dB at the ends of the color map
+	std::string spectrumSaved = "";
+
+	// Level of detail, filled every frame by DrawTrajectory()
+	std::vector<int> lodFirsts, lodCounts;
+	std::vector<int> lodElementCounts;
+	std::vector<const void*> lodElementOffsets;
+	size_t lodDrawnSamples = 0;
+	size_t lodCulledChunks = 0;
+	std::shared_ptr<ShaderProgram> program;
 
 	// Camera
-	glm::mat4 view;
-	glm::mat4 projection;
+	Camera camera;
+	bool viewChanged = true;
 	float cameraAngleX = 0.0f;
 	float cameraAngleY = 0.0f;
 	float cameraAngleZ = 0.0f;
@@ -100,17 +181,24 @@ private:
 
 	// Dimensions
 	const float CUBE_SIZE = 1.0f;
+	const float CUBE_SCALE = 0.125f;	// shared board mesh is drawn at this size
 	const float AXIS_LENGTH = 3.5f;
 	const float CUBE_AXIS_LENGTH = 0.2f;
-
-	// Shader sources
-	const char* vertexShaderSource;
-	const char* fragmentShaderSource;
+	const float TRAJECTORY_SCALE = 10.0f;	// metres to scene units, applied by the model matrix
+	const glm::vec3 TRAJECTORY_COLOR = glm::vec3(1.0f, 1.0f, 0.0f);
+	const glm::vec3 METHOD_COLORS[METHOD_COUNT] = { glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.8f, 1.0f), glm::vec3(1.0f, 0.3f, 0.8f) };
+	const float CAMERA_FOV = 45.0f;
+	const float LOD_PIXEL_ERROR = 1.0f;	// coarsest level whose error stays under this many pixels is drawn
 
 	glm::vec3 cubePosition;
 	glm::mat3x3 cubeRotation;
 	
-	int currentFrame = 0;
+	// Playback, driven by the wall clock and the recorded sample times
+	Trajectory::PoseQuery poses;
+	double playbackTime = 0.0;		// s from the first sample
+	float playbackSpeed = 1.0f;
+	size_t playbackSample = 0;
+	std::chrono::steady_clock::time_point playbackTick;
 };
 
 #endif // PLAYSCENE_H
@@ -8,6 +8,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <fstream>
 #include "UIStuff.h"
+#include "Camera.h"
+#include "GpuCache.h"
+#include "Fusion.h"
 
 class RecordScene : public Scene {
 public:
@@ -18,16 +21,15 @@ public:
 	void Update() override;
 	void RenderUI() override;
 	void InitRender() override;
+	double DataInterval() const override;
 
 private:
 	
-    void InitBoard();
-    void InitAxes();
     void SetupCamera();
-    void CompileShaders();
     std::string GenerateCSVFIlePath();
     bool StartNewRecording();
     void WriteToCSV();
+    void UpdateFusion();
     void StopRecording();
     
 
@@ -36,29 +38,34 @@ private:
     std::string csvFilePath;
     std::string savePath = "";
     bool isRecording = false;
+    bool headerWritten = false;     // after the first row, it decides whether the gyroscope columns are there
 
     
 
     //OpenGL stuff
-    unsigned int shaderProgram;
-    unsigned int boardVAO, boardVBO;
-    unsigned int axesVAO, axesVBO;
-    const char* vertexShaderSource;
-    const char* fragmentShaderSource;
+    //shared through GpuCache, nothing is rebuilt when the scene is opened again
+    std::shared_ptr<ShaderProgram> program;
+    std::shared_ptr<Mesh> board;
+    std::shared_ptr<Mesh> axes;
 
-    glm::mat4 view;
-    glm::mat4 projection;
+    Camera camera;
 
-    float BOARD_WIDTH;
-    float BOARD_HEIGHT;
-    float BOARD_THICKNESS;
-    float AXIS_LENGTH;
+    const float AXIS_LENGTH = 1.5f;
 
     //data stuff
     std::vector<float> q;
     std::vector<float> a;
+    std::vector<float> g;           // rad/s, if the board sends it
+    bool hasGyro = false;
     unsigned long time;
 
+    //orientation fused on the host from g and a, shown instead of the DMP one
+    const char* orientations[3] = { "DMP", "Madgwick", "Mahony" };
+    int orientationIndex = 0;
+    bool fusionAligned = false;     // the filter starts level from the first accelerometer sample
+    Trajectory::Fusion fusion;
+    std::vector<float> fusedQ;
+
 
     UIStuff::PopUp popUp;
 };
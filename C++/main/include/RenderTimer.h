@@ -0,0 +1,40 @@
+#pragma once
+#ifndef RENDERTIMER_H
+#define RENDERTIMER_H
+
+#include <chrono>
+
+//queries in flight, results are read a few frames later so the CPU never waits for the GPU
+#define RENDER_TIMER_QUERIES 4
+
+/**
+* @class RenderTimer
+* @brief CPU time of submitting GL commands and GPU time of executing them (GL_TIME_ELAPSED query).
+* Both are smoothed over recent frames.
+*/
+class RenderTimer {
+public:
+    RenderTimer() = default;
+    ~RenderTimer();
+    RenderTimer(const RenderTimer&) = delete;
+    RenderTimer& operator=(const RenderTimer&) = delete;
+
+    void Begin();
+    void End();
+
+    double GetCpuMilliseconds() const { return cpuMilliseconds; }
+    double GetGpuMilliseconds() const { return gpuMilliseconds; }
+
+private:
+    void ReadFinished();
+
+    unsigned int queries[RENDER_TIMER_QUERIES] = { 0 };
+    bool issued[RENDER_TIMER_QUERIES] = { false };
+    int current = 0;
+    bool measuring = false;
+    std::chrono::steady_clock::time_point cpuStart;
+    double cpuMilliseconds = 0.0;
+    double gpuMilliseconds = 0.0;
+};
+
+#endif // RENDERTIMER_H
@@ -14,8 +14,31 @@ public:
     virtual void Update() = 0;
     virtual void RenderUI() = 0;
 
+    /**
+    * @brief seconds between Update() calls when there is no input, 0 - Update() only runs with redraws
+    */
+    virtual double DataInterval() const { return 0.0; }
+    /**
+    * @brief true while the picture changes by itself (playback, calculation, uploads), a frame is drawn every display tick
+    */
+    virtual bool IsAnimating() const { return false; }
+    /**
+    * @brief true once after Update() changed something on screen
+    */
+    bool TakeRedrawRequest() {
+        bool requested = redrawRequested;
+        redrawRequested = false;
+        return requested;
+    }
+
 public:
     COM::Port* p_comPort;
+
+protected:
+    void RequestRedraw() { redrawRequested = true; }
+
+private:
+    bool redrawRequested = true;
 };
 
 #endif // SCENE_H
\ No newline at end of file
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef SHADERPROGRAM_H
+#define SHADERPROGRAM_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+/**
+* @class ShaderProgram
+* @brief Compiled and linked GL program.
+* Uniform locations are looked up once after linking and the Camera block is bound to CAMERA_BINDING,
+* so drawing never queries the driver by name.
+*/
+class ShaderProgram {
+public:
+    ShaderProgram() = default;
+    ~ShaderProgram();
+    ShaderProgram(const ShaderProgram&) = delete;
+    ShaderProgram& operator=(const ShaderProgram&) = delete;
+
+    /**
+    * @brief compiles both stages, links them and resolves uniforms
+    * @param retrievable keep the linked binary available for GetBinary()
+    * @return false if compiling or linking failed, the log goes to std::cerr
+    */
+    bool Compile(const char* vertexSource, const char* fragmentSource, bool retrievable = false);
+    /**
+    * @brief links the program from a binary saved by GetBinary()
+    * @return false if the driver rejects it (other GPU or driver version), Compile() is needed then
+    */
+    bool LoadBinary(unsigned int format, const void* binary, int length);
+    /**
+    * @brief linked program as the driver stores it, needs Compile(..., true)
+    */
+    bool GetBinary(unsigned int& format, std::vector<char>& binary) const;
+    void Use() const;
+    void SetModel(const glm::mat4& model) const;
+
+    unsigned int Id() const { return id; }
+    /**
+    * @brief location resolved at link time, -1 if the program has no such uniform
+    */
+    int ModelLocation() const { return modelLocation; }
+    /**
+    * @brief looks up any other uniform, call it once after Compile() and keep the result
+    */
+    int UniformLocation(const char* name) const;
+
+private:
+    void ResolveUniforms();
+
+    unsigned int id = 0;
+    int modelLocation = -1;
+};
+
+#endif // SHADERPROGRAM_H
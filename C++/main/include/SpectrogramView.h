@@ -0,0 +1,63 @@
+#pragma once
+#ifndef SPECTROGRAMVIEW_H
+#define SPECTROGRAMVIEW_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "imgui.h"
+#include "Spectrum.h"
+
+//columns the texture holds, the most that are shown at once
+#define SPECTROGRAM_VIEW_COLUMNS 1024
+
+/**
+* @class SpectrogramView
+* @brief Scrolling spectrogram image of a Spectrum, kept in one texture used as a ring of columns.
+* Every column goes to the row (its index mod SPECTROGRAM_VIEW_COLUMNS) of the texture, so scrolling only uploads the columns
+* that came into view, the rest stay where they are. The image is drawn transposed, time to the right and frequency up.
+*/
+class SpectrogramView {
+public:
+    SpectrogramView() = default;
+    ~SpectrogramView();
+    SpectrogramView(const SpectrogramView&) = delete;
+    SpectrogramView& operator=(const SpectrogramView&) = delete;
+
+    /**
+    * @brief the spectrum was computed again, every column is uploaded at the next Draw()
+    */
+    void Invalidate() { cachedCount = 0; }
+    /**
+    * @brief only columns [begin, end) were computed again, the ones of them in the ring are uploaded at the next Draw()
+    */
+    void Invalidate(size_t begin, size_t end) {
+        dirtyBegin = std::min(dirtyBegin, begin);
+        dirtyEnd = std::max(dirtyEnd, end);
+    }
+    /**
+    * @brief draws the columns from first on at the cursor, needs the GL context
+    * @param lowDb, highDb range of the color map, changing it uploads every shown column again
+    */
+    void Draw(const Trajectory::Spectrum& spectrum, size_t first, const ImVec2& size, float lowDb, float highDb);
+    /**
+    * @brief columns drawn at once for this spectrum
+    */
+    static size_t VisibleColumns(const Trajectory::Spectrum& spectrum);
+
+    size_t GetUploadedColumns() const { return uploadedColumns; }   // by the last Draw()
+
+private:
+    void Upload(const Trajectory::Spectrum& spectrum, size_t begin, size_t end);
+
+    unsigned int texture = 0;
+    size_t bins = 0;                            // texture width
+    size_t cachedFirst = 0, cachedCount = 0;    // columns the texture holds
+    size_t dirtyBegin = SIZE_MAX, dirtyEnd = 0;  // computed again since they were uploaded
+    float cachedLow = 0.0f, cachedHigh = 0.0f;
+    size_t uploadedColumns = 0;
+    std::vector<uint32_t> pixels;               // RGBA of the columns being uploaded
+};
+
+#endif // SPECTROGRAMVIEW_H
@@ -0,0 +1,58 @@
+#include "Camera.h"
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+
+//std140: two column-major mat4 one after another
+#define CAMERA_VIEW_OFFSET 0
+#define CAMERA_PROJECTION_OFFSET sizeof(glm::mat4)
+#define CAMERA_BUFFER_SIZE (2 * sizeof(glm::mat4))
+
+Camera::~Camera() {
+    if (buffer != 0) glDeleteBuffers(1, &buffer);
+}
+
+void Camera::Init() {
+    if (buffer == 0) {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, CAMERA_BUFFER_SIZE, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, buffer);
+    viewChanged = true;
+    projectionChanged = true;
+}
+
+void Camera::SetView(const glm::mat4& matrix) {
+    if (matrix == view) return;
+    view = matrix;
+    viewChanged = true;
+}
+
+void Camera::SetProjection(const glm::mat4& matrix) {
+    if (matrix == projection) return;
+    projection = matrix;
+    projectionChanged = true;
+}
+
+void Camera::Upload() {
+    frameCount++;
+    if (!viewChanged && !projectionChanged) return;
+
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    if (viewChanged && projectionChanged) {
+        glm::mat4 both[2] = { view, projection };
+        glBufferSubData(GL_UNIFORM_BUFFER, CAMERA_VIEW_OFFSET, CAMERA_BUFFER_SIZE, both);
+    }
+    else if (viewChanged) {
+        glBufferSubData(GL_UNIFORM_BUFFER, CAMERA_VIEW_OFFSET, sizeof(glm::mat4), glm::value_ptr(view));
+    }
+    else {
+        glBufferSubData(GL_UNIFORM_BUFFER, CAMERA_PROJECTION_OFFSET, sizeof(glm::mat4), glm::value_ptr(projection));
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    viewChanged = false;
+    projectionChanged = false;
+    uploadCount++;
+}
@@ -0,0 +1,136 @@
+#include "FrameScheduler.h"
+#include <algorithm>
+#include <ctime>
+#include <thread>
+#include <GLFW/glfw3.h>
+#include "imgui.h"
+#include "imgui_internal.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+//longest sleep with nothing to wake up for
+#define MAX_WAIT_SECONDS 0.5
+//frames drawn after input, ImGui settles hover and window sizes over a couple of frames
+#define INPUT_REDRAW_FRAMES 3
+//a frame this close to its tick is drawn now rather than after one more wait
+#define FRAME_SLACK_SECONDS 0.001
+#define STATS_WINDOW_SECONDS 1.0
+
+static double Seconds(std::chrono::steady_clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+FrameScheduler::FrameScheduler(double displayRate) : frameInterval(1.0 / displayRate) {
+    lastFrame = lastUpdate = windowStart = Clock::now();
+    windowCpuStart = ProcessCpuSeconds();
+}
+
+void FrameScheduler::Attach(GLFWwindow* window) {
+    glfwSetWindowUserPointer(window, this);
+    glfwSetWindowRefreshCallback(window, [](GLFWwindow* refreshed) {
+        static_cast<FrameScheduler*>(glfwGetWindowUserPointer(refreshed))->RequestRedraw();
+    });
+    glfwSetFramebufferSizeCallback(window, [](GLFWwindow* resized, int, int) {
+        static_cast<FrameScheduler*>(glfwGetWindowUserPointer(resized))->RequestRedraw();
+    });
+}
+
+void FrameScheduler::SetAdaptive(bool value) {
+    adaptive = value;
+    RequestRedraw();
+}
+
+void FrameScheduler::WaitForWork(double dataInterval, bool animating) {
+    Clock::time_point now = Clock::now();
+    double timeout = 0.0;
+    if (!adaptive) {
+        //fixed loop: every iteration is a frame, sleep what is left of it
+        timeout = frameInterval - Seconds(now - lastFrame);
+        if (timeout > 0.0) {
+            std::this_thread::sleep_for(std::chrono::duration<double>(timeout));
+        }
+        glfwPollEvents();
+    }
+    else {
+        timeout = MAX_WAIT_SECONDS;
+        if (redrawFrames > 0 || animating) {
+            timeout = std::min(timeout, frameInterval - Seconds(now - lastFrame));
+        }
+        if (dataInterval > 0.0) {
+            timeout = std::min(timeout, dataInterval - Seconds(now - lastUpdate));
+        }
+        if (timeout > 0.0) {
+            glfwWaitEventsTimeout(timeout);
+        }
+        else {
+            glfwPollEvents();
+        }
+        //input ImGui got from any of its windows, the main one or a detached viewport
+        ImGuiContext* context = ImGui::GetCurrentContext();
+        if (context != nullptr && context->InputEventsQueue.Size > 0) {
+            RequestRedraw(INPUT_REDRAW_FRAMES);
+        }
+    }
+
+    Clock::time_point wake = Clock::now();
+    windowWaitSeconds += Seconds(wake - now);
+    Measure(wake);
+}
+
+void FrameScheduler::RequestRedraw(int count) {
+    redrawFrames = std::max(redrawFrames, count);
+}
+
+bool FrameScheduler::FrameDue(bool animating) const {
+    if (!adaptive) return true;
+    if (redrawFrames == 0 && !animating) return false;
+    return Seconds(Clock::now() - lastFrame) >= frameInterval - FRAME_SLACK_SECONDS;
+}
+
+bool FrameScheduler::DataDue(double dataInterval) const {
+    return dataInterval > 0.0 && Seconds(Clock::now() - lastUpdate) >= dataInterval - FRAME_SLACK_SECONDS;
+}
+
+void FrameScheduler::Updated() {
+    lastUpdate = Clock::now();
+    updates++;
+}
+
+void FrameScheduler::FrameDrawn() {
+    lastFrame = Clock::now();
+    frames++;
+    if (redrawFrames > 0) redrawFrames--;
+}
+
+void FrameScheduler::Measure(Clock::time_point now) {
+    double elapsed = Seconds(now - windowStart);
+    if (elapsed < STATS_WINDOW_SECONDS) return;
+
+    double cpu = ProcessCpuSeconds();
+    stats.framesPerSecond = frames / elapsed;
+    stats.updatesPerSecond = updates / elapsed;
+    stats.cpuPercent = (cpu - windowCpuStart) / elapsed * 100.0;
+    stats.waitPercent = windowWaitSeconds / elapsed * 100.0;
+
+    windowStart = now;
+    windowCpuStart = cpu;
+    windowWaitSeconds = 0.0;
+    frames = 0;
+    updates = 0;
+}
+
+double FrameScheduler::ProcessCpuSeconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0.0;
+    //100 ns ticks
+    auto toSeconds = [](const FILETIME& time) {
+        return ((static_cast<unsigned long long>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 1e-7;
+    };
+    return toSeconds(kernel) + toSeconds(user);
+#else
+    //clock() is process CPU time everywhere but on Windows
+    return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+}
@@ -0,0 +1,272 @@
+#include "GpuCache.h"
+#include "Camera.h"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <glad/glad.h>
+
+//first bytes of a saved program binary
+#define PROGRAM_BINARY_MAGIC 0x31425054u
+#define FLOATS_PER_VERTEX 6
+
+static const char* colorVertexSource = "#version 330 core\n"
+    "layout (location = 0) in vec3 aPos;\n"
+    "layout (location = 1) in vec3 aColor;\n"
+    "uniform mat4 model;\n"
+    CAMERA_BLOCK_GLSL
+    "out vec3 ourColor;\n"
+    "void main()\n"
+    "{\n"
+    "   gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
+    "   ourColor = aColor;\n"
+    "}\0";
+
+static const char* colorFragmentSource = "#version 330 core\n"
+    "in vec3 ourColor;\n"
+    "out vec4 FragColor;\n"
+    "void main()\n"
+    "{\n"
+    "   FragColor = vec4(ourColor, 1.0f);\n"
+    "}\0";
+
+//FNV-1a, the same on every run and compiler, unlike std::hash
+static unsigned long long Hash(unsigned long long hash, const char* text) {
+    if (text == nullptr) return hash;
+    for (; *text; text++) {
+        hash ^= static_cast<unsigned char>(*text);
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+Mesh::Mesh(const std::vector<float>& vertices) : vertexCount(static_cast<int>(vertices.size() / FLOATS_PER_VERTEX)) {
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+    //pos
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    //colors
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+Mesh::~Mesh() {
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &vbo);
+}
+
+void Mesh::Draw(unsigned int mode) const {
+    glBindVertexArray(vao);
+    glDrawArrays(mode, 0, vertexCount);
+}
+
+GpuCache& GpuCache::Get() {
+    static GpuCache cache;
+    return cache;
+}
+
+std::shared_ptr<ShaderProgram> GpuCache::Program(const std::string& name, const char* vertexSource, const char* fragmentSource) {
+    stats.requests++;
+    auto cached = programs.find(name);
+    if (cached != programs.end()) {
+        stats.hits++;
+        return cached->second;
+    }
+
+    auto program = std::make_shared<ShaderProgram>();
+    if (binaryFolder.empty()) {
+        program->Compile(vertexSource, fragmentSource);
+        stats.programsCompiled++;
+    }
+    else {
+        //a binary is only valid for the same sources on the same driver
+        unsigned long long key = Hash(Hash(Hash(Hash(14695981039346656037ull, vertexSource), fragmentSource),
+            reinterpret_cast<const char*>(glGetString(GL_RENDERER))), reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+        std::string path = binaryFolder + "/" + name + ".bin";
+        if (LoadProgramBinary(*program, path, key)) {
+            stats.programsFromDisk++;
+        }
+        else {
+            if (program->Compile(vertexSource, fragmentSource, true)) {
+                SaveProgramBinary(*program, path, key);
+            }
+            stats.programsCompiled++;
+        }
+    }
+    programs[name] = program;
+    return program;
+}
+
+std::shared_ptr<Mesh> GpuCache::GetMesh(const std::string& name, const std::function<std::vector<float>()>& build) {
+    stats.requests++;
+    auto cached = meshes.find(name);
+    if (cached != meshes.end()) {
+        stats.hits++;
+        return cached->second;
+    }
+    auto mesh = std::make_shared<Mesh>(build());
+    stats.meshesBuilt++;
+    meshes[name] = mesh;
+    return mesh;
+}
+
+std::shared_ptr<ShaderProgram> GpuCache::ColorProgram() {
+    return Program("color", colorVertexSource, colorFragmentSource);
+}
+
+std::shared_ptr<Mesh> GpuCache::BoardMesh() {
+    return GetMesh("board", []() {
+        float halfW = 0.3f;
+        float halfH = 0.5f;
+        float halfT = 0.05f;
+        return std::vector<float>{
+            //front
+            -halfW, -halfH,  halfT,  0.8f, 0.2f, 0.2f,
+             halfW, -halfH,  halfT,  0.8f, 0.2f, 0.2f,
+             halfW,  halfH,  halfT,  0.8f, 0.2f, 0.2f,
+             halfW,  halfH,  halfT,  0.8f, 0.2f, 0.2f,
+            -halfW,  halfH,  halfT,  0.8f, 0.2f, 0.2f,
+            -halfW, -halfH,  halfT,  0.8f, 0.2f, 0.2f,
+
+            //back
+            -halfW, -halfH, -halfT,  0.8f, 0.2f, 0.2f,
+             halfW, -halfH, -halfT,  0.8f, 0.2f, 0.2f,
+             halfW,  halfH, -halfT,  0.8f, 0.2f, 0.2f,
+             halfW,  halfH, -halfT,  0.8f, 0.2f, 0.2f,
+            -halfW,  halfH, -halfT,  0.8f, 0.2f, 0.2f,
+            -halfW, -halfH, -halfT,  0.8f, 0.2f, 0.2f,
+
+            //left
+            -halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
+            -halfW,  halfH, -halfT,  0.6f, 0.1f, 0.1f,
+            -halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
+            -halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
+            -halfW, -halfH,  halfT,  0.6f, 0.1f, 0.1f,
+            -halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
+
+            //right
+             halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
+             halfW,  halfH, -halfT,  0.6f, 0.1f, 0.1f,
+             halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
+             halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
+             halfW, -halfH,  halfT,  0.6f, 0.1f, 0.1f,
+             halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
+
+             //bottom
+             -halfW, -halfH, -halfT,  0.5f, 0.1f, 0.1f,
+              halfW, -halfH, -halfT,  0.5f, 0.1f, 0.1f,
+              halfW, -halfH,  halfT,  0.5f, 0.1f, 0.1f,
+              halfW, -halfH,  halfT,  0.5f, 0.1f, 0.1f,
+             -halfW, -halfH,  halfT,  0.5f, 0.1f, 0.1f,
+             -halfW, -halfH, -halfT,  0.5f, 0.1f, 0.1f,
+
+             //top
+             -halfW,  halfH, -halfT,  0.7f, 0.2f, 0.2f,
+              halfW,  halfH, -halfT,  0.7f, 0.2f, 0.2f,
+              halfW,  halfH,  halfT,  0.7f, 0.2f, 0.2f,
+              halfW,  halfH,  halfT,  0.7f, 0.2f, 0.2f,
+             -halfW,  halfH,  halfT,  0.7f, 0.2f, 0.2f,
+             -halfW,  halfH, -halfT,  0.7f, 0.2f, 0.2f
+        };
+    });
+}
+
+std::shared_ptr<Mesh> GpuCache::TriadMesh() {
+    return GetMesh("triad", []() {
+        return std::vector<float>{
+            // X axis (red)
+            0.0f, 0.0f, 0.0f, 0.8f, 0.2f, 0.2f,
+            1.0f, 0.0f, 0.0f, 0.8f, 0.2f, 0.2f,
+
+            // Y axis (green)
+            0.0f, 0.0f, 0.0f, 0.2f, 0.8f, 0.2f,
+            0.0f, 1.0f, 0.0f, 0.2f, 0.8f, 0.2f,
+
+            // Z axis (blue)
+            0.0f, 0.0f, 0.0f, 0.2f, 0.2f, 0.8f,
+            0.0f, 0.0f, 1.0f, 0.2f, 0.2f, 0.8f
+        };
+    });
+}
+
+void GpuCache::SetBinaryFolder(const std::string& folder) {
+    binaryFolder = folder;
+    if (binaryFolder.empty()) return;
+
+    //binaries need GL 4.1 or the extension and at least one format the driver can give back
+    int formats = 0;
+    if (GLAD_GL_VERSION_4_1 || GLAD_GL_ARB_get_program_binary) {
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    std::error_code error;
+    if (formats == 0 || (!std::filesystem::create_directories(binaryFolder, error) && error)) {
+        std::cerr << "Program binaries are not kept: " << (formats == 0 ? "not supported by the driver" : error.message()) << std::endl;
+        binaryFolder.clear();
+    }
+}
+
+bool GpuCache::LoadProgramBinary(ShaderProgram& program, const std::string& path, unsigned long long key) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+
+    uint32_t magic = 0, format = 0;
+    unsigned long long savedKey = 0;
+    file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+    file.read(reinterpret_cast<char*>(&savedKey), sizeof(savedKey));
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    if (!file || magic != PROGRAM_BINARY_MAGIC || savedKey != key) return false;
+
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    return !binary.empty() && program.LoadBinary(format, binary.data(), static_cast<int>(binary.size()));
+}
+
+void GpuCache::SaveProgramBinary(const ShaderProgram& program, const std::string& path, unsigned long long key) {
+    unsigned int format = 0;
+    std::vector<char> binary;
+    if (!program.GetBinary(format, binary)) return;
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        std::cerr << "Error due file creating " << path << std::endl;
+        return;
+    }
+    uint32_t magic = PROGRAM_BINARY_MAGIC, savedFormat = format;
+    file.write(reinterpret_cast<const char*>(&magic), sizeof(magic));
+    file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+    file.write(reinterpret_cast<const char*>(&savedFormat), sizeof(savedFormat));
+    file.write(binary.data(), binary.size());
+}
+
+void GpuCache::Trim() {
+    for (auto program = programs.begin(); program != programs.end(); ) {
+        program = program->second.use_count() == 1 ? programs.erase(program) : std::next(program);
+    }
+    for (auto mesh = meshes.begin(); mesh != meshes.end(); ) {
+        mesh = mesh->second.use_count() == 1 ? meshes.erase(mesh) : std::next(mesh);
+    }
+}
+
+void GpuCache::Clear() {
+    programs.clear();
+    meshes.clear();
+}
+
+GpuCache::Stats GpuCache::GetStats() const {
+    Stats current = stats;
+    current.programs = programs.size();
+    current.meshes = meshes.size();
+    current.inUse = 0;
+    for (const auto& program : programs) current.inUse += program.second.use_count() - 1;
+    for (const auto& mesh : meshes) current.inUse += mesh.second.use_count() - 1;
+    return current;
+}
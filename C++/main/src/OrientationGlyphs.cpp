@@ -0,0 +1,142 @@
+#include "OrientationGlyphs.h"
+#include "Camera.h"
+#include "GpuCache.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <glad/glad.h>
+
+//glyphs in the coarsest level
+#define GLYPH_FIRST_LEVEL 8
+//screen distance between neighbouring glyphs and length of a glyph axis, pixels
+#define GLYPH_SPACING_PIXELS 48.0f
+#define GLYPH_SIZE_PIXELS 16.0f
+
+static const char* glyphVertexSource = "#version 330 core\n"
+    "layout (location = 0) in vec3 aPos;\n"
+    "layout (location = 1) in vec3 aColor;\n"
+    "layout (location = 2) in vec3 instancePosition;\n"
+    "layout (location = 3) in vec4 instanceRotation;\n"
+    "uniform mat4 model;\n"
+    "uniform float glyphSize;\n"
+    CAMERA_BLOCK_GLSL
+    "out vec3 ourColor;\n"
+    "void main()\n"
+    "{\n"
+    //conjugate, the same convention as the animated cube
+    "   vec3 u = -instanceRotation.yzw;\n"
+    "   vec3 p = aPos * glyphSize;\n"
+    "   vec3 rotated = p + 2.0 * cross(u, cross(u, p) + instanceRotation.x * p);\n"
+    "   gl_Position = projection * view * (model * vec4(instancePosition, 1.0) + vec4(rotated, 0.0));\n"
+    "   ourColor = aColor;\n"
+    "}\0";
+
+static const char* glyphFragmentSource = "#version 330 core\n"
+    "in vec3 ourColor;\n"
+    "out vec4 FragColor;\n"
+    "void main()\n"
+    "{\n"
+    "   FragColor = vec4(ourColor, 1.0f);\n"
+    "}\0";
+
+OrientationGlyphs::~OrientationGlyphs() {
+    glDeleteVertexArrays(1, &vao);
+    glDeleteBuffers(1, &instanceVBO);
+}
+
+void OrientationGlyphs::Init() {
+    GpuCache& cache = GpuCache::Get();
+    program = cache.Program("glyph", glyphVertexSource, glyphFragmentSource);
+    glyphSizeLocation = program->UniformLocation("glyphSize");
+    //the same unit axes the cube uses, read from its buffer
+    triad = cache.TriadMesh();
+
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &instanceVBO);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, triad->Vbo());
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    //one position and quaternion per glyph
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, GLYPH_INSTANCE_SIZE * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(2, 1);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, GLYPH_INSTANCE_SIZE * sizeof(float), (void*)(3 * sizeof(float)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribDivisor(3, 1);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+void OrientationGlyphs::Build(Trajectory::Span<float> positions, Trajectory::Span<float> quaternions) {
+    instances.clear();
+    levels.clear();
+    pathLength = 0.0f;
+    size_t rows = std::min(positions.size() / 3, quaternions.size() / 4);
+    if (rows == 0) return;
+
+    glm::vec3 low(FLT_MAX), high(-FLT_MAX);
+    for (size_t i = 0; i < rows; i++) {
+        glm::vec3 point(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+        low = glm::min(low, point);
+        high = glm::max(high, point);
+        if (i > 0) {
+            pathLength += glm::length(point - glm::vec3(positions[i * 3 - 3], positions[i * 3 - 2], positions[i * 3 - 1]));
+        }
+    }
+    center = (low + high) * 0.5f;
+
+    //every level halves the stride and adds the samples in between, down to GLYPH_MAX_INSTANCES in total
+    size_t finest = std::max<size_t>(1, (rows + GLYPH_MAX_INSTANCES - 1) / GLYPH_MAX_INSTANCES);
+    size_t coarsest = finest;
+    while (rows / coarsest > GLYPH_FIRST_LEVEL) coarsest *= 2;
+
+    instances.reserve((rows / finest + 1) * GLYPH_INSTANCE_SIZE);
+    for (size_t stride = coarsest; ; stride /= 2) {
+        size_t first = stride == coarsest ? 0 : stride;
+        size_t step = stride == coarsest ? stride : stride * 2;
+        for (size_t i = first; i < rows; i += step) {
+            instances.insert(instances.end(), &positions[i * 3], &positions[i * 3] + 3);
+            instances.insert(instances.end(), &quaternions[i * 4], &quaternions[i * 4] + 4);
+        }
+        levels.push_back(instances.size() / GLYPH_INSTANCE_SIZE);
+        if (stride == finest) break;
+    }
+}
+
+void OrientationGlyphs::Upload() {
+    glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(float), instances.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    drawLevels = levels;
+    drawCenter = center;
+    drawPathLength = pathLength;
+}
+
+void OrientationGlyphs::Draw(const glm::mat4& model, const glm::mat4& view, float pixelsPerUnit) {
+    drawnCount = 0;
+    if (drawLevels.empty()) return;
+
+    //the longer the path is on screen, the more of the evenly spread prefix is drawn
+    float distance = std::max(glm::length(glm::vec3(view * model * glm::vec4(drawCenter, 1.0f))), 0.1f);
+    float scale = glm::length(glm::vec3(model[0]));
+    float wanted = drawPathLength * scale * pixelsPerUnit / distance / GLYPH_SPACING_PIXELS;
+    size_t count = drawLevels[0];
+    for (size_t level : drawLevels) {
+        if (level <= wanted) count = level;
+    }
+
+    program->Use();
+    program->SetModel(model);
+    glUniform1f(glyphSizeLocation, GLYPH_SIZE_PIXELS * distance / pixelsPerUnit);
+    glBindVertexArray(vao);
+    glDrawArraysInstanced(GL_LINES, 0, triad->VertexCount(), static_cast<GLsizei>(count));
+    glBindVertexArray(0);
+    drawnCount = count;
+}
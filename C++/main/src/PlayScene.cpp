@@ -8,11 +8,15 @@
 #include <iomanip>
 #include <thread>
 #include <future>
+#include <algorithm>
+#include "TaskScheduler.h"
 
 #include <cmath>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_access.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
 
@@ -20,84 +24,103 @@
 #include <chrono>
 #include <iomanip>
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif // !M_PI
-
-
-
-PlayScene::PlayScene(COM::Port* comPort) : Scene(comPort), isCalculating(false), calculationProgress(0) {
-    vertexShaderSource = "#version 330 core\n"
-        "layout (location = 0) in vec3 aPos;\n"
-        "layout (location = 1) in vec3 aColor;\n"
-        "uniform mat4 model;\n"
-        "uniform mat4 view;\n"
-        "uniform mat4 projection;\n"
-        "out vec3 ourColor;\n"
-        "void main()\n"
-        "{\n"
-        "   gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
-        "   ourColor = aColor;\n"
-        "}\0";
-
-    fragmentShaderSource = "#version 330 core\n"
-        "in vec3 ourColor;\n"
-        "out vec4 FragColor;\n"
-        "void main()\n"
-        "{\n"
-        "   FragColor = vec4(ourColor, 1.0f);\n"
-        "}\0";
+//rows of the coarse preview, it is computed only if the input has at least PREVIEW_MIN_FACTOR times more
+#define PREVIEW_ROWS 65536
+#define PREVIEW_MIN_FACTOR 4
+//positions uploaded per frame, so a huge trajectory does not stall a single frame
+#define UPLOAD_SLICE_BYTES (8 * 1024 * 1024)
+//camera keys are read with GetAsyncKeyState, which sends no window events, so they are polled this often
+#define KEY_POLL_SECONDS 0.05
+//longest wall time one playback step may take, a stalled frame does not make the board jump
+#define PLAYBACK_MAX_STEP_SECONDS 0.25
+#define PLAYBACK_MIN_SPEED 0.1f
+#define PLAYBACK_MAX_SPEED 100.0f
+//how far from the cursor a sample is still picked, and the size of its marker in scene units
+#define PICK_RADIUS_PIXELS 8.0f
+#define PICK_MARKER_SIZE 0.1f
+//ensemble size the UI allows
+#define ENSEMBLE_MIN_MEMBERS 10
+#define ENSEMBLE_MAX_MEMBERS 1000
+//cross-sections of the uncertainty tube along the whole path and lines around each
+#define TUBE_RINGS 1024
+#define TUBE_SIDES 12
+//Allan deviation and spectral density plots, colors of x, y, z
+#define ALLAN_PLOT_HEIGHT 260.0f
+#define SPECTRUM_PLOT_HEIGHT 200.0f
+#define SPECTROGRAM_HEIGHT 240.0f
+//levels of the spectrogram below its largest one
+#define SPECTROGRAM_RANGE_DB 80.0f
+static const ImU32 AXIS_COLORS[A_SIZE] = { IM_COL32(230, 80, 80, 255), IM_COL32(80, 200, 80, 255), IM_COL32(90, 140, 255, 255) };
+
+PlayScene::PlayScene(COM::Port* comPort) : Scene(comPort), isCalculating(false) {
 }
 
 PlayScene::~PlayScene() {
     if (calculationFuture.valid()) {
         calculationFuture.wait();
     }
-    glDeleteVertexArrays(1, &cubeVAO);
-    glDeleteBuffers(1, &cubeVBO);
-    glDeleteVertexArrays(1, &axesVAO);
-    glDeleteBuffers(1, &axesVBO);
-    glDeleteVertexArrays(1, &pointsVAO);
-    glDeleteBuffers(1, &pointsVBO);
-    glDeleteProgram(shaderProgram);
+    if (ensembleFuture.valid()) {
+        ensembleFuture.wait();
+    }
+    if (tunerFuture.valid()) {
+        tunerFuture.wait();
+    }
+    if (allanFuture.valid()) {
+        allanFuture.wait();
+    }
+    if (spectrumFuture.valid()) {
+        spectrumFuture.wait();
+    }
+    DeletePoints(finalPoints);
+    DeletePoints(previewPoints);
+    for (PointsBuffer& points : comparisonPoints) {
+        DeletePoints(points);
+    }
 }
 
 void PlayScene::InitRender() {
-    CompileShaders();
-    InitCube();
-    InitAxes();
+    //everything but the axes is shared with the other scenes and the previous instances of this one
+    GpuCache& cache = GpuCache::Get();
+    program = cache.ColorProgram();
+    board = cache.BoardMesh();
+    boardAxes = cache.TriadMesh();
+    axes = cache.GetMesh("play axes", [this]() {
+        return std::vector<float>{
+            // X axis (red)
+            -AXIS_LENGTH, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+            AXIS_LENGTH, 0.0f, 0.0f, 1.0f, 0.6f, 0.6f,
+
+            // Y axis (green)
+            0.0f, -AXIS_LENGTH, 0.0f, 0.0f, 1.0f, 0.6f,
+            0.0f, AXIS_LENGTH, 0.0f, 0.6f, 1.0f, 0.6f,
+
+            // Z axis (blue)
+            0.0f, 0.0f, -AXIS_LENGTH, 0.0f, 0.0f, 1.0f,
+            0.0f, 0.0f, AXIS_LENGTH, 0.6f, 0.6f, 1.0f
+        };
+    });
+    glyphs.Init();
+
+    cubePosition = glm::vec3(0.0f, 0.0f, 0.0f);
+    cubeRotation = glm::mat3x3(1, 0, 0, 0, 1, 0, 0, 0, 1);
     SetupCamera();
-    
 }
 
 void PlayScene::Render() {
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glUseProgram(shaderProgram);
-
-    // Update camera view matrix based on rotation and zoom
-    glm::vec3 cameraPos = glm::vec3(3.0f, 2.0f, 3.0f) * cameraDistance;
-    glm::mat4 view = glm::lookAt(
-        cameraPos,
-        glm::vec3(0.0f, 0.0f, 0.0f),
-        glm::vec3(0.0f, 0.0f, 1.0f)
-    );
-    view = glm::rotate(view, glm::radians(cameraAngleX), glm::vec3(1.0f, 0.0f, 0.0f));
-    view = glm::rotate(view, glm::radians(cameraAngleY), glm::vec3(0.0f, 1.0f, 0.0f));
-    view = glm::rotate(view, glm::radians(cameraAngleZ), glm::vec3(0.0f, 0.0f, 1.0f));
-
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    //camera matrices go to the GPU only when they changed, locations were resolved at link time
+    camera.Upload();
+    program->Use();
 
     // Draw coordinate axes (white)
     glm::mat4 axisModel = glm::mat4(1.0f);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(axisModel));
-    glBindVertexArray(axesVAO);
-    glDrawArrays(GL_LINES, 0, 6);
+    program->SetModel(axisModel);
+    axes->Draw(GL_LINES);
 
     // Draw cube with position and rotation from specialized variables
-    if (!pos.empty() && !isCalculating.load())
+    if (!engine.Positions().empty() && !isCalculating.load())
     {
         {
             glm::mat4 cubeModel = glm::mat4(1.0f);
@@ -107,33 +130,141 @@ void PlayScene::Render() {
             glm::mat4 rotationMat = glm::mat4(cubeRotation);
             cubeModel = cubeModel * rotationMat;
 
-            glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(cubeModel));
-            glBindVertexArray(cubeVAO);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+            program->SetModel(glm::scale(cubeModel, glm::vec3(CUBE_SCALE)));
+            board->Draw(GL_TRIANGLES);
 
             // Draw cube's local axes (red, green, blue)
-            glBindVertexArray(cubeAxesVAO);
-            glDrawArrays(GL_LINES, 0, 6);
+            program->SetModel(glm::scale(cubeModel, glm::vec3(CUBE_AXIS_LENGTH)));
+            boardAxes->Draw(GL_LINES);
         }
-    // Draw points from pos array
-        {
-            glm::mat4 pointsModel = glm::mat4(1.0f);
-            glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(pointsModel));
-            glBindVertexArray(pointsVAO);
-            glDrawArrays(GL_POINTS, 0, pos.size() / 3);
+    }
 
-            //  ,  
-            glDrawArrays(GL_LINE_STRIP, 0, pos.size() / 3); 
+    // Draw points from pos array, the preview until the final trajectory is uploaded
+    const PointsBuffer* shownPoints = finalPoints.IsReady() ? &finalPoints : (previewPoints.IsReady() ? &previewPoints : nullptr);
+    if (shownPoints != nullptr) {
+        glm::mat4 pointsModel = glm::scale(glm::mat4(1.0f), glm::vec3(TRAJECTORY_SCALE));
+        program->SetModel(pointsModel);
+
+        int viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        float pixelsPerUnit = viewport[3] / (2.0f * tanf(glm::radians(CAMERA_FOV) * 0.5f));
+        //the other methods go first, so the level of detail stats are the ones of the selected path
+        glm::vec3 color = TRAJECTORY_COLOR;
+        if (shownPoints == &finalPoints && methodsCompared) {
+            for (int m = 0; m < METHOD_COUNT; m++) {
+                if (!comparisonPoints[m].IsReady()) continue;
+                glVertexAttrib3f(1, METHOD_COLORS[m].r, METHOD_COLORS[m].g, METHOD_COLORS[m].b);
+                DrawTrajectory(comparisonPoints[m], pointsModel, pixelsPerUnit);
+            }
+            color = METHOD_COLORS[static_cast<int>(engine.GetSettings().method)];
+        }
+        //color array is disabled in the points vao, so every vertex gets this constant
+        glVertexAttrib3f(1, color.r, color.g, color.b);
+        DrawTrajectory(*shownPoints, pointsModel, pixelsPerUnit);
+        if (showTube && tube && shownPoints == &finalPoints) {
+            tube->Draw(GL_LINES);
+        }
+        if (showGlyphs && shownPoints == &finalPoints) {
+            glyphs.Draw(pointsModel, camera.GetView(), pixelsPerUnit);
+        }
+        if (picked.found && shownPoints == &finalPoints) {
+            Trajectory::Span<float> pos = engine.Positions();
+            glm::vec3 pickedPosition(pos[picked.sample * 3], pos[picked.sample * 3 + 1], pos[picked.sample * 3 + 2]);
+            program->Use();
+            program->SetModel(glm::scale(glm::translate(glm::mat4(1.0f), pickedPosition * TRAJECTORY_SCALE), glm::vec3(PICK_MARKER_SIZE)));
+            boardAxes->Draw(GL_LINES);
         }
     }
 
     glBindVertexArray(0);
 }
 
+void PlayScene::DrawTrajectory(const PointsBuffer& points, const glm::mat4& model, float pixelsPerUnit) {
+    lodFirsts.clear();
+    lodCounts.clear();
+    lodElementCounts.clear();
+    lodElementOffsets.clear();
+    lodDrawnSamples = 0;
+    lodCulledChunks = 0;
+
+    //frustum planes in trajectory units (Gribb-Hartmann), so chunk spheres are tested as they are
+    glm::mat4 clip = camera.GetProjection() * camera.GetView() * model;
+    glm::vec4 planes[6];
+    for (int i = 0; i < 3; i++) {
+        planes[i * 2] = glm::row(clip, 3) + glm::row(clip, i);
+        planes[i * 2 + 1] = glm::row(clip, 3) - glm::row(clip, i);
+    }
+    for (glm::vec4& plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+
+    glm::mat4 modelView = camera.GetView() * model;
+
+    for (const Trajectory::PathLod::Chunk& chunk : points.lod->Chunks()) {
+        glm::vec3 center(chunk.center[0], chunk.center[1], chunk.center[2]);
+        bool visible = true;
+        for (const glm::vec4& plane : planes) {
+            if (glm::dot(glm::vec3(plane), center) + plane.w < -chunk.radius) {
+                visible = false;
+                break;
+            }
+        }
+        if (!visible) {
+            lodCulledChunks++;
+            continue;
+        }
+
+        //screen error of a level is its world error seen from the nearest point of the chunk
+        float distance = glm::length(glm::vec3(modelView * glm::vec4(center, 1.0f))) - chunk.radius * TRAJECTORY_SCALE;
+        distance = std::max(distance, 0.1f);
+        float pixelsPerError = TRAJECTORY_SCALE * pixelsPerUnit / distance;
+        size_t level = chunk.levels.size() - 1;
+        while (level > 0 && chunk.levels[level].error * pixelsPerError > LOD_PIXEL_ERROR) {
+            level--;
+        }
+
+        const Trajectory::PathLod::Level& picked = chunk.levels[level];
+        if (level == 0) {
+            lodFirsts.push_back(static_cast<int>(chunk.first));
+            lodCounts.push_back(static_cast<int>(picked.count));
+        }
+        else {
+            lodElementCounts.push_back(static_cast<int>(picked.count));
+            lodElementOffsets.push_back(reinterpret_cast<const void*>(picked.offset * sizeof(uint32_t)));
+        }
+        lodDrawnSamples += picked.count;
+    }
+
+    glBindVertexArray(points.vao);
+    for (GLenum mode : { GL_POINTS, GL_LINE_STRIP }) {
+        if (!lodFirsts.empty()) {
+            glMultiDrawArrays(mode, lodFirsts.data(), lodCounts.data(), static_cast<GLsizei>(lodFirsts.size()));
+        }
+        if (!lodElementCounts.empty()) {
+            glMultiDrawElements(mode, lodElementCounts.data(), GL_UNSIGNED_INT, lodElementOffsets.data(), static_cast<GLsizei>(lodElementCounts.size()));
+        }
+    }
+}
+
+double PlayScene::DataInterval() const {
+    return KEY_POLL_SECONDS;
+}
+
+bool PlayScene::IsAnimating() const {
+    bool uploading = (finalPoints.lod != nullptr && !finalPoints.IsReady()) || (previewPoints.lod != nullptr && !previewPoints.IsReady());
+    for (const PointsBuffer& points : comparisonPoints) {
+        uploading = uploading || (points.lod != nullptr && !points.IsReady());
+    }
+    return isPlaying || isCalculating.load() || calculationFuture.valid() || previewReady.load() || uploading || ensembleFuture.valid() ||
+        tunerFuture.valid() || allanFuture.valid() || spectrumFuture.valid();
+}
+
 void PlayScene::Update() {
     // Handle camera rotation with WASD
     const float rotationSpeed = 2.0f;
     const float zoomSpeed = 0.1f;
+    const float previousAngleX = cameraAngleX, previousAngleY = cameraAngleY, previousAngleZ = cameraAngleZ;
+    const float previousDistance = cameraDistance;
 
     if (GetAsyncKeyState('A') & 0x8000) {
         cameraAngleY -= rotationSpeed;
@@ -168,378 +299,486 @@ void PlayScene::Update() {
     cameraAngleY = fmod(cameraAngleY, 360.0f);
     cameraAngleZ = fmod(cameraAngleZ, 360.0f);
 
+    if (cameraAngleX != previousAngleX || cameraAngleY != previousAngleY || cameraAngleZ != previousAngleZ || cameraDistance != previousDistance) {
+        viewChanged = true;
+    }
+    if (viewChanged) {
+        UpdateView();
+        RequestRedraw();
+    }
+    Pick();
+
 
+    if (previewReady.exchange(false)) {
+        InitPoints(previewPoints, previewEngine.Positions(), previewLod);
+    }
     if (calculationFuture.valid() &&
         calculationFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
         calculationFuture.get(); 
-        InitPoints();
+        InitPoints(finalPoints, engine.Positions(), pathLod);
+        glyphs.Upload();
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            if (methodsCompared && m != static_cast<int>(engine.GetSettings().method)) {
+                InitPoints(comparisonPoints[m], engine.MethodPositions(static_cast<Trajectory::IntegrationMethod>(m)), comparisonLods[m]);
+            }
+        }
+    }
+    if (ensembleFuture.valid() &&
+        ensembleFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        ensembleFuture.get();
+        if (!tubeVertices.empty()) {
+            tube = std::make_unique<Mesh>(tubeVertices);
+        }
+    }
+    if (tunerFuture.valid() &&
+        tunerFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        tunerFuture.get();
+    }
+    if (allanFuture.valid() &&
+        allanFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        allanFuture.get();
+        showAllan = !allan.Taus().empty();
+    }
+    if (spectrumFuture.valid() &&
+        spectrumFuture.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        spectrumFuture.get();
+        size_t changedBegin = 0, changedEnd = 0;
+        spectrum.ChangedColumns(changedBegin, changedEnd);
+        Trajectory::Span<float> image = spectrum.Spectrogram();
+        if (spectrum.GetStats().columnsComputed < spectrum.Columns()) {
+            //same layout, only the changed columns are uploaded again, the view stays where it was
+            spectrogramView.Invalidate(changedBegin, changedEnd);
+        }
+        else if (!image.empty()) {
+            //new columns, the colors start from the largest level
+            spectrogramView.Invalidate();
+            spectrogramStart = 0.0f;
+            spectrogramLevels[1] = std::ceil(*std::max_element(image.begin(), image.end()));
+            spectrogramLevels[0] = spectrogramLevels[1] - SPECTROGRAM_RANGE_DB;
+        }
+        showSpectrum = spectrum.Columns() > 0;
+    }
+    UploadPoints(previewPoints);
+    UploadPoints(finalPoints);
+    for (PointsBuffer& points : comparisonPoints) {
+        UploadPoints(points);
+    }
+    if (finalPoints.IsReady()) {
+        previewPoints.lod = nullptr;
     }
 
     if (isPlaying) {
-
-            cubePosition = glm::vec3(pos[currentFrame * 3] * 10.0f, pos[currentFrame * 3 + 1] * 10.0f, pos[currentFrame * 3 + 2] * 10.0f);
-            cubeRotation = glm::mat3x3(
-                Rs[currentFrame * 9    ], Rs[currentFrame * 9 + 1], Rs[currentFrame * 9 + 2],
-                Rs[currentFrame * 9 + 3], Rs[currentFrame * 9 + 4], Rs[currentFrame * 9 + 5],
-                Rs[currentFrame * 9 + 6], Rs[currentFrame * 9 + 7], Rs[currentFrame * 9 + 8]
-            );
-            currentFrame = (currentFrame + 1) % ts.size();
-
+        //recorded time follows the wall clock, whatever the frame rate and the sample rate are
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::min(std::chrono::duration<double>(now - playbackTick).count(), PLAYBACK_MAX_STEP_SECONDS);
+        playbackTick = now;
+        playbackTime += elapsed * playbackSpeed;
+        double duration = poses.Duration();
+        playbackTime = duration > 0.0 ? fmod(playbackTime, duration) : 0.0;
+        ShowPose(playbackTime);
     }
 
 }
 
-void PlayScene::LoadData() {
-    ts.clear();
-    qs.clear();
-    as.clear();
-
-    std::ifstream file(csvFilePath);
-    if (!file.is_open()) {
-        std::cerr << "Error due file opening " << csvFilePath << std::endl;
+void PlayScene::Pick() {
+    //only the final trajectory is indexed, and only while the calculation thread leaves it alone
+    ImGuiIO& io = ImGui::GetIO();
+    if (!finalPoints.IsReady() || isCalculating.load() || io.WantCaptureMouse || !ImGui::IsMousePosValid()) {
+        if (picked.found) RequestRedraw();
+        picked = Trajectory::SpatialIndex::Hit();
         return;
     }
 
-    std::string line;
-    bool firstLine = true;
-
-
-    dataSize.store(0);
-
-    while (std::getline(file, line)) {
-        if (firstLine) {
-            firstLine = false;
-            continue;
-        }
-
-        std::istringstream iss(line);
-        std::string token;
-        int column = 0;
-        static bool isFirstTime = true;    
-
-        while (std::getline(iss, token, ',')) {
-            // 0 is delta time
-            if (column == 0) {
-                try {
-                    ts.push_back(std::stoull(token) / 1000.0f);
-                    isFirstTime = false;
-                }
-                catch (...) {
-                    std::cerr << "Error parsing time (microseconds) in file: " << csvFilePath << std::endl;
-                    ts.push_back(0.0f);
-                }
-            }
-            else if (column >= T_SIZE && column <= Q_SIZE) {
-                // Columns 1-4 go to qs
-                try {
-                    float value = std::stof(token);
-                    qs.push_back(value);
-
-                }
-                catch (...) {
-                    std::cerr << "Quarantion conversion error " << token << std::endl;
-                    qs.push_back(0.0f);
-                }
-            }
-            else {
-                // Remaining columns go to as
-                try {
-                    float value = std::stof(token);
-                    as.push_back(value);
-                }
-                catch (...) {
-                    std::cerr << "Acceliration conversion error " << token << std::endl;
-                    as.push_back(0.0f);
-                }
-            }
-
-            column++;
-            
-        }
-        dataSize.store(dataSize + 1);
+    //cursor ray in trajectory units; with viewports enabled ImGui gives the mouse in screen coordinates
+    int viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    ImVec2 windowPosition = ImGui::GetMainViewport()->Pos;
+    float x = (io.MousePos.x - windowPosition.x) * io.DisplayFramebufferScale.x;
+    float y = viewport[3] - (io.MousePos.y - windowPosition.y) * io.DisplayFramebufferScale.y;
+    glm::vec4 viewportRect(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glm::vec3 nearPoint = glm::unProject(glm::vec3(x, y, 0.0f), camera.GetView(), camera.GetProjection(), viewportRect) / TRAJECTORY_SCALE;
+    glm::vec3 farPoint = glm::unProject(glm::vec3(x, y, 1.0f), camera.GetView(), camera.GetProjection(), viewportRect) / TRAJECTORY_SCALE;
+    glm::vec3 direction = farPoint - nearPoint;
+
+    //PICK_RADIUS_PIXELS at the distance of the scene origin
+    float pixelsPerUnit = viewport[3] / (2.0f * tanf(glm::radians(CAMERA_FOV) * 0.5f));
+    float eyeDistance = glm::length(glm::vec3(glm::inverse(camera.GetView())[3]));
+    float radius = PICK_RADIUS_PIXELS * eyeDistance / pixelsPerUnit / TRAJECTORY_SCALE;
+
+    auto start = std::chrono::steady_clock::now();
+    Trajectory::SpatialIndex::Hit hit = spatialIndex.PickRay(&nearPoint.x, &direction.x, radius);
+    pickMicroseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+    if (hit.found != picked.found || hit.sample != picked.sample) {
+        RequestRedraw();
     }
-
-    calculationProgress.store(dataSize);
-
-    file.close();
-   
-    std::cout << "Data loaded: q count: " << qs.size() / Q_SIZE << " a count: " << as.size() / A_SIZE << " t count: " << ts.size() << std::endl;
-
+    picked = hit;
 }
 
-void PlayScene::AddRotationMatrix(float w, float x, float y, float z) {
-    //quaternions to rotation matrix 
-    float R[9] =
-    {
-        1.0f - 2.0f * pow(y, 2) - 2.0f * pow(z, 2),   2.0f * x * y - 2.0f * z * w,                  2.0f * x * z + 2.0f * y * w,
-        2.0f * x * y + 2.0f * z * w,                  1.0f - 2.0f * pow(x, 2) - 2.0f * pow(z, 2),   2.0f * y * z - 2.0f * x * w,
-        2.0f * x * z - 2.0f * y * w,                  2.0f * y * z + 2.0f * x * w,                  1.0f - 2.0f * pow(x, 2) - 2.0f * pow(y, 2)
-
-    };
-    Rs.insert(Rs.end(), R, R + R_SIZE);
+void PlayScene::ShowPose(double time) {
+    if (poses.Rows() == 0) return;
+    //samples between two frames are skipped, the pose is interpolated at the exact time
+    Trajectory::Pose pose = poses.At(time);
+    cubePosition = glm::vec3(pose.position[0], pose.position[1], pose.position[2]) * TRAJECTORY_SCALE;
+    //transposed like the rows of Engine::Rotations() were read before
+    glm::quat rotation(pose.orientation[0], pose.orientation[1], pose.orientation[2], pose.orientation[3]);
+    cubeRotation = glm::mat3_cast(glm::conjugate(rotation));
+    playbackSample = pose.sample;
 }
 
-void PlayScene::TiltCompensateA(int i) {
-    const float* R = &Rs[i * R_SIZE];
-    float* a = &as[i * A_SIZE];
-
-    const float ax = a[0], ay = a[1], az = a[2];
-
-    // R x a 
-    a[0] = R[0] * ax + R[1] * ay + R[2] * az;  
-    a[1] = R[3] * ax + R[4] * ay + R[5] * az;  
-    a[2] = R[6] * ax + R[7] * ay + R[8] * az; 
+void PlayScene::StartEnsemble() {
+    tube.reset();
+    ensembleSettings.members = static_cast<size_t>(ensembleMembers);
+    isEnsembleRunning = true;
+    //reads the engine buffers, calculation is locked out until it is done
+    ensembleFuture = TaskScheduler::Get().Async([this]() {
+        tubeVertices.clear();
+        if (ensemble.Run(engine, ensembleSettings)) {
+            BuildTube();
+        }
+        isEnsembleRunning = false;
+    }, TaskPriority::HIGH);
 }
 
-void PlayScene::CompensateGravity(int i) {
-    //basicly here first two row: value - 0, but what if gravity direction will change?
-    float* a = &as[i * A_SIZE];
-    a[0] -= gravityVector[0];
-    a[1] -= gravityVector[1];
-    a[2] -= gravityVector[2];
-
-    //convert to metrs per second
-    a[0] *= g;
-    a[1] *= g;
-    a[2] *= g;
+void PlayScene::StartTuning() {
+    isTuning = true;
+    //reads the engine buffers like the ensemble
+    tunerFuture = TaskScheduler::Get().Async([this]() {
+        tuner.Run(engine, tuningSettings);
+        isTuning = false;
+    }, TaskPriority::HIGH);
 }
 
-void PlayScene::ConvertAtoV(int i) {
-    Integrate(i, as, vs);
+void PlayScene::StartAllan() {
+    isAllanRunning = true;
+    allanSaved = "";
+    //only the raw input is read, still the calculation is locked out, it reloads it
+    allanFuture = TaskScheduler::Get().Async([this]() {
+        allan.Run(engine);
+        isAllanRunning = false;
+    }, TaskPriority::HIGH);
 }
 
-void PlayScene::Integrate(int i, const std::vector<float>& input, std::vector<float>& output) {
-    if (i == 0) return;
-    switch (integrationMethodIndex)
-    {
-    case 0:
-        SquaresIntegration(i, input, output);
-        break;
-    case 1:
-        TrapezoidIntegration(i, input, output);
-        break;
-    case 2:
-        RungeKuttaIntegration(i, input, output);
-        break;
-    default:
-        SquaresIntegration(i, input, output);
-        break;
+void PlayScene::RenderAllanPanel() {
+    if (!showAllan || isAllanRunning.load()) {
+        return;
+    }
+    ImGui::Begin("Allan deviation", &showAllan);
+    Trajectory::Span<double> taus = allan.Taus();
+    Trajectory::Span<double> deviations = allan.Deviations();
+
+    //log-log, whole decades on both axes
+    double low = 1e30, high = 0.0;
+    for (double deviation : deviations) {
+        if (deviation > 0.0) {
+            low = std::min(low, deviation);
+            high = std::max(high, deviation);
+        }
+    }
+    double x0 = std::floor(std::log10(taus[0])), x1 = std::ceil(std::log10(taus[taus.size() - 1]));
+    double y0 = std::floor(std::log10(low)), y1 = std::ceil(std::log10(high));
+    x1 = std::max(x1, x0 + 1.0);
+    y1 = std::max(y1, y0 + 1.0);
+
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImVec2 size(ImGui::GetContentRegionAvail().x, ALLAN_PLOT_HEIGHT);
+    ImGui::Dummy(size);
+    ImDrawList* draw = ImGui::GetWindowDrawList();
+    auto toScreen = [&](double tau, double deviation) {
+        return ImVec2(origin.x + static_cast<float>((std::log10(tau) - x0) / (x1 - x0)) * size.x,
+            origin.y + static_cast<float>((y1 - std::log10(deviation)) / (y1 - y0)) * size.y);
+    };
+    draw->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y), IM_COL32(20, 20, 20, 255));
+    char label[32];
+    for (double x = x0; x <= x1; x += 1.0) {
+        ImVec2 p = toScreen(std::pow(10.0, x), std::pow(10.0, y0));
+        draw->AddLine(ImVec2(p.x, origin.y), ImVec2(p.x, origin.y + size.y), IM_COL32(70, 70, 70, 255));
+        std::snprintf(label, sizeof(label), "1e%.0f s", x);
+        draw->AddText(ImVec2(p.x + 2.0f, origin.y + size.y - ImGui::GetTextLineHeight()), IM_COL32(160, 160, 160, 255), label);
+    }
+    for (double y = y0; y <= y1; y += 1.0) {
+        ImVec2 p = toScreen(std::pow(10.0, x0), std::pow(10.0, y));
+        draw->AddLine(ImVec2(origin.x, p.y), ImVec2(origin.x + size.x, p.y), IM_COL32(70, 70, 70, 255));
+        std::snprintf(label, sizeof(label), "1e%.0f g", y);
+        draw->AddText(ImVec2(origin.x + 2.0f, p.y), IM_COL32(160, 160, 160, 255), label);
+    }
+    std::vector<ImVec2> curve;
+    for (int axis = 0; axis < A_SIZE; axis++) {
+        curve.clear();
+        for (size_t t = 0; t < taus.size(); t++) {
+            double deviation = deviations[t * A_SIZE + axis];
+            if (deviation > 0.0) curve.push_back(toScreen(taus[t], deviation));
+        }
+        draw->AddPolyline(curve.data(), static_cast<int>(curve.size()), AXIS_COLORS[axis], 0, 2.0f);
     }
-}
 
-void PlayScene::HighPass3DFilter(std::vector<float>& data, float sample_rate, float cutoff) {
+    const Trajectory::AllanVariance::Stats& stats = allan.GetStats();
+    ImGui::Text("%zu samples at %.2f ms, %zu taus in %.1f ms", stats.rows, stats.sampleTime * 1000.0, taus.size(), stats.seconds * 1000.0);
+    const char* axes[A_SIZE] = { "x", "y", "z" };
+    for (int axis = 0; axis < A_SIZE; axis++) {
+        ImGui::TextColored(ImGui::ColorConvertU32ToFloat4(AXIS_COLORS[axis]),
+            "%s: noise %.5f g per sample, random walk %.6f g/sqrt(Hz), bias instability %.6f g at %.1f s", axes[axis],
+            stats.sampleNoise[axis], stats.randomWalk[axis], stats.biasInstability[axis], stats.biasInstabilityTau[axis]);
+    }
 
+    if (outputPath == "") {
+        ImGui::BeginDisabled();
+    }
+    if (ImGui::Button("Export")) {
+        std::string path = outputPath + "/allan_deviation.csv";
+        allanSaved = allan.Save(path) ? "Saved to " + path : "Could not write " + path;
+    }
+    if (outputPath == "") {
+        ImGui::EndDisabled();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Use as uncertainty model")) {
+        //per-sample white noise and bias instability, averaged over the axes
+        ensembleSettings.accelNoise = static_cast<float>((stats.sampleNoise[0] + stats.sampleNoise[1] + stats.sampleNoise[2]) / A_SIZE);
+        ensembleSettings.accelBias = static_cast<float>((stats.biasInstability[0] + stats.biasInstability[1] + stats.biasInstability[2]) / A_SIZE);
+    }
+    if (allanSaved != "") {
+        ImGui::Text("%s", allanSaved.c_str());
+    }
+    ImGui::End();
+}
 
-    // Buttower coef 1 order
-    double tan_wc = std::tan(M_PI * cutoff);
-    double b0 = 1.0 / (1.0 + tan_wc);
-    double b1 = -b0;
-    double a1 = (tan_wc - 1.0) / (tan_wc + 1.0);
+void PlayScene::StartSpectrum() {
+    isSpectrumRunning = true;
+    spectrumSaved = "";
+    spectrumSettings.segment = size_t(256) << spectrumSegmentIndex;
+    spectrumFuture = TaskScheduler::Get().Async([this]() {
+        spectrum.Run(engine, spectrumSettings);
+        isSpectrumRunning = false;
+    }, TaskPriority::HIGH);
+}
 
-    int num_columns = 3;
-    size_t num_rows = data.size() / num_columns;
-    for (size_t col = 0; col < num_columns; ++col) {
-        std::vector<double> column(num_rows);
-        for (size_t i = 0; i < num_rows; ++i) {
-            column[i] = data[i * num_columns + col];
+void PlayScene::RenderSpectrumPanel() {
+    //the density plot needs a bin above DC
+    if (!showSpectrum || isSpectrumRunning.load() || spectrum.Frequencies().size() < 2) {
+        return;
+    }
+    ImGui::Begin("Spectrum", &showSpectrum);
+    Trajectory::Span<double> frequencies = spectrum.Frequencies();
+    Trajectory::Span<double> density = spectrum.Density();
+    const Trajectory::Spectrum::Stats& stats = spectrum.GetStats();
+
+    //density in dB over log frequency, from the first bin above DC to Nyquist
+    double f0 = std::log10(frequencies[1]), f1 = std::log10(frequencies[frequencies.size() - 1]);
+    double low = 1e30, high = -1e30;
+    for (double value : density) {
+        double level = 10.0 * std::log10(value + 1e-20);
+        low = std::min(low, level);
+        high = std::max(high, level);
+    }
+    low = std::floor(low / 10.0) * 10.0;
+    high = std::max(std::ceil(high / 10.0) * 10.0, low + 10.0);
+
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImVec2 size(ImGui::GetContentRegionAvail().x, SPECTRUM_PLOT_HEIGHT);
+    //a click picks the high-pass cutoff
+    ImGui::InvisibleButton("density", size);
+    if (ImGui::IsItemClicked()) {
+        double share = (ImGui::GetIO().MousePos.x - origin.x) / size.x;
+        pipelineSettings.filterCutoff = std::pow(10.0, f0 + share * (f1 - f0));
+    }
+    ImDrawList* draw = ImGui::GetWindowDrawList();
+    auto toScreen = [&](double frequency, double level) {
+        return ImVec2(origin.x + static_cast<float>((std::log10(frequency) - f0) / (f1 - f0)) * size.x,
+            origin.y + static_cast<float>((high - level) / (high - low)) * size.y);
+    };
+    draw->AddRectFilled(origin, ImVec2(origin.x + size.x, origin.y + size.y), IM_COL32(20, 20, 20, 255));
+    char label[32];
+    for (double x = std::ceil(f0); x <= f1; x += 1.0) {
+        ImVec2 p = toScreen(std::pow(10.0, x), low);
+        draw->AddLine(ImVec2(p.x, origin.y), ImVec2(p.x, origin.y + size.y), IM_COL32(70, 70, 70, 255));
+        std::snprintf(label, sizeof(label), "%g Hz", std::pow(10.0, x));
+        draw->AddText(ImVec2(p.x + 2.0f, origin.y + size.y - ImGui::GetTextLineHeight()), IM_COL32(160, 160, 160, 255), label);
+    }
+    for (double y = low; y <= high; y += 20.0) {
+        ImVec2 p = toScreen(frequencies[1], y);
+        draw->AddLine(ImVec2(origin.x, p.y), ImVec2(origin.x + size.x, p.y), IM_COL32(70, 70, 70, 255));
+        std::snprintf(label, sizeof(label), "%.0f dB", y);
+        draw->AddText(ImVec2(origin.x + 2.0f, p.y), IM_COL32(160, 160, 160, 255), label);
+    }
+    std::vector<ImVec2> curve;
+    for (int axis = 0; axis < A_SIZE; axis++) {
+        curve.clear();
+        for (size_t k = 1; k < frequencies.size(); k++) {
+            curve.push_back(toScreen(frequencies[k], 10.0 * std::log10(density[k * A_SIZE + axis] + 1e-20)));
         }
-
-        // Straight pass
-        std::vector<double> forward(num_rows);
-        double prev_input = 0.0, prev_output = 0.0;
-        for (size_t i = 0; i < num_rows; ++i) {
-            forward[i] = b0 * column[i] + b1 * prev_input - a1 * prev_output;
-            prev_input = column[i];
-            prev_output = forward[i];
+        draw->AddPolyline(curve.data(), static_cast<int>(curve.size()), AXIS_COLORS[axis], 0, 1.5f);
+    }
+    if (pipelineSettings.filterCutoff > 0.0) {
+        float x = toScreen(pipelineSettings.filterCutoff, low).x;
+        if (x >= origin.x && x <= origin.x + size.x) {
+            draw->AddLine(ImVec2(x, origin.y), ImVec2(x, origin.y + size.y), IM_COL32(255, 255, 255, 200), 1.5f);
         }
+    }
+    ImGui::Text("%zu samples at %.1f Hz, %zu segments in %.1f ms (%zu of %zu columns computed), peak at %.2f Hz, cutoff %.4f Hz (click the plot to set it)",
+        stats.samples, stats.sampleRate, stats.segments, stats.seconds * 1000.0, stats.columnsComputed, spectrum.Columns(),
+        stats.peakFrequency, pipelineSettings.filterCutoff);
+
+    //spectrogram, only the columns scrolled into view are uploaded
+    size_t visible = SpectrogramView::VisibleColumns(spectrum);
+    float lastStart = static_cast<float>((spectrum.Columns() - visible) * spectrum.ColumnSeconds());
+    ImGui::SliderFloat("Start, s", &spectrogramStart, 0.0f, lastStart, "%.2f");
+    ImGui::DragFloatRange2("Levels, dB", &spectrogramLevels[0], &spectrogramLevels[1], 1.0f, -300.0f, 100.0f, "%.0f");
+    size_t first = static_cast<size_t>(std::max(0.0f, spectrogramStart) / spectrum.ColumnSeconds());
+    spectrogramView.Draw(spectrum, first, ImVec2(ImGui::GetContentRegionAvail().x, SPECTROGRAM_HEIGHT),
+        spectrogramLevels[0], spectrogramLevels[1]);
+    ImGui::Text("%.2f - %.2f s, 0 - %.1f Hz, %zu columns uploaded", first * spectrum.ColumnSeconds(),
+        (first + visible) * spectrum.ColumnSeconds(), stats.sampleRate / 2.0, spectrogramView.GetUploadedColumns());
+
+    if (outputPath == "") {
+        ImGui::BeginDisabled();
+    }
+    if (ImGui::Button("Export")) {
+        std::string path = outputPath + "/acceleration_psd.csv";
+        spectrumSaved = spectrum.Save(path) ? "Saved to " + path : "Could not write " + path;
+    }
+    if (outputPath == "") {
+        ImGui::EndDisabled();
+    }
+    if (spectrumSaved != "") {
+        ImGui::Text("%s", spectrumSaved.c_str());
+    }
+    ImGui::End();
+}
 
-        // Return pass (like filtfilt)
-        std::vector<double> backward(num_rows);
-        prev_input = 0.0;
-        prev_output = 0.0;
-        for (int i = num_rows - 1; i >= 0; --i) {
-            backward[i] = b0 * forward[i] + b1 * prev_input - a1 * prev_output;
-            prev_input = forward[i];
-            prev_output = backward[i];
+void PlayScene::BuildTube() {
+    Trajectory::Span<float> mean = ensemble.Mean();
+    Trajectory::Span<float> spread = ensemble.Spread();
+    size_t rows = mean.size() / 3;
+    size_t step = std::max<size_t>(1, rows / TUBE_RINGS);
+    float maxSpread = std::max(ensemble.GetStats().maxSpread, 1e-9f);
+    auto at = [&](size_t i) { return glm::vec3(mean[i * 3], mean[i * 3 + 1], mean[i * 3 + 2]); };
+    tubeVertices.reserve((rows / step + 1) * TUBE_SIDES * 2 * 2 * 6);
+
+    //a ring of the radial deviation around the mean at every step, green to red with the deviation, joined along the path
+    std::vector<glm::vec3> previousRing, ring(TUBE_SIDES);
+    for (size_t i = 0; i < rows; i += step) {
+        glm::vec3 tangent = at(std::min(i + step, rows - 1)) - at(i >= step ? i - step : 0);
+        tangent = glm::length(tangent) > 0.0f ? glm::normalize(tangent) : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 up = fabs(tangent.z) < 0.9f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 side = glm::normalize(glm::cross(tangent, up));
+        glm::vec3 normal = glm::cross(tangent, side);
+
+        float radius = sqrtf(spread[i * 3] * spread[i * 3] + spread[i * 3 + 1] * spread[i * 3 + 1] + spread[i * 3 + 2] * spread[i * 3 + 2]);
+        float level = radius / maxSpread;
+        glm::vec3 color = glm::mix(glm::vec3(0.2f, 0.8f, 0.3f), glm::vec3(1.0f, 0.2f, 0.2f), level);
+        for (int k = 0; k < TUBE_SIDES; k++) {
+            float angle = 2.0f * glm::pi<float>() * k / TUBE_SIDES;
+            ring[k] = at(i) + radius * (cosf(angle) * side + sinf(angle) * normal);
         }
-
-        // Saving
-        for (size_t i = 0; i < num_rows; ++i) {
-            data[i * num_columns + col] = backward[i];
+        auto line = [&](const glm::vec3& from, const glm::vec3& to) {
+            tubeVertices.insert(tubeVertices.end(), { from.x, from.y, from.z, color.r, color.g, color.b, to.x, to.y, to.z, color.r, color.g, color.b });
+        };
+        for (int k = 0; k < TUBE_SIDES; k++) {
+            line(ring[k], ring[(k + 1) % TUBE_SIDES]);
+            if (!previousRing.empty()) line(previousRing[k], ring[k]);
         }
+        previousRing = ring;
     }
-
-}
-
-void PlayScene::ConvertVtoPos(int i) {
-    Integrate(i, vs, pos);
 }
 
 void PlayScene::StartCalculation() {
     std::cout << "Calc start\n"; 
-    ts.clear();
-    qs.clear();
-    as.clear();
-    Rs.clear();
-    vs.clear();
-    pos.clear();
-    calculationProgress.store(0);
-    calculationFuture = std::async(std::launch::async, &PlayScene::Calculate, this);
+    engine.ResetProgress();
+    //buffers of both engines are about to be rewritten, whatever is still uploading from them is dropped
+    finalPoints.lod = nullptr;
+    previewPoints.lod = nullptr;
+    for (PointsBuffer& points : comparisonPoints) {
+        points.lod = nullptr;
+    }
+    methodsCompared = compareMethods;
+    glyphs.Clear();
+    poses.Clear();
+    ensemble.Clear();
+    tube.reset();
+    picked = Trajectory::SpatialIndex::Hit();
+    boxSamples.clear();
+    playbackTime = 0.0;
+    playbackSample = 0;
+    calculationFuture = TaskScheduler::Get().Async([this]() { Calculate(); }, TaskPriority::HIGH);
 
 }
 
 
 
-void PlayScene::SaveToSCV(const std::vector<float>& data, int s, const char* header, const char* name) {
-    if (!saveCalculations || outputPath == "") return;
-
-    std::ofstream file(outputPath + "/" + name);
-    file << header << "\n";
-    for (int i = 0; i < data.size(); i += s) {
-        for (int j = 0; j < s; j++) {
-            file << data[i + j];
-            if (j != s - 1) file << ",";
-        }
-        file << "\n";
-    }
-    file.close();
-}
-
-
 void PlayScene::Calculate() {
 
     
     isCalculating = true;
-
-    //1. Load of quaternions and accelerometer data
-    LoadData();
-    if (qs.size() < 4) {
-        std::cerr << "Not enough data!\n";
-        return;
+    bool exportStages = saveCalculations && outputPath != "";
+    if (exportStages) {
+        exporter.Begin(outputPath, static_cast<ExportFormat>(exportFormatIndex));
     }
-    SaveToSCV(as, 3, "ax,ay,az", "1_raw_acc.csv");
-    SaveToSCV(ts, 1, "delta_t", "1_delta_t.csv");
-    SaveToSCV(qs, 4, "qw,qx,qy,qz", "1_raw_quarant.csv");
-    
-    //2. Calculate rotation matrices
-    for (int i = 0; i < qs.size(); i += Q_SIZE) {
-        float w = qs[i];
-        float x = qs[i + 1];
-        float y = qs[i + 2];
-        float z = qs[i + 3];
+    engine.SetExporter(exportStages ? &exporter : nullptr);
 
-        AddRotationMatrix(w, x, y, z);
-        calculationProgress.store(calculationProgress + 1);
-    }
-    SaveToSCV(Rs, 9, "R11,R12,R13,R21,R22,R23,R31,R32,R33", "2_R.csv");
+    Trajectory::Settings settings = pipelineSettings;
+    settings.method = static_cast<Trajectory::IntegrationMethod>(integrationMethodIndex);
+    engine.SetSettings(settings);
 
-    //3. Tilt compensation
-    for (int i = 0; i < ts.size(); i++) {
-        TiltCompensateA(i);
-        calculationProgress.store(calculationProgress + 1);
+    //1. Load of quaternions and accelerometer data
+    engine.Load(csvFilePath);
+    std::cout << "Data loaded: " << engine.Rows() << " rows" << std::endl;
+
+    //long recordings get a low-pass filtered, decimated preview first, it is shown while the full run goes on
+    //Auto keeps about PREVIEW_ROWS rows, a chosen factor is used on anything longer than PREVIEW_ROWS
+    bool autoFactor = previewFactorIndex == 0;
+    if (engine.Rows() >= PREVIEW_ROWS * (autoFactor ? PREVIEW_MIN_FACTOR : 1)) {
+        size_t factor = autoFactor ? engine.Rows() / PREVIEW_ROWS : static_cast<size_t>(1) << previewFactorIndex;
+        if (previewEngine.LoadDecimated(engine, factor)) {
+            //stages may round the factor up
+            previewFactor = (engine.Rows() + previewEngine.Rows() - 1) / previewEngine.Rows();
+            //a fixed uniform rate would give the preview every row back
+            Trajectory::Settings previewSettings = settings;
+            previewSettings.resampleRate /= previewFactor;
+            previewEngine.SetSettings(previewSettings);
+            if (previewEngine.Run()) {
+                previewLod.Build(previewEngine.Positions());
+                previewReady = true;
+            }
+        }
     }
-    SaveToSCV(as, 3, "ax,ay,az", "3_rot_comp_acc.csv");
 
-    //4. Convert to linear velocity
-    for (int i = 0; i < ts.size(); i++) {
-        CompensateGravity(i);
-        calculationProgress.store(calculationProgress + 1);
+    //2.-8. every stage of the pipeline, 5.-8. once per method when comparing
+    if (!(methodsCompared ? engine.RunComparison() : engine.Run())) {
+        isCalculating = false;
+        return;
     }
-    SaveToSCV(as, 3, "ax,ay,az", "4_g_comp_acc.csv");
-
-    //5. Velocity calculation
-    double sampleRate = 0.0; //for 6.
-    vs.resize(as.size());
-    vs[0] = vs[1] = vs[2] = 0.0f;
-    for (int i = 0; i < ts.size(); i++) {
-        ConvertAtoV(i);
-        calculationProgress.store(calculationProgress + 1);
-
-        sampleRate += ts[i];
+    std::cout << "Calc end\n";
 
+    //levels of detail are built here, off the render thread; InitPoints() only uploads them
+    pathLod.Build(engine.Positions());
+    glyphs.Build(engine.Positions(), engine.Quaternions());
+    poses.Build(engine);
+    spatialIndex.Build(engine.Positions());
+    if (methodsCompared) {
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            Trajectory::IntegrationMethod method = static_cast<Trajectory::IntegrationMethod>(m);
+            divergences[m] = engine.MethodDivergence(method, settings.method);
+            if (method != settings.method) {
+                comparisonLods[m].Build(engine.MethodPositions(method));
+            }
+        }
     }
-    sampleRate = 1.0 / (sampleRate / ts.size());
-    SaveToSCV(vs, 3, "vx,vy,vz", "5_raw_velocity.csv");
-
-    //6. Drift compensation
-    double nyQuist = 0.5f * sampleRate;
-    double normalCutoff = filterCutoff / nyQuist;
-    HighPass3DFilter(vs, sampleRate, normalCutoff);
-    calculationProgress.store(calculationProgress + dataSize.load());
-    SaveToSCV(vs, 3, "vx,vy,vz", "6_filtered_velocity.csv");
 
-    //7. Position calculation
-    pos.resize(vs.size());
-    for (int i = 0; i < ts.size(); i++) {
-        ConvertVtoPos(i);
-        calculationProgress.store(calculationProgress + 1);
+    //stages are written while the math goes on, only the tail is waited here
+    if (exportStages) {
+        exporter.Wait();
+        const StageExporter::Stats& exportStats = exporter.GetStats();
+        std::cout << "Export end: " << exportStats.files << " files (" << exportStats.failed << " failed), " << exportStats.bytes << " bytes, " << exportStats.seconds << " s\n";
     }
-    SaveToSCV(pos, 3, "px,py,pz", "7_raw_position.csv");
-
-    //8. Position filtration
-    HighPass3DFilter(pos, sampleRate, normalCutoff);
-    calculationProgress.store(calculationProgress + dataSize.load());
-    std::cout << "Calc end\n";
-    SaveToSCV(pos, 3, "px,py,pz", "8_filtered_position.csv");
     
     isCalculating = false;
 
 
 }
 
-#pragma region Integration_methods
-void PlayScene::SquaresIntegration(int i, const std::vector<float>& input, std::vector<float>& output) {
-    if (i == 0) {
-        return;
-    }
-    output[i * 3] = output[(i - 1) * 3] + input[i * 3] * ts[i];
-    output[i * 3 + 1] = output[(i - 1) * 3 + 1] + input[i * 3 + 1] * ts[i];
-    output[i * 3 + 2] = output[(i - 1) * 3 + 2] + input[i * 3 + 2] * ts[i];
-}
-
-
-void PlayScene::TrapezoidIntegration(int i, const std::vector<float>& input, std::vector<float>& output) {
-    if (i == 0) {
-        return;
-    }
-
-    // (f(x_i) + f(x_{i-1})) * delta_x / 2
-    output[i * 3] = output[(i - 1) * 3] + (input[(i - 1) * 3] + input[i * 3]) * ts[i] / 2.0f;
-    output[i * 3 + 1] = output[(i - 1) * 3 + 1] + (input[(i - 1) * 3 + 1] + input[i * 3 + 1]) * ts[i] / 2.0f;
-    output[i * 3 + 2] = output[(i - 1) * 3 + 2] + (input[(i - 1) * 3 + 2] + input[i * 3 + 2]) * ts[i] / 2.0f;
-}
-
-
-void PlayScene::RungeKuttaIntegration(int i, const std::vector<float>& input, std::vector<float>& output) {
-    if (i == 0) {
-        return; 
-    }
-
-    const float dt = ts[i]; 
-    const float half_dt = dt * 0.5f;
-
-    for (int k = 0; k < 3; ++k) {
-        const float prev_vel = output[(i - 1) * 3 + k];
-        const float prev_acc = input[(i - 1) * 3 + k];
-        const float curr_acc = input[i * 3 + k];
-
-        float k1 = prev_acc * dt;
-        float k2 = (prev_acc + 0.5f * (curr_acc - prev_acc)) * dt;
-        float k3 = k2; 
-        float k4 = curr_acc * dt;
-
-        output[i * 3 + k] = prev_vel + (k1 + 2.0f * k2 + 2.0f * k3 + k4) / 6.0f;
-    }
-
-    
-}
-
-
-#pragma endregion
-
 
 void PlayScene::RenderUI() {
-    int calcProgress = calculationProgress.load();
+    float calcProgress = engine.GetProgress();
     bool isCalc = isCalculating.load();
 
     ImGui::Begin("Play Scene");
@@ -549,7 +788,7 @@ void PlayScene::RenderUI() {
 
     if (ImGui::Button("Choose input data file")) {
         csvFilePath = UIStuff::OpenFileDialog(L"*.txt;*.csv");
-        calculationProgress.store(0);
+        engine.ResetProgress();
     }
     ImGui::Text("Input file path:");
     ImGui::SameLine();
@@ -559,7 +798,7 @@ void PlayScene::RenderUI() {
     if (ImGui::Button("Choose output path")) {
 
         outputPath = UIStuff::OpenFolderDialog();
-        calculationProgress.store(0);
+        engine.ResetProgress();
     }
     ImGui::Text("Output path:");
     ImGui::SameLine();
@@ -579,11 +818,54 @@ void PlayScene::RenderUI() {
         }
         ImGui::EndCombo();
     }
+    ImGui::Checkbox("Compare all methods", &compareMethods);
+    ImGui::InputDouble("High-pass cutoff, Hz", &pipelineSettings.filterCutoff, 0.0, 0.0, "%.4f");
+    ImGui::InputFloat("g, m/s^2", &pipelineSettings.g, 0.0f, 0.0f, "%.3f");
+    ImGui::InputFloat3("Gravity, g", pipelineSettings.gravityVector, "%.4f");
+    ImGui::InputFloat3("Accel bias, g", pipelineSettings.accelBias, "%.4f");
+    ImGui::Checkbox("High-pass filter", &pipelineSettings.highPass);
+    //fused on the host from the gyroscope columns of the recording instead of the DMP quaternions
+    int orientationIndex = pipelineSettings.fuse ? 1 + static_cast<int>(pipelineSettings.fusion.filter) : 0;
+    if (ImGui::Combo("Orientation", &orientationIndex, orientations, IM_ARRAYSIZE(orientations))) {
+        pipelineSettings.fuse = orientationIndex != 0;
+        if (pipelineSettings.fuse) pipelineSettings.fusion.filter = static_cast<Trajectory::FusionFilter>(orientationIndex - 1);
+    }
+    if (pipelineSettings.fuse) {
+        if (pipelineSettings.fusion.filter == Trajectory::FusionFilter::MADGWICK) {
+            ImGui::InputFloat("Madgwick beta, rad/s", &pipelineSettings.fusion.beta, 0.0f, 0.0f, "%.4f");
+        }
+        else {
+            ImGui::InputFloat("Mahony Kp", &pipelineSettings.fusion.kp, 0.0f, 0.0f, "%.3f");
+            ImGui::InputFloat("Mahony Ki, 1/s", &pipelineSettings.fusion.ki, 0.0f, 0.0f, "%.4f");
+        }
+        if (!isCalc && engine.Rows() > 0 && !engine.HasGyroscope()) {
+            ImGui::Text("The loaded recording has no gyroscope columns");
+        }
+    }
+    ImGui::Checkbox("Resample to uniform rate", &pipelineSettings.resample);
+    if (pipelineSettings.resample) {
+        //0 keeps the mean rate of the recording
+        int interpolationIndex = static_cast<int>(pipelineSettings.interpolation);
+        if (ImGui::Combo("Acceleration interpolation", &interpolationIndex, interpolations, IM_ARRAYSIZE(interpolations))) {
+            pipelineSettings.interpolation = static_cast<Trajectory::Interpolation>(interpolationIndex);
+        }
+        ImGui::InputDouble("Uniform rate, Hz", &pipelineSettings.resampleRate, 0.0, 0.0, "%.1f");
+    }
+    ImGui::Combo("Preview factor", &previewFactorIndex, previewFactors, IM_ARRAYSIZE(previewFactors));
+    ImGui::Checkbox("Zero velocity when still", &pipelineSettings.zeroVelocity);
+    if (pipelineSettings.zeroVelocity) {
+        //still: input vector and rotation rate hardly change within the window
+        ImGui::InputFloat("Still window, s", &pipelineSettings.stationaryWindow, 0.0f, 0.0f, "%.2f");
+        ImGui::InputFloat("Still accel deviation, g", &pipelineSettings.stationaryAccel, 0.0f, 0.0f, "%.4f");
+        ImGui::InputFloat("Still rotation rate, rad/s", &pipelineSettings.stationaryRate, 0.0f, 0.0f, "%.3f");
+    }
     if (isCalc) {
         ImGui::EndDisabled();
     }
 
-    if (csvFilePath == "" || isPlaying) {
+    //all of them read the engine buffers in the background
+    bool isBackground = isEnsembleRunning.load() || isTuning.load() || isAllanRunning.load() || isSpectrumRunning.load();
+    if (csvFilePath == "" || isPlaying || isBackground) {
         ImGui::BeginDisabled();
     }
     if (ImGui::Button("Start calculation") && !isCalc) {
@@ -591,26 +873,235 @@ void PlayScene::RenderUI() {
         StartCalculation();
         
     }
-    if (csvFilePath == "" || isPlaying) {
+    if (csvFilePath == "" || isPlaying || isBackground) {
         ImGui::EndDisabled();
     }
     ImGui::Checkbox("Save calculations to files", &saveCalculations);
+    if (saveCalculations) {
+        ImGui::Combo("File format", &exportFormatIndex, exportFormats, IM_ARRAYSIZE(exportFormats));
+        const StageExporter::Stats& exportStats = exporter.GetStats();
+        if (!isCalc && exportStats.files > 0) {
+            ImGui::Text("Last export: %zu files (%zu failed), %.2f MB in %.3f s", exportStats.files, exportStats.failed, exportStats.bytes / (1024.0f * 1024.0f), exportStats.seconds);
+        }
+    }
     
 
     ImGui::Text("Calculation progress:");
     ImGui::SameLine();
-    ImGui::Text("%.2f",((float)calcProgress / (float)dataSize.load()) / ETAPS_COUNT * 100.0f);
+    ImGui::Text("%.2f", calcProgress * 100.0f);
+
+    if (!isCalc) {
+        const PipelineArena::Stats& arenaStats = engine.GetArenaStats();
+        ImGui::Text("Buffers: %zu rows reserved, high-water %zu rows, %.2f MB",
+            arenaStats.capacityRows, arenaStats.highWaterRows, arenaStats.reservedBytes / (1024.0f * 1024.0f));
+        ImGui::Text("Reallocations: %zu in %zu runs", arenaStats.growCount, arenaStats.runCount);
+    }
+    ImGui::Text("Camera uploads: %zu in %zu frames", camera.GetUploadCount(), camera.GetFrameCount());
+    const PointsBuffer* shownPoints = finalPoints.IsReady() ? &finalPoints : (previewPoints.IsReady() ? &previewPoints : nullptr);
+    if (shownPoints == &previewPoints) {
+        ImGui::Text("Preview: %zu points, %zu input rows low-pass filtered into each", previewPoints.lod->Samples(), previewFactor);
+    }
+    else if (shownPoints == &finalPoints) {
+        ImGui::Text("Trajectory buffer: %zu points, %.2f MB, uploaded in %.2f ms over %d frames",
+            finalPoints.lod->Samples(), (finalPoints.totalBytes + finalPoints.indexBytes) / (1024.0f * 1024.0f),
+            finalPoints.uploadMilliseconds, finalPoints.uploadFrames);
+    }
+    if (shownPoints != nullptr) {
+        ImGui::Text("Level of detail: %zu points drawn, %zu of %zu chunks culled",
+            lodDrawnSamples, lodCulledChunks, shownPoints->lod->Chunks().size());
+    }
+    if (shownPoints == &finalPoints && engine.GetSettings().zeroVelocity) {
+        ImGui::Text("Stationary: %zu of %zu rows, %zu moving spans", engine.StationaryRows(), engine.Rows(), engine.MovingSpans().size() / 2);
+    }
+    ImGui::Checkbox("Show orientation along the path", &showGlyphs);
+    if (showGlyphs && shownPoints == &finalPoints) {
+        ImGui::SameLine();
+        ImGui::Text("(%zu glyphs)", glyphs.GetDrawnCount());
+    }
+
+    if (finalPoints.IsReady() && !isCalc && methodsCompared) {
+        //distances are to the selected method, the one shown in the other panels
+        int selected = static_cast<int>(engine.GetSettings().method);
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            ImVec4 color(METHOD_COLORS[m].r, METHOD_COLORS[m].g, METHOD_COLORS[m].b, 1.0f);
+            const Trajectory::Divergence& divergence = divergences[m];
+            if (m == selected) {
+                ImGui::TextColored(color, "%s (selected): path %.3f m", integrationMethods[m], divergence.pathLength);
+                continue;
+            }
+            ImGui::TextColored(color, "%s: path %.3f m, apart by max %.4f m, rms %.4f m, at the end %.4f m",
+                integrationMethods[m], divergence.pathLength, divergence.maxDistance, divergence.rmsDistance, divergence.endDistance);
+        }
+    }
+
+    if (finalPoints.IsReady() && !isCalc) {
+        if (picked.found) {
+            size_t i = picked.sample;
+            Trajectory::Span<float> pos = engine.Positions();
+            Trajectory::Span<float> vs = engine.Velocities();
+            Trajectory::Span<float> qs = engine.Quaternions();
+            ImGui::Text("Picked sample %zu at %.3f s (%.1f us)", i, poses.Index().TimeAt(i), pickMicroseconds);
+            ImGui::Text("Position: %.4f, %.4f, %.4f m", pos[i * 3], pos[i * 3 + 1], pos[i * 3 + 2]);
+            ImGui::Text("Velocity: %.4f, %.4f, %.4f m/s", vs[i * 3], vs[i * 3 + 1], vs[i * 3 + 2]);
+            ImGui::Text("Quaternion: %.4f, %.4f, %.4f, %.4f", qs[i * 4], qs[i * 4 + 1], qs[i * 4 + 2], qs[i * 4 + 3]);
+        }
+        else {
+            ImGui::Text("Point at the path to see its sample (%.1f us per pick)", pickMicroseconds);
+        }
+
+        ImGui::InputFloat3("Box min, m", boxLow);
+        ImGui::InputFloat3("Box max, m", boxHigh);
+        if (ImGui::Button("Find samples in box")) {
+            auto start = std::chrono::steady_clock::now();
+            spatialIndex.InBox(boxLow, boxHigh, boxSamples);
+            std::sort(boxSamples.begin(), boxSamples.end());
+            boxMicroseconds = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+        }
+        if (!boxSamples.empty()) {
+            ImGui::Text("%zu samples in the box (%.1f us), first %u at %.3f s, last %u at %.3f s", boxSamples.size(), boxMicroseconds,
+                boxSamples.front(), poses.Index().TimeAt(boxSamples.front()), boxSamples.back(), poses.Index().TimeAt(boxSamples.back()));
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Uncertainty")) {
+        //error models of the perturbed copies, one standard deviation each
+        ImGui::SliderInt("Members", &ensembleMembers, ENSEMBLE_MIN_MEMBERS, ENSEMBLE_MAX_MEMBERS);
+        ImGui::InputFloat("Accel noise, g", &ensembleSettings.accelNoise, 0.0f, 0.0f, "%.4f");
+        ImGui::InputFloat("Accel bias, g", &ensembleSettings.accelBias, 0.0f, 0.0f, "%.4f");
+        ImGui::InputFloat("Orientation noise, rad", &ensembleSettings.quaternionNoise, 0.0f, 0.0f, "%.4f");
+        ImGui::InputFloat("Time jitter, s", &ensembleSettings.timeJitter, 0.0f, 0.0f, "%.5f");
+        if (!finalPoints.IsReady() || isCalc || isBackground) {
+            ImGui::BeginDisabled();
+        }
+        if (ImGui::Button("Estimate uncertainty")) {
+            StartEnsemble();
+        }
+        if (!finalPoints.IsReady() || isCalc || isBackground) {
+            ImGui::EndDisabled();
+        }
+        if (isEnsembleRunning.load()) {
+            ImGui::SameLine();
+            ImGui::Text("%.0f%%", ensemble.GetProgress() * 100.0f);
+        }
+        else if (tube) {
+            const Trajectory::Ensemble::Stats& ensembleStats = ensemble.GetStats();
+            ImGui::Text("%zu members in %.2f s, %.1f M member-rows/s", ensembleStats.members, ensembleStats.seconds,
+                ensembleStats.members * ensembleStats.rows / ensembleStats.seconds / 1e6);
+            ImGui::Text("Position deviation: %.4f m at the end, %.4f m at most", ensembleStats.endSpread, ensembleStats.maxSpread);
+            ImGui::Checkbox("Show uncertainty tube", &showTube);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Noise")) {
+        //Allan deviation of the recording's accelerometer, meant for long recordings of the board lying still
+        if (!finalPoints.IsReady() || isCalc || isBackground) {
+            ImGui::BeginDisabled();
+        }
+        if (ImGui::Button("Compute Allan deviation")) {
+            StartAllan();
+        }
+        if (!finalPoints.IsReady() || isCalc || isBackground) {
+            ImGui::EndDisabled();
+        }
+        if (isAllanRunning.load()) {
+            ImGui::SameLine();
+            ImGui::Text("%.0f%%", allan.GetProgress() * 100.0f);
+        }
+        else if (!allan.Taus().empty()) {
+            ImGui::SameLine();
+            ImGui::Checkbox("Show", &showAllan);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Spectrum")) {
+        //world frame acceleration of the last calculation, to see vibration and where to put the cutoff
+        ImGui::Combo("Segment, samples", &spectrumSegmentIndex, spectrumSegments, IM_ARRAYSIZE(spectrumSegments));
+        ImGui::Checkbox("Resample to uniform time", &spectrumSettings.resample);
+        if (!finalPoints.IsReady() || isCalc || isBackground) {
+            ImGui::BeginDisabled();
+        }
+        if (ImGui::Button("Analyze spectrum")) {
+            StartSpectrum();
+        }
+        if (!finalPoints.IsReady() || isCalc || isBackground) {
+            ImGui::EndDisabled();
+        }
+        if (isSpectrumRunning.load()) {
+            ImGui::SameLine();
+            ImGui::Text("%.0f%%", spectrum.GetProgress() * 100.0f);
+        }
+        else if (spectrum.Columns() > 0) {
+            ImGui::SameLine();
+            ImGui::Checkbox("Show##spectrum", &showSpectrum);
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Tune parameters")) {
+        //searched around the settings of the last calculation, over its trajectory
+        int objectiveIndex = static_cast<int>(tuningSettings.objective);
+        if (ImGui::Combo("Objective", &objectiveIndex, tuningObjectives, IM_ARRAYSIZE(tuningObjectives))) {
+            tuningSettings.objective = static_cast<Trajectory::TuningObjective>(objectiveIndex);
+        }
+        if (tuningSettings.objective == Trajectory::TuningObjective::REST_AT_ENDS) {
+            ImGui::InputFloat("Still at either end, s", &tuningSettings.restSeconds, 0.0f, 0.0f, "%.2f");
+        }
+        if (!finalPoints.IsReady() || isCalc || isBackground) {
+            ImGui::BeginDisabled();
+        }
+        if (ImGui::Button("Tune")) {
+            StartTuning();
+        }
+        if (!finalPoints.IsReady() || isCalc || isBackground) {
+            ImGui::EndDisabled();
+        }
+        const Trajectory::TuningResult& tuned = tuner.GetResult();
+        if (isTuning.load()) {
+            ImGui::SameLine();
+            ImGui::Text("%.0f%%", tuner.GetProgress() * 100.0f);
+        }
+        else if (tuned.evaluations > 0) {
+            const float* gravity = tuned.settings.gravityVector;
+            ImGui::Text("Cutoff %.4f Hz, bias %.4f, %.4f, %.4f g, gravity %.4f g", tuned.settings.filterCutoff,
+                tuned.settings.accelBias[0], tuned.settings.accelBias[1], tuned.settings.accelBias[2],
+                std::sqrt(gravity[0] * gravity[0] + gravity[1] * gravity[1] + gravity[2] * gravity[2]));
+            ImGui::Text("Objective %.3f%% -> %.3f%%", tuned.initialObjective * 100.0, tuned.objective * 100.0);
+            ImGui::Text("%zu candidates in %.2f s, %.1f per second", tuned.evaluations, tuned.seconds, tuned.evaluations / tuned.seconds);
+            if (csvFilePath == "" || isPlaying || isCalc || isBackground) {
+                ImGui::BeginDisabled();
+            }
+            if (ImGui::Button("Use tuned parameters")) {
+                pipelineSettings = tuned.settings;
+                StartCalculation();
+            }
+            if (csvFilePath == "" || isPlaying || isCalc || isBackground) {
+                ImGui::EndDisabled();
+            }
+        }
+    }
 
     if (isCalc || calcProgress == 0) {
         ImGui::BeginDisabled();
     }
     if (ImGui::Button(isPlaying ? "Stop animation": "Show animation")) {
         isPlaying = !isPlaying;
+        playbackTick = std::chrono::steady_clock::now();
+    }
+    ImGui::SliderFloat("Speed", &playbackSpeed, PLAYBACK_MIN_SPEED, PLAYBACK_MAX_SPEED, "%.1fx", ImGuiSliderFlags_Logarithmic);
+    //the index is rebuilt by the calculation thread
+    size_t playbackRows = isCalc ? 0 : poses.Rows();
+    float seekTime = static_cast<float>(playbackTime);
+    if (ImGui::SliderFloat("Time, s", &seekTime, 0.0f, isCalc ? 0.0f : static_cast<float>(poses.Duration()), "%.2f")) {
+        playbackTime = seekTime;
+        ShowPose(playbackTime);
     }
+    ImGui::Text("Sample %zu of %zu", playbackSample, playbackRows);
     if (isCalc || calcProgress == 0) {
         ImGui::EndDisabled();
     }
     ImGui::End();
+
+    RenderAllanPanel();
+    RenderSpectrumPanel();
     
 
 
@@ -618,284 +1109,94 @@ void PlayScene::RenderUI() {
 }
 
 
-void PlayScene::CompileShaders() {
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-    }
-
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-    }
-
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+void PlayScene::UpdateView() {
+    glm::vec3 cameraPos = glm::vec3(3.0f, 2.0f, 3.0f) * cameraDistance;
+    glm::mat4 view = glm::lookAt(
+        cameraPos,
+        glm::vec3(0.0f, 0.0f, 0.0f),
+        glm::vec3(0.0f, 0.0f, 1.0f)
+    );
+    view = glm::rotate(view, glm::radians(cameraAngleX), glm::vec3(1.0f, 0.0f, 0.0f));
+    view = glm::rotate(view, glm::radians(cameraAngleY), glm::vec3(0.0f, 1.0f, 0.0f));
+    view = glm::rotate(view, glm::radians(cameraAngleZ), glm::vec3(0.0f, 0.0f, 1.0f));
+    camera.SetView(view);
+    viewChanged = false;
 }
 
 void PlayScene::SetupCamera() {
-    view = glm::lookAt(
-        glm::vec3(3.0f, 2.0f, 3.0f), // camera position
-        glm::vec3(0.0f, 0.0f, 0.0f), // look at origin
-        glm::vec3(0.0f, 0.0f, 1.0f)  // up vector
-    );
-
-    projection = glm::perspective(
-        glm::radians(45.0f), // FOV
+    camera.Init();
+    camera.SetProjection(glm::perspective(
+        glm::radians(CAMERA_FOV), // FOV
         800.0f / 600.0f,    // aspect ratio
         0.1f,               // near plane
         100.0f              // far plane
-    );
+    ));
+    UpdateView();
 
     glEnable(GL_DEPTH_TEST);
     glPointSize(5.0f); // Set point size for position markers
 }
 
-void PlayScene::InitPoints() {
-    if (pointsVAO != 0) {
-        glDeleteVertexArrays(1, &pointsVAO);
-        glDeleteBuffers(1, &pointsVBO);
-    }
-    if (pos.empty()) return;
-
-    // Create vector with positions and colors (yellow)
-    std::vector<float> vertices;
-    for (size_t i = 0; i < pos.size(); i += 3) {
-        vertices.push_back(pos[i] * 10.0f);
-        vertices.push_back(pos[i + 1] * 10.0f);
-        vertices.push_back(pos[i + 2] * 10.0f);
-        vertices.push_back(1.0f); // R
-        vertices.push_back(1.0f); // G
-        vertices.push_back(0.0f); // B
-    }
-
-    glGenVertexArrays(1, &pointsVAO);
-    glGenBuffers(1, &pointsVBO);
-
-    glBindVertexArray(pointsVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, pointsVBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-}
-
-void PlayScene::InitCube() {
-    {
-        float BOARD_WIDTH = 0.6f;
-        float BOARD_HEIGHT = 1.0f;
-        float BOARD_THICKNESS = 0.1f;
-        float AXIS_LENGTH = 1.5f;
-
-        float halfW = BOARD_WIDTH / 16.0f;
-        float halfH = BOARD_HEIGHT / 16.0f;
-        float halfT = BOARD_THICKNESS / 16.0f;
-
-
-        cubePosition = glm::vec3(0.0f, 0.0f, 0.0f);
-        cubeRotation = glm::mat3x3(1, 0, 0, 0, 1, 0, 0, 0, 1);
-
-        std::vector<float> vertices = {
-            //front
-            -halfW, -halfH,  halfT,  0.8f, 0.2f, 0.2f,
-             halfW, -halfH,  halfT,  0.8f, 0.2f, 0.2f,
-             halfW,  halfH,  halfT,  0.8f, 0.2f, 0.2f,
-             halfW,  halfH,  halfT,  0.8f, 0.2f, 0.2f,
-            -halfW,  halfH,  halfT,  0.8f, 0.2f, 0.2f,
-            -halfW, -halfH,  halfT,  0.8f, 0.2f, 0.2f,
-
-            //back
-            -halfW, -halfH, -halfT,  0.8f, 0.2f, 0.2f,
-             halfW, -halfH, -halfT,  0.8f, 0.2f, 0.2f,
-             halfW,  halfH, -halfT,  0.8f, 0.2f, 0.2f,
-             halfW,  halfH, -halfT,  0.8f, 0.2f, 0.2f,
-            -halfW,  halfH, -halfT,  0.8f, 0.2f, 0.2f,
-            -halfW, -halfH, -halfT,  0.8f, 0.2f, 0.2f,
-
-            //left
-            -halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
-            -halfW,  halfH, -halfT,  0.6f, 0.1f, 0.1f,
-            -halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
-            -halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
-            -halfW, -halfH,  halfT,  0.6f, 0.1f, 0.1f,
-            -halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
-
-            //right
-             halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
-             halfW,  halfH, -halfT,  0.6f, 0.1f, 0.1f,
-             halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
-             halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
-             halfW, -halfH,  halfT,  0.6f, 0.1f, 0.1f,
-             halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
-
-             //bottom
-             -halfW, -halfH, -halfT,  0.5f, 0.1f, 0.1f,
-              halfW, -halfH, -halfT,  0.5f, 0.1f, 0.1f,
-              halfW, -halfH,  halfT,  0.5f, 0.1f, 0.1f,
-              halfW, -halfH,  halfT,  0.5f, 0.1f, 0.1f,
-             -halfW, -halfH,  halfT,  0.5f, 0.1f, 0.1f,
-             -halfW, -halfH, -halfT,  0.5f, 0.1f, 0.1f,
-
-             //top
-             -halfW,  halfH, -halfT,  0.7f, 0.2f, 0.2f,
-              halfW,  halfH, -halfT,  0.7f, 0.2f, 0.2f,
-              halfW,  halfH,  halfT,  0.7f, 0.2f, 0.2f,
-              halfW,  halfH,  halfT,  0.7f, 0.2f, 0.2f,
-             -halfW,  halfH,  halfT,  0.7f, 0.2f, 0.2f,
-             -halfW,  halfH, -halfT,  0.7f, 0.2f, 0.2f
-        };
+void PlayScene::InitPoints(PointsBuffer& points, Trajectory::Span<float> positions, const Trajectory::PathLod& lod) {
+    points.lod = nullptr;
+    if (positions.empty()) return;
 
-        /*
-        std::vector<float> vertices = {
-            // Front face (red)
-            -halfSize, -halfSize,  halfSize,  0.8f, 0.2f, 0.2f,
-             halfSize, -halfSize,  halfSize,  0.8f, 0.2f, 0.2f,
-             halfSize,  halfSize,  halfSize,  0.8f, 0.2f, 0.2f,
-             halfSize,  halfSize,  halfSize,  0.8f, 0.2f, 0.2f,
-            -halfSize,  halfSize,  halfSize,  0.8f, 0.2f, 0.2f,
-            -halfSize, -halfSize,  halfSize,  0.8f, 0.2f, 0.2f,
-
-            // Back face (red)
-            -halfSize, -halfSize, -halfSize,  0.8f, 0.2f, 0.2f,
-             halfSize, -halfSize, -halfSize,  0.8f, 0.2f, 0.2f,
-             halfSize,  halfSize, -halfSize,  0.8f, 0.2f, 0.2f,
-             halfSize,  halfSize, -halfSize,  0.8f, 0.2f, 0.2f,
-            -halfSize,  halfSize, -halfSize,  0.8f, 0.2f, 0.2f,
-            -halfSize, -halfSize, -halfSize,  0.8f, 0.2f, 0.2f,
-
-            // Left face (darker red)
-            -halfSize,  halfSize,  halfSize,  0.6f, 0.1f, 0.1f,
-            -halfSize,  halfSize, -halfSize,  0.6f, 0.1f, 0.1f,
-            -halfSize, -halfSize, -halfSize,  0.6f, 0.1f, 0.1f,
-            -halfSize, -halfSize, -halfSize,  0.6f, 0.1f, 0.1f,
-            -halfSize, -halfSize,  halfSize,  0.6f, 0.1f, 0.1f,
-            -halfSize,  halfSize,  halfSize,  0.6f, 0.1f, 0.1f,
-
-            // Right face (darker red)
-             halfSize,  halfSize,  halfSize,  0.6f, 0.1f, 0.1f,
-             halfSize,  halfSize, -halfSize,  0.6f, 0.1f, 0.1f,
-             halfSize, -halfSize, -halfSize,  0.6f, 0.1f, 0.1f,
-             halfSize, -halfSize, -halfSize,  0.6f, 0.1f, 0.1f,
-             halfSize, -halfSize,  halfSize,  0.6f, 0.1f, 0.1f,
-             halfSize,  halfSize,  halfSize,  0.6f, 0.1f, 0.1f,
-
-             // Bottom face (darkest red)
-             -halfSize, -halfSize, -halfSize,  0.5f, 0.1f, 0.1f,
-              halfSize, -halfSize, -halfSize,  0.5f, 0.1f, 0.1f,
-              halfSize, -halfSize,  halfSize,  0.5f, 0.1f, 0.1f,
-              halfSize, -halfSize,  halfSize,  0.5f, 0.1f, 0.1f,
-             -halfSize, -halfSize,  halfSize,  0.5f, 0.1f, 0.1f,
-             -halfSize, -halfSize, -halfSize,  0.5f, 0.1f, 0.1f,
-
-             // Top face (bright red)
-             -halfSize,  halfSize, -halfSize,  0.7f, 0.2f, 0.2f,
-              halfSize,  halfSize, -halfSize,  0.7f, 0.2f, 0.2f,
-              halfSize,  halfSize,  halfSize,  0.7f, 0.2f, 0.2f,
-              halfSize,  halfSize,  halfSize,  0.7f, 0.2f, 0.2f,
-             -halfSize,  halfSize,  halfSize,  0.7f, 0.2f, 0.2f,
-             -halfSize,  halfSize, -halfSize,  0.7f, 0.2f, 0.2f
-        };
-        */
-        glGenVertexArrays(1, &cubeVAO);
-        glGenBuffers(1, &cubeVBO);
+    if (points.vao == 0) {
+        glGenVertexArrays(1, &points.vao);
+        glGenBuffers(1, &points.vbo);
+        glGenBuffers(1, &points.ebo);
 
-        glBindVertexArray(cubeVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
+        glBindVertexArray(points.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, points.vbo);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
-
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        //the element buffer binding is part of the vao
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, points.ebo);
         glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
     }
-    {
-        std::vector<float> vertices = {
-            // X axis (red)
-            0.0f, 0.0f, 0.0f, 0.8f, 0.2f, 0.2f,
-            CUBE_AXIS_LENGTH, 0.0f, 0.0f, 0.8f, 0.2f, 0.2f,
 
-            // Y axis (green)
-            0.0f, 0.0f, 0.0f, 0.2f, 0.8f, 0.2f,
-            0.0f, CUBE_AXIS_LENGTH, 0.0f, 0.2f, 0.8f, 0.2f,
-
-            // Z axis (blue)
-            0.0f, 0.0f, 0.0f, 0.2f, 0.2f, 0.8f,
-            0.0f, 0.0f, CUBE_AXIS_LENGTH, 0.2f, 0.2f, 0.8f
-        };
-
-        glGenVertexArrays(1, &cubeAxesVAO);
-        glGenBuffers(1, &cubeAxesVBO);
-
-        glBindVertexArray(cubeAxesVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, cubeAxesVBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
+    auto uploadStart = std::chrono::steady_clock::now();
+    points.source = positions.data();
+    points.totalBytes = positions.size() * sizeof(float);
+    points.uploadedBytes = 0;
+    points.uploadFrames = 0;
 
+    //positions go straight from the engine buffer in UploadPoints(), scale and color are applied in Render()
+    if (points.totalBytes > points.capacityBytes || points.totalBytes < points.capacityBytes / 4) {
+        glBindBuffer(GL_ARRAY_BUFFER, points.vbo);
+        glBufferData(GL_ARRAY_BUFFER, points.totalBytes, nullptr, GL_STATIC_DRAW);
         glBindBuffer(GL_ARRAY_BUFFER, 0);
-        glBindVertexArray(0);
+        points.capacityBytes = points.totalBytes;
     }
-}
 
-void PlayScene::InitAxes() {
-    std::vector<float> vertices = {
-        // X axis (red)
-        -AXIS_LENGTH, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-        AXIS_LENGTH, 0.0f, 0.0f, 1.0f, 0.6f, 0.6f,
-
-        // Y axis (green)
-        0.0f, -AXIS_LENGTH, 0.0f, 0.0f, 1.0f, 0.6f,
-        0.0f, AXIS_LENGTH, 0.0f, 0.6f, 1.0f, 0.6f,
-
-        // Z axis (blue)
-        0.0f, 0.0f, -AXIS_LENGTH, 0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, AXIS_LENGTH, 0.6f, 0.6f, 1.0f
-    };
-
-    glGenVertexArrays(1, &axesVAO);
-    glGenBuffers(1, &axesVBO);
+    //coarse levels index into the same positions and are small, they go at once
+    const std::vector<uint32_t>& lodIndices = lod.Indices();
+    points.indexBytes = lodIndices.size() * sizeof(uint32_t);
+    glBindVertexArray(points.vao);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, points.indexBytes, lodIndices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
 
-    glBindVertexArray(axesVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, axesVBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    points.uploadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count();
+    points.lod = &lod;
+}
 
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+void PlayScene::UploadPoints(PointsBuffer& points) {
+    if (points.lod == nullptr || points.uploadedBytes == points.totalBytes) return;
 
+    auto uploadStart = std::chrono::steady_clock::now();
+    size_t bytes = std::min<size_t>(UPLOAD_SLICE_BYTES, points.totalBytes - points.uploadedBytes);
+    glBindBuffer(GL_ARRAY_BUFFER, points.vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, points.uploadedBytes, bytes, reinterpret_cast<const char*>(points.source) + points.uploadedBytes);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    points.uploadedBytes += bytes;
+    points.uploadFrames++;
+    points.uploadMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart).count();
+}
+
+void PlayScene::DeletePoints(PointsBuffer& points) {
+    glDeleteVertexArrays(1, &points.vao);
+    glDeleteBuffers(1, &points.vbo);
+    glDeleteBuffers(1, &points.ebo);
+    points = PointsBuffer();
 }
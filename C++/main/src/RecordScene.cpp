@@ -16,37 +16,14 @@
 #include <charconv>
 #include <algorithm>
 
-RecordScene::RecordScene(COM::Port* comPort) : Scene(comPort) {
-    vertexShaderSource = "#version 330 core\n"
-        "layout (location = 0) in vec3 aPos;\n"
-        "layout (location = 1) in vec3 aColor;\n"
-        "uniform mat4 model;\n"
-        "uniform mat4 view;\n"
-        "uniform mat4 projection;\n"
-        "out vec3 ourColor;\n"
-        "void main()\n"
-        "{\n"
-        "   gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
-        "   ourColor = aColor;\n"
-        "}\0";
-
-    fragmentShaderSource = "#version 330 core\n"
-        "in vec3 ourColor;\n"
-        "out vec4 FragColor;\n"
-        "void main()\n"
-        "{\n"
-        "   FragColor = vec4(ourColor, 1.0f);\n"
-        "}\0";
-
-    //Board sizes
-    BOARD_WIDTH = 0.6f;
-    BOARD_HEIGHT = 1.0f;
-    BOARD_THICKNESS = 0.1f;
-    AXIS_LENGTH = 1.5f;
+//how often the COM port is read while it is open, the DMP sends a sample about every 10 ms
+#define PORT_POLL_SECONDS 0.005
 
-    
+RecordScene::RecordScene(COM::Port* comPort) : Scene(comPort) {
     q = { 1.0f, 0.0f, 0.0f, 0.0f };
     a = { 0.0f, 0.0f, 0.0f };
+    g = { 0.0f, 0.0f, 0.0f };
+    fusedQ = q;
 
     //if somehow we forget to open com port
     if (p_comPort) {
@@ -59,23 +36,28 @@ RecordScene::RecordScene(COM::Port* comPort) : Scene(comPort) {
 }
 
 RecordScene::~RecordScene() {
-    glDeleteVertexArrays(1, &boardVAO);
-    glDeleteBuffers(1, &boardVBO);
-
-    glDeleteVertexArrays(1, &axesVAO);
-    glDeleteBuffers(1, &axesVBO);
-
-    glDeleteProgram(shaderProgram);
-
-    if (csvFile.is_open()) {
-        csvFile.close();
-    }
+    StopRecording();
 }
 
 void RecordScene::InitRender() {
-    CompileShaders();
-    InitBoard();
-    InitAxes();
+    GpuCache& cache = GpuCache::Get();
+    program = cache.ColorProgram();
+    board = cache.BoardMesh();
+    axes = cache.GetMesh("record axes", [this]() {
+        return std::vector<float>{
+            //X red
+            0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+            AXIS_LENGTH, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
+
+            //Y green
+            0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
+            0.0f, AXIS_LENGTH, 0.0f, 0.0f, 1.0f, 0.0f,
+
+            //Z blue
+            0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
+            0.0f, 0.0f, AXIS_LENGTH, 0.0f, 0.0f, 1.0f
+        };
+    });
     SetupCamera();
 }
 
@@ -89,15 +71,14 @@ std::string RecordScene::GenerateCSVFIlePath() {
 }
 
 bool RecordScene::StartNewRecording() {
-    if (csvFile.is_open()) {
-        csvFile.close();
-    }
+    StopRecording();
 
     csvFilePath = GenerateCSVFIlePath();
 
     csvFile.open(csvFilePath);
     if (csvFile.is_open()) {
-        csvFile << "t,w,x,y,z,ax,ay,az\n";
+        headerWritten = false;
+        fusionAligned = false;
         return true;
     }
     else {
@@ -109,11 +90,18 @@ bool RecordScene::StartNewRecording() {
 
 void RecordScene::WriteToCSV() {
     if (csvFile.is_open()) {
-        
+        if (!headerWritten) {
+            csvFile << (hasGyro ? "t,w,x,y,z,ax,ay,az,gx,gy,gz\n" : "t,w,x,y,z,ax,ay,az\n");
+            headerWritten = true;
+        }
 
         csvFile << time << ","
             << q[0] << "," << q[1] << "," << q[2] << "," << q[3] << ","
-            << a[0] << "," << a[1] << "," << a[2] << "\n";
+            << a[0] << "," << a[1] << "," << a[2];
+        if (hasGyro) {
+            csvFile << "," << g[0] << "," << g[1] << "," << g[2];
+        }
+        csvFile << "\n";
 
         //  ,       
         csvFile.flush();
@@ -123,12 +111,18 @@ void RecordScene::WriteToCSV() {
 void RecordScene::StopRecording() {
     if (csvFile.is_open()) {
         csvFile.close();
+        //empty marker tells trajectory_watch that the recording is complete
+        std::ofstream marker(csvFilePath + ".done");
     }
 }
 
 
 
 
+double RecordScene::DataInterval() const {
+    return p_comPort && p_comPort->IsOpen() ? PORT_POLL_SECONDS : 0.0;
+}
+
 void RecordScene::Update() {
     if (!p_comPort || !p_comPort->IsOpen()) return;
 
@@ -139,6 +133,7 @@ void RecordScene::Update() {
             if (line.empty()) continue;
             //we get some command code
             if (line.length() == 2) {
+                RequestRedraw();
                 //Start translation code
                 if (line[0] == '1') {
                     isRecording = StartNewRecording();
@@ -156,7 +151,7 @@ void RecordScene::Update() {
             }
 
             if (isRecording) {
-                float values[7];
+                float values[10];
                 const char* ptr = line.data();
                 const char* const end = ptr + line.size();
                 int i = 0;
@@ -173,25 +168,32 @@ void RecordScene::Update() {
                     i++;
                 }
 
-                // Then parse the 7 float values
-                while (i < 8 && ptr < end) {
-                    const char* comma = std::strchr(ptr, ',');
-                    if (i == 7) comma = end; // last value
-                    if (!comma && i != 7) break;
+                // Then parse the 7 float values, 10 if the board also sends the gyroscope
+                while (i < 11 && ptr < end) {
+                    const char* comma = std::find(ptr, end, ',');
                     auto result = std::from_chars(ptr, comma, values[i - 1]);
-                    if (result.ec != std::errc() || (comma != end && *comma != ',')) {
+                    if (result.ec != std::errc()) {
                         break;
                     }
                     ptr = comma + 1;
                     i++;
                 }
 
-                if (i == 8) {
-                    // Store time and other values as needed
-                    // You might want to add time to your CSV or store it somewhere
+                if (i == 8 || i == 11) {
                     std::copy(values, values + 4, q.begin());
                     std::copy(values + 4, values + 7, a.begin());
-                    WriteToCSV(); // Modify WriteToCSV to accept time parameter
+                    //a recording keeps the columns of its first row
+                    if (!headerWritten) hasGyro = i == 11;
+                    //a row without the gyroscope columns is written with zeros there, as Engine reads it, and not fused
+                    if (hasGyro && i == 11) {
+                        std::copy(values + 7, values + 10, g.begin());
+                        UpdateFusion();
+                    }
+                    else if (hasGyro) {
+                        std::fill(g.begin(), g.end(), 0.0f);
+                    }
+                    WriteToCSV();
+                    RequestRedraw();
                 }
             }
         }
@@ -202,33 +204,48 @@ void RecordScene::Update() {
 }
 
 
+void RecordScene::UpdateFusion() {
+    if (orientationIndex == 0) {
+        fusionAligned = false;
+        return;
+    }
+    Trajectory::FusionSettings settings = fusion.GetSettings();
+    settings.filter = orientationIndex == 1 ? Trajectory::FusionFilter::MADGWICK : Trajectory::FusionFilter::MAHONY;
+    fusion.SetSettings(settings);
+    if (!fusionAligned) {
+        fusion.Align(0, a.data());
+        fusionAligned = true;
+    }
+    float dt = time / 1000.0f;
+    fusion.Update(g.data(), a.data(), &dt);
+    fusion.Get(0, fusedQ.data());
+}
+
 void RecordScene::Render() {
     glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glUseProgram(shaderProgram);
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    //the camera is fixed here, so only the first frame uploads it
+    camera.Upload();
+    program->Use();
 
     //3D model based on quarantion
+    const std::vector<float>& shown = orientationIndex != 0 && hasGyro ? fusedQ : q;
     glm::mat4 model = glm::mat4(1.0f);
-    float angle = 2.0f * acos(q[0]);
-    float norm = sqrt(1.0f - q[0] * q[0]);
+    float angle = 2.0f * acos(shown[0]);
+    float norm = sqrt(1.0f - shown[0] * shown[0]);
     if (norm > 0.001f) {
         norm = 1.0f / norm;
-        glm::vec3 axis(q[1] * norm, q[2] * norm, q[3] * norm);
+        glm::vec3 axis(shown[1] * norm, shown[2] * norm, shown[3] * norm);
         model = glm::rotate(model, angle, axis);
     }
-    glUniformMatrix4fv(glGetUniformLocation(shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+    program->SetModel(model);
 
     //draw board
-    glBindVertexArray(boardVAO);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
-    glBindVertexArray(0);
+    board->Draw(GL_TRIANGLES);
 
     //draw axes
-    glBindVertexArray(axesVAO);
-    glDrawArrays(GL_LINES, 0, 6);
+    axes->Draw(GL_LINES);
     glBindVertexArray(0);
 }
 
@@ -255,172 +272,41 @@ void RecordScene::RenderUI() {
 
     ImGui::Text("Accel values:");
     ImGui::Text("x: %.3f, y: %.3f, z: %.3f", a[0], a[1], a[2]);
-    ImGui::End();
 
-    popUp.RenderPopUp();
-
-
-}
-
-void RecordScene::InitBoard() {
-    float halfW = BOARD_WIDTH / 2.0f;
-    float halfH = BOARD_HEIGHT / 2.0f;
-    float halfT = BOARD_THICKNESS / 2.0f;
-
-    std::vector<float> vertices = {
-        //front
-        -halfW, -halfH,  halfT,  0.8f, 0.2f, 0.2f,
-         halfW, -halfH,  halfT,  0.8f, 0.2f, 0.2f,
-         halfW,  halfH,  halfT,  0.8f, 0.2f, 0.2f,
-         halfW,  halfH,  halfT,  0.8f, 0.2f, 0.2f,
-        -halfW,  halfH,  halfT,  0.8f, 0.2f, 0.2f,
-        -halfW, -halfH,  halfT,  0.8f, 0.2f, 0.2f,
-
-        //back
-        -halfW, -halfH, -halfT,  0.8f, 0.2f, 0.2f,
-         halfW, -halfH, -halfT,  0.8f, 0.2f, 0.2f,
-         halfW,  halfH, -halfT,  0.8f, 0.2f, 0.2f,
-         halfW,  halfH, -halfT,  0.8f, 0.2f, 0.2f,
-        -halfW,  halfH, -halfT,  0.8f, 0.2f, 0.2f,
-        -halfW, -halfH, -halfT,  0.8f, 0.2f, 0.2f,
-
-        //left
-        -halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
-        -halfW,  halfH, -halfT,  0.6f, 0.1f, 0.1f,
-        -halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
-        -halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
-        -halfW, -halfH,  halfT,  0.6f, 0.1f, 0.1f,
-        -halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
-
-        //right
-         halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
-         halfW,  halfH, -halfT,  0.6f, 0.1f, 0.1f,
-         halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
-         halfW, -halfH, -halfT,  0.6f, 0.1f, 0.1f,
-         halfW, -halfH,  halfT,  0.6f, 0.1f, 0.1f,
-         halfW,  halfH,  halfT,  0.6f, 0.1f, 0.1f,
-
-         //bottom
-         -halfW, -halfH, -halfT,  0.5f, 0.1f, 0.1f,
-          halfW, -halfH, -halfT,  0.5f, 0.1f, 0.1f,
-          halfW, -halfH,  halfT,  0.5f, 0.1f, 0.1f,
-          halfW, -halfH,  halfT,  0.5f, 0.1f, 0.1f,
-         -halfW, -halfH,  halfT,  0.5f, 0.1f, 0.1f,
-         -halfW, -halfH, -halfT,  0.5f, 0.1f, 0.1f,
-
-         //top
-         -halfW,  halfH, -halfT,  0.7f, 0.2f, 0.2f,
-          halfW,  halfH, -halfT,  0.7f, 0.2f, 0.2f,
-          halfW,  halfH,  halfT,  0.7f, 0.2f, 0.2f,
-          halfW,  halfH,  halfT,  0.7f, 0.2f, 0.2f,
-         -halfW,  halfH,  halfT,  0.7f, 0.2f, 0.2f,
-         -halfW,  halfH, -halfT,  0.7f, 0.2f, 0.2f
-    };
-
-    glGenVertexArrays(1, &boardVAO);
-    glGenBuffers(1, &boardVBO);
-
-    glBindVertexArray(boardVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, boardVBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-    //pos
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    //colors
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-}
-
-void RecordScene::InitAxes() {
-    std::vector<float> vertices = {
-        //X red
-        0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-        AXIS_LENGTH, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-
-        //Y green
-        0.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
-        0.0f, AXIS_LENGTH, 0.0f, 0.0f, 1.0f, 0.0f,
-
-        //Z blue
-        0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
-        0.0f, 0.0f, AXIS_LENGTH, 0.0f, 0.0f, 1.0f
-    };
-
-    glGenVertexArrays(1, &axesVAO);
-    glGenBuffers(1, &axesVBO);
-
-    glBindVertexArray(axesVAO);
-    glBindBuffer(GL_ARRAY_BUFFER, axesVBO);
-    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
-
-    //pos
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    //colors
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
-}
-
-void RecordScene::CompileShaders() {
-    //shader compilation
-    unsigned int vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-    glCompileShader(vertexShader);
-
-    int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
+    //the board is drawn with the fused orientation, the recording keeps the DMP one
+    ImGui::Separator();
+    ImGui::Combo("Shown orientation", &orientationIndex, orientations, IM_ARRAYSIZE(orientations));
+    if (hasGyro) {
+        ImGui::Text("Gyro values, rad/s:");
+        ImGui::Text("x: %.3f, y: %.3f, z: %.3f", g[0], g[1], g[2]);
+        if (orientationIndex != 0) {
+            ImGui::Text("Fused: w: %.3f, x: %.3f, y: %.3f, z: %.3f", fusedQ[0], fusedQ[1], fusedQ[2], fusedQ[3]);
+        }
     }
-
-    unsigned int fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentShaderSource, NULL);
-    glCompileShader(fragmentShader);
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragmentShader, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+    else if (orientationIndex != 0) {
+        ImGui::Text("The board sends no gyroscope columns, the DMP orientation is shown");
     }
+    ImGui::End();
+
+    popUp.RenderPopUp();
 
-    shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
-        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
-    }
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
 }
 
 void RecordScene::SetupCamera() {
-
-
-
-    view = glm::lookAt(
+    camera.Init();
+    camera.SetView(glm::lookAt(
         glm::vec3(3.0f, 2.0f, 3.0f), //camera pos
         glm::vec3(0.0f, 0.0f, 0.0f), //view point
         glm::vec3(0.0f, 0.0f, 1.0f)  //top vector
-    );
+    ));
 
-    projection = glm::perspective(
+    camera.SetProjection(glm::perspective(
         glm::radians(45.0f), //FOV
         800.0f / 600.0f,     //aspect ratio
         0.1f,                //near
         50.0f                //far
-    );
+    ));
 
     glEnable(GL_DEPTH_TEST);
 }
\ No newline at end of file
@@ -0,0 +1,46 @@
+#include "RenderTimer.h"
+#include <glad/glad.h>
+
+//weight of the newest frame in the average
+#define RENDER_TIMER_SMOOTHING 0.05
+
+static double Smooth(double average, double value) {
+    return average == 0.0 ? value : average + (value - average) * RENDER_TIMER_SMOOTHING;
+}
+
+RenderTimer::~RenderTimer() {
+    if (queries[0] != 0) glDeleteQueries(RENDER_TIMER_QUERIES, queries);
+}
+
+void RenderTimer::ReadFinished() {
+    for (int i = 0; i < RENDER_TIMER_QUERIES; i++) {
+        if (!issued[i]) continue;
+        GLint available = 0;
+        glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) continue;
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+        gpuMilliseconds = Smooth(gpuMilliseconds, nanoseconds * 1e-6);
+        issued[i] = false;
+    }
+}
+
+void RenderTimer::Begin() {
+    if (queries[0] == 0) glGenQueries(RENDER_TIMER_QUERIES, queries);
+    ReadFinished();
+
+    //all queries still pending: GPU is far behind, this frame is not measured on the GPU
+    measuring = !issued[current];
+    if (measuring) glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+    cpuStart = std::chrono::steady_clock::now();
+}
+
+void RenderTimer::End() {
+    double cpu = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cpuStart).count();
+    cpuMilliseconds = Smooth(cpuMilliseconds, cpu);
+    if (measuring) {
+        glEndQuery(GL_TIME_ELAPSED);
+        issued[current] = true;
+        current = (current + 1) % RENDER_TIMER_QUERIES;
+    }
+}
@@ -0,0 +1,101 @@
+#include "ShaderProgram.h"
+#include "Camera.h"
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+#include <iostream>
+
+static unsigned int CompileStage(GLenum type, const char* source, const char* name) {
+    unsigned int shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+
+    int success;
+    char infoLog[512];
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        glGetShaderInfoLog(shader, 512, NULL, infoLog);
+        std::cerr << "ERROR::SHADER::" << name << "::COMPILATION_FAILED\n" << infoLog << std::endl;
+    }
+    return shader;
+}
+
+ShaderProgram::~ShaderProgram() {
+    if (id != 0) glDeleteProgram(id);
+}
+
+bool ShaderProgram::Compile(const char* vertexSource, const char* fragmentSource, bool retrievable) {
+    unsigned int vertexShader = CompileStage(GL_VERTEX_SHADER, vertexSource, "VERTEX");
+    unsigned int fragmentShader = CompileStage(GL_FRAGMENT_SHADER, fragmentSource, "FRAGMENT");
+
+    if (id != 0) glDeleteProgram(id);
+    id = glCreateProgram();
+    glAttachShader(id, vertexShader);
+    glAttachShader(id, fragmentShader);
+    if (retrievable) {
+        glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(id);
+
+    int success;
+    char infoLog[512];
+    glGetProgramiv(id, GL_LINK_STATUS, &success);
+    if (!success) {
+        glGetProgramInfoLog(id, 512, NULL, infoLog);
+        std::cerr << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+    }
+
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
+    ResolveUniforms();
+    return success != 0;
+}
+
+bool ShaderProgram::LoadBinary(unsigned int format, const void* binary, int length) {
+    if (id != 0) glDeleteProgram(id);
+    id = glCreateProgram();
+    glProgramBinary(id, format, binary, length);
+
+    int success;
+    glGetProgramiv(id, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(id);
+        id = 0;
+        return false;
+    }
+    ResolveUniforms();
+    return true;
+}
+
+bool ShaderProgram::GetBinary(unsigned int& format, std::vector<char>& binary) const {
+    int length = 0;
+    glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return false;
+    binary.resize(length);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(id, length, &length, &binaryFormat, binary.data());
+    binary.resize(length);
+    format = binaryFormat;
+    return length > 0;
+}
+
+void ShaderProgram::ResolveUniforms() {
+    //everything the draw calls need is resolved here once
+    modelLocation = glGetUniformLocation(id, "model");
+    unsigned int cameraBlock = glGetUniformBlockIndex(id, CAMERA_BLOCK_NAME);
+    if (cameraBlock != GL_INVALID_INDEX) {
+        glUniformBlockBinding(id, cameraBlock, CAMERA_BINDING);
+    }
+}
+
+int ShaderProgram::UniformLocation(const char* name) const {
+    return glGetUniformLocation(id, name);
+}
+
+void ShaderProgram::Use() const {
+    glUseProgram(id);
+}
+
+void ShaderProgram::SetModel(const glm::mat4& model) const {
+    glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(model));
+}
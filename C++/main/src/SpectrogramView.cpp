@@ -0,0 +1,104 @@
+#include "SpectrogramView.h"
+#include <algorithm>
+#include <cmath>
+#include <glad/glad.h>
+
+//color map from the lowest to the highest level
+#define SPECTROGRAM_STOPS 5
+static const float SPECTROGRAM_COLORS[SPECTROGRAM_STOPS][3] = {
+    { 0.0f, 0.0f, 0.02f }, { 0.3f, 0.05f, 0.45f }, { 0.8f, 0.2f, 0.3f }, { 1.0f, 0.6f, 0.1f }, { 1.0f, 1.0f, 0.75f } };
+
+SpectrogramView::~SpectrogramView() {
+    glDeleteTextures(1, &texture);
+}
+
+size_t SpectrogramView::VisibleColumns(const Trajectory::Spectrum& spectrum) {
+    return std::min<size_t>(spectrum.Columns(), SPECTROGRAM_VIEW_COLUMNS);
+}
+
+void SpectrogramView::Draw(const Trajectory::Spectrum& spectrum, size_t first, const ImVec2& size, float lowDb, float highDb) {
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImGui::Dummy(size);
+    size_t columns = spectrum.Columns();
+    uploadedColumns = 0;
+    if (columns == 0) {
+        return;
+    }
+
+    if (texture == 0) {
+        glGenTextures(1, &texture);
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    if (bins != spectrum.Bins()) {
+        //a row per column, so a column is one contiguous upload
+        bins = spectrum.Bins();
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, static_cast<GLsizei>(bins), SPECTROGRAM_VIEW_COLUMNS, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        //nearest, the neighbouring row of the ring is not the neighbouring column
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        cachedCount = 0;
+    }
+    if (lowDb != cachedLow || highDb != cachedHigh) {
+        cachedLow = lowDb;
+        cachedHigh = highDb;
+        cachedCount = 0;
+    }
+
+    //columns in the ring that were computed again
+    if (cachedCount != 0 && dirtyBegin < dirtyEnd) {
+        size_t begin = std::max(dirtyBegin, cachedFirst), end = std::min(dirtyEnd, std::min(cachedFirst + cachedCount, columns));
+        if (begin < end) Upload(spectrum, begin, end);
+    }
+    dirtyBegin = SIZE_MAX;
+    dirtyEnd = 0;
+
+    //only the columns that are not in the ring yet
+    size_t visible = VisibleColumns(spectrum);
+    first = std::min(first, columns - visible);
+    size_t last = first + visible, cachedLast = cachedFirst + cachedCount;
+    if (cachedCount == 0 || last <= cachedFirst || first >= cachedLast) {
+        Upload(spectrum, first, last);
+    }
+    else {
+        if (first < cachedFirst) Upload(spectrum, first, cachedFirst);
+        if (last > cachedLast) Upload(spectrum, cachedLast, last);
+    }
+    cachedFirst = first;
+    cachedCount = visible;
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    //transposed: texture rows go to the right, the lowest bin is at the bottom; v past 1 wraps around the ring
+    float v0 = static_cast<float>(first % SPECTROGRAM_VIEW_COLUMNS) / SPECTROGRAM_VIEW_COLUMNS;
+    float v1 = v0 + static_cast<float>(visible) / SPECTROGRAM_VIEW_COLUMNS;
+    ImVec2 corner(origin.x + size.x, origin.y + size.y);
+    ImGui::GetWindowDrawList()->AddImageQuad((ImTextureID)(intptr_t)texture,
+        origin, ImVec2(corner.x, origin.y), corner, ImVec2(origin.x, corner.y),
+        ImVec2(1.0f, v0), ImVec2(1.0f, v1), ImVec2(0.0f, v1), ImVec2(0.0f, v0));
+}
+
+void SpectrogramView::Upload(const Trajectory::Spectrum& spectrum, size_t begin, size_t end) {
+    Trajectory::Span<float> image = spectrum.Spectrogram();
+    float range = std::max(cachedHigh - cachedLow, 1e-3f);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    while (begin < end) {
+        //up to the end of the ring
+        size_t slot = begin % SPECTROGRAM_VIEW_COLUMNS;
+        size_t count = std::min(end - begin, SPECTROGRAM_VIEW_COLUMNS - slot);
+        pixels.resize(count * bins);
+        for (size_t i = 0; i < count * bins; i++) {
+            float level = std::clamp((image[begin * bins + i] - cachedLow) / range, 0.0f, 1.0f) * (SPECTROGRAM_STOPS - 1);
+            int stop = std::min(static_cast<int>(level), SPECTROGRAM_STOPS - 2);
+            float t = level - stop;
+            const float* a = SPECTROGRAM_COLORS[stop];
+            const float* b = SPECTROGRAM_COLORS[stop + 1];
+            pixels[i] = IM_COL32(static_cast<int>((a[0] + (b[0] - a[0]) * t) * 255.0f), static_cast<int>((a[1] + (b[1] - a[1]) * t) * 255.0f),
+                static_cast<int>((a[2] + (b[2] - a[2]) * t) * 255.0f), 255);
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, static_cast<GLint>(slot), static_cast<GLsizei>(bins), static_cast<GLsizei>(count),
+            GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        uploadedColumns += count;
+        begin += count;
+    }
+}
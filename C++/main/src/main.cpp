@@ -21,11 +21,13 @@
 #include "NoRenderScene.h"
 #include "RecordScene.h"
 #include "PlayScene.h"
+#include "TaskScheduler.h"
+#include "RenderTimer.h"
+#include "GpuCache.h"
+#include "FrameScheduler.h"
 
 #define TARGET_FPS 60
 
-const double TARGET_FRAME_TIME = 1.0 / TARGET_FPS;
-
 std::unique_ptr<COM::Port> currentPort;
 std::vector<std::string> comPorts;
 int selectedPortIndex = -1;
@@ -64,6 +66,7 @@ std::unique_ptr<Scene> CreateScene(SceneType type) {
 
 int main(void)
 {
+    auto startTime = std::chrono::high_resolution_clock::now();
     glfwSetErrorCallback(error_callback);
 
     if (!glfwInit())
@@ -92,6 +95,9 @@ int main(void)
 
 
     enableReportGlErrors();
+#if PROGRAM_BINARY_CACHE
+    GpuCache::Get().SetBinaryFolder(PROGRAM_BINARY_CACHE_PATH);
+#endif
     glfwSwapInterval(1);
     //glfwSwapInterval(1); //vsync
 
@@ -125,12 +131,33 @@ int main(void)
 
     SceneType currentSceneType = SceneType::NORENDER;
     auto currentScene = CreateScene(currentSceneType);
+    RenderTimer renderTimer;
+    FrameScheduler frameScheduler(TARGET_FPS);
+    frameScheduler.Attach(window);
+    //from the start of main to the first presented frame, and CreateScene + InitRender of the last switch
+    double coldStartMilliseconds = 0.0;
+    double sceneSwitchMilliseconds = 0.0;
     const char* sceneItems[] = { "No Render", "Record", "Play"};
     UpdateAvailablePorts();
 
     while (!glfwWindowShouldClose(window))
     {
-        auto frameStart = std::chrono::high_resolution_clock::now();
+        //sleeps until input, the scene's next data tick or the next due frame
+        double dataInterval = currentScene ? currentScene->DataInterval() : 0.0;
+        bool animating = currentScene && currentScene->IsAnimating();
+        frameScheduler.WaitForWork(dataInterval, animating);
+
+        bool frameDue = frameScheduler.FrameDue(animating);
+        if (currentScene && (frameDue || frameScheduler.DataDue(dataInterval))) {
+            currentScene->Update();
+            frameScheduler.Updated();
+            if (currentScene->TakeRedrawRequest()) {
+                frameScheduler.RequestRedraw();
+                frameDue = frameScheduler.FrameDue(currentScene->IsAnimating());
+            }
+        }
+        if (!frameDue) continue;
+
         int width = 0, height = 0;
         glfwGetFramebufferSize(window, &width, &height);
        
@@ -138,8 +165,9 @@ int main(void)
         glClear(GL_COLOR_BUFFER_BIT);
 
         if (currentScene) {
-            currentScene->Update();
+            renderTimer.Begin();
             currentScene->Render();
+            renderTimer.End();
         }
 
 #pragma region imgui
@@ -193,13 +221,52 @@ int main(void)
 
                 if (newSceneType != currentSceneType) {
                     currentSceneType = newSceneType;
+                    auto switchStart = std::chrono::high_resolution_clock::now();
                     currentScene = CreateScene(currentSceneType);
                     if (currentScene) {
                         currentScene->InitRender();
                     }
+                    sceneSwitchMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - switchStart).count();
                 }
             }
         }
+
+        ImGui::Separator();
+        if (ImGui::CollapsingHeader("Task scheduler")) {
+            TaskScheduler::Stats schedulerStats = TaskScheduler::Get().GetStats();
+            ImGui::Text("Tasks: %zu executed, %zu stolen, %zu run by waiting threads",
+                schedulerStats.executed, schedulerStats.steals, schedulerStats.helped);
+            for (size_t i = 0; i < schedulerStats.workers.size(); i++) {
+                const TaskScheduler::WorkerStats& worker = schedulerStats.workers[i];
+                ImGui::Text("Worker %zu: queued %zu high / %zu low, executed %zu, steals %zu, busy %.1f%%",
+                    i, worker.queued[static_cast<int>(TaskPriority::HIGH)], worker.queued[static_cast<int>(TaskPriority::LOW)],
+                    worker.executed, worker.steals, worker.utilization * 100.0);
+            }
+        }
+        if (ImGui::CollapsingHeader("Render timing")) {
+            ImGui::Text("Scene render: %.3f ms CPU, %.3f ms GPU", renderTimer.GetCpuMilliseconds(), renderTimer.GetGpuMilliseconds());
+        }
+        if (ImGui::CollapsingHeader("Frame loop")) {
+            const FrameScheduler::Stats& frameStats = frameScheduler.GetStats();
+            bool adaptive = frameScheduler.IsAdaptive();
+            if (ImGui::Checkbox("Redraw only on changes", &adaptive)) {
+                frameScheduler.SetAdaptive(adaptive);
+            }
+            ImGui::Text("CPU: %.1f%% of a core, waiting for events %.1f%% of the time", frameStats.cpuPercent, frameStats.waitPercent);
+            ImGui::Text("Frames: %.1f/s, scene updates: %.1f/s", frameStats.framesPerSecond, frameStats.updatesPerSecond);
+        }
+        if (ImGui::CollapsingHeader("GPU resources")) {
+            GpuCache::Stats cacheStats = GpuCache::Get().GetStats();
+            ImGui::Text("Cold start: %.1f ms, last scene switch: %.2f ms", coldStartMilliseconds, sceneSwitchMilliseconds);
+            ImGui::Text("Cached: %zu programs, %zu meshes, %zu references in use",
+                cacheStats.programs, cacheStats.meshes, cacheStats.inUse);
+            ImGui::Text("Requests: %zu, reused %zu", cacheStats.requests, cacheStats.hits);
+            ImGui::Text("Programs: %zu compiled, %zu from disk, meshes built: %zu",
+                cacheStats.programsCompiled, cacheStats.programsFromDisk, cacheStats.meshesBuilt);
+            if (ImGui::Button("Release unused")) {
+                GpuCache::Get().Trim();
+            }
+        }
         ImGui::End();
 
         
@@ -225,18 +292,15 @@ int main(void)
 #pragma endregion
 
         glfwSwapBuffers(window);
-        glfwPollEvents();
-
-
-        auto frameEnd = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> frameDuration = frameEnd - frameStart;
-        double elapsedTime = frameDuration.count();
-
-        if (elapsedTime < TARGET_FRAME_TIME) {
-            std::this_thread::sleep_for(std::chrono::duration<double>(TARGET_FRAME_TIME - elapsedTime));
+        frameScheduler.FrameDrawn();
+        if (coldStartMilliseconds == 0.0) {
+            coldStartMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
         }
     }
 
+    //GL objects have to go while the context is alive
+    currentScene.reset();
+    GpuCache::Get().Clear();
     glfwDestroyWindow(window);
     glfwTerminate();
     return 0;
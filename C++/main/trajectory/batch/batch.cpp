@@ -0,0 +1,410 @@
+//Processes many recordings at once without a window, for reprocessing whole folders of sessions.
+//Every recording gets its trajectory file and a row in summary.csv.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "AllanVariance.h"
+#include "Engine.h"
+#include "Spectrum.h"
+
+namespace fs = std::filesystem;
+
+struct Options {
+    std::vector<std::string> inputs;
+    std::string outputPath = "trajectories";
+    Trajectory::Settings settings;
+    ExportFormat format = ExportFormat::CSV;
+    unsigned jobs = 0;
+    bool writeTrajectories = true;
+    bool writeAllan = false;
+    bool writeSpectrum = false;
+    bool quiet = false;
+};
+
+struct Result {
+    bool ok = false;
+    size_t samples = 0;
+    double duration = 0.0;      // s of recording
+    double pathLength = 0.0;    // m
+    double finalDrift = 0.0;    // m between first and last position
+    double seconds = 0.0;       // processing time
+};
+
+static void PrintUsage() {
+    std::cout <<
+        "usage: trajectory_batch [options] <recording|folder|glob>...\n"
+        "  --out FOLDER        output folder (default: trajectories)\n"
+        "  --method NAME       squares | trapezoid | runge-kutta (default: squares)\n"
+        "  --cutoff HZ         high-pass cutoff (default: 0.1)\n"
+        "  --g VALUE           m/s^2 in one accelerometer unit (default: 9.81)\n"
+        "  --gravity X,Y,Z     gravity in the world frame (default: 0,0,1)\n"
+        "  --bias X,Y,Z        accelerometer offset, subtracted from the input (default: 0,0,0)\n"
+        "  --zupt              zero velocity where the board is still\n"
+        "  --no-highpass       skip the high-pass filter of velocity and position\n"
+        "  --resample MODE     linear | cubic: put the rows on a uniform time grid first\n"
+        "  --rate HZ           rate of the uniform grid (default: mean rate of the recording)\n"
+        "  --fuse FILTER       madgwick | mahony: orientation from the gyroscope columns instead of the recorded quaternions\n"
+        "  --beta VALUE        Madgwick gain, rad/s (default: 0.1)\n"
+        "  --kp VALUE          Mahony proportional gain (default: 0.5)\n"
+        "  --ki VALUE          Mahony integral gain, 1/s (default: 0)\n"
+        "  --format FORMAT     csv | npy | both (default: csv)\n"
+        "  --jobs N            recordings processed at once (default: number of cores)\n"
+        "  --summary-only      do not write trajectories\n"
+        "  --allan             also write the Allan deviation of the accelerometer, <name>_allan.csv\n"
+        "  --psd               also write the Welch spectral density of the acceleration, <name>_psd.csv\n"
+        "  --quiet             no line per recording\n"
+        "folders are searched for *.csv, globs support *, ? and ** (quote them to skip the shell)\n";
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        }
+        else if (arg == "--out" && hasValue) {
+            options.outputPath = argv[++i];
+        }
+        else if (arg == "--method" && hasValue) {
+            std::string method = argv[++i];
+            if (method == "squares") options.settings.method = Trajectory::IntegrationMethod::SQUARES;
+            else if (method == "trapezoid") options.settings.method = Trajectory::IntegrationMethod::TRAPEZOID;
+            else if (method == "runge-kutta") options.settings.method = Trajectory::IntegrationMethod::RUNGE_KUTTA;
+            else {
+                std::cerr << "Unknown method " << method << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--cutoff" && hasValue) {
+            options.settings.filterCutoff = std::atof(argv[++i]);
+        }
+        else if (arg == "--g" && hasValue) {
+            options.settings.g = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if (arg == "--gravity" && hasValue) {
+            float* v = options.settings.gravityVector;
+            if (std::sscanf(argv[++i], "%f,%f,%f", &v[0], &v[1], &v[2]) != 3) {
+                std::cerr << "Gravity must be X,Y,Z" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--bias" && hasValue) {
+            float* v = options.settings.accelBias;
+            if (std::sscanf(argv[++i], "%f,%f,%f", &v[0], &v[1], &v[2]) != 3) {
+                std::cerr << "Bias must be X,Y,Z" << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--zupt") {
+            options.settings.zeroVelocity = true;
+        }
+        else if (arg == "--no-highpass") {
+            options.settings.highPass = false;
+        }
+        else if (arg == "--resample" && hasValue) {
+            std::string interpolation = argv[++i];
+            options.settings.resample = true;
+            if (interpolation == "linear") options.settings.interpolation = Trajectory::Interpolation::LINEAR;
+            else if (interpolation == "cubic") options.settings.interpolation = Trajectory::Interpolation::CUBIC;
+            else {
+                std::cerr << "Unknown interpolation " << interpolation << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--rate" && hasValue) {
+            options.settings.resampleRate = std::atof(argv[++i]);
+        }
+        else if (arg == "--fuse" && hasValue) {
+            std::string filter = argv[++i];
+            options.settings.fuse = true;
+            if (filter == "madgwick") options.settings.fusion.filter = Trajectory::FusionFilter::MADGWICK;
+            else if (filter == "mahony") options.settings.fusion.filter = Trajectory::FusionFilter::MAHONY;
+            else {
+                std::cerr << "Unknown fusion filter " << filter << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--beta" && hasValue) {
+            options.settings.fusion.beta = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if (arg == "--kp" && hasValue) {
+            options.settings.fusion.kp = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if (arg == "--ki" && hasValue) {
+            options.settings.fusion.ki = static_cast<float>(std::atof(argv[++i]));
+        }
+        else if (arg == "--format" && hasValue) {
+            std::string format = argv[++i];
+            if (format == "csv") options.format = ExportFormat::CSV;
+            else if (format == "npy") options.format = ExportFormat::NPY;
+            else if (format == "both") options.format = ExportFormat::CSV_AND_NPY;
+            else {
+                std::cerr << "Unknown format " << format << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--jobs" && hasValue) {
+            options.jobs = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--allan") {
+            options.writeAllan = true;
+        }
+        else if (arg == "--psd") {
+            options.writeSpectrum = true;
+        }
+        else if (arg == "--summary-only") {
+            options.writeTrajectories = false;
+        }
+        else if (arg == "--quiet") {
+            options.quiet = true;
+        }
+        else if (arg.size() > 1 && arg[0] == '-' && arg[1] == '-') {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+        else {
+            options.inputs.push_back(arg);
+        }
+    }
+    return !options.inputs.empty();
+}
+
+#pragma region Glob
+//* and ? inside one path component
+static bool MatchName(const char* pattern, const char* name) {
+    if (*pattern == '\0') return *name == '\0';
+    if (*pattern == '*') {
+        for (const char* rest = name; ; rest++) {
+            if (MatchName(pattern + 1, rest)) return true;
+            if (*rest == '\0') return false;
+        }
+    }
+    if (*name == '\0') return false;
+    return (*pattern == '?' || *pattern == *name) && MatchName(pattern + 1, name + 1);
+}
+
+static bool HasWildcard(const std::string& component) {
+    return component.find_first_of("*?") != std::string::npos;
+}
+
+static void Expand(const fs::path& base, const std::vector<std::string>& components, size_t index, std::vector<fs::path>& files) {
+    std::error_code error;
+    if (index == components.size()) {
+        if (fs::is_regular_file(base, error)) files.push_back(base);
+        return;
+    }
+
+    const std::string& component = components[index];
+    const fs::path folder = base.empty() ? fs::path(".") : base;
+    if (component == "**") {
+        //zero or more folders, every file below if it is the last component
+        bool last = index + 1 == components.size();
+        if (!last) Expand(base, components, index + 1, files);
+        for (fs::directory_iterator it(folder, error), end; !error && it != end; it.increment(error)) {
+            if (it->is_directory(error)) Expand(base / it->path().filename(), components, index, files);
+            else if (last) Expand(base / it->path().filename(), components, index + 1, files);
+        }
+    }
+    else if (!HasWildcard(component)) {
+        Expand(base / component, components, index + 1, files);
+    }
+    else {
+        for (fs::directory_iterator it(folder, error), end; !error && it != end; it.increment(error)) {
+            std::string name = it->path().filename().string();
+            if (name[0] == '.' && component[0] != '.') continue;
+            if (MatchName(component.c_str(), name.c_str())) Expand(base / name, components, index + 1, files);
+        }
+    }
+}
+
+static void CollectRecordings(const std::string& input, std::vector<fs::path>& files) {
+    std::error_code error;
+    fs::path path(input);
+    if (fs::is_directory(path, error)) {
+        path /= "*.csv";
+    }
+    else if (!HasWildcard(input)) {
+        files.push_back(path);
+        return;
+    }
+
+    std::vector<std::string> components;
+    for (const fs::path& part : path.relative_path()) {
+        components.push_back(part.string());
+    }
+    std::vector<fs::path> found;
+    Expand(path.root_path(), components, 0, found);
+    if (found.empty()) std::cerr << "Nothing matches " << input << std::endl;
+    std::sort(found.begin(), found.end());
+    files.insert(files.end(), found.begin(), found.end());
+}
+#pragma endregion
+
+//output names are file stems, the same stem in different folders gets a number
+static std::vector<std::string> MakeOutputNames(const std::vector<fs::path>& files) {
+    std::vector<std::string> names;
+    std::map<std::string, int> used;
+    for (const fs::path& file : files) {
+        std::string stem = file.stem().string();
+        int count = used[stem]++;
+        names.push_back(count == 0 ? stem : stem + "_" + std::to_string(count + 1));
+    }
+    return names;
+}
+
+static void Measure(const Trajectory::Engine& engine, Result& result) {
+    Trajectory::Span<float> ts = engine.Times();
+    Trajectory::Span<float> pos = engine.Positions();
+    result.samples = engine.Rows();
+    result.duration = 0.0;
+    for (float t : ts) result.duration += t;
+
+    result.pathLength = 0.0;
+    for (size_t i = INTEGRATION_SIZE; i < pos.size(); i += INTEGRATION_SIZE) {
+        double dx = pos[i] - pos[i - 3];
+        double dy = pos[i + 1] - pos[i - 2];
+        double dz = pos[i + 2] - pos[i - 1];
+        result.pathLength += std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+    size_t last = pos.size() - INTEGRATION_SIZE;
+    double dx = pos[last] - pos[0];
+    double dy = pos[last + 1] - pos[1];
+    double dz = pos[last + 2] - pos[2];
+    result.finalDrift = std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+static bool WriteSummary(const std::string& path, const std::vector<fs::path>& files, const std::vector<Result>& results) {
+    std::ofstream summary(path);
+    if (!summary.is_open()) {
+        std::cerr << "Error due file creating " << path << std::endl;
+        return false;
+    }
+    summary << "file,status,samples,duration_s,path_length_m,final_drift_m,processing_ms\n";
+    char line[512];
+    for (size_t i = 0; i < files.size(); i++) {
+        const Result& r = results[i];
+        std::snprintf(line, sizeof(line), ",%s,%zu,%.3f,%.6f,%.6f,%.3f\n",
+            r.ok ? "ok" : "failed", r.samples, r.duration, r.pathLength, r.finalDrift, r.seconds * 1000.0);
+        summary << files[i].string() << line;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 1;
+    }
+
+    std::vector<fs::path> files;
+    for (const std::string& input : options.inputs) {
+        CollectRecordings(input, files);
+    }
+    if (files.empty()) {
+        std::cerr << "No recordings" << std::endl;
+        return 1;
+    }
+    std::error_code error;
+    fs::create_directories(options.outputPath, error);
+    if (error) {
+        std::cerr << "Error due folder creating " << options.outputPath << ": " << error.message() << std::endl;
+        return 1;
+    }
+
+    TaskScheduler& scheduler = TaskScheduler::Get();
+    std::vector<std::string> names = MakeOutputNames(files);
+    std::vector<Result> results(files.size());
+    unsigned jobs = options.jobs == 0 ? scheduler.WorkerCount() : options.jobs;
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, files.size()));
+
+    //every job owns an engine and takes the next recording when it is done, so long and short
+    //recordings even out and each engine keeps its buffers from one recording to the next
+    std::atomic<size_t> nextFile{ 0 };
+    std::atomic<size_t> doneFiles{ 0 };
+    std::mutex printMutex;
+    auto job = [&]() {
+        Trajectory::Engine engine(scheduler);
+        engine.SetSettings(options.settings);
+        StageExporter exporter(scheduler);
+        Trajectory::AllanVariance allan(scheduler);
+        Trajectory::Spectrum spectrum(scheduler);
+        //recording whose trajectory is still being written
+        size_t exporting = files.size();
+        auto finishExport = [&]() {
+            if (exporting == files.size()) return;
+            if (!exporter.Wait()) {
+                results[exporting].ok = false;
+                std::lock_guard<std::mutex> lock(printMutex);
+                std::printf("%s: failed, trajectory not written\n", files[exporting].string().c_str());
+            }
+            exporting = files.size();
+        };
+        for (size_t i = nextFile++; i < files.size(); i = nextFile++) {
+            Result& result = results[i];
+            auto start = std::chrono::steady_clock::now();
+            result.ok = engine.Load(files[i].string()) && engine.Run();
+            if (result.ok) {
+                Measure(engine, result);
+                if (options.writeTrajectories) {
+                    //waits for the previous trajectory, the current one is written while the next file loads
+                    finishExport();
+                    exporter.Begin(options.outputPath, options.format);
+                    Trajectory::Span<float> pos = engine.Positions();
+                    exporter.Submit(pos.data(), pos.size(), INTEGRATION_SIZE, "px,py,pz", (names[i] + ".csv").c_str());
+                    exporting = i;
+                }
+                if (options.writeAllan) {
+                    result.ok = allan.Run(engine) && allan.Save((fs::path(options.outputPath) / (names[i] + "_allan.csv")).string());
+                }
+                if (options.writeSpectrum && result.ok) {
+                    result.ok = spectrum.Run(engine) && spectrum.Save((fs::path(options.outputPath) / (names[i] + "_psd.csv")).string());
+                }
+            }
+            result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+            size_t done = ++doneFiles;
+            if (!options.quiet) {
+                std::lock_guard<std::mutex> lock(printMutex);
+                std::printf("[%zu/%zu] %s: %s, %zu samples, %.1f ms\n", done, files.size(), files[i].string().c_str(),
+                    result.ok ? "ok" : "failed", result.samples, result.seconds * 1000.0);
+            }
+        }
+        finishExport();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    TaskGroup group;
+    for (unsigned j = 0; j < jobs; j++) {
+        scheduler.Submit(job, TaskPriority::LOW, &group);
+    }
+    scheduler.Wait(group);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::string summaryPath = (fs::path(options.outputPath) / "summary.csv").string();
+    WriteSummary(summaryPath, files, results);
+
+    size_t samples = 0;
+    size_t failed = 0;
+    for (const Result& r : results) {
+        samples += r.samples;
+        if (!r.ok) failed++;
+    }
+    std::printf("%zu recordings (%zu failed), %zu samples in %.3f s: %.0f samples/s, %.1f recordings/s on %u jobs\n",
+        files.size(), failed, samples, seconds, samples / seconds, files.size() / seconds, jobs);
+    std::printf("summary: %s\n", summaryPath.c_str());
+    return failed == 0 ? 0 : 2;
+}
@@ -0,0 +1,258 @@
+//Pipeline benchmark without a window.
+//usage: trajectory_bench [rows] [runs]        synthetic recording of rows samples
+//       trajectory_bench --file path [runs]   real recording
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include "AllanVariance.h"
+#include "Engine.h"
+#include "Ensemble.h"
+#include "Fusion.h"
+#include "PoseQuery.h"
+#include "Spectrum.h"
+#include "Tuner.h"
+
+#define DEFAULT_ROWS 1000000
+#define DEFAULT_RUNS 5
+//10 ms between samples, like the recorder
+#define SAMPLE_MILLISECONDS 10
+//pose queries timed after the runs
+#define POSE_QUERIES 4000000
+//Monte Carlo ensemble on a 10 minute synthetic recording, whatever the main one is
+#define ENSEMBLE_ROWS 60000
+#define ENSEMBLE_MEMBERS 1000
+//parameter search on a recording that ends where it started, 100 circles in 2 pi * 100 s
+#define TUNER_ROWS 62832
+//host fusion of FUSION_LANES sensors, each this many rows of the main recording
+#define FUSION_BANK_ROWS 65536
+
+//slow turn around z while moving on a circle, in the format of RecordScene
+static std::string MakeRecording(size_t rows) {
+    std::string text = "t,w,x,y,z,ax,ay,az\n";
+    text.reserve(rows * 64);
+    char line[128];
+    for (size_t i = 0; i < rows; i++) {
+        double t = i * SAMPLE_MILLISECONDS / 1000.0;
+        double half = 0.05 * t;
+        double ax = -0.1 * std::cos(t);
+        double ay = -0.1 * std::sin(t);
+        //accelerometer sees the world acceleration and gravity in the rotated frame
+        double c = std::cos(2.0 * half), s = std::sin(2.0 * half);
+        int length = std::snprintf(line, sizeof(line), "%d,%.6f,0.000000,0.000000,%.6f,%.6f,%.6f,1.000000\n",
+            SAMPLE_MILLISECONDS, std::cos(half), std::sin(half), c * ax + s * ay, -s * ax + c * ay);
+        text.append(line, length);
+    }
+    return text;
+}
+
+static double Milliseconds(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    std::string file = "";
+    size_t rows = DEFAULT_ROWS;
+    int runs = DEFAULT_RUNS;
+    int arg = 1;
+    if (arg + 1 < argc && std::strcmp(argv[arg], "--file") == 0) {
+        file = argv[arg + 1];
+        arg += 2;
+    }
+    else if (arg < argc) {
+        rows = std::strtoull(argv[arg++], nullptr, 10);
+    }
+    if (arg < argc) {
+        runs = std::max(1, std::atoi(argv[arg]));
+    }
+
+    std::string recording = file == "" ? MakeRecording(rows) : "";
+    Trajectory::Engine engine;
+    std::cout << "workers: " << TaskScheduler::Get().WorkerCount() << "\n";
+
+    double bestLoad = 1e30;
+    for (int r = 0; r < runs; r++) {
+        auto start = std::chrono::steady_clock::now();
+        bool loaded = file == "" ? engine.LoadFromMemory(recording.data(), recording.size()) : engine.Load(file);
+        if (!loaded) return 1;
+        bestLoad = std::min(bestLoad, Milliseconds(start));
+    }
+    rows = engine.Rows();
+    std::printf("load: %zu rows, %.2f ms, %.1f Msamples/s\n", rows, bestLoad, rows / bestLoad / 1000.0);
+
+    const char* names[3] = { "squares", "trapezoid", "runge-kutta" };
+    double separate = 0.0;
+    for (int m = 0; m < 3; m++) {
+        Trajectory::Settings settings;
+        settings.method = static_cast<Trajectory::IntegrationMethod>(m);
+        engine.SetSettings(settings);
+
+        double best = 1e30;
+        for (int r = 0; r < runs; r++) {
+            auto start = std::chrono::steady_clock::now();
+            if (!engine.Run()) return 1;
+            best = std::min(best, Milliseconds(start));
+        }
+        separate += best;
+        Trajectory::Span<float> pos = engine.Positions();
+        std::printf("run %-12s %.2f ms, %.1f Msamples/s, end (%.4f, %.4f, %.4f) m\n", names[m], best, rows / best / 1000.0,
+            pos[pos.size() - 3], pos[pos.size() - 2], pos[pos.size() - 1]);
+    }
+
+    //all methods in one comparison run against the three runs above
+    double bestComparison = 1e30;
+    for (int r = 0; r < runs; r++) {
+        auto start = std::chrono::steady_clock::now();
+        if (!engine.RunComparison()) return 1;
+        bestComparison = std::min(bestComparison, Milliseconds(start));
+    }
+    std::printf("comparison: %.2f ms, %.2f ms in separate runs, %.2fx\n", bestComparison, separate, separate / bestComparison);
+    for (int m = 1; m < 3; m++) {
+        Trajectory::Divergence divergence = engine.MethodDivergence(static_cast<Trajectory::IntegrationMethod>(m), Trajectory::IntegrationMethod::SQUARES);
+        std::printf("  %-12s from squares: max %.4f m, rms %.4f m, end %.4f m, path %.4f m\n", names[m],
+            divergence.maxDistance, divergence.rmsDistance, divergence.endDistance, divergence.pathLength);
+    }
+
+    //interpolated poses of the last run: moments in time order, like playback or resampling, then scattered
+    Trajectory::PoseQuery poses;
+    poses.Build(engine);
+    std::vector<double> times(POSE_QUERIES);
+    std::vector<float> queryPositions(POSE_QUERIES * 3), queryVelocities(POSE_QUERIES * 3), queryOrientations(POSE_QUERIES * 4);
+    for (size_t i = 0; i < times.size(); i++) {
+        times[i] = poses.Duration() * i / times.size();
+    }
+    for (int order = 0; order < 2; order++) {
+        if (order == 1) {
+            std::shuffle(times.begin(), times.end(), std::mt19937(1));
+        }
+        double best = 1e30;
+        for (int r = 0; r < runs; r++) {
+            auto start = std::chrono::steady_clock::now();
+            poses.At(Trajectory::Span<double>(times.data(), times.size()), queryPositions.data(), queryVelocities.data(), queryOrientations.data());
+            best = std::min(best, Milliseconds(start));
+        }
+        std::printf("poses %-10s %zu queries, %.2f ms, %.1f Mqueries/s\n", order == 0 ? "ascending" : "scattered",
+            times.size(), best, times.size() / best / 1000.0);
+    }
+
+    //Allan deviation of the main recording, every axis
+    Trajectory::AllanVariance allan;
+    if (!allan.Run(engine)) return 1;
+    const Trajectory::AllanVariance::Stats& allanStats = allan.GetStats();
+    std::printf("allan: %zu rows, %zu taus, %.2f ms, %.1f Msamples/s\n", allanStats.rows, allan.Taus().size(),
+        allanStats.seconds * 1000.0, allanStats.rows / allanStats.seconds / 1e6);
+
+    //Welch density and spectrogram of the main recording, resampled first
+    Trajectory::Spectrum spectrum;
+    if (!spectrum.Run(engine)) return 1;
+    const Trajectory::Spectrum::Stats& spectrumStats = spectrum.GetStats();
+    std::printf("spectrum: %zu rows, %zu segments, %zu columns, %.2f ms, %.1f Msamples/s\n", spectrumStats.rows, spectrumStats.segments,
+        spectrum.Columns(), spectrumStats.seconds * 1000.0, spectrumStats.rows / spectrumStats.seconds / 1e6);
+
+    //one run is enough, it takes seconds on a single core
+    Trajectory::Engine tenMinutes;
+    std::string ensembleRecording = MakeRecording(ENSEMBLE_ROWS);
+    if (!tenMinutes.LoadFromMemory(ensembleRecording.data(), ensembleRecording.size()) || !tenMinutes.Run()) return 1;
+    Trajectory::Ensemble ensemble;
+    Trajectory::EnsembleSettings ensembleSettings;
+    ensembleSettings.members = ENSEMBLE_MEMBERS;
+    if (!ensemble.Run(tenMinutes, ensembleSettings)) return 1;
+    const Trajectory::Ensemble::Stats& ensembleStats = ensemble.GetStats();
+    std::printf("ensemble: %zu members x %zu rows, %.2f s, %.1f M member-rows/s, end spread %.4f m, max %.4f m\n",
+        ensembleStats.members, ensembleStats.rows, ensembleStats.seconds,
+        ensembleStats.members * ensembleStats.rows / ensembleStats.seconds / 1e6, ensembleStats.endSpread, ensembleStats.maxSpread);
+
+    //parameter search with the default settings, the cost matters here: synthetic input has no bias to find
+    Trajectory::Engine closed;
+    std::string closedRecording = MakeRecording(TUNER_ROWS);
+    if (!closed.LoadFromMemory(closedRecording.data(), closedRecording.size()) || !closed.Run()) return 1;
+    Trajectory::Tuner tuner;
+    if (!tuner.Run(closed, Trajectory::TuningSettings())) return 1;
+    const Trajectory::TuningResult& tuned = tuner.GetResult();
+    std::printf("tuner: %zu evaluations x %zu rows, %.2f s, %.1f evaluations/s, objective %.4f -> %.4f\n",
+        tuned.evaluations, tuned.rows, tuned.seconds, tuned.evaluations / tuned.seconds, tuned.initialObjective, tuned.objective);
+    std::printf("tuner: cutoff %.4f Hz, bias %.4f %.4f %.4f, gravity %.4f %.4f %.4f\n", tuned.settings.filterCutoff,
+        tuned.settings.accelBias[0], tuned.settings.accelBias[1], tuned.settings.accelBias[2],
+        tuned.settings.gravityVector[0], tuned.settings.gravityVector[1], tuned.settings.gravityVector[2]);
+
+    //the preview of the UI: decimation and a run of what is left
+    Trajectory::Engine preview;
+    for (size_t factor : { 4, 32 }) {
+        double decimate = 1e30, total = 1e30;
+        for (int r = 0; r < runs; r++) {
+            auto start = std::chrono::steady_clock::now();
+            if (!preview.LoadDecimated(engine, factor)) return 1;
+            decimate = std::min(decimate, Milliseconds(start));
+            if (!preview.Run()) return 1;
+            total = std::min(total, Milliseconds(start));
+        }
+        std::printf("preview x%-2zu decimate %.2f ms, %.1f Msamples/s, with run %.2f ms, %zu -> %zu rows\n", factor, decimate,
+            rows / decimate / 1000.0, total, engine.Rows(), preview.Rows());
+    }
+
+    const PipelineArena::Stats& arenaStats = engine.GetArenaStats();
+    std::printf("arena: %.2f MB reserved, %zu reallocations in %zu runs\n",
+        arenaStats.reservedBytes / (1024.0 * 1024.0), arenaStats.growCount, arenaStats.runCount);
+
+    //the main recording put on a uniform grid first, after the arena line: the source buffers are extra
+    const char* interpolations[2] = { "linear", "cubic" };
+    for (int i = 0; i < 2; i++) {
+        Trajectory::Settings settings;
+        settings.resample = true;
+        settings.interpolation = static_cast<Trajectory::Interpolation>(i);
+        engine.SetSettings(settings);
+        double best = 1e30;
+        for (int r = 0; r < runs; r++) {
+            auto start = std::chrono::steady_clock::now();
+            if (!engine.Run()) return 1;
+            best = std::min(best, Milliseconds(start));
+        }
+        Trajectory::Span<float> pos = engine.Positions();
+        std::printf("run resampled %-7s %.2f ms, %.1f Msamples/s, %zu -> %zu rows, end (%.4f, %.4f, %.4f) m\n", interpolations[i], best,
+            rows / best / 1000.0, engine.LoadedRows(), engine.Rows(), pos[pos.size() - 3], pos[pos.size() - 2], pos[pos.size() - 1]);
+    }
+
+    //host fusion of the main recording, the gyroscope sees its turn of 0.1 rad/s around z: one sensor, then FUSION_LANES at once
+    size_t fusionRows = engine.Rows();
+    const float* ts = engine.Times().data();
+    const float* raw = engine.RawAccelerations().data();
+    std::vector<float> gyro(fusionRows * GYRO_SIZE, 0.0f), qs(fusionRows * Q_SIZE);
+    for (size_t i = 0; i < fusionRows; i++) gyro[i * GYRO_SIZE + 2] = 0.1f;
+    size_t bankRows = std::min<size_t>(FUSION_BANK_ROWS, fusionRows);
+    std::vector<float> bankTs(bankRows * FUSION_LANES), bankGyro(bankRows * GYRO_SIZE * FUSION_LANES);
+    std::vector<float> bankAccel(bankRows * A_SIZE * FUSION_LANES), bankQs(bankRows * Q_SIZE * FUSION_LANES);
+    for (size_t i = 0; i < bankRows; i++) {
+        for (size_t l = 0; l < FUSION_LANES; l++) {
+            bankTs[i * FUSION_LANES + l] = ts[i];
+            for (int axis = 0; axis < A_SIZE; axis++) {
+                bankGyro[(i * GYRO_SIZE + axis) * FUSION_LANES + l] = gyro[i * GYRO_SIZE + axis];
+                bankAccel[(i * A_SIZE + axis) * FUSION_LANES + l] = raw[i * A_SIZE + axis];
+            }
+        }
+    }
+    const char* filters[2] = { "madgwick", "mahony" };
+    for (int f = 0; f < 2; f++) {
+        Trajectory::FusionSettings fusionSettings;
+        fusionSettings.filter = static_cast<Trajectory::FusionFilter>(f);
+        double single = 1e30, bank = 1e30;
+        for (int r = 0; r < runs; r++) {
+            Trajectory::Fusion fusion(fusionSettings);
+            auto start = std::chrono::steady_clock::now();
+            fusion.Run(ts, gyro.data(), raw, fusionRows, qs.data());
+            single = std::min(single, Milliseconds(start));
+            Trajectory::FusionBank fusionBank(fusionSettings);
+            start = std::chrono::steady_clock::now();
+            fusionBank.Run(bankTs.data(), bankGyro.data(), bankAccel.data(), bankRows, bankQs.data());
+            bank = std::min(bank, Milliseconds(start));
+        }
+        std::printf("fusion %-8s %.2f ms, %.1f Msamples/s, %d lanes %.1f Msamples/s\n", filters[f], single,
+            fusionRows / single / 1000.0, FUSION_LANES, bankRows * FUSION_LANES / bank / 1000.0);
+    }
+    return 0;
+}
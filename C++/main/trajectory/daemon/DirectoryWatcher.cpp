@@ -0,0 +1,90 @@
+#include "DirectoryWatcher.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+//room for many events with long names per read
+#define EVENT_BUFFER_SIZE (64 * 1024)
+
+DirectoryWatcher::DirectoryWatcher() : buffer(EVENT_BUFFER_SIZE) {
+    inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        std::cerr << "inotify_init1 error: " << std::strerror(errno) << std::endl;
+    }
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        std::cerr << "eventfd error: " << std::strerror(errno) << std::endl;
+    }
+}
+
+DirectoryWatcher::~DirectoryWatcher() {
+    if (inotifyFd >= 0) close(inotifyFd);
+    if (wakeFd >= 0) close(wakeFd);
+}
+
+bool DirectoryWatcher::Add(const std::string& folder) {
+    int watch = inotify_add_watch(inotifyFd, folder.c_str(),
+        IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_ONLYDIR);
+    if (watch < 0) {
+        std::cerr << "Error due watching " << folder << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    folders[watch] = folder;
+    return true;
+}
+
+bool DirectoryWatcher::Poll(int timeoutMilliseconds, std::vector<Event>& events) {
+    pollfd fds[2] = { { inotifyFd, POLLIN, 0 }, { wakeFd, POLLIN, 0 } };
+    int ready = poll(fds, 2, timeoutMilliseconds);
+    if (ready < 0) {
+        //a signal is not an error, the caller checks its flags
+        return errno == EINTR;
+    }
+
+    if (fds[1].revents & POLLIN) {
+        uint64_t count;
+        while (read(wakeFd, &count, sizeof(count)) > 0) {}
+    }
+    if (!(fds[0].revents & POLLIN)) return true;
+
+    while (true) {
+        ssize_t bytes = read(inotifyFd, buffer.data(), buffer.size());
+        if (bytes < 0) {
+            return errno == EAGAIN || errno == EINTR;
+        }
+        for (ssize_t offset = 0; offset < bytes; ) {
+            const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer.data() + offset);
+            offset += sizeof(inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                events.push_back({ EventType::OVERFLOW, "" });
+                continue;
+            }
+            auto folder = folders.find(event->wd);
+            if (folder == folders.end() || event->len == 0 || (event->mask & IN_ISDIR)) continue;
+
+            std::string path = folder->second + "/" + event->name;
+            if (event->mask & IN_MOVED_TO) {
+                events.push_back({ EventType::MOVED_IN, path });
+            }
+            else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                events.push_back({ EventType::REMOVED, path });
+            }
+            else {
+                events.push_back({ EventType::CHANGED, path });
+            }
+        }
+    }
+}
+
+void DirectoryWatcher::Wake() {
+    uint64_t one = 1;
+    if (write(wakeFd, &one, sizeof(one)) < 0) {
+        //counter is already signaled, Poll() wakes up anyway
+    }
+}
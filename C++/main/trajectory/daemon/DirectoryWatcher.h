@@ -0,0 +1,53 @@
+#pragma once
+#ifndef DIRECTORYWATCHER_H
+#define DIRECTORYWATCHER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+* @class DirectoryWatcher
+* @brief inotify watch of several folders (Linux only, not recursive)
+*/
+class DirectoryWatcher {
+public:
+    enum class EventType {
+        CHANGED,    // created, written or closed after writing
+        MOVED_IN,   // renamed into the folder, the file is complete
+        REMOVED,
+        OVERFLOW,   // kernel queue overflowed, folders must be scanned again
+    };
+    struct Event {
+        EventType type;
+        std::string path;
+    };
+
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+    DirectoryWatcher(const DirectoryWatcher&) = delete;
+    DirectoryWatcher& operator=(const DirectoryWatcher&) = delete;
+
+    bool IsOpen() const { return inotifyFd >= 0 && wakeFd >= 0; }
+    /**
+    * @brief starts watching folder
+    */
+    bool Add(const std::string& folder);
+    /**
+    * @brief waits up to timeout for events and appends them to events
+    * @return false if the watch is broken
+    */
+    bool Poll(int timeoutMilliseconds, std::vector<Event>& events);
+    /**
+    * @brief ends a running Poll() early, can be called from any thread
+    */
+    void Wake();
+
+private:
+    int inotifyFd = -1;
+    int wakeFd = -1;
+    std::map<int, std::string> folders;
+    std::vector<char> buffer;
+};
+
+#endif // DIRECTORYWATCHER_H
@@ -0,0 +1,90 @@
+#include "JobJournal.h"
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+static const char* stateNames[3] = { "queued", "done", "failed" };
+
+static void WriteLine(std::ostream& out, const std::string& recording, const JournalEntry& entry) {
+    char fields[128];
+    std::snprintf(fields, sizeof(fields), "%s\t%ju\t%lld\t%zu\t%.3f\t", stateNames[static_cast<int>(entry.state)],
+        entry.size, entry.modified, entry.samples, entry.seconds);
+    out << fields << recording << "\n";
+}
+
+bool JobJournal::Open(const std::string& journalPath) {
+    path = journalPath;
+    entries.clear();
+
+    std::ifstream in(path);
+    std::string line;
+    size_t lineNumber = 0;
+    while (std::getline(in, line)) {
+        lineNumber++;
+        char state[16];
+        JournalEntry entry;
+        int consumed = 0;
+        if (std::sscanf(line.c_str(), "%15s\t%ju\t%lld\t%zu\t%lf\t%n", state, &entry.size, &entry.modified,
+            &entry.samples, &entry.seconds, &consumed) != 5 || consumed == 0) {
+            //the last line may be cut by a crash, everything before it is still valid
+            std::cerr << "Skipping broken journal line " << lineNumber << " in " << path << std::endl;
+            continue;
+        }
+        std::string name = state;
+        if (name == "queued") entry.state = JobState::QUEUED;
+        else if (name == "done") entry.state = JobState::DONE;
+        else if (name == "failed") entry.state = JobState::FAILED;
+        else continue;
+        entries[line.substr(consumed)] = entry;
+    }
+    in.close();
+
+    return Compact();
+}
+
+bool JobJournal::Compact() {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::trunc);
+        if (!out.is_open()) {
+            std::cerr << "Error due file creating " << temporary << std::endl;
+            return false;
+        }
+        for (const auto& entry : entries) {
+            WriteLine(out, entry.first, entry.second);
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        std::cerr << "Error due journal replacing " << path << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    file.open(path, std::ios::app);
+    return file.is_open();
+}
+
+const JournalEntry* JobJournal::Find(const std::string& recording) const {
+    auto entry = entries.find(recording);
+    return entry == entries.end() ? nullptr : &entry->second;
+}
+
+bool JobJournal::IsFinished(const std::string& recording, uintmax_t size, long long modified) const {
+    const JournalEntry* entry = Find(recording);
+    return entry && entry->state != JobState::QUEUED && entry->size == size && entry->modified == modified;
+}
+
+void JobJournal::Record(const std::string& recording, const JournalEntry& entry) {
+    entries[recording] = entry;
+    WriteLine(file, recording, entry);
+    file.flush();
+}
+
+std::vector<std::string> JobJournal::Unfinished() const {
+    std::vector<std::string> recordings;
+    for (const auto& entry : entries) {
+        if (entry.second.state == JobState::QUEUED) recordings.push_back(entry.first);
+    }
+    return recordings;
+}
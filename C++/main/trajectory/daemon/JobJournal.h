@@ -0,0 +1,62 @@
+#pragma once
+#ifndef JOBJOURNAL_H
+#define JOBJOURNAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+enum class JobState {
+    QUEUED,     // accepted, not finished yet; requeued after a restart
+    DONE,
+    FAILED,
+};
+
+struct JournalEntry {
+    JobState state = JobState::QUEUED;
+    uintmax_t size = 0;         // recording size when it was accepted
+    long long modified = 0;     // recording last write time when it was accepted
+    size_t samples = 0;
+    double seconds = 0.0;       // processing time
+};
+
+/**
+* @class JobJournal
+* @brief Append-only log of recording jobs, so a restarted service neither loses nor repeats work.
+* One line per state change: state, size, modified, samples, seconds, path (tab separated).
+*/
+class JobJournal {
+public:
+    /**
+    * @brief reads the journal, rewrites it with the last state of every recording and opens it for appending
+    */
+    bool Open(const std::string& path);
+    /**
+    * @brief last entry of recording or nullptr
+    */
+    const JournalEntry* Find(const std::string& recording) const;
+    /**
+    * @brief true if recording was already processed and did not change since
+    */
+    bool IsFinished(const std::string& recording, uintmax_t size, long long modified) const;
+    /**
+    * @brief appends a state change and flushes it
+    */
+    void Record(const std::string& recording, const JournalEntry& entry);
+    /**
+    * @brief recordings that were queued but never finished
+    */
+    std::vector<std::string> Unfinished() const;
+
+private:
+    bool Compact();
+
+    std::map<std::string, JournalEntry> entries;
+    std::ofstream file;
+    std::string path;
+};
+
+#endif // JOBJOURNAL_H
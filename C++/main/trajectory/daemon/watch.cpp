@@ -0,0 +1,501 @@
+//Service that watches recording folders and computes every finished recording once.
+//A recording is finished when RecordScene wrote its <name>.csv.done marker or when its size
+//did not change for the settle time. State survives restarts through the job journal.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "DirectoryWatcher.h"
+#include "Engine.h"
+#include "JobJournal.h"
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+//how often candidates are checked when no events arrive
+#define POLL_MILLISECONDS 250
+#define MARKER_EXTENSION ".done"
+
+struct Options {
+    std::vector<std::string> folders;
+    std::string outputPath = "processed";
+    Trajectory::Settings settings;
+    ExportFormat format = ExportFormat::NPY;
+    unsigned workers = 2;
+    double settleSeconds = 5.0;
+    bool requireMarker = false;
+    double metricsSeconds = 10.0;
+};
+
+struct Job {
+    std::string recording;
+    std::string outputFolder;
+    uintmax_t size = 0;
+    long long modified = 0;
+    Clock::time_point ready;
+};
+
+//one engine per worker, its buffers stay between jobs
+struct Slot {
+    explicit Slot(TaskScheduler& scheduler) : engine(scheduler), exporter(scheduler) {}
+
+    Trajectory::Engine engine;
+    StageExporter exporter;
+    Job job;
+    bool busy = false;
+    std::atomic<bool> finished{ false };
+    bool ok = false;
+    double queueSeconds = 0.0;
+    double processSeconds = 0.0;
+};
+
+struct Candidate {
+    uintmax_t size = 0;
+    Clock::time_point changed;
+};
+
+struct Metrics {
+    Clock::time_point start = Clock::now();
+    size_t accepted = 0;
+    size_t skipped = 0;     // already in the journal
+    size_t done = 0;
+    size_t failed = 0;
+    size_t samples = 0;
+    double queueSecondsSum = 0.0;
+    double queueSecondsMax = 0.0;
+    double processSecondsSum = 0.0;
+    double totalSecondsSum = 0.0;   // finished to processed
+};
+
+static volatile std::sig_atomic_t stopRequested = 0;
+
+static void OnSignal(int) {
+    stopRequested = 1;
+}
+
+static void PrintUsage() {
+    std::cout <<
+        "usage: trajectory_watch [options] <folder>...\n"
+        "  --out FOLDER            output folder, journal and metrics (default: processed)\n"
+        "  --workers N             recordings processed at once (default: 2)\n"
+        "  --settle SECONDS        unchanged size that marks a recording finished (default: 5)\n"
+        "  --require-marker        only take recordings with a <name>.csv.done marker\n"
+        "  --metrics SECONDS       metrics report interval (default: 10)\n"
+        "  --method NAME           squares | trapezoid | runge-kutta (default: squares)\n"
+        "  --cutoff HZ             high-pass cutoff (default: 0.1)\n"
+        "  --format FORMAT         csv | npy | both (default: npy)\n";
+}
+
+static bool ParseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") {
+            return false;
+        }
+        else if (arg == "--out" && hasValue) {
+            options.outputPath = argv[++i];
+        }
+        else if (arg == "--workers" && hasValue) {
+            options.workers = static_cast<unsigned>(std::max(1, std::atoi(argv[++i])));
+        }
+        else if (arg == "--settle" && hasValue) {
+            options.settleSeconds = std::atof(argv[++i]);
+        }
+        else if (arg == "--require-marker") {
+            options.requireMarker = true;
+        }
+        else if (arg == "--metrics" && hasValue) {
+            options.metricsSeconds = std::max(1.0, std::atof(argv[++i]));
+        }
+        else if (arg == "--method" && hasValue) {
+            std::string method = argv[++i];
+            if (method == "squares") options.settings.method = Trajectory::IntegrationMethod::SQUARES;
+            else if (method == "trapezoid") options.settings.method = Trajectory::IntegrationMethod::TRAPEZOID;
+            else if (method == "runge-kutta") options.settings.method = Trajectory::IntegrationMethod::RUNGE_KUTTA;
+            else {
+                std::cerr << "Unknown method " << method << std::endl;
+                return false;
+            }
+        }
+        else if (arg == "--cutoff" && hasValue) {
+            options.settings.filterCutoff = std::atof(argv[++i]);
+        }
+        else if (arg == "--format" && hasValue) {
+            std::string format = argv[++i];
+            if (format == "csv") options.format = ExportFormat::CSV;
+            else if (format == "npy") options.format = ExportFormat::NPY;
+            else if (format == "both") options.format = ExportFormat::CSV_AND_NPY;
+            else {
+                std::cerr << "Unknown format " << format << std::endl;
+                return false;
+            }
+        }
+        else if (arg.size() > 1 && arg[0] == '-' && arg[1] == '-') {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return false;
+        }
+        else {
+            options.folders.push_back(arg);
+        }
+    }
+    return !options.folders.empty();
+}
+
+static bool EndsWith(const std::string& text, const std::string& end) {
+    return text.size() >= end.size() && text.compare(text.size() - end.size(), end.size(), end) == 0;
+}
+
+static long long ModifiedTime(const std::string& path) {
+    std::error_code error;
+    auto time = fs::last_write_time(path, error);
+    return error ? 0 : static_cast<long long>(time.time_since_epoch().count());
+}
+
+class WatchService {
+public:
+    explicit WatchService(const Options& options, TaskScheduler& scheduler = TaskScheduler::Get()) : options(options), scheduler(scheduler) {}
+
+    bool Start();
+    void Run();
+
+private:
+    void Scan();
+    void OnEvent(const DirectoryWatcher::Event& event);
+    void CheckCandidates();
+    void Enqueue(const std::string& recording, uintmax_t size);
+    bool IsPending(const std::string& recording) const;
+    void Dispatch();
+    void Collect();
+    void Process(Slot& slot);
+    void ReportMetrics(bool final);
+    std::string OutputFolder(const std::string& recording) const;
+
+    Options options;
+    TaskScheduler& scheduler;
+    DirectoryWatcher watcher;
+    JobJournal journal;
+    std::map<std::string, Candidate> candidates;
+    std::deque<Job> queue;
+    std::vector<std::unique_ptr<Slot>> slots;
+    std::map<std::string, std::string> outputFolders;     // watched folder -> output folder
+    TaskGroup running;
+    Metrics metrics;
+    Clock::time_point lastReport = Clock::now();
+};
+
+bool WatchService::Start() {
+    std::error_code error;
+    fs::path output = fs::absolute(options.outputPath, error);
+    fs::create_directories(output, error);
+    for (std::string& folder : options.folders) {
+        if (!fs::is_directory(folder, error)) {
+            std::cerr << "Not a folder: " << folder << std::endl;
+            return false;
+        }
+        if (fs::equivalent(folder, options.outputPath, error)) {
+            std::cerr << "Output folder can not be a watched folder" << std::endl;
+            return false;
+        }
+        //journal keys are built from the folder, so ./in, in/ and /abs/in started from anywhere are the same recordings
+        folder = fs::weakly_canonical(fs::absolute(folder, error), error).string();
+        while (folder.size() > 1 && folder.back() == '/') folder.pop_back();
+        //the output folder is named after the watched one, two folders of the same name would overwrite each other
+        std::string outputFolder = (output / fs::path(folder).filename()).string();
+        for (const auto& other : outputFolders) {
+            if (other.second == outputFolder) {
+                std::cerr << (other.first == folder ? "Folder watched twice: " : "Watched folders with the same name: ")
+                    << other.first << ", " << folder << std::endl;
+                return false;
+            }
+        }
+        fs::create_directories(outputFolder, error);
+        outputFolders[folder] = outputFolder;
+    }
+    if (!watcher.IsOpen()) return false;
+    for (const std::string& folder : options.folders) {
+        if (!watcher.Add(folder)) return false;
+    }
+
+    if (!journal.Open((output / "journal.tsv").string())) return false;
+
+    //jobs cut by the last shutdown come first
+    for (const std::string& recording : journal.Unfinished()) {
+        std::error_code sizeError;
+        uintmax_t size = fs::file_size(recording, sizeError);
+        if (!sizeError) Enqueue(recording, size);
+    }
+    for (unsigned i = 0; i < options.workers; i++) {
+        slots.push_back(std::make_unique<Slot>(scheduler));
+        slots.back()->engine.SetSettings(options.settings);
+    }
+    //files that appeared while the service was down
+    Scan();
+    return true;
+}
+
+void WatchService::Scan() {
+    for (const std::string& folder : options.folders) {
+        std::error_code error;
+        for (fs::directory_iterator it(folder, error), end; !error && it != end; it.increment(error)) {
+            if (!it->is_regular_file(error)) continue;
+            OnEvent({ DirectoryWatcher::EventType::CHANGED, folder + "/" + it->path().filename().string() });
+        }
+    }
+}
+
+void WatchService::OnEvent(const DirectoryWatcher::Event& event) {
+    if (event.type == DirectoryWatcher::EventType::OVERFLOW) {
+        std::cerr << "Watch queue overflow, scanning folders again" << std::endl;
+        Scan();
+        return;
+    }
+
+    std::string recording = event.path;
+    bool marker = EndsWith(recording, MARKER_EXTENSION);
+    if (marker) recording.resize(recording.size() - std::strlen(MARKER_EXTENSION));
+    if (!EndsWith(recording, ".csv")) return;
+
+    if (event.type == DirectoryWatcher::EventType::REMOVED) {
+        if (!marker) candidates.erase(recording);
+        return;
+    }
+    std::error_code error;
+    uintmax_t size = fs::file_size(recording, error);
+    if (error) return;
+    if (journal.IsFinished(recording, size, ModifiedTime(recording))) {
+        metrics.skipped++;
+        return;
+    }
+
+    //a marker or a file moved in from elsewhere is complete right away
+    if (marker || event.type == DirectoryWatcher::EventType::MOVED_IN) {
+        candidates.erase(recording);
+        Enqueue(recording, size);
+        return;
+    }
+    if (options.requireMarker) return;
+    Candidate& candidate = candidates[recording];
+    candidate.size = size;
+    candidate.changed = Clock::now();
+}
+
+void WatchService::CheckCandidates() {
+    if (options.requireMarker) return;
+    Clock::time_point now = Clock::now();
+    for (auto it = candidates.begin(); it != candidates.end(); ) {
+        std::error_code error;
+        uintmax_t size = fs::file_size(it->first, error);
+        if (error) {
+            it = candidates.erase(it);
+            continue;
+        }
+        if (size != it->second.size) {
+            it->second.size = size;
+            it->second.changed = now;
+        }
+        if (std::chrono::duration<double>(now - it->second.changed).count() >= options.settleSeconds) {
+            Enqueue(it->first, size);
+            it = candidates.erase(it);
+            continue;
+        }
+        ++it;
+    }
+}
+
+bool WatchService::IsPending(const std::string& recording) const {
+    for (const Job& queued : queue) {
+        if (queued.recording == recording) return true;
+    }
+    for (const auto& slot : slots) {
+        if (slot->busy && slot->job.recording == recording) return true;
+    }
+    return false;
+}
+
+void WatchService::Enqueue(const std::string& recording, uintmax_t size) {
+    long long modified = ModifiedTime(recording);
+    if (IsPending(recording) || journal.IsFinished(recording, size, modified)) return;
+
+    Job job;
+    job.recording = recording;
+    job.outputFolder = OutputFolder(recording);
+    job.size = size;
+    job.modified = modified;
+    job.ready = Clock::now();
+
+    JournalEntry entry;
+    entry.state = JobState::QUEUED;
+    entry.size = job.size;
+    entry.modified = job.modified;
+    journal.Record(recording, entry);
+    queue.push_back(job);
+    metrics.accepted++;
+}
+
+std::string WatchService::OutputFolder(const std::string& recording) const {
+    std::string folder = fs::path(recording).parent_path().string();
+    auto output = outputFolders.find(folder);
+    return output == outputFolders.end() ? options.outputPath : output->second;
+}
+
+void WatchService::Dispatch() {
+    for (auto& slotPointer : slots) {
+        if (queue.empty()) return;
+        Slot& slot = *slotPointer;
+        if (slot.busy) continue;
+
+        slot.job = queue.front();
+        queue.pop_front();
+        slot.busy = true;
+        slot.finished = false;
+        scheduler.Submit([this, &slot]() { Process(slot); }, TaskPriority::LOW, &running);
+    }
+}
+
+void WatchService::Process(Slot& slot) {
+    Clock::time_point start = Clock::now();
+    slot.queueSeconds = std::chrono::duration<double>(start - slot.job.ready).count();
+
+    slot.ok = slot.engine.Load(slot.job.recording) && slot.engine.Run();
+    if (slot.ok) {
+        Trajectory::Span<float> pos = slot.engine.Positions();
+        std::string name = fs::path(slot.job.recording).stem().string() + ".csv";
+        slot.exporter.Begin(slot.job.outputFolder, options.format);
+        slot.exporter.Submit(pos.data(), pos.size(), INTEGRATION_SIZE, "px,py,pz", name.c_str());
+        //a trajectory that is not on disk is not done, the journal gets failed
+        slot.ok = slot.exporter.Wait();
+    }
+    slot.processSeconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    slot.finished.store(true, std::memory_order_release);
+    watcher.Wake();
+}
+
+void WatchService::Collect() {
+    Clock::time_point now = Clock::now();
+    for (auto& slotPointer : slots) {
+        Slot& slot = *slotPointer;
+        if (!slot.busy || !slot.finished.load(std::memory_order_acquire)) continue;
+        slot.busy = false;
+
+        JournalEntry entry;
+        entry.state = slot.ok ? JobState::DONE : JobState::FAILED;
+        entry.size = slot.job.size;
+        entry.modified = slot.job.modified;
+        entry.samples = slot.ok ? slot.engine.Rows() : 0;
+        entry.seconds = slot.processSeconds;
+        journal.Record(slot.job.recording, entry);
+
+        if (slot.ok) metrics.done++;
+        else metrics.failed++;
+        metrics.samples += entry.samples;
+        metrics.queueSecondsSum += slot.queueSeconds;
+        metrics.queueSecondsMax = std::max(metrics.queueSecondsMax, slot.queueSeconds);
+        metrics.processSecondsSum += slot.processSeconds;
+        metrics.totalSecondsSum += std::chrono::duration<double>(now - slot.job.ready).count();
+        std::printf("%s: %s, %zu samples, queued %.3f s, processed %.3f s\n", slot.job.recording.c_str(),
+            slot.ok ? "done" : "failed", entry.samples, slot.queueSeconds, slot.processSeconds);
+    }
+    std::fflush(stdout);
+}
+
+void WatchService::ReportMetrics(bool final) {
+    Clock::time_point now = Clock::now();
+    if (!final && std::chrono::duration<double>(now - lastReport).count() < options.metricsSeconds) return;
+    lastReport = now;
+
+    size_t finished = metrics.done + metrics.failed;
+    size_t inFlight = 0;
+    for (const auto& slot : slots) {
+        if (slot->busy) inFlight++;
+    }
+    double uptime = std::chrono::duration<double>(now - metrics.start).count();
+    double queueAverage = finished ? metrics.queueSecondsSum / finished : 0.0;
+    double processAverage = finished ? metrics.processSecondsSum / finished : 0.0;
+    double totalAverage = finished ? metrics.totalSecondsSum / finished : 0.0;
+    double samplesPerSecond = metrics.processSecondsSum > 0.0 ? metrics.samples / metrics.processSecondsSum : 0.0;
+
+    std::printf("queue %zu, running %zu, done %zu, failed %zu, skipped %zu | latency queue %.3f s (max %.3f), processing %.3f s, total %.3f s | %.0f samples/s\n",
+        queue.size(), inFlight, metrics.done, metrics.failed, metrics.skipped,
+        queueAverage, metrics.queueSecondsMax, processAverage, totalAverage, samplesPerSecond);
+    std::fflush(stdout);
+
+    //Prometheus text format, replaced atomically so a collector never reads half of it
+    fs::path metricsPath = fs::path(options.outputPath) / "metrics.prom";
+    std::string temporary = metricsPath.string() + ".tmp";
+    FILE* file = std::fopen(temporary.c_str(), "w");
+    if (!file) return;
+    std::fprintf(file,
+        "trajectory_watch_uptime_seconds %.3f\n"
+        "trajectory_watch_queue_length %zu\n"
+        "trajectory_watch_in_flight %zu\n"
+        "trajectory_watch_jobs_total{state=\"accepted\"} %zu\n"
+        "trajectory_watch_jobs_total{state=\"done\"} %zu\n"
+        "trajectory_watch_jobs_total{state=\"failed\"} %zu\n"
+        "trajectory_watch_jobs_total{state=\"skipped\"} %zu\n"
+        "trajectory_watch_samples_total %zu\n"
+        "trajectory_watch_queue_latency_seconds_sum %.6f\n"
+        "trajectory_watch_queue_latency_seconds_max %.6f\n"
+        "trajectory_watch_processing_seconds_sum %.6f\n"
+        "trajectory_watch_end_to_end_seconds_sum %.6f\n"
+        "trajectory_watch_finished_jobs %zu\n"
+        "trajectory_watch_samples_per_second %.1f\n",
+        uptime, queue.size(), inFlight, metrics.accepted, metrics.done, metrics.failed, metrics.skipped, metrics.samples,
+        metrics.queueSecondsSum, metrics.queueSecondsMax, metrics.processSecondsSum, metrics.totalSecondsSum,
+        finished, samplesPerSecond);
+    std::fclose(file);
+    std::error_code error;
+    fs::rename(temporary, metricsPath, error);
+}
+
+void WatchService::Run() {
+    std::vector<DirectoryWatcher::Event> events;
+    while (!stopRequested) {
+        events.clear();
+        if (!watcher.Poll(POLL_MILLISECONDS, events)) {
+            std::cerr << "Watch failed, stopping" << std::endl;
+            break;
+        }
+        for (const DirectoryWatcher::Event& event : events) {
+            OnEvent(event);
+        }
+        CheckCandidates();
+        Collect();
+        Dispatch();
+        ReportMetrics(false);
+    }
+
+    //running jobs are finished, queued ones stay in the journal for the next start
+    std::printf("Stopping, waiting for %zu running jobs\n", static_cast<size_t>(std::count_if(slots.begin(), slots.end(),
+        [](const std::unique_ptr<Slot>& slot) { return slot->busy; })));
+    scheduler.Wait(running);
+    Collect();
+    ReportMetrics(true);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 1;
+    }
+    std::signal(SIGINT, OnSignal);
+    std::signal(SIGTERM, OnSignal);
+
+    WatchService service(options);
+    if (!service.Start()) return 1;
+    std::printf("Watching %zu folders with %u workers\n", options.folders.size(), options.workers);
+    service.Run();
+    return 0;
+}
@@ -0,0 +1,82 @@
+#pragma once
+#ifndef ALLANVARIANCE_H
+#define ALLANVARIANCE_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Engine.h"
+#include "TaskScheduler.h"
+
+namespace Trajectory {
+
+    struct AllanSettings {
+        size_t tausPerDecade = 10;      // cluster sizes are 10^(j / tausPerDecade) samples, rounded, each one once
+        //clusters per cluster size: one starts every max(1, m / samplesPerCluster) samples, which keeps the estimate
+        //close to the fully overlapping one while large clusters cost less; 0 - every sample, fully overlapping
+        size_t samplesPerCluster = 16;
+    };
+
+    /**
+    * @class AllanVariance
+    * @brief Overlapping Allan deviation of every accelerometer axis of a loaded recording, and the noise terms read from it.
+    * Samples are taken as uniform at the mean sample time. Every axis becomes a prefix sum in double (its mean taken out first),
+    * then sigma^2(m) = <(S[k + 2m] - 2 S[k + m] + S[k])^2> / (2 m^2). Cluster sizes with a cluster at every sample share one sweep
+    * split into blocks between the workers, the others are split between the workers one per task. Partial sums are added up in a fixed order.
+    */
+    class AllanVariance {
+    public:
+        struct Stats {
+            size_t rows = 0;
+            double sampleTime = 0.0;        // s, mean
+            double seconds = 0.0;           // computation
+            //accelerometer units
+            double sampleNoise[A_SIZE] = {};        // deviation at the sample time, white noise of one sample
+            double randomWalk[A_SIZE] = {};         // per sqrt(Hz), sigma(tau) sqrt(tau) where the slope is -1/2
+            double biasInstability[A_SIZE] = {};    // minimum of the curve / 0.664
+            double biasInstabilityTau[A_SIZE] = {}; // s, where the minimum is
+        };
+
+        explicit AllanVariance(TaskScheduler& scheduler = TaskScheduler::Get()) : scheduler(scheduler) {}
+
+        /**
+        * @brief computes the curves of the loaded recording, engine does not need to be Run()
+        * @return false if there are less than 3 rows
+        */
+        bool Run(const Engine& engine, const AllanSettings& settings = AllanSettings());
+        /**
+        * @brief writes tau,adev_x,adev_y,adev_z
+        * @return false if the file can not be created
+        */
+        bool Save(const std::string& path) const;
+        void Clear();
+
+        Span<double> Taus() const { return Span<double>(taus.data(), taus.size()); }                  // s
+        Span<double> Deviations() const { return Span<double>(deviations.data(), deviations.size()); }  // A_SIZE per tau, accelerometer units
+        const Stats& GetStats() const { return stats; }
+        /**
+        * @brief share of the sweeps done, can be read from another thread
+        */
+        float GetProgress() const;
+
+    private:
+        size_t Stride(size_t m) const;
+        //sum of (S[k + 2m] - 2 S[k + m] + S[k])^2 over k in [begin, end) at stride
+        double SquaredSum(size_t begin, size_t end, size_t stride, size_t m) const;
+        void Characterize();
+
+        TaskScheduler& scheduler;
+        std::vector<double> sums;       // prefix sum of one axis, rows + 1
+        std::vector<size_t> clusters;   // m of every tau
+        size_t samplesPerCluster = 0;
+        std::vector<double> taus;
+        std::vector<double> deviations;
+        Stats stats;
+        std::atomic<size_t> sweepsDone{ 0 };
+        std::atomic<size_t> sweepsTotal{ 0 };
+    };
+
+}
+
+#endif // ALLANVARIANCE_H
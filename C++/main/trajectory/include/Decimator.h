@@ -0,0 +1,53 @@
+#pragma once
+#ifndef DECIMATOR_H
+#define DECIMATOR_H
+
+#include <cstddef>
+#include <vector>
+#include "Engine.h"
+#include "TaskScheduler.h"
+
+//largest factor of one filter, Engine::LoadDecimated() does larger ones in stages
+#define DECIMATOR_MAX_FACTOR 32
+//taps per phase, the filter is DECIMATOR_PHASE_TAPS * factor long; a multiple of 8 keeps the dot products whole vectors.
+//The length sets the transition band below the new Nyquist frequency, 32 keep rows flat up to about 3/4 of it
+#define DECIMATOR_PHASE_TAPS 32
+
+namespace Trajectory {
+
+    /**
+    * @class Decimator
+    * @brief Anti-aliased decimation of accelerometer rows by 2..DECIMATOR_MAX_FACTOR.
+    * A Kaiser windowed sinc low-pass with unit gain at 0 Hz, so gravity passes unchanged. Its cutoff is half the transition
+    * band below the new Nyquist frequency, so the stop band (about 80 dB down) starts there and nothing aliases back.
+    * Only the kept rows are computed (the polyphase form): each one is a dot product of the filter with the
+    * rows around its block, written as one flat loop over the interleaved axes that the compiler turns into vector code.
+    * Output row n is centered on input rows [n factor, (n + 1) factor), rows past the ends repeat the first and the last one.
+    */
+    class Decimator {
+    public:
+        /**
+        * @param factor clamped to 2..DECIMATOR_MAX_FACTOR
+        */
+        explicit Decimator(size_t factor);
+
+        /**
+        * @param input A_SIZE per row
+        * @param output A_SIZE per row, OutputRows(rows) rows
+        */
+        void Run(const float* input, size_t rows, float* output, TaskScheduler& scheduler = TaskScheduler::Get()) const;
+
+        size_t Factor() const { return factor; }
+        size_t OutputRows(size_t rows) const { return (rows + factor - 1) / factor; }
+        Span<float> Taps() const { return Span<float>(taps.data(), taps.size()); }
+
+    private:
+        size_t factor;
+        size_t offset;                  // rows of the filter before the first row of a block
+        std::vector<float> taps;
+        std::vector<float> interleaved; // every tap A_SIZE times, the layout of the input
+    };
+
+}
+
+#endif // DECIMATOR_H
@@ -0,0 +1,223 @@
+#pragma once
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Fusion.h"
+#include "PipelineArena.h"
+#include "StageExporter.h"
+#include "TaskScheduler.h"
+
+//load + orientation and resampling + 7 computing stages + stationary detection
+#define STAGE_COUNT 10
+
+namespace Trajectory {
+
+    enum class IntegrationMethod {
+        SQUARES,
+        TRAPEZOID,
+        RUNGE_KUTTA,
+    };
+
+    //acceleration between the rows of the resampling, quaternions are always slerped
+    enum class Interpolation {
+        LINEAR,
+        CUBIC,      // Hermite, slopes from the neighbouring rows
+    };
+
+    /**
+    * @brief how far one integration method ends up from another over the same recording
+    */
+    struct Divergence {
+        float maxDistance = 0.0f;   // m, largest distance between positions of the same sample
+        float rmsDistance = 0.0f;   // m
+        float endDistance = 0.0f;   // m, between the last positions
+        float pathLength = 0.0f;    // m, of the compared method
+    };
+
+    struct Settings {
+        IntegrationMethod method = IntegrationMethod::SQUARES;
+        double filterCutoff = 0.1;                          // high-pass cutoff, Hz
+        float g = 9.81f;                                    // m/s^2 in one unit of the accelerometer
+        float gravityVector[3] = { 0.0f, 0.0f, 1.0f };      // gravity in the world frame, accelerometer units
+        float accelBias[3] = { 0.0f, 0.0f, 0.0f };          // sensor offset, subtracted from the raw input, accelerometer units
+        bool highPass = true;                               // stages 6 and 8
+        //0. orientation: quaternions fused on the host from the gyroscope columns replace the recorded ones
+        bool fuse = false;
+        FusionSettings fusion;
+        //0. resampling: rows are put on a uniform time grid before everything else, so every later stage sees one dt
+        bool resample = false;
+        Interpolation interpolation = Interpolation::LINEAR;
+        double resampleRate = 0.0;                          // Hz, 0 - the mean rate of the recording
+        //zero velocity updates: velocity is clamped to 0 where the board is stationary,
+        //the drift of every moving span in between is taken out linearly in time
+        bool zeroVelocity = false;
+        float stationaryWindow = 0.2f;                      // s, centered window of the detection
+        float stationaryAccel = 0.01f;                      // accelerometer units, largest standard deviation of the input vector in the window
+        float stationaryRate = 0.05f;                       // rad/s, largest mean rotation rate in the window
+    };
+
+    /**
+    * @class Span
+    * @brief Read-only view of a contiguous part of an Engine buffer, valid until the next Load or Run
+    */
+    template<class T>
+    class Span {
+    public:
+        Span() = default;
+        Span(const T* data, size_t size) : first(data), count(size) {}
+
+        const T* data() const { return first; }
+        size_t size() const { return count; }
+        bool empty() const { return count == 0; }
+        const T& operator[](size_t i) const { return first[i]; }
+        const T* begin() const { return first; }
+        const T* end() const { return first + count; }
+
+    private:
+        const T* first = nullptr;
+        size_t count = 0;
+    };
+
+    /**
+    * @class Engine
+    * @brief The trajectory pipeline without any window, GL or UI.
+    * Load() reads a recording once, Run() computes acceleration, velocity and position with the current
+    * settings and can be called again with other settings without reloading the file.
+    */
+    class Engine {
+    public:
+        /**
+        * @param scheduler pool the stages run on
+        */
+        explicit Engine(TaskScheduler& scheduler = TaskScheduler::Get());
+
+        /**
+        * @brief reads a recording (header line, then t,w,x,y,z,ax,ay,az per line, optionally followed by gx,gy,gz in rad/s;
+        * the first row decides whether the gyroscope columns are there)
+        * @param path csv file
+        * @return false if the file can not be opened
+        */
+        bool Load(const std::string& path);
+        /**
+        * @brief same as Load() for a recording that is already in memory
+        */
+        bool LoadFromMemory(const char* text, size_t bytes);
+        /**
+        * @brief loads a coarse copy of the recording loaded in full, for a quick preview
+        * Every factor rows become one: delta times are summed, accelerations and rotation rates go through the anti-aliasing Decimator,
+        * the middle quaternion is kept. Factors above DECIMATOR_MAX_FACTOR are split into about equal stages, each rounded up,
+        * so there may be a few rows less than full.Rows() / factor.
+        * @return false if full has nothing loaded
+        */
+        bool LoadDecimated(const Engine& full, size_t factor);
+        /**
+        * @brief computes every stage of the loaded recording
+        * @return false if there is not enough data
+        */
+        bool Run();
+        /**
+        * @brief computes the loaded recording with every integration method at once
+        * Stages 2-4 run once for all of them, and each integration stage is one sweep over the rows that takes
+        * the steps of every method. Positions() and Velocities() then hold settings.method, as after Run();
+        * stages are not exported.
+        * @return false if there is not enough data
+        */
+        bool RunComparison();
+        /**
+        * @brief result of a method in the last RunComparison(), empty after Run()
+        */
+        Span<float> MethodPositions(IntegrationMethod method) const;
+        Span<float> MethodVelocities(IntegrationMethod method) const;
+        /**
+        * @brief compares the positions of two methods of the last RunComparison()
+        */
+        Divergence MethodDivergence(IntegrationMethod method, IntegrationMethod reference) const;
+
+        void SetSettings(const Settings& newSettings) { settings = newSettings; }
+        const Settings& GetSettings() const { return settings; }
+        /**
+        * @brief every stage is also given to exporter if it is set, Begin()/Wait() are up to the caller
+        */
+        void SetExporter(StageExporter* stageExporter) { exporter = stageExporter; }
+
+        size_t Rows() const { return rows; }                    // after resampling
+        size_t LoadedRows() const { return resampled ? sourceRows : rows; }
+        bool IsResampled() const { return resampled; }          // every Times() is the same
+        bool IsFused() const { return fused; }                  // Quaternions() come from settings.fusion
+        bool HasGyroscope() const { return !arena.gyro.empty(); }
+        double SampleRate() const { return sampleRate; }
+        Span<float> Times() const { return Span<float>(arena.ts.data(), arena.ts.size()); }                  // T_SIZE per row, s
+        Span<float> Quaternions() const { return Span<float>(arena.qs.data(), arena.qs.size()); }            // Q_SIZE per row
+        Span<float> RawAccelerations() const { return Span<float>(arena.raw.data(), arena.raw.size()); }     // A_SIZE per row, as recorded
+        Span<float> Gyroscope() const { return Span<float>(arena.gyro.data(), arena.gyro.size()); }          // GYRO_SIZE per loaded row, rad/s
+        Span<float> Rotations() const { return Span<float>(arena.Rs.data(), arena.Rs.size()); }              // R_SIZE per row
+        Span<float> Accelerations() const { return Span<float>(arena.as.data(), arena.as.size()); }          // A_SIZE per row, world frame, m/s^2
+        Span<float> Velocities() const { return Span<float>(arena.vs.data(), arena.vs.size()); }             // INTEGRATION_SIZE per row, m/s
+        Span<float> Positions() const { return Span<float>(arena.pos.data(), arena.pos.size()); }            // INTEGRATION_SIZE per row, m
+        //zero velocity updates only, empty otherwise
+        Span<uint8_t> Stationary() const { return Span<uint8_t>(arena.still.data(), arena.still.size()); }  // 1 per row, 1 if still
+        Span<size_t> MovingSpans() const { return Span<size_t>(arena.spans.data(), arena.spans.size()); }    // begin and end row of every span between still rows
+        size_t StationaryRows() const { return stationaryRows; }
+
+        /**
+        * @brief part of the work done by the current Load + Run, 0..1, can be read from any thread
+        */
+        float GetProgress() const;
+        void ResetProgress() { progress.store(0); }
+        const PipelineArena::Stats& GetArenaStats() const { return arena.GetStats(); }
+        /**
+        * @brief gives all buffers back, the loaded recording is lost
+        */
+        void Release();
+
+    private:
+        using IntegrationStep = void (Engine::*)(size_t, const std::vector<float>&, std::vector<float>&);
+
+        bool Parse();
+        bool RunShared();
+        bool Resample();
+        void RestoreLoaded();
+        bool Fuse();
+        void RestoreRecorded();
+        void ParseRow(size_t row, const char* begin, const char* end);
+        void ComputeRotationMatrix(size_t i);
+        void TiltCompensateA(size_t i);
+        void CompensateGravity(size_t i);
+        void DetectStationary();
+        void ZeroVelocity(std::vector<float>& velocity);
+        void ForEachSample(void (Engine::*stage)(size_t));
+        void Integrate(const std::vector<float>& input, std::vector<float>& output, bool skipStill = false);
+        void IntegrateMethods(const std::vector<float>* const inputs[METHOD_COUNT], std::vector<float>* const outputs[METHOD_COUNT]);
+        void PrefixSum(std::vector<float>& output);
+        static IntegrationStep StepOf(IntegrationMethod method);
+        void HighPass3DFilter(std::vector<float>& data, float cutoff);
+        void Export(const std::vector<float>& data, int stride, const char* header, const char* name);
+
+        //integration methods
+        void SquaresIntegration(size_t i, const std::vector<float>& input, std::vector<float>& output);
+        void TrapezoidIntegration(size_t i, const std::vector<float>& input, std::vector<float>& output);
+        void RungeKuttaIntegration(size_t i, const std::vector<float>& input, std::vector<float>& output);
+
+        TaskScheduler& scheduler;
+        PipelineArena arena;
+        Settings settings;
+        StageExporter* exporter = nullptr;
+        std::string source = "";
+        size_t rows = 0;
+        double sampleRate = 0.0;
+        size_t stationaryRows = 0;
+        bool resampled = false;         // the loaded rows are in the source buffers of the arena
+        size_t sourceRows = 0;
+        float uniformStep = 0.0f;       // s, dt of every row after resampling, 0 otherwise
+        bool fused = false;             // the recorded quaternions are in recordedQs of the arena
+        std::atomic<size_t> progress{ 0 };
+        std::atomic<size_t> progressTotal{ 1 };
+    };
+
+}
+
+#endif // ENGINE_H
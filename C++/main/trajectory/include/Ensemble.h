@@ -0,0 +1,88 @@
+#pragma once
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Engine.h"
+#include "LanePipeline.h"
+#include "TaskScheduler.h"
+
+namespace Trajectory {
+
+    /**
+    * @brief error models of the perturbed copies, every value is one standard deviation
+    */
+    struct EnsembleSettings {
+        size_t members = 200;
+        float accelNoise = 0.004f;          // accelerometer units, white noise of every sample and axis
+        float accelBias = 0.005f;           // accelerometer units, constant through a member, per axis
+        float quaternionNoise = 0.002f;     // rad, small rotation of every sample's orientation around each axis
+        float timeJitter = 0.0003f;         // s, of every timestamp, deltas change by the difference of two
+        uint32_t seed = 1;
+    };
+
+    /**
+    * @class Ensemble
+    * @brief Monte Carlo uncertainty of a computed run: stages 3-8 are repeated for many perturbed copies of
+    * the recording and only the per-sample mean and spread of their positions is kept.
+    * Members go through a LanePipeline PIPELINE_LANES at a time, groups of them are split between the workers.
+    * Noise is approximately normal, see LanePipeline::Normal().
+    */
+    class Ensemble {
+    public:
+        struct Stats {
+            size_t members = 0;
+            size_t rows = 0;
+            double seconds = 0.0;
+            float endSpread = 0.0f;     // m, radial standard deviation at the last sample
+            float maxSpread = 0.0f;     // m, largest radial standard deviation
+        };
+
+        explicit Ensemble(TaskScheduler& scheduler = TaskScheduler::Get()) : scheduler(scheduler) {}
+
+        /**
+        * @brief runs the ensemble around the last Run() of engine, with its settings
+        * Every member is seeded from settings.seed and its own index, whatever task computes it.
+        * @return false if engine has nothing computed
+        */
+        bool Run(const Engine& engine, const EnsembleSettings& settings);
+        void Clear();
+
+        Span<float> Mean() const { return Span<float>(mean.data(), mean.size()); }        // xyz per row, m
+        Span<float> Spread() const { return Span<float>(spread.data(), spread.size()); }  // standard deviation of xyz per row, m
+        const Stats& GetStats() const { return stats; }
+        /**
+        * @brief share of the member groups done, can be read from another thread
+        */
+        float GetProgress() const;
+
+    private:
+        //a part runs its groups one after the other with its own buffers, parts are the parallel tasks
+        struct Part {
+            LanePipeline pipeline;
+            std::vector<double> sums;       // 3 per row, deviation from the nominal positions
+            std::vector<double> squares;    // 3 per row
+        };
+
+        void RunGroup(Part& part, size_t group);
+
+        TaskScheduler& scheduler;
+        std::vector<Part> parts;
+        std::vector<float> mean;
+        std::vector<float> spread;
+        Stats stats;
+        std::atomic<size_t> groupsDone{ 0 };
+        std::atomic<size_t> groupsTotal{ 0 };
+
+        //inputs of the current run
+        const Engine* engine = nullptr;
+        EnsembleSettings settings;
+        size_t rows = 0;
+    };
+
+}
+
+#endif // ENSEMBLE_H
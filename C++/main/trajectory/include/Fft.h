@@ -0,0 +1,44 @@
+#pragma once
+#ifndef FFT_H
+#define FFT_H
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+namespace Trajectory {
+
+    /**
+    * @class Fft
+    * @brief Iterative radix-2 complex FFT of one power-of-two size, no dependencies.
+    * The twiddles and the bit reversal are computed once; Forward() only reads them, so one Fft is shared by all threads,
+    * each with its own data.
+    */
+    class Fft {
+    public:
+        /**
+        * @param size power of two, at least 2
+        */
+        explicit Fft(size_t size);
+
+        /**
+        * @brief in place, X[k] = sum x[n] e^(-2 pi i k n / size)
+        */
+        void Forward(std::complex<float>* data) const;
+        /**
+        * @brief spectra of two real signals packed as x + i y by Forward(), bins 0..size/2 of each
+        */
+        void SplitReal(const std::complex<float>* packed, std::complex<float>* x, std::complex<float>* y) const;
+
+        size_t Size() const { return size; }
+        static bool IsPowerOfTwo(size_t n) { return n >= 2 && (n & (n - 1)) == 0; }
+
+    private:
+        size_t size;
+        std::vector<std::complex<float>> twiddles;  // e^(-2 pi i k / size), k < size / 2
+        std::vector<size_t> reversal;               // pairs of indices to swap
+    };
+
+}
+
+#endif // FFT_H
@@ -0,0 +1,85 @@
+#pragma once
+#ifndef FUSION_H
+#define FUSION_H
+
+#include <cstddef>
+#include "PipelineArena.h"
+
+//sensors of FusionBank updated together, one per SIMD lane
+#define FUSION_LANES 8
+
+namespace Trajectory {
+
+    enum class FusionFilter {
+        MADGWICK,   // gradient descent step towards the accelerometer
+        MAHONY,     // PI feedback of the error between measured and estimated gravity
+    };
+
+    struct FusionSettings {
+        FusionFilter filter = FusionFilter::MADGWICK;
+        float beta = 0.1f;      // rad/s, Madgwick gain: how fast gyroscope drift is pulled back to the accelerometer
+        float kp = 0.5f;        // Mahony proportional gain
+        float ki = 0.0f;        // Mahony integral gain, 1/s, learns a constant gyroscope bias if not 0
+    };
+
+    /**
+    * @class FusionLanes
+    * @brief Orientation of Lanes sensors from gyroscope and accelerometer, without magnetometer (yaw drifts).
+    * Quaternions are w, x, y, z and turn the sensor frame into the world frame, the same as the DMP ones of Engine;
+    * world z points up, along the measured acceleration at rest.
+    * The state is a fixed array per component with Lanes floats, an update is one flat loop over the lanes
+    * without branches that the compiler turns into vector code, and nothing is allocated after construction.
+    * Fusion is one sensor (batch reprocessing of a recording, or a live stream), FusionBank is FUSION_LANES
+    * sensors at once.
+    */
+    template<size_t Lanes>
+    class FusionLanes {
+    public:
+        explicit FusionLanes(const FusionSettings& settings = FusionSettings());
+
+        void SetSettings(const FusionSettings& newSettings) { settings = newSettings; }
+        const FusionSettings& GetSettings() const { return settings; }
+
+        /**
+        * @brief every lane to the identity, Mahony integral to 0
+        */
+        void Reset();
+        void Reset(size_t lane, const float q[Q_SIZE]);
+        /**
+        * @brief tilt of a lane from one accelerometer sample at rest, yaw 0
+        */
+        void Align(size_t lane, const float accel[A_SIZE]);
+
+        /**
+        * @brief one sample of every lane
+        * @param gyro rad/s, sensor frame: x of every lane, then y, then z
+        * @param accel any unit, only the direction is used, same layout; all 0 - gyroscope only
+        * @param dt s, of every lane
+        */
+        void Update(const float* gyro, const float* accel, const float* dt);
+        /**
+        * @brief rows samples of every lane from the current state, the layout of Update() per row
+        * @param qs Q_SIZE * Lanes per row: w of every lane, then x, y, z; the state after each row
+        */
+        void Run(const float* ts, const float* gyro, const float* accel, size_t rows, float* qs);
+
+        void Get(size_t lane, float q[Q_SIZE]) const;
+
+    private:
+        template<FusionFilter Filter>
+        void Step(const float* gyro, const float* accel, const float* dt);
+
+        FusionSettings settings;
+        float q[Q_SIZE][Lanes];
+        float integral[3][Lanes];   // Mahony, rad/s
+    };
+
+    using Fusion = FusionLanes<1>;
+    using FusionBank = FusionLanes<FUSION_LANES>;
+
+    extern template class FusionLanes<1>;
+    extern template class FusionLanes<FUSION_LANES>;
+
+}
+
+#endif // FUSION_H
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef LANEPIPELINE_H
+#define LANEPIPELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Engine.h"
+
+//variants computed together, one per SIMD lane
+#define PIPELINE_LANES 8
+
+namespace Trajectory {
+
+    /**
+    * @class LanePipeline
+    * @brief Stages 3-8 of Engine for PIPELINE_LANES variants of one computed recording at once.
+    * Zero velocity updates use the stationary rows engine found, they are not detected again per lane.
+    * Every lane has its own accelerometer bias, gravity and cutoff and may get random errors added to its input;
+    * rotations, time deltas and the input of a row are loaded once for all lanes, and the stages are four
+    * sweeps over the rows with flat loops over all axes and lanes. Runs on the calling thread: the buffers are
+    * a workspace reused by the next Run(), one pipeline per parallel task.
+    */
+    class LanePipeline {
+    public:
+        struct Lanes {
+            float bias[3][PIPELINE_LANES] = {};         // accelerometer units, subtracted from the raw input
+            float gravity[3][PIPELINE_LANES] = {};      // world frame, accelerometer units
+            double cutoff[PIPELINE_LANES] = {};         // high-pass, Hz
+
+            //random errors, standard deviations, all 0 - the exact input
+            float accelNoise = 0.0f;        // accelerometer units, white noise of every sample and axis
+            float accelBias = 0.0f;         // accelerometer units, constant through a lane, per axis
+            float angleNoise = 0.0f;        // rad, small rotation of every sample's orientation around each axis
+            float timeJitter = 0.0f;        // s, of every timestamp, deltas change by the difference of two
+            uint32_t seeds[PIPELINE_LANES] = {};
+        };
+
+        /**
+        * @brief computes the lanes over the last Run() of engine, with its integration method and g
+        * @return false if engine has nothing computed
+        */
+        bool Run(const Engine& engine, const Lanes& lanes);
+
+        size_t Rows() const { return rows; }
+        /**
+        * @brief filtered velocity and position of row i: x of every lane, then y, then z
+        */
+        const float* Velocity(size_t i) const { return &v[i * 3 * PIPELINE_LANES]; }
+        const float* Position(size_t i) const { return &p[i * 3 * PIPELINE_LANES]; }
+        /**
+        * @brief workspace size for a recording of rows
+        */
+        static size_t BytesFor(size_t rows) { return rows * 7 * PIPELINE_LANES * sizeof(float); }
+
+        /**
+        * @brief approximately normal: xorshift32, then the four bytes summed up; tails end at about 3.5 sigma.
+        * Cheap, the same on every compiler and vectorizes over the lanes
+        */
+        static float Normal(uint32_t& state);
+        /**
+        * @brief splitmix64: advances state and gives the next well mixed 64 bits, for seeds and uniform draws
+        */
+        static uint64_t SplitMix64(uint64_t& state);
+
+    private:
+        template<bool Noisy, class Area>
+        void RunLanes(const Engine& engine, const Lanes& lanes, const Area& area);
+
+        size_t rows = 0;
+        std::vector<float> ts;  // PIPELINE_LANES per row
+        std::vector<float> v;   // 3 * PIPELINE_LANES per row
+        std::vector<float> p;   // 3 * PIPELINE_LANES per row
+    };
+
+}
+
+#endif // LANEPIPELINE_H
@@ -0,0 +1,66 @@
+#pragma once
+#ifndef PATHLOD_H
+#define PATHLOD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Engine.h"
+#include "TaskScheduler.h"
+
+//samples per chunk, neighbouring chunks share their border sample so strips stay connected
+#define LOD_CHUNK_SAMPLES 65536
+//levels stop when a chunk is down to its two end samples or after this many
+#define LOD_MAX_LEVELS 24
+
+namespace Trajectory {
+
+    /**
+    * @class PathLod
+    * @brief Multi-resolution hierarchy of a trajectory for drawing, built without GL.
+    * The path is cut into chunks, every chunk has levels simplified with Douglas-Peucker from the level below
+    * with doubling tolerance. Level 0 is the chunk itself, coarser levels are indices into the original positions.
+    */
+    class PathLod {
+    public:
+        struct Level {
+            float error = 0.0f;     // max distance of any original sample from this level, position units
+            size_t offset = 0;      // first index in Indices(), unused for level 0
+            size_t count = 0;       // samples in the level
+        };
+        struct Chunk {
+            size_t first = 0;       // first sample
+            float center[3] = { 0.0f, 0.0f, 0.0f };
+            float radius = 0.0f;    // bounding sphere around center
+            std::vector<Level> levels;
+        };
+
+        explicit PathLod(TaskScheduler& scheduler = TaskScheduler::Get()) : scheduler(scheduler) {}
+
+        /**
+        * @brief builds every chunk in parallel
+        * @param positions xyz per sample, the same buffer later drawn as level 0
+        * @param baseTolerance tolerance of level 1, 0 picks 1e-6 of the path extent
+        */
+        void Build(Span<float> positions, float baseTolerance = 0.0f);
+        void Clear();
+
+        const std::vector<Chunk>& Chunks() const { return chunks; }
+        /**
+        * @brief indices of every coarse level of every chunk, one buffer
+        */
+        const std::vector<uint32_t>& Indices() const { return indices; }
+        size_t Samples() const { return samples; }
+
+    private:
+        void BuildChunk(const float* positions, Chunk& chunk, size_t count, float baseTolerance, std::vector<uint32_t>& chunkIndices);
+
+        TaskScheduler& scheduler;
+        std::vector<Chunk> chunks;
+        std::vector<uint32_t> indices;
+        size_t samples = 0;
+    };
+
+}
+
+#endif // PATHLOD_H
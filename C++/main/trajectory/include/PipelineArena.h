@@ -0,0 +1,85 @@
+#pragma once
+#ifndef PIPELINEARENA_H
+#define PIPELINEARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define Q_SIZE 4
+#define A_SIZE 3
+#define R_SIZE 9
+#define T_SIZE 1
+#define INTEGRATION_SIZE 3
+#define GYRO_SIZE 3
+//rotation rate of the stationary detection
+#define MOTION_SIZE 1
+//integration methods, each gets its own buffers in a comparison run
+#define METHOD_COUNT 3
+
+/**
+* @class PipelineArena
+* @brief Owns every buffer of the trajectory pipeline.
+* Buffers are sized once from the row count and keep their capacity between runs,
+* so recomputing a file of similar size does not touch the heap.
+*/
+class PipelineArena {
+public:
+    struct Stats {
+        size_t highWaterRows = 0;   // biggest row count ever prepared
+        size_t highWaterBytes = 0;  // biggest file ever read
+        size_t capacityRows = 0;    // rows every buffer holds without growing
+        size_t reservedBytes = 0;   // memory currently owned by the arena
+        size_t growCount = 0;       // how many times the buffers had to be reallocated
+        size_t runCount = 0;        // how many times the arena was prepared
+    };
+
+    /**
+    * @brief makes room for the raw text of the input file and resizes text to bytes
+    * @param bytes file size
+    */
+    char* PrepareText(size_t bytes);
+    /**
+    * @brief makes room for rows samples in every buffer and empties them
+    * @param rows upper bound of samples in the input
+    */
+    void Prepare(size_t rows);
+    /**
+    * @brief gives all memory back
+    */
+    void Release();
+
+    const Stats& GetStats() const { return stats; }
+
+    std::string text;               // raw contents of the input file
+    std::vector<float> ts;          // T_SIZE per row
+    std::vector<float> qs;          // Q_SIZE per row
+    std::vector<float> raw;         // A_SIZE per row, accelerometer as recorded
+    std::vector<float> as;          // A_SIZE per row
+    std::vector<float> Rs;          // R_SIZE per row
+    std::vector<float> vs;          // INTEGRATION_SIZE per row
+    std::vector<float> pos;         // INTEGRATION_SIZE per row
+    std::vector<double> scratch;    // filter column of every axis, times of the loaded rows in resampling
+    //recordings with gyroscope columns only, empty otherwise
+    std::vector<float> gyro;        // GYRO_SIZE per loaded row, rad/s
+    std::vector<float> recordedQs;  // Q_SIZE per loaded row, the recorded quaternions while qs holds fused ones; allocated on first use
+    //resampling only, the loaded rows while ts, qs and raw hold the uniform ones; allocated on first use
+    std::vector<float> sourceTs;    // T_SIZE per row
+    std::vector<float> sourceQs;    // Q_SIZE per row
+    std::vector<float> sourceRaw;   // A_SIZE per row
+    //zero velocity updates only, empty otherwise
+    std::vector<float> motion;      // MOTION_SIZE per row
+    std::vector<uint8_t> still;     // 1 per row, 1 if the board is stationary
+    std::vector<size_t> spans;      // begin and end row of every moving span between stationary rows
+    //comparison run only, allocated on first use
+    std::vector<float> methodVs[METHOD_COUNT];      // INTEGRATION_SIZE per row
+    std::vector<float> methodPos[METHOD_COUNT];     // INTEGRATION_SIZE per row
+
+private:
+    void UpdateReservedBytes();
+
+    Stats stats;
+};
+
+#endif // PIPELINEARENA_H
@@ -0,0 +1,68 @@
+#pragma once
+#ifndef POSEQUERY_H
+#define POSEQUERY_H
+
+#include <cstddef>
+#include "Engine.h"
+#include "TaskScheduler.h"
+#include "TimeIndex.h"
+
+namespace Trajectory {
+
+    struct Pose {
+        float position[3] = { 0.0f, 0.0f, 0.0f };           // m
+        float velocity[3] = { 0.0f, 0.0f, 0.0f };           // m/s
+        float orientation[4] = { 1.0f, 0.0f, 0.0f, 0.0f };  // quaternion w, x, y, z
+        size_t sample = 0;                                  // row at or before the moment
+    };
+
+    /**
+    * @class PoseQuery
+    * @brief Where the board was at any moment of a computed run, between rows position and velocity are
+    * interpolated linearly and orientation spherically (slerp).
+    * Reads the Engine buffers in place, so it is valid until the next Load or Run of that engine.
+    */
+    class PoseQuery {
+    public:
+        explicit PoseQuery(TaskScheduler& scheduler = TaskScheduler::Get()) : scheduler(scheduler) {}
+
+        /**
+        * @brief indexes the sample times of the last Run() of engine
+        */
+        void Build(const Engine& engine);
+        void Clear();
+
+        size_t Rows() const { return index.Rows(); }
+        double Duration() const { return index.Duration(); }
+        const TimeIndex& Index() const { return index; }
+
+        /**
+        * @param time s from the first row, clamped to the recording; NaN gives the first row
+        */
+        Pose At(double time) const;
+        /**
+        * @brief poses at many moments, split between the workers
+        * Queries are located a block at a time, ascending runs of times by galloping from the previous row,
+        * then interpolated in plain loops over the block.
+        * @param positions, velocities 3 floats per query, orientations 4 (w, x, y, z); any can be nullptr
+        */
+        void At(Span<double> times, float* positions, float* velocities, float* orientations) const;
+
+        /**
+        * @brief shortest arc between two unit quaternions (w, x, y, z), normalized; also used by Engine's resampling
+        */
+        static void Slerp(const float* from, const float* to, float fraction, float* out);
+
+    private:
+        void AtRange(const double* times, size_t count, float* positions, float* velocities, float* orientations) const;
+
+        TaskScheduler& scheduler;
+        TimeIndex index;
+        Span<float> positions;
+        Span<float> velocities;
+        Span<float> quaternions;
+    };
+
+}
+
+#endif // POSEQUERY_H
@@ -0,0 +1,76 @@
+#pragma once
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Engine.h"
+#include "TaskScheduler.h"
+
+//samples in a leaf, searched linearly
+#define SPATIAL_LEAF_SAMPLES 16
+
+namespace Trajectory {
+
+    /**
+    * @class SpatialIndex
+    * @brief k-d tree over the trajectory samples for picking and region queries, built without GL.
+    * The tree is implicit: samples are reordered so every node is a range with its median in the middle,
+    * only the split axis of every node is stored. Nodes are numbered like a heap (children 2k+1, 2k+2).
+    */
+    class SpatialIndex {
+    public:
+        struct Hit {
+            bool found = false;
+            size_t sample = 0;
+            float distance = 0.0f;  // from the ray or the point, position units
+            float along = 0.0f;     // ray parameter of the closest approach, rays only
+        };
+
+        explicit SpatialIndex(TaskScheduler& scheduler = TaskScheduler::Get()) : scheduler(scheduler) {}
+
+        /**
+        * @brief builds the tree, subtrees in parallel
+        * @param positions xyz per sample
+        */
+        void Build(Span<float> positions);
+        void Clear();
+        size_t Samples() const { return points.size(); }
+
+        /**
+        * @brief sample closest to a ray, among those within radius of it
+        * @param direction need not be normalized
+        */
+        Hit PickRay(const float origin[3], const float direction[3], float radius) const;
+        /**
+        * @brief sample closest to point, within radius of it
+        */
+        Hit Nearest(const float point[3], float radius) const;
+        /**
+        * @brief every sample inside the box, in no particular order
+        */
+        void InBox(const float low[3], const float high[3], std::vector<uint32_t>& samples) const;
+
+    private:
+        struct Point {
+            float position[3];
+            uint32_t sample;
+        };
+        struct Box {
+            float low[3];
+            float high[3];
+        };
+
+        void BuildNode(size_t node, size_t begin, size_t end);
+        void BuildSubtree(size_t node, size_t begin, size_t end);
+
+        TaskScheduler& scheduler;
+        std::vector<Point> points;
+        std::vector<uint8_t> axes;  // split axis of every inner node
+        Box bounds = {};
+    };
+
+}
+
+#endif // SPATIALINDEX_H
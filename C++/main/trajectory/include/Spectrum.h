@@ -0,0 +1,107 @@
+#pragma once
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "Engine.h"
+#include "TaskScheduler.h"
+
+//shortest segment, also the shortest recording that is analyzed
+#define SPECTRUM_MIN_SEGMENT 16
+
+namespace Trajectory {
+
+    struct SpectrumSettings {
+        size_t segment = 1024;      // samples per FFT, power of two from SPECTRUM_MIN_SEGMENT, halved until it fits in a short recording
+        float overlap = 0.5f;       // share of a segment shared with the next one, 0..0.95
+        //rows are put on a uniform grid at the mean sample time first, linear between the rows,
+        //rows with a zero time step are replaced by the next one; otherwise they are taken as uniform.
+        //Not needed if the engine resampled them already
+        bool resample = true;
+        size_t maxColumns = 4096;   // spectrogram columns, neighbouring segments are averaged into one above this
+    };
+
+    /**
+    * @class Spectrum
+    * @brief Welch power spectral density and spectrogram of the world frame acceleration of a computed recording.
+    * Every segment is Hann windowed with its mean taken out, x and y go through one complex FFT as x + i y, z through another.
+    * Segments are grouped into spectrogram columns and the columns are split into a fixed number of parts, each part
+    * sums its own Welch average, and the parts are added up in order.
+    * The input of the last Run() is kept: a Run() with the same segment layout computes again only the parts whose
+    * input samples changed and keeps the columns and Welch sums of the others.
+    */
+    class Spectrum {
+    public:
+        struct Stats {
+            size_t rows = 0;
+            size_t samples = 0;         // after resampling
+            size_t segments = 0;
+            double sampleRate = 0.0;    // Hz
+            double peakFrequency = 0.0; // Hz, largest density of all axes together without the DC bin
+            size_t columnsComputed = 0; // the other columns were kept from the last Run()
+            double seconds = 0.0;       // computation
+        };
+
+        explicit Spectrum(TaskScheduler& scheduler = TaskScheduler::Get()) : scheduler(scheduler) {}
+
+        /**
+        * @brief analyzes Accelerations() of the engine, it has to be Run()
+        * @return false if there are less than SPECTRUM_MIN_SEGMENT rows or the segment is not a power of two of at least that
+        */
+        bool Run(const Engine& engine, const SpectrumSettings& settings = SpectrumSettings());
+        /**
+        * @brief writes frequency,psd_x,psd_y,psd_z
+        * @return false if the file can not be created
+        */
+        bool Save(const std::string& path) const;
+        void Clear();
+
+        size_t Bins() const { return frequencies.size(); }     // segment / 2 + 1
+        size_t Columns() const { return Bins() == 0 ? 0 : spectrogram.size() / Bins(); }
+        double ColumnSeconds() const { return columnSeconds; }  // time between the starts of two columns
+        double SegmentSeconds() const;
+        Span<double> Frequencies() const { return Span<double>(frequencies.data(), frequencies.size()); }  // Hz
+        Span<double> Density() const { return Span<double>(density.data(), density.size()); }              // A_SIZE per bin, (m/s^2)^2/Hz
+        Span<float> Spectrogram() const { return Span<float>(spectrogram.data(), spectrogram.size()); }    // Bins() per column, dB of all axes together
+        /**
+        * @brief columns computed by the last Run(), [begin, end), the ones outside are as before it
+        */
+        void ChangedColumns(size_t& begin, size_t& end) const {
+            begin = changedBegin;
+            end = changedEnd;
+        }
+        const Stats& GetStats() const { return stats; }
+        /**
+        * @brief share of the segments done, can be read from another thread
+        */
+        float GetProgress() const;
+
+    private:
+        //puts the rows on a uniform grid, returns the sample time
+        double Resample(const Engine& engine);
+
+        TaskScheduler& scheduler;
+        std::vector<float> samples;     // A_SIZE per sample, resampled rows
+        std::vector<float> previous;    // A_SIZE per sample, input of the last Run()
+        std::vector<double> partials;   // bins * A_SIZE per part, Welch sums
+        std::vector<double> times;      // s, from the first row
+        std::vector<double> frequencies;
+        std::vector<double> density;
+        std::vector<float> spectrogram;
+        double columnSeconds = 0.0;
+        size_t segmentSize = 0;
+        size_t segmentHop = 0;
+        size_t columnSegments = 0;
+        double analyzedRate = 0.0;
+        size_t changedBegin = 0, changedEnd = 0;
+        Stats stats;
+        std::atomic<size_t> segmentsDone{ 0 };
+        std::atomic<size_t> segmentsTotal{ 0 };
+    };
+
+}
+
+#endif // SPECTRUM_H
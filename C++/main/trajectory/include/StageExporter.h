@@ -0,0 +1,89 @@
+#pragma once
+#ifndef STAGEEXPORTER_H
+#define STAGEEXPORTER_H
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TaskScheduler.h"
+
+enum class ExportFormat {
+    CSV,
+    NPY,
+    CSV_AND_NPY,
+};
+
+/**
+* @class StageExporter
+* @brief Writes intermediate pipeline stages to files in the background.
+* Submit() takes a snapshot of the data, so the pipeline can keep modifying its buffers
+* while the files are formatted and written as low priority tasks of the given TaskScheduler.
+*/
+class StageExporter {
+public:
+    struct Stats {
+        size_t files = 0;
+        size_t failed = 0;      // files that could not be created or written completely
+        size_t bytes = 0;
+        double seconds = 0.0;   // from Begin() until the last file was written
+    };
+
+    explicit StageExporter(TaskScheduler& scheduler = TaskScheduler::Get()) : scheduler(scheduler) {}
+    ~StageExporter();
+
+    /**
+    * @brief starts a new export, waits for the previous one
+    * @param folder output folder
+    * @param format file format of every stage
+    */
+    void Begin(const std::string& folder, ExportFormat format);
+    /**
+    * @brief snapshots data and writes it in the background
+    * @param data values, stride per row
+    * @param stride values per row
+    * @param header comma separated column names (CSV only)
+    * @param name file name with .csv extension, .npy is used for binary files
+    */
+    void Submit(const std::vector<float>& data, int stride, const char* header, const char* name);
+    /**
+    * @brief same as above for count values that are not in a vector
+    */
+    void Submit(const float* data, size_t count, int stride, const char* header, const char* name);
+    /**
+    * @brief blocks until every submitted stage is on disk
+    * @return false if a file of this export could not be created or written
+    */
+    bool Wait();
+
+    const Stats& GetStats() const { return stats; }
+
+private:
+    struct Job {
+        std::vector<float> data;
+        std::vector<char> buffer;
+        int stride = 1;
+        std::string header;
+        std::string path;
+        size_t bytes = 0;
+        size_t failed = 0;
+    };
+
+    void WriteJob(Job& job);
+    void WriteCSV(Job& job);
+    void WriteNPY(Job& job);
+
+    TaskScheduler& scheduler;
+    //jobs are kept between exports so their buffers keep the capacity
+    std::vector<std::unique_ptr<Job>> jobs;
+    size_t usedJobs = 0;
+    size_t countedJobs = 0;
+    TaskGroup pending;
+    std::string folder;
+    ExportFormat format = ExportFormat::CSV;
+    std::chrono::steady_clock::time_point start;
+    Stats stats;
+};
+
+#endif // STAGEEXPORTER_H
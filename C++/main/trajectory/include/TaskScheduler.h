@@ -0,0 +1,171 @@
+#pragma once
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class TaskPriority {
+    HIGH,   // somebody is looking at the screen waiting for it
+    LOW,    // batch work: exports, background processing
+};
+
+#define TASK_PRIORITY_COUNT 2
+
+/**
+* @class TaskGroup
+* @brief Counter of unfinished tasks that can be waited with TaskScheduler::Wait
+*/
+class TaskGroup {
+public:
+    TaskGroup() = default;
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class TaskScheduler;
+    std::atomic<size_t> pending{ 0 };
+    std::mutex mutex;
+    std::condition_variable doneCondition;
+    std::exception_ptr error;
+};
+
+/**
+* @class TaskScheduler
+* @brief Process-wide work-stealing thread pool.
+* Every worker owns a queue per priority, pops its own newest task and steals the oldest
+* task of other workers when idle. High priority tasks are always taken before low ones.
+* Threads waiting for a group run queued tasks instead of blocking: high priority ones and those of the
+* group they wait for, never an unrelated low priority task that would add its whole run to the wait.
+*/
+class TaskScheduler {
+public:
+    struct WorkerStats {
+        size_t queued[TASK_PRIORITY_COUNT] = { 0, 0 };
+        size_t executed = 0;
+        size_t steals = 0;
+        double utilization = 0.0;  // busy time / lifetime of the worker, 0..1
+    };
+    struct Stats {
+        std::vector<WorkerStats> workers;
+        size_t executed = 0;
+        size_t steals = 0;
+        size_t helped = 0;      // tasks run by waiting threads outside of the pool
+    };
+
+    /**
+    * @brief the scheduler shared by the whole process, sized to the hardware
+    */
+    static TaskScheduler& Get();
+
+    /**
+    * @param workers number of threads, 0 means hardware concurrency
+    */
+    explicit TaskScheduler(unsigned workers = 0);
+    ~TaskScheduler();
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    /**
+    * @brief queues a task, group (if any) is counted until the task ends
+    */
+    void Submit(std::function<void()> task, TaskPriority priority = TaskPriority::LOW, TaskGroup* group = nullptr);
+    /**
+    * @brief queues a task and gives a future of its result
+    */
+    template<class F>
+    auto Async(F&& function, TaskPriority priority = TaskPriority::LOW) -> std::future<decltype(function())> {
+        using Result = decltype(function());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(function));
+        std::future<Result> result = task->get_future();
+        Submit([task]() { (*task)(); }, priority);
+        return result;
+    }
+    /**
+    * @brief splits [begin, end) in chunks of at least grain items and runs body(chunkBegin, chunkEnd) on all workers.
+    * The calling thread takes part and returns when every chunk is done. Nothing is allocated.
+    */
+    template<class F>
+    void ParallelFor(size_t begin, size_t end, size_t grain, const F& body, TaskPriority priority = TaskPriority::HIGH) {
+        ParallelFor(begin, end, grain, &CallRange<F>, &body, priority);
+    }
+    /**
+    * @brief runs high priority tasks and tasks of the group until it is done, rethrows the first exception of the group
+    */
+    void Wait(TaskGroup& group);
+
+    unsigned WorkerCount() const { return static_cast<unsigned>(workers.size()); }
+    Stats GetStats() const;
+
+private:
+    using RangeFunction = void (*)(const void* body, size_t begin, size_t end);
+
+    template<class F>
+    static void CallRange(const void* body, size_t begin, size_t end) {
+        (*static_cast<const F*>(body))(begin, end);
+    }
+
+    struct Task {
+        std::function<void()> function;
+        //ParallelFor chunks carry the body by pointer, so queuing them never allocates
+        RangeFunction range = nullptr;
+        const void* body = nullptr;
+        size_t begin = 0;
+        size_t end = 0;
+        TaskGroup* group = nullptr;
+    };
+
+    //ring buffer that keeps its capacity, owner works at the back, thieves at the front
+    class TaskQueue {
+    public:
+        void PushBack(Task&& task);
+        bool PopBack(Task& task);
+        bool PopFront(Task& task);
+        //newest task of group, the ones after it move up
+        bool PopGroup(const TaskGroup* group, Task& task);
+        size_t Size() const { return count; }
+    private:
+        std::vector<Task> tasks;
+        size_t head = 0;
+        size_t count = 0;
+    };
+
+    struct Worker {
+        mutable std::mutex mutex;
+        TaskQueue queues[TASK_PRIORITY_COUNT];
+        std::atomic<size_t> executed{ 0 };
+        std::atomic<size_t> steals{ 0 };
+        std::atomic<long long> busyNanoseconds{ 0 };
+        std::thread thread;
+    };
+
+    void ParallelFor(size_t begin, size_t end, size_t grain, RangeFunction range, const void* body, TaskPriority priority);
+    void Push(Task&& task, TaskPriority priority);
+    //tasks up to lowest priority of any group, below it only the ones of group
+    bool Pop(int self, TaskPriority lowest, const TaskGroup* group, Task& task);
+    bool TryRunOne(int self, TaskPriority lowest, const TaskGroup* group = nullptr);
+    void Run(Task& task);
+    void WorkerLoop(int index);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::chrono::steady_clock::time_point startTime;
+    std::atomic<size_t> queuedCount{ 0 };
+    std::atomic<size_t> nextWorker{ 0 };
+    std::atomic<size_t> helped{ 0 };
+    std::atomic<bool> stopping{ false };
+    std::mutex sleepMutex;
+    std::condition_variable sleepCondition;
+};
+
+#endif // TASKSCHEDULER_H
@@ -0,0 +1,55 @@
+#pragma once
+#ifndef TIMEINDEX_H
+#define TIMEINDEX_H
+
+#include <cstddef>
+#include <vector>
+#include "Engine.h"
+
+namespace Trajectory {
+
+    /**
+    * @class TimeIndex
+    * @brief Time of every sample from the start of the recording, for finding the samples around any moment.
+    * The recording keeps only the delta time of every row, this sums them once so a lookup is a binary search.
+    * A table of uniform time buckets narrows the search first; rows come at a nearly constant rate, so most
+    * lookups touch one or two rows instead of log n scattered ones.
+    */
+    class TimeIndex {
+    public:
+        //the moment lies between row index and index + 1, fraction of the way
+        struct Sample {
+            size_t index = 0;
+            float fraction = 0.0f;
+        };
+
+        /**
+        * @param deltaTimes T_SIZE per row, s since the previous row (Engine::Times()), negative ones count as 0
+        */
+        void Build(Span<float> deltaTimes);
+        void Clear();
+
+        size_t Rows() const { return times.size(); }
+        double Duration() const { return times.empty() ? 0.0 : times.back(); }
+        double TimeAt(size_t row) const { return times[row]; }
+        /**
+        * @brief O(log n), times outside the recording give its first or last row, NaN the first
+        */
+        Sample Locate(double time) const;
+        /**
+        * @brief same result as Locate(), searched outwards from the row of an earlier result
+        * a moment a few rows after hint is found by galloping from it, so a sweep forward in time costs almost nothing per call
+        */
+        Sample LocateFrom(double time, size_t hint) const;
+
+    private:
+        Sample Between(size_t next, double time) const;
+
+        std::vector<double> times;      // row 0 is at 0
+        std::vector<size_t> buckets;    // last row at or before the start of every bucket, one bucket per row
+        double bucketScale = 0.0;       // buckets per second
+    };
+
+}
+
+#endif // TIMEINDEX_H
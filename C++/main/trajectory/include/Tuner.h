@@ -0,0 +1,94 @@
+#pragma once
+#ifndef TUNER_H
+#define TUNER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Engine.h"
+#include "LanePipeline.h"
+#include "TaskScheduler.h"
+
+namespace Trajectory {
+
+    enum class TuningObjective {
+        RETURN_TO_START,    // the recording ends where it started: distance between the first and the last position / path length
+        REST_AT_ENDS,       // the board lies still at the start and at the end: RMS velocity there / RMS velocity of the whole recording
+    };
+    //the divisors are capped at those of the engine's own run, so a wrong bias can not win by adding motion either
+
+    struct TuningSettings {
+        TuningObjective objective = TuningObjective::RETURN_TO_START;
+        double minCutoff = 0.01;        // Hz, the cutoff is searched on a log scale
+        double maxCutoff = 1.0;         // Hz
+        float maxBias = 0.05f;          // accelerometer units, every axis is searched in [-maxBias, maxBias]
+        float minGravity = 0.95f;       // accelerometer units, magnitude of the gravity vector, its direction is kept
+        float maxGravity = 1.05f;
+        float restSeconds = 1.0f;       // REST_AT_ENDS, still this long at either end
+        int rounds = 6;                 // every round searches around the best so far, in half the span of the previous one
+        size_t candidates = 64;         // per round, rounded up to whole LanePipeline groups
+        uint32_t seed = 1;
+    };
+
+    struct TuningResult {
+        Settings settings;              // of the engine, with the best cutoff, bias and gravity
+        double objective = 0.0;         // of the best parameters, share (dimensionless)
+        double initialObjective = 0.0;  // of the engine settings the search started from
+        size_t evaluations = 0;
+        size_t rows = 0;
+        double seconds = 0.0;
+    };
+
+    /**
+    * @class Tuner
+    * @brief Searches the high-pass cutoff, the accelerometer bias and the gravity magnitude that minimize an objective
+    * over a computed run, without touching the engine.
+    * Candidates are LanePipeline lanes, groups of them are split between the workers; the pipelines are a workspace
+    * kept for the next Run(). The objectives are ratios, so the filter can not win by flattening the whole path.
+    */
+    class Tuner {
+    public:
+        explicit Tuner(TaskScheduler& scheduler = TaskScheduler::Get()) : scheduler(scheduler) {}
+
+        /**
+        * @brief searches around the last Run() of engine, starting from its settings
+        * @return false if engine has nothing computed
+        */
+        bool Run(const Engine& engine, const TuningSettings& settings);
+        /**
+        * @brief frees the workspace
+        */
+        void Clear();
+
+        const TuningResult& GetResult() const { return result; }
+        /**
+        * @brief share of the candidates done, can be read from another thread
+        */
+        float GetProgress() const;
+
+    private:
+        struct Candidate {
+            double cutoff;
+            float bias[3];
+            float gravity;
+            double objective;
+        };
+
+        void Evaluate(const Engine& engine, std::vector<Candidate>& candidates);
+        void Objectives(const LanePipeline& pipeline, double objectives[PIPELINE_LANES]) const;
+
+        TaskScheduler& scheduler;
+        std::vector<LanePipeline> workspaces;
+        TuningSettings settings;
+        TuningResult result;
+        float gravityDirection[3] = { 0.0f, 0.0f, 1.0f };
+        size_t restRows[2] = { 0, 0 };  // rows at the start and at the end, REST_AT_ENDS
+        double referenceMotion = 0.0;   // path length or RMS velocity of the engine's run, cap of the divisors
+        std::atomic<size_t> groupsDone{ 0 };
+        std::atomic<size_t> groupsTotal{ 0 };
+    };
+
+}
+
+#endif // TUNER_H
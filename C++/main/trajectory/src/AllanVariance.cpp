@@ -0,0 +1,234 @@
+#include "AllanVariance.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+//rows per block of the prefix sum, blocks depend only on rows
+#define ALLAN_BLOCK_ROWS 65536
+//clusters per block of the sweep shared by the cluster sizes that start one at every sample, it stays in cache for all of them
+#define ALLAN_SWEEP_ROWS 8192
+//sigma(tau) = B * 0.664 at the flat bottom of the curve (IEEE Std 952)
+#define BIAS_INSTABILITY_FACTOR 0.664
+//slopes accepted as -1/2, white noise
+#define WHITE_SLOPE_MIN -0.6
+#define WHITE_SLOPE_MAX -0.4
+
+namespace Trajectory {
+
+    bool AllanVariance::Run(const Engine& engine, const AllanSettings& settings) {
+        auto start = std::chrono::steady_clock::now();
+        size_t rows = engine.Rows();
+        if (rows < 3 || engine.RawAccelerations().size() < rows * A_SIZE) {
+            return false;
+        }
+        Span<float> raw = engine.RawAccelerations();
+        Span<float> ts = engine.Times();
+
+        double duration = 0.0;
+        for (size_t i = 0; i < rows; i++) duration += ts[i];
+        stats = Stats();
+        stats.rows = rows;
+        stats.sampleTime = duration / rows;
+
+        //cluster sizes from 1 to (rows - 1) / 2, at least two clusters of the largest
+        clusters.clear();
+        size_t maxCluster = (rows - 1) / 2;
+        double perDecade = static_cast<double>(std::max<size_t>(1, settings.tausPerDecade));
+        for (int j = 0; ; j++) {
+            size_t m = static_cast<size_t>(std::llround(std::pow(10.0, j / perDecade)));
+            if (m > maxCluster) break;
+            if (clusters.empty() || m != clusters.back()) clusters.push_back(m);
+        }
+        size_t tauCount = clusters.size();
+        taus.resize(tauCount);
+        for (size_t t = 0; t < tauCount; t++) taus[t] = clusters[t] * stats.sampleTime;
+        deviations.assign(tauCount * A_SIZE, 0.0);
+
+        sweepsDone.store(0);
+        sweepsTotal.store(A_SIZE * (tauCount + 1));
+        samplesPerCluster = settings.samplesPerCluster;
+        size_t denseCount = 0;
+        while (denseCount < tauCount && Stride(clusters[denseCount]) == 1) denseCount++;
+        size_t sweepBlocks = (rows - 2 * clusters[0] + ALLAN_SWEEP_ROWS) / ALLAN_SWEEP_ROWS;
+        std::vector<double> partials(sweepBlocks * denseCount);
+
+        size_t blocks = (rows + ALLAN_BLOCK_ROWS - 1) / ALLAN_BLOCK_ROWS;
+        std::vector<double> blockSums(blocks);
+        sums.resize(rows + 1);
+
+        for (int axis = 0; axis < A_SIZE; axis++) {
+            //prefix sum of the axis minus its mean: block sums, offsets in order, then every block from its offset
+            scheduler.ParallelFor(0, blocks, 1, [&](size_t begin, size_t end) {
+                for (size_t b = begin; b < end; b++) {
+                    size_t last = std::min(rows, (b + 1) * ALLAN_BLOCK_ROWS);
+                    double sum = 0.0;
+                    for (size_t i = b * ALLAN_BLOCK_ROWS; i < last; i++) sum += raw[i * A_SIZE + axis];
+                    blockSums[b] = sum;
+                }
+            });
+            double mean = 0.0;
+            for (double sum : blockSums) mean += sum;
+            mean /= rows;
+            double offset = 0.0;
+            for (size_t b = 0; b < blocks; b++) {
+                size_t count = std::min(rows, (b + 1) * ALLAN_BLOCK_ROWS) - b * ALLAN_BLOCK_ROWS;
+                double sum = blockSums[b] - count * mean;
+                blockSums[b] = offset;
+                offset += sum;
+            }
+            sums[0] = 0.0;
+            scheduler.ParallelFor(0, blocks, 1, [&](size_t begin, size_t end) {
+                double* S = sums.data();
+                for (size_t b = begin; b < end; b++) {
+                    size_t first = b * ALLAN_BLOCK_ROWS, last = std::min(rows, first + ALLAN_BLOCK_ROWS);
+                    double sum = blockSums[b];
+                    for (size_t i = first; i < last; i++) {
+                        sum += raw[i * A_SIZE + axis] - mean;
+                        S[i + 1] = sum;
+                    }
+                }
+            });
+            sweepsDone.fetch_add(1);
+
+            //cluster sizes with a cluster at every sample: one sweep for all of them, in blocks of clusters,
+            //the partial sums of a block are added up in order
+            scheduler.ParallelFor(0, sweepBlocks, 1, [&](size_t begin, size_t end) {
+                for (size_t b = begin; b < end; b++) {
+                    for (size_t t = 0; t < denseCount; t++) {
+                        size_t m = clusters[t];
+                        size_t first = b * ALLAN_SWEEP_ROWS, last = std::min(rows - 2 * m + 1, first + ALLAN_SWEEP_ROWS);
+                        partials[b * denseCount + t] = first < last ? SquaredSum(first, last, 1, m) : 0.0;
+                    }
+                }
+            });
+            for (size_t t = 0; t < denseCount; t++) {
+                size_t m = clusters[t];
+                double sum = 0.0;
+                for (size_t b = 0; b < sweepBlocks; b++) sum += partials[b * denseCount + t];
+                deviations[t * A_SIZE + axis] = std::sqrt(sum / (2.0 * m * m * (rows - 2 * m + 1)));
+            }
+            sweepsDone.fetch_add(denseCount);
+
+            //the rest are short sweeps, one task per cluster size
+            scheduler.ParallelFor(denseCount, tauCount, 1, [&](size_t begin, size_t end) {
+                for (size_t t = begin; t < end; t++) {
+                    size_t m = clusters[t];
+                    size_t stride = Stride(m);
+                    size_t count = (rows - 2 * m) / stride + 1;
+                    deviations[t * A_SIZE + axis] = std::sqrt(SquaredSum(0, count * stride, stride, m) / (2.0 * m * m * count));
+                    sweepsDone.fetch_add(1);
+                }
+            });
+        }
+
+        Characterize();
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    size_t AllanVariance::Stride(size_t m) const {
+        return samplesPerCluster == 0 ? 1 : std::max<size_t>(1, m / samplesPerCluster);
+    }
+
+    double AllanVariance::SquaredSum(size_t begin, size_t end, size_t stride, size_t m) const {
+        const double* S = sums.data();
+        //four independent sums, the loop is not held up by one addition chain
+        double acc[4] = { 0.0, 0.0, 0.0, 0.0 };
+        if (stride == 1) {
+            //three streams, flat loop
+            const double* S0 = S + begin;
+            const double* S1 = S + begin + m;
+            const double* S2 = S + begin + 2 * m;
+            size_t count = end - begin, j = 0;
+            for (; j + 4 <= count; j += 4) {
+                for (size_t u = 0; u < 4; u++) {
+                    double d = S2[j + u] - 2.0 * S1[j + u] + S0[j + u];
+                    acc[u] += d * d;
+                }
+            }
+            for (; j < count; j++) {
+                double d = S2[j] - 2.0 * S1[j] + S0[j];
+                acc[0] += d * d;
+            }
+            return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+        }
+        size_t k = begin;
+        for (; k + 3 * stride < end; k += 4 * stride) {
+            for (size_t u = 0; u < 4; u++) {
+                size_t i = k + u * stride;
+                double d = S[i + 2 * m] - 2.0 * S[i + m] + S[i];
+                acc[u] += d * d;
+            }
+        }
+        for (; k < end; k += stride) {
+            double d = S[k + 2 * m] - 2.0 * S[k + m] + S[k];
+            acc[0] += d * d;
+        }
+        return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+    }
+
+    void AllanVariance::Characterize() {
+        size_t tauCount = taus.size();
+        for (int axis = 0; axis < A_SIZE; axis++) {
+            auto deviation = [&](size_t t) { return deviations[t * A_SIZE + axis]; };
+            stats.sampleNoise[axis] = deviation(0);
+
+            //random walk: sigma(tau) sqrt(tau) on the -1/2 part of the curve, the median of it
+            std::vector<double> walks;
+            for (size_t t = 0; t + 1 < tauCount; t++) {
+                if (deviation(t) <= 0.0 || deviation(t + 1) <= 0.0) continue;
+                double slope = std::log(deviation(t + 1) / deviation(t)) / std::log(taus[t + 1] / taus[t]);
+                if (slope >= WHITE_SLOPE_MIN && slope <= WHITE_SLOPE_MAX) walks.push_back(deviation(t) * std::sqrt(taus[t]));
+            }
+            if (walks.empty()) {
+                stats.randomWalk[axis] = deviation(0) * std::sqrt(taus[0]);
+            }
+            else {
+                std::nth_element(walks.begin(), walks.begin() + walks.size() / 2, walks.end());
+                stats.randomWalk[axis] = walks[walks.size() / 2];
+            }
+
+            size_t lowest = 0;
+            for (size_t t = 1; t < tauCount; t++) {
+                if (deviation(t) < deviation(lowest)) lowest = t;
+            }
+            stats.biasInstability[axis] = deviation(lowest) / BIAS_INSTABILITY_FACTOR;
+            stats.biasInstabilityTau[axis] = taus[lowest];
+        }
+    }
+
+    bool AllanVariance::Save(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error due file creating " << path << std::endl;
+            return false;
+        }
+        file << "tau,adev_x,adev_y,adev_z\n";
+        char line[128];
+        for (size_t t = 0; t < taus.size(); t++) {
+            int length = std::snprintf(line, sizeof(line), "%.9g,%.9g,%.9g,%.9g\n", taus[t],
+                deviations[t * A_SIZE], deviations[t * A_SIZE + 1], deviations[t * A_SIZE + 2]);
+            file.write(line, length);
+        }
+        return file.good();
+    }
+
+    void AllanVariance::Clear() {
+        std::vector<double>().swap(sums);
+        clusters.clear();
+        taus.clear();
+        deviations.clear();
+        stats = Stats();
+        sweepsDone.store(0);
+        sweepsTotal.store(0);
+    }
+
+    float AllanVariance::GetProgress() const {
+        size_t total = sweepsTotal.load();
+        return total == 0 ? 0.0f : static_cast<float>(sweepsDone.load()) / static_cast<float>(total);
+    }
+
+}
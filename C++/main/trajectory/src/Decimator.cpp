@@ -0,0 +1,89 @@
+#include "Decimator.h"
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif // !M_PI
+
+//about 80 dB stop band
+#define DECIMATOR_KAISER_BETA 8.0
+//output rows per task
+#define DECIMATOR_GRAIN 1024
+//accumulators of the dot product, a multiple of A_SIZE and of the vector width
+#define DECIMATOR_LANES 24
+
+namespace Trajectory {
+
+    //modified Bessel function of the first kind, order 0, by its series
+    static double BesselI0(double x) {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 50 && term > 1e-12 * sum; k++) {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    Decimator::Decimator(size_t newFactor) {
+        factor = std::clamp<size_t>(newFactor, 2, DECIMATOR_MAX_FACTOR);
+        size_t length = DECIMATOR_PHASE_TAPS * factor;
+        offset = (length - factor) / 2;
+
+        //center of the block in filter coordinates. The window gives a transition band this wide for its
+        //attenuation and length (Kaiser's design formula); the cutoff is half of it below the output Nyquist
+        //frequency, so the stop band starts there and nothing above it folds back
+        double center = offset + (factor - 1) / 2.0;
+        double attenuation = DECIMATOR_KAISER_BETA / 0.1102 + 8.7;
+        double transition = (attenuation - 7.95) / (14.36 * (length - 1));
+        double cutoff = 0.5 / factor - transition / 2.0;
+        double half = (length - 1) / 2.0;
+        taps.resize(length);
+        double sum = 0.0;
+        for (size_t k = 0; k < length; k++) {
+            double x = k - center;
+            double sinc = x == 0.0 ? 2.0 * cutoff : std::sin(2.0 * M_PI * cutoff * x) / (M_PI * x);
+            double r = std::min(1.0, std::fabs(x) / half);
+            double window = BesselI0(DECIMATOR_KAISER_BETA * std::sqrt(1.0 - r * r)) / BesselI0(DECIMATOR_KAISER_BETA);
+            taps[k] = static_cast<float>(sinc * window);
+            sum += taps[k];
+        }
+        for (float& tap : taps) tap = static_cast<float>(tap / sum);
+
+        interleaved.resize(length * A_SIZE);
+        for (size_t k = 0; k < length; k++) {
+            for (int axis = 0; axis < A_SIZE; axis++) interleaved[k * A_SIZE + axis] = taps[k];
+        }
+    }
+
+    void Decimator::Run(const float* input, size_t rows, float* output, TaskScheduler& scheduler) const {
+        size_t length = taps.size();
+        size_t outputRows = OutputRows(rows);
+        scheduler.ParallelFor(0, outputRows, DECIMATOR_GRAIN, [&](size_t begin, size_t end) {
+            const float* h = interleaved.data();
+            for (size_t n = begin; n < end; n++) {
+                float* out = &output[n * A_SIZE];
+                long long first = static_cast<long long>(n * factor) - static_cast<long long>(offset);
+                if (first >= 0 && static_cast<size_t>(first) + length <= rows) {
+                    //inside: taps and rows are both A_SIZE * length floats, DECIMATOR_LANES accumulators at a time
+                    const float* x = &input[first * A_SIZE];
+                    float acc[DECIMATOR_LANES] = {};
+                    for (size_t j = 0; j < length * A_SIZE; j += DECIMATOR_LANES) {
+                        for (size_t u = 0; u < DECIMATOR_LANES; u++) acc[u] += h[j + u] * x[j + u];
+                    }
+                    out[0] = out[1] = out[2] = 0.0f;
+                    for (size_t u = 0; u < DECIMATOR_LANES; u++) out[u % A_SIZE] += acc[u];
+                    continue;
+                }
+                //ends: rows outside the input repeat the nearest one
+                float sum[A_SIZE] = {};
+                for (size_t k = 0; k < length; k++) {
+                    long long r = std::clamp<long long>(first + static_cast<long long>(k), 0, static_cast<long long>(rows) - 1);
+                    for (int axis = 0; axis < A_SIZE; axis++) sum[axis] += taps[k] * input[r * A_SIZE + axis];
+                }
+                for (int axis = 0; axis < A_SIZE; axis++) out[axis] = sum[axis];
+            }
+        });
+    }
+
+}
@@ -0,0 +1,985 @@
+#include "Engine.h"
+#include "Decimator.h"
+#include "PoseQuery.h"
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string_view>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif // !M_PI
+
+//samples per task for per-sample stages
+#define PARALLEL_GRAIN 4096
+//input text per parse task
+#define PARSE_CHUNK_BYTES (256 * 1024)
+#define MAX_PARSE_CHUNKS 256
+//rows per block of the integration scan
+#define SCAN_BLOCK_ROWS 16384
+#define MAX_SCAN_BLOCKS 256
+//rows per block of the stationary detection, each block starts its window sums anew
+#define STILL_BLOCK_ROWS 16384
+//moving spans per task of the zero velocity update
+#define SPAN_GRAIN 64
+//filters of LoadDecimated(), DECIMATOR_MAX_FACTOR^4 is more than any recording
+#define MAX_DECIMATION_STAGES 4
+//grid rows whose source rows and weights are looked up before the flat interpolation loops
+#define RESAMPLE_BLOCK 256
+
+namespace Trajectory {
+
+    //Parallel sums of the library are split into blocks fixed by the input size, never by the worker count,
+    //and the blocks are added up in order: float addition is not associative, so any other split would change
+    //the last bits with the core count. Rows per block of the integration scan and of the sums over its rows:
+    static size_t ScanBlockRows(size_t rows) {
+        return std::max<size_t>(SCAN_BLOCK_ROWS, (rows + MAX_SCAN_BLOCKS - 1) / MAX_SCAN_BLOCKS);
+    }
+
+    static float ParseFloat(const char* begin, const char* end, const char* errorMessage) {
+        while (begin < end && *begin == ' ') begin++;
+        float value = 0.0f;
+        if (std::from_chars(begin, end, value).ec != std::errc()) {
+            std::cerr << errorMessage << std::string_view(begin, end - begin) << std::endl;
+            return 0.0f;
+        }
+        return value;
+    }
+
+    //calls lineFunction(lineBegin, lineEnd) for every not empty line in [begin, end)
+    template<class F>
+    static void ForEachLine(const char* begin, const char* end, F lineFunction) {
+        while (begin < end) {
+            const char* lineEnd = std::find(begin, end, '\n');
+            const char* next = lineEnd == end ? end : lineEnd + 1;
+            if (lineEnd > begin && lineEnd[-1] == '\r') lineEnd--;
+            if (lineEnd > begin) lineFunction(begin, lineEnd);
+            begin = next;
+        }
+    }
+
+    Engine::Engine(TaskScheduler& scheduler) : scheduler(scheduler) {
+    }
+
+    bool Engine::Load(const std::string& path) {
+        source = path;
+        std::ifstream file;
+        //no stream buffer: the whole file is read straight into the arena
+        file.rdbuf()->pubsetbuf(nullptr, 0);
+        file.open(path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error due file opening " << path << std::endl;
+            arena.Prepare(0);
+            rows = 0;
+            return false;
+        }
+
+        file.seekg(0, std::ios::end);
+        size_t bytes = static_cast<size_t>(file.tellg());
+        file.seekg(0, std::ios::beg);
+        char* text = arena.PrepareText(bytes);
+        file.read(text, bytes);
+        file.close();
+
+        return Parse();
+    }
+
+    bool Engine::LoadFromMemory(const char* text, size_t bytes) {
+        source = "<memory>";
+        std::copy(text, text + bytes, arena.PrepareText(bytes));
+        return Parse();
+    }
+
+    bool Engine::LoadDecimated(const Engine& full, size_t factor) {
+        source = full.source;
+        factor = std::max<size_t>(1, factor);
+        resampled = false;
+        fused = false;
+        uniformStep = 0.0f;
+
+        //as few stages as DECIMATOR_MAX_FACTOR allows, about the same factor each
+        size_t stages[MAX_DECIMATION_STAGES];
+        size_t stageCount = 0;
+        while (std::pow(static_cast<double>(DECIMATOR_MAX_FACTOR), static_cast<double>(stageCount)) < factor &&
+            stageCount < MAX_DECIMATION_STAGES) {
+            stageCount++;
+        }
+        size_t total = 1;
+        for (size_t s = 0, rest = factor; s < stageCount; s++) {
+            stages[s] = std::min<size_t>(DECIMATOR_MAX_FACTOR,
+                static_cast<size_t>(std::ceil(std::pow(static_cast<double>(rest), 1.0 / (stageCount - s)) - 1e-9)));
+            rest = (rest + stages[s] - 1) / stages[s];
+            total *= stages[s];
+        }
+        rows = (full.rows + total - 1) / total;
+
+        arena.Prepare(rows);
+        arena.ts.resize(rows * T_SIZE);
+        arena.qs.resize(rows * Q_SIZE);
+        arena.raw.resize(rows * A_SIZE);
+
+        //stage by stage, as and pos are free until Run()
+        auto decimate = [&](const std::vector<float>& source, std::vector<float>& target) {
+            if (stageCount == 0) {
+                target = source;
+                return;
+            }
+            const float* input = source.data();
+            size_t inputRows = full.rows;
+            for (size_t s = 0; s < stageCount; s++) {
+                Decimator decimator(stages[s]);
+                std::vector<float>& output = s + 1 == stageCount ? target : (s % 2 == 0 ? arena.as : arena.pos);
+                output.resize(decimator.OutputRows(inputRows) * A_SIZE);
+                decimator.Run(input, inputRows, output.data(), scheduler);
+                input = output.data();
+                inputRows = decimator.OutputRows(inputRows);
+            }
+        };
+        decimate(full.arena.raw, arena.raw);
+        //rotation rates of the same rows only, a resampled full has them at the loaded ones
+        if (full.arena.gyro.size() == full.rows * GYRO_SIZE && !full.arena.gyro.empty()) {
+            decimate(full.arena.gyro, arena.gyro);
+        }
+
+        scheduler.ParallelFor(0, rows, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t row = begin; row < end; row++) {
+                size_t first = row * total;
+                size_t last = std::min(first + total, full.rows);
+                float dt = 0.0f;
+                for (size_t i = first; i < last; i++) dt += full.arena.ts[i];
+                arena.ts[row] = dt;
+                size_t middle = first + (last - first) / 2;
+                std::copy_n(&full.arena.qs[middle * Q_SIZE], Q_SIZE, &arena.qs[row * Q_SIZE]);
+            }
+        });
+
+        progressTotal.store(std::max<size_t>(1, rows * STAGE_COUNT));
+        progress.store(rows);
+        return rows != 0;
+    }
+
+    bool Engine::Parse() {
+        const char* const begin = arena.text.data();
+        const char* const end = begin + arena.text.size();
+        //skip header
+        const char* body = std::find(begin, end, '\n');
+        body = body == end ? end : body + 1;
+
+        //chunks start right after a line break, so every line belongs to exactly one chunk
+        size_t chunkCount = std::min<size_t>(MAX_PARSE_CHUNKS, std::max<size_t>(1, (end - body) / PARSE_CHUNK_BYTES));
+        const char* chunkBegin[MAX_PARSE_CHUNKS + 1];
+        size_t chunkFirstRow[MAX_PARSE_CHUNKS + 1];
+        chunkBegin[0] = body;
+        for (size_t c = 1; c < chunkCount; c++) {
+            const char* split = std::max(chunkBegin[c - 1], body + (end - body) * c / chunkCount);
+            split = std::find(split, end, '\n');
+            chunkBegin[c] = split == end ? end : split + 1;
+        }
+        chunkBegin[chunkCount] = end;
+
+        //1. rows of every chunk
+        scheduler.ParallelFor(0, chunkCount, 1, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last; c++) {
+                size_t count = 0;
+                ForEachLine(chunkBegin[c], chunkBegin[c + 1], [&count](const char*, const char*) { count++; });
+                chunkFirstRow[c + 1] = count;
+            }
+        });
+        chunkFirstRow[0] = 0;
+        for (size_t c = 1; c <= chunkCount; c++) {
+            chunkFirstRow[c] += chunkFirstRow[c - 1];
+        }
+        rows = chunkFirstRow[chunkCount];
+        resampled = false;
+        fused = false;
+        uniformStep = 0.0f;
+
+        //gyroscope columns if the first row has them
+        const char* firstLine = std::find(body, end, '\n');
+        bool hasGyro = static_cast<size_t>(std::count(body, firstLine, ',')) >= T_SIZE + Q_SIZE + A_SIZE + GYRO_SIZE - 1;
+
+        arena.Prepare(rows);
+        arena.ts.resize(rows * T_SIZE);
+        arena.qs.resize(rows * Q_SIZE);
+        arena.raw.resize(rows * A_SIZE);
+        if (hasGyro) arena.gyro.resize(rows * GYRO_SIZE);
+
+        //2. every chunk knows its first row, so they are parsed independently
+        scheduler.ParallelFor(0, chunkCount, 1, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last; c++) {
+                size_t row = chunkFirstRow[c];
+                ForEachLine(chunkBegin[c], chunkBegin[c + 1], [this, &row](const char* lineBegin, const char* lineEnd) {
+                    ParseRow(row++, lineBegin, lineEnd);
+                });
+            }
+        });
+
+        progressTotal.store(std::max<size_t>(1, rows * STAGE_COUNT));
+        progress.store(rows);
+        return true;
+    }
+
+    void Engine::ParseRow(size_t row, const char* begin, const char* end) {
+        int column = 0;
+        const char* token = begin;
+        float* q = &arena.qs[row * Q_SIZE];
+        float* a = &arena.raw[row * A_SIZE];
+        float* g = arena.gyro.empty() ? nullptr : &arena.gyro[row * GYRO_SIZE];
+        int columns = T_SIZE + Q_SIZE + A_SIZE + (g ? GYRO_SIZE : 0);
+
+        while (token <= end && column < columns) {
+            const char* comma = std::find(token, end, ',');
+            // 0 is delta time
+            if (column == 0) {
+                unsigned long long time = 0;
+                if (std::from_chars(token, comma, time).ec != std::errc()) {
+                    std::cerr << "Error parsing time (microseconds) in file: " << source << std::endl;
+                    time = 0;
+                }
+                arena.ts[row] = time / 1000.0f;
+            }
+            else if (column >= T_SIZE && column <= Q_SIZE) {
+                // Columns 1-4 go to qs
+                q[column - T_SIZE] = ParseFloat(token, comma, "Quarantion conversion error ");
+            }
+            else if (column < T_SIZE + Q_SIZE + A_SIZE) {
+                // Columns 5-7 go to raw accelerations
+                a[column - T_SIZE - Q_SIZE] = ParseFloat(token, comma, "Acceliration conversion error ");
+            }
+            else {
+                // Columns 8-10 go to the gyroscope
+                g[column - T_SIZE - Q_SIZE - A_SIZE] = ParseFloat(token, comma, "Gyroscope conversion error ");
+            }
+            column++;
+            token = comma + 1;
+        }
+        //short row leaves zeros from Prepare in the missing columns
+    }
+
+    bool Engine::Run() {
+        if (!RunShared()) return false;
+        progressTotal.store(rows * STAGE_COUNT);
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            arena.methodVs[m].clear();
+            arena.methodPos[m].clear();
+        }
+
+        //5. Velocity calculation
+        Integrate(arena.as, arena.vs);
+        Export(arena.vs, 3, "vx,vy,vz", "5_raw_velocity.csv");
+
+        //6. Drift compensation: high-pass, then zero velocity where the board is still
+        double nyQuist = 0.5f * sampleRate;
+        double normalCutoff = settings.filterCutoff / nyQuist;
+        if (settings.highPass) HighPass3DFilter(arena.vs, normalCutoff);
+        if (settings.zeroVelocity) ZeroVelocity(arena.vs);
+        progress.fetch_add(rows);
+        Export(arena.vs, 3, "vx,vy,vz", "6_filtered_velocity.csv");
+
+        //7. Position calculation, still spans do not move
+        Integrate(arena.vs, arena.pos, settings.zeroVelocity);
+        Export(arena.pos, 3, "px,py,pz", "7_raw_position.csv");
+
+        //8. Position filtration
+        if (settings.highPass) HighPass3DFilter(arena.pos, normalCutoff);
+        progress.fetch_add(rows);
+        Export(arena.pos, 3, "px,py,pz", "8_filtered_position.csv");
+        return true;
+    }
+
+    bool Engine::RunComparison() {
+        if (!RunShared()) return false;
+        //stages 5-8 once per method
+        progressTotal.store(rows * (STAGE_COUNT - 4 + 4 * METHOD_COUNT));
+
+        //5. Velocity of every method from one sweep over the accelerations
+        const std::vector<float>* accelerations[METHOD_COUNT];
+        const std::vector<float>* velocities[METHOD_COUNT];
+        std::vector<float>* velocityOutputs[METHOD_COUNT];
+        std::vector<float>* positionOutputs[METHOD_COUNT];
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            accelerations[m] = &arena.as;
+            velocities[m] = &arena.methodVs[m];
+            velocityOutputs[m] = &arena.methodVs[m];
+            positionOutputs[m] = &arena.methodPos[m];
+        }
+        IntegrateMethods(accelerations, velocityOutputs);
+
+        //6. Drift compensation
+        double nyQuist = 0.5f * sampleRate;
+        double normalCutoff = settings.filterCutoff / nyQuist;
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            if (settings.highPass) HighPass3DFilter(arena.methodVs[m], normalCutoff);
+            if (settings.zeroVelocity) ZeroVelocity(arena.methodVs[m]);
+            progress.fetch_add(rows);
+        }
+
+        //7. Position of every method, each from its own velocity
+        IntegrateMethods(velocities, positionOutputs);
+
+        //8. Position filtration
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            if (settings.highPass) HighPass3DFilter(arena.methodPos[m], normalCutoff);
+            progress.fetch_add(rows);
+        }
+
+        //the selected method is also the regular result
+        int selected = static_cast<int>(settings.method);
+        arena.vs = arena.methodVs[selected];
+        arena.pos = arena.methodPos[selected];
+        return true;
+    }
+
+    //0. orientation and resampling, 1. check, 2.-4. rotation, tilt and gravity compensation, the part every integration method shares
+    bool Engine::RunShared() {
+        //0. Orientation and uniform time grid, always from the loaded rows
+        RestoreLoaded();
+        if (settings.fuse) {
+            if (!Fuse()) {
+                std::cerr << "No gyroscope data to fuse!\n";
+                return false;
+            }
+        }
+        else {
+            RestoreRecorded();
+        }
+        if (settings.resample) {
+            if (!Resample()) {
+                std::cerr << "Not enough data!\n";
+                return false;
+            }
+        }
+        //integration needs a step between two rows
+        if (rows < 2) {
+            std::cerr << "Not enough data!\n";
+            return false;
+        }
+        progressTotal.store(rows * STAGE_COUNT);
+        progress.store(2 * rows);
+        Export(arena.raw, 3, "ax,ay,az", "1_raw_acc.csv");
+        Export(arena.ts, 1, "delta_t", "1_delta_t.csv");
+        Export(arena.qs, 4, "qw,qx,qy,qz", "1_raw_quarant.csv");
+
+        //2. Calculate rotation matrices
+        arena.Rs.resize(rows * R_SIZE);
+        ForEachSample(&Engine::ComputeRotationMatrix);
+        Export(arena.Rs, 9, "R11,R12,R13,R21,R22,R23,R31,R32,R33", "2_R.csv");
+
+        //3. Tilt compensation, raw input is kept for the next run
+        arena.as.resize(rows * A_SIZE);
+        ForEachSample(&Engine::TiltCompensateA);
+        Export(arena.as, 3, "ax,ay,az", "3_rot_comp_acc.csv");
+
+        //4. Convert to linear velocity
+        ForEachSample(&Engine::CompensateGravity);
+        Export(arena.as, 3, "ax,ay,az", "4_g_comp_acc.csv");
+
+        //for 4a. and 6.
+        sampleRate = std::accumulate(arena.ts.begin(), arena.ts.end(), 0.0);
+        sampleRate = 1.0 / (sampleRate / rows);
+
+        //4a. Stationary detection for 6.
+        if (settings.zeroVelocity) {
+            DetectStationary();
+        }
+        else {
+            arena.motion.clear();
+            arena.still.clear();
+            arena.spans.clear();
+            stationaryRows = 0;
+        }
+        progress.fetch_add(rows);
+        return true;
+    }
+
+    bool Engine::Resample() {
+        //the loaded rows go to the source buffers, every run resamples them anew
+        if (!resampled) {
+            std::swap(arena.ts, arena.sourceTs);
+            std::swap(arena.qs, arena.sourceQs);
+            std::swap(arena.raw, arena.sourceRaw);
+            sourceRows = rows;
+            resampled = true;
+        }
+        size_t count = sourceRows;
+        if (count < 2) {
+            rows = 0;
+            return false;
+        }
+
+        //monotonic time base: ts holds the step before every row, negative steps count as 0. Rows stamped
+        //with the time of the row before them (0 ms steps of the recorder) are spread evenly between the previous
+        //stamp and theirs, so every row keeps its own time and none of them is lost
+        const float* ts = arena.sourceTs.data();
+        arena.scratch.resize(count);
+        double* times = arena.scratch.data();
+        times[0] = 0.0;
+        for (size_t i = 1; i < count; i++) times[i] = times[i - 1] + std::max(0.0f, ts[i]);
+        double duration = times[count - 1];
+        if (duration <= 0.0) {
+            rows = 0;
+            return false;
+        }
+        double meanStep = duration / (count - 1);
+        for (size_t i = 0; i < count; ) {
+            size_t last = i;
+            while (last + 1 < count && times[last + 1] == times[i]) last++;
+            if (last > i) {
+                double stamp = times[i];
+                double previous = i > 0 ? times[i - 1] : stamp - (last - i + 1) * meanStep;
+                for (size_t j = i; j <= last; j++) times[j] = previous + (stamp - previous) * (j - i + 1) / (last - i + 1);
+            }
+            i = last + 1;
+        }
+
+        //uniform grid over the same span
+        double start = times[0];
+        duration = times[count - 1] - start;
+        double rate = settings.resampleRate > 0.0 ? settings.resampleRate : (count - 1) / duration;
+        double step = 1.0 / rate;
+        rows = static_cast<size_t>(duration * rate + 1e-9) + 1;
+        uniformStep = static_cast<float>(step);
+        arena.ts.assign(rows * T_SIZE, uniformStep);
+        arena.qs.resize(rows * Q_SIZE);
+        arena.raw.resize(rows * A_SIZE);
+
+        bool cubic = settings.interpolation == Interpolation::CUBIC;
+        scheduler.ParallelFor(0, rows, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+            const float* q = arena.sourceQs.data();
+            const float* a = arena.sourceRaw.data();
+            float* outQ = arena.qs.data();
+            float* outA = arena.raw.data();
+            //source row before every grid row and the weights of the rows around it
+            size_t index[RESAMPLE_BLOCK];
+            float fraction[RESAMPLE_BLOCK];
+            float weights[RESAMPLE_BLOCK][4];
+            size_t i = static_cast<size_t>(std::upper_bound(times, times + count, start + begin * step) - times);
+            i = std::min(i > 0 ? i - 1 : 0, count - 2);
+            for (size_t blockBegin = begin; blockBegin < end; blockBegin += RESAMPLE_BLOCK) {
+                size_t blockCount = std::min<size_t>(RESAMPLE_BLOCK, end - blockBegin);
+                for (size_t k = 0; k < blockCount; k++) {
+                    double t = start + (blockBegin + k) * step;
+                    while (i + 2 < count && times[i + 1] <= t) i++;
+                    double h = times[i + 1] - times[i];
+                    double u = std::clamp((t - times[i]) / h, 0.0, 1.0);
+                    index[k] = i;
+                    fraction[k] = static_cast<float>(u);
+                    if (!cubic) {
+                        weights[k][0] = 0.0f;
+                        weights[k][1] = static_cast<float>(1.0 - u);
+                        weights[k][2] = static_cast<float>(u);
+                        weights[k][3] = 0.0f;
+                        continue;
+                    }
+                    //Hermite basis with slopes (a[i + 1] - a[i - 1]) / (t[i + 1] - t[i - 1]), one-sided at the ends,
+                    //written as weights of rows i - 1 .. i + 2
+                    double h00 = (1.0 + 2.0 * u) * (1.0 - u) * (1.0 - u), h10 = u * (1.0 - u) * (1.0 - u);
+                    double h01 = u * u * (3.0 - 2.0 * u), h11 = u * u * (u - 1.0);
+                    size_t before = i > 0 ? i - 1 : i, after = std::min(i + 2, count - 1);
+                    double s0 = h10 * h / (times[i + 1] - times[before]), s1 = h11 * h / (times[after] - times[i]);
+                    double w[4] = { -s0, h00 - s1, h01 + s0, s1 };
+                    //one-sided slopes use the row itself instead of the missing neighbour
+                    if (before == i) {
+                        w[1] += w[0];
+                        w[0] = 0.0;
+                    }
+                    if (after == i + 1) {
+                        w[2] += w[3];
+                        w[3] = 0.0;
+                    }
+                    for (int c = 0; c < 4; c++) weights[k][c] = static_cast<float>(w[c]);
+                }
+
+                //accelerations, a flat loop over the weights
+                for (size_t k = 0; k < blockCount; k++) {
+                    size_t r = index[k];
+                    const float* a0 = &a[(r > 0 ? r - 1 : r) * A_SIZE];
+                    const float* a1 = &a[r * A_SIZE];
+                    const float* a2 = &a[(r + 1) * A_SIZE];
+                    const float* a3 = &a[std::min(r + 2, count - 1) * A_SIZE];
+                    const float* w = weights[k];
+                    float* out = &outA[(blockBegin + k) * A_SIZE];
+                    for (int c = 0; c < A_SIZE; c++) out[c] = w[0] * a0[c] + w[1] * a1[c] + w[2] * a2[c] + w[3] * a3[c];
+                }
+
+                //quaternions, shortest arc
+                for (size_t k = 0; k < blockCount; k++) {
+                    const float* q0 = &q[index[k] * Q_SIZE];
+                    PoseQuery::Slerp(q0, q0 + Q_SIZE, fraction[k], &outQ[(blockBegin + k) * Q_SIZE]);
+                }
+            }
+        });
+        return true;
+    }
+
+    void Engine::RestoreLoaded() {
+        if (!resampled) return;
+        std::swap(arena.ts, arena.sourceTs);
+        std::swap(arena.qs, arena.sourceQs);
+        std::swap(arena.raw, arena.sourceRaw);
+        rows = sourceRows;
+        resampled = false;
+        uniformStep = 0.0f;
+    }
+
+    bool Engine::Fuse() {
+        if (rows == 0 || arena.gyro.size() < rows * GYRO_SIZE) return false;
+        //the recorded quaternions go aside once, every run fuses anew
+        if (!fused) {
+            std::swap(arena.qs, arena.recordedQs);
+            arena.qs.resize(rows * Q_SIZE);
+            fused = true;
+        }
+
+        //one sensor is one sequence, so a single lane on this thread; it starts level from the first
+        //accelerometer row with yaw 0, the DMP does the same when it starts
+        Fusion fusion(settings.fusion);
+        fusion.Align(0, arena.raw.data());
+        fusion.Run(arena.ts.data(), arena.gyro.data(), arena.raw.data(), rows, arena.qs.data());
+        return true;
+    }
+
+    void Engine::RestoreRecorded() {
+        if (!fused) return;
+        std::swap(arena.qs, arena.recordedQs);
+        fused = false;
+    }
+
+    Span<float> Engine::MethodPositions(IntegrationMethod method) const {
+        const std::vector<float>& buffer = arena.methodPos[static_cast<int>(method)];
+        return Span<float>(buffer.data(), buffer.size());
+    }
+
+    Span<float> Engine::MethodVelocities(IntegrationMethod method) const {
+        const std::vector<float>& buffer = arena.methodVs[static_cast<int>(method)];
+        return Span<float>(buffer.data(), buffer.size());
+    }
+
+    Divergence Engine::MethodDivergence(IntegrationMethod method, IntegrationMethod reference) const {
+        Divergence divergence;
+        Span<float> a = MethodPositions(method), b = MethodPositions(reference);
+        size_t count = std::min(a.size(), b.size()) / INTEGRATION_SIZE;
+        if (count == 0) return divergence;
+
+        //partial results per block, added up in order
+        size_t blockRows = ScanBlockRows(count);
+        size_t blocks = (count + blockRows - 1) / blockRows;
+        double squares[MAX_SCAN_BLOCKS], lengths[MAX_SCAN_BLOCKS];
+        float maxima[MAX_SCAN_BLOCKS];
+        scheduler.ParallelFor(0, blocks, 1, [&](size_t begin, size_t end) {
+            for (size_t block = begin; block < end; block++) {
+                double squareSum = 0.0, length = 0.0;
+                float maximum = 0.0f;
+                size_t last = std::min(count, (block + 1) * blockRows);
+                for (size_t i = block * blockRows; i < last; i++) {
+                    const float* p = &a[i * INTEGRATION_SIZE];
+                    const float* q = &b[i * INTEGRATION_SIZE];
+                    float d[3] = { p[0] - q[0], p[1] - q[1], p[2] - q[2] };
+                    float squared = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+                    squareSum += squared;
+                    maximum = std::max(maximum, squared);
+                    if (i > 0) {
+                        float s[3] = { p[0] - p[-3], p[1] - p[-2], p[2] - p[-1] };
+                        length += std::sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+                    }
+                }
+                squares[block] = squareSum;
+                lengths[block] = length;
+                maxima[block] = maximum;
+            }
+        });
+
+        double squareSum = 0.0, length = 0.0;
+        float maximum = 0.0f;
+        for (size_t block = 0; block < blocks; block++) {
+            squareSum += squares[block];
+            length += lengths[block];
+            maximum = std::max(maximum, maxima[block]);
+        }
+        const float* p = &a[(count - 1) * INTEGRATION_SIZE];
+        const float* q = &b[(count - 1) * INTEGRATION_SIZE];
+        divergence.maxDistance = std::sqrt(maximum);
+        divergence.rmsDistance = static_cast<float>(std::sqrt(squareSum / count));
+        divergence.endDistance = std::sqrt((p[0] - q[0]) * (p[0] - q[0]) + (p[1] - q[1]) * (p[1] - q[1]) + (p[2] - q[2]) * (p[2] - q[2]));
+        divergence.pathLength = static_cast<float>(length);
+        return divergence;
+    }
+
+    float Engine::GetProgress() const {
+        return static_cast<float>(progress.load()) / static_cast<float>(progressTotal.load());
+    }
+
+    void Engine::Release() {
+        arena.Release();
+        rows = 0;
+        resampled = false;
+        fused = false;
+        uniformStep = 0.0f;
+        progress.store(0);
+    }
+
+    void Engine::Export(const std::vector<float>& data, int stride, const char* header, const char* name) {
+        if (exporter) exporter->Submit(data, stride, header, name);
+    }
+
+    void Engine::ComputeRotationMatrix(size_t i) {
+        const float w = arena.qs[i * Q_SIZE];
+        const float x = arena.qs[i * Q_SIZE + 1];
+        const float y = arena.qs[i * Q_SIZE + 2];
+        const float z = arena.qs[i * Q_SIZE + 3];
+
+        //quaternions to rotation matrix
+        float* R = &arena.Rs[i * R_SIZE];
+        R[0] = 1.0f - 2.0f * pow(y, 2) - 2.0f * pow(z, 2);  R[1] = 2.0f * x * y - 2.0f * z * w;                 R[2] = 2.0f * x * z + 2.0f * y * w;
+        R[3] = 2.0f * x * y + 2.0f * z * w;                 R[4] = 1.0f - 2.0f * pow(x, 2) - 2.0f * pow(z, 2);  R[5] = 2.0f * y * z - 2.0f * x * w;
+        R[6] = 2.0f * x * z - 2.0f * y * w;                 R[7] = 2.0f * y * z + 2.0f * x * w;                 R[8] = 1.0f - 2.0f * pow(x, 2) - 2.0f * pow(y, 2);
+    }
+
+    void Engine::TiltCompensateA(size_t i) {
+        const float* R = &arena.Rs[i * R_SIZE];
+        const float* in = &arena.raw[i * A_SIZE];
+        float* a = &arena.as[i * A_SIZE];
+
+        const float ax = in[0] - settings.accelBias[0], ay = in[1] - settings.accelBias[1], az = in[2] - settings.accelBias[2];
+
+        // R x a
+        a[0] = R[0] * ax + R[1] * ay + R[2] * az;
+        a[1] = R[3] * ax + R[4] * ay + R[5] * az;
+        a[2] = R[6] * ax + R[7] * ay + R[8] * az;
+    }
+
+    void Engine::CompensateGravity(size_t i) {
+        //basicly here first two row: value - 0, but what if gravity direction will change?
+        float* a = &arena.as[i * A_SIZE];
+        a[0] -= settings.gravityVector[0];
+        a[1] -= settings.gravityVector[1];
+        a[2] -= settings.gravityVector[2];
+
+        //convert to metrs per second
+        a[0] *= settings.g;
+        a[1] *= settings.g;
+        a[2] *= settings.g;
+    }
+
+    void Engine::DetectStationary() {
+        arena.motion.resize(rows * MOTION_SIZE);
+        arena.still.resize(rows);
+
+        //rotation rate of every row from the previous one, a flat loop
+        scheduler.ParallelFor(1, rows, PARALLEL_GRAIN, [this](size_t begin, size_t end) {
+            const float* q = arena.qs.data();
+            const float* t = arena.ts.data();
+            float* rate = arena.motion.data();
+            for (size_t i = begin; i < end; i++) {
+                const float* a = &q[(i - 1) * Q_SIZE];
+                const float* b = &q[i * Q_SIZE];
+                float dot = std::fabs(a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3]);
+                //angle = 2 asin(sin(angle / 2)), close to 2 sin(angle / 2) for the small turns between samples
+                float half = std::sqrt(std::max(0.0f, 1.0f - dot * dot));
+                rate[i] = t[i] > 0.0f ? 2.0f * half / t[i] : 0.0f;
+            }
+        });
+        arena.motion[0] = rows > 1 ? arena.motion[1] : 0.0f;
+
+        //centered window, shorter at the ends. Variance of the input vector (sum over the axes, |a| alone hardly
+        //changes with a move across gravity) and the mean rate come from running sums, O(1) per row;
+        //every block starts them anew from its first row, so a row does not depend on how far the sums ran before it
+        size_t half = static_cast<size_t>(settings.stationaryWindow * sampleRate / 2.0);
+        size_t blocks = (rows + STILL_BLOCK_ROWS - 1) / STILL_BLOCK_ROWS;
+        double maxVariance = static_cast<double>(settings.stationaryAccel) * settings.stationaryAccel;
+        double maxRate = settings.stationaryRate;
+        scheduler.ParallelFor(0, blocks, 1, [&](size_t begin, size_t end) {
+            const float* in = arena.raw.data();
+            const float* rates = arena.motion.data();
+            uint8_t* still = arena.still.data();
+            for (size_t b = begin; b < end; b++) {
+                size_t first = b * STILL_BLOCK_ROWS, last = std::min(rows, first + STILL_BLOCK_ROWS);
+                //sums of the input minus the first row of the block, less cancellation
+                double reference[A_SIZE] = { in[first * A_SIZE], in[first * A_SIZE + 1], in[first * A_SIZE + 2] };
+                double sums[A_SIZE] = {}, squares = 0.0, rate = 0.0;
+                auto add = [&](size_t j, double sign) {
+                    for (int k = 0; k < A_SIZE; k++) {
+                        double d = in[j * A_SIZE + k] - reference[k];
+                        sums[k] += sign * d;
+                        squares += sign * d * d;
+                    }
+                    rate += sign * rates[j];
+                };
+                size_t low = first > half ? first - half : 0, high = std::min(rows, first + half + 1);
+                for (size_t j = low; j < high; j++) add(j, 1.0);
+                for (size_t i = first; i < last; i++) {
+                    double n = static_cast<double>(high - low);
+                    double variance = squares / n;
+                    for (int k = 0; k < A_SIZE; k++) variance -= (sums[k] / n) * (sums[k] / n);
+                    still[i] = variance <= maxVariance && rate / n <= maxRate ? 1 : 0;
+                    //slide: row i + half + 1 comes in, row i - half goes out
+                    if (high < rows) add(high++, 1.0);
+                    if (i >= half) add(low++, -1.0);
+                }
+            }
+        });
+
+        //moving spans for 6., in order
+        arena.spans.clear();
+        stationaryRows = 0;
+        for (size_t i = 0; i < rows; i++) {
+            if (arena.still[i]) {
+                stationaryRows++;
+                continue;
+            }
+            size_t begin = i;
+            while (i < rows && !arena.still[i]) i++;
+            arena.spans.push_back(begin);
+            arena.spans.push_back(i);
+            i--;
+        }
+    }
+
+    void Engine::ZeroVelocity(std::vector<float>& velocity) {
+        //every moving span is measured from the still row before it and, if a still row ends it,
+        //its residual velocity there is taken out linearly in time; spans only read still rows, so they run in parallel
+        size_t spanCount = arena.spans.size() / 2;
+        scheduler.ParallelFor(0, spanCount, SPAN_GRAIN, [&](size_t begin, size_t end) {
+            float* v = velocity.data();
+            const float* t = arena.ts.data();
+            for (size_t s = begin; s < end; s++) {
+                size_t first = arena.spans[s * 2], last = arena.spans[s * 2 + 1];
+                double anchor[3] = { 0.0, 0.0, 0.0 }, residual[3] = { 0.0, 0.0, 0.0 };
+                if (first > 0) {
+                    for (int k = 0; k < 3; k++) anchor[k] = v[(first - 1) * 3 + k];
+                }
+                double duration = 0.0;
+                if (last < rows) {
+                    for (size_t i = first; i <= last; i++) duration += t[i];
+                    for (int k = 0; k < 3; k++) residual[k] = v[last * 3 + k] - anchor[k];
+                }
+                double scale = duration > 0.0 ? 1.0 / duration : 0.0;
+                double time = 0.0;
+                for (size_t i = first; i < last; i++) {
+                    time += t[i];
+                    double ramp = time * scale;
+                    for (int k = 0; k < 3; k++) {
+                        v[i * 3 + k] = static_cast<float>(v[i * 3 + k] - anchor[k] - residual[k] * ramp);
+                    }
+                }
+            }
+        });
+
+        scheduler.ParallelFor(0, rows, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+            float* v = velocity.data();
+            const uint8_t* still = arena.still.data();
+            for (size_t i = begin; i < end; i++) {
+                float keep = still[i] ? 0.0f : 1.0f;
+                v[i * 3] *= keep;
+                v[i * 3 + 1] *= keep;
+                v[i * 3 + 2] *= keep;
+            }
+        });
+    }
+
+    void Engine::ForEachSample(void (Engine::*stage)(size_t)) {
+        scheduler.ParallelFor(0, rows, PARALLEL_GRAIN, [this, stage](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                (this->*stage)(i);
+            }
+            progress.fetch_add(end - begin);
+        });
+    }
+
+    Engine::IntegrationStep Engine::StepOf(IntegrationMethod method) {
+        switch (method)
+        {
+        case IntegrationMethod::SQUARES:
+            return &Engine::SquaresIntegration;
+        case IntegrationMethod::TRAPEZOID:
+            return &Engine::TrapezoidIntegration;
+        case IntegrationMethod::RUNGE_KUTTA:
+            return &Engine::RungeKuttaIntegration;
+        default:
+            return &Engine::SquaresIntegration;
+        }
+    }
+
+    void Engine::Integrate(const std::vector<float>& input, std::vector<float>& output, bool skipStill) {
+        IntegrationStep step = StepOf(settings.method);
+
+        output.resize(rows * INTEGRATION_SIZE);
+        output[0] = output[1] = output[2] = 0.0f;
+        progress.fetch_add(1);
+
+        //every step only needs the input, so all of them are computed at once...
+        const uint8_t* still = skipStill && arena.still.size() == rows ? arena.still.data() : nullptr;
+        if (uniformStep > 0.0f && !still && settings.method != IntegrationMethod::RUNGE_KUTTA) {
+            //one dt after resampling: flat loops over all floats, the same results as the steps below
+            const float dt = uniformStep;
+            bool trapezoid = settings.method == IntegrationMethod::TRAPEZOID;
+            scheduler.ParallelFor(1, rows, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+                const float* in = input.data();
+                float* out = output.data();
+                if (trapezoid) {
+                    for (size_t j = begin * 3; j < end * 3; j++) out[j] = (in[j - 3] + in[j]) * dt / 2.0f;
+                }
+                else {
+                    for (size_t j = begin * 3; j < end * 3; j++) out[j] = in[j] * dt;
+                }
+                progress.fetch_add(end - begin);
+            });
+            PrefixSum(output);
+            return;
+        }
+        scheduler.ParallelFor(1, rows, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                //input is 0 on both ends of a step between still rows
+                if (still && still[i] && still[i - 1]) {
+                    output[i * 3] = output[i * 3 + 1] = output[i * 3 + 2] = 0.0f;
+                    continue;
+                }
+                (this->*step)(i, input, output);
+            }
+            progress.fetch_add(end - begin);
+        });
+
+        //...and summed up
+        PrefixSum(output);
+    }
+
+    void Engine::IntegrateMethods(const std::vector<float>* const inputs[METHOD_COUNT], std::vector<float>* const outputs[METHOD_COUNT]) {
+        IntegrationStep steps[METHOD_COUNT];
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            steps[m] = StepOf(static_cast<IntegrationMethod>(m));
+            outputs[m]->resize(rows * INTEGRATION_SIZE);
+            (*outputs[m])[0] = (*outputs[m])[1] = (*outputs[m])[2] = 0.0f;
+        }
+        progress.fetch_add(METHOD_COUNT);
+
+        //one pass over the rows for all methods: a chunk of input and ts is loaded once and used by every step
+        scheduler.ParallelFor(1, rows, PARALLEL_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) {
+                for (int m = 0; m < METHOD_COUNT; m++) {
+                    (this->*steps[m])(i, *inputs[m], *outputs[m]);
+                }
+            }
+            progress.fetch_add((end - begin) * METHOD_COUNT);
+        });
+
+        for (int m = 0; m < METHOD_COUNT; m++) {
+            PrefixSum(*outputs[m]);
+        }
+    }
+
+    void Engine::PrefixSum(std::vector<float>& output) {
+        //blocked parallel scan: every block sums up on its own, then gets the total of the blocks before it
+        size_t blockRows = ScanBlockRows(rows);
+        size_t blocks = (rows + blockRows - 1) / blockRows;
+        float blockSums[MAX_SCAN_BLOCKS][INTEGRATION_SIZE];
+
+        scheduler.ParallelFor(0, blocks, 1, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++) {
+                size_t last = std::min(rows, (b + 1) * blockRows);
+                float* out = output.data();
+                for (size_t i = b * blockRows + 1; i < last; i++) {
+                    out[i * 3] += out[(i - 1) * 3];
+                    out[i * 3 + 1] += out[(i - 1) * 3 + 1];
+                    out[i * 3 + 2] += out[(i - 1) * 3 + 2];
+                }
+                for (int k = 0; k < INTEGRATION_SIZE; k++) {
+                    blockSums[b][k] = out[(last - 1) * 3 + k];
+                }
+            }
+        });
+
+        for (size_t b = 1; b < blocks; b++) {
+            for (int k = 0; k < INTEGRATION_SIZE; k++) {
+                blockSums[b][k] += blockSums[b - 1][k];
+            }
+        }
+
+        scheduler.ParallelFor(1, blocks, 1, [&](size_t begin, size_t end) {
+            for (size_t b = begin; b < end; b++) {
+                size_t last = std::min(rows, (b + 1) * blockRows);
+                float* out = output.data();
+                const float* offset = blockSums[b - 1];
+                for (size_t i = b * blockRows; i < last; i++) {
+                    out[i * 3] += offset[0];
+                    out[i * 3 + 1] += offset[1];
+                    out[i * 3 + 2] += offset[2];
+                }
+            }
+        });
+    }
+
+    void Engine::HighPass3DFilter(std::vector<float>& data, float cutoff) {
+        // Buttower coef 1 order
+        double tan_wc = std::tan(M_PI * cutoff);
+        double b0 = 1.0 / (1.0 + tan_wc);
+        double b1 = -b0;
+        double a1 = (tan_wc - 1.0) / (tan_wc + 1.0);
+
+        int num_columns = 3;
+        size_t num_rows = data.size() / num_columns;
+        arena.scratch.resize(num_rows * num_columns);
+
+        //axes are independent, each one gets its own part of scratch
+        scheduler.ParallelFor(0, num_columns, 1, [&](size_t begin, size_t end) {
+            for (size_t col = begin; col < end; ++col) {
+                double* forward = &arena.scratch[col * num_rows];
+
+                // Straight pass
+                double prev_input = 0.0, prev_output = 0.0;
+                for (size_t i = 0; i < num_rows; ++i) {
+                    double column = data[i * num_columns + col];
+                    forward[i] = b0 * column + b1 * prev_input - a1 * prev_output;
+                    prev_input = column;
+                    prev_output = forward[i];
+                }
+
+                // Return pass (like filtfilt), saved straight back into data
+                prev_input = 0.0;
+                prev_output = 0.0;
+                for (long long i = static_cast<long long>(num_rows) - 1; i >= 0; --i) {
+                    double backward = b0 * forward[i] + b1 * prev_input - a1 * prev_output;
+                    prev_input = forward[i];
+                    prev_output = backward;
+                    data[i * num_columns + col] = backward;
+                }
+            }
+        });
+    }
+
+#pragma region Integration_methods
+    //Every method writes the area under input between samples i - 1 and i into output[i],
+    //Integrate() turns the areas into the running sum
+    void Engine::SquaresIntegration(size_t i, const std::vector<float>& input, std::vector<float>& output) {
+        output[i * 3] = input[i * 3] * arena.ts[i];
+        output[i * 3 + 1] = input[i * 3 + 1] * arena.ts[i];
+        output[i * 3 + 2] = input[i * 3 + 2] * arena.ts[i];
+    }
+
+    void Engine::TrapezoidIntegration(size_t i, const std::vector<float>& input, std::vector<float>& output) {
+        // (f(x_i) + f(x_{i-1})) * delta_x / 2
+        output[i * 3] = (input[(i - 1) * 3] + input[i * 3]) * arena.ts[i] / 2.0f;
+        output[i * 3 + 1] = (input[(i - 1) * 3 + 1] + input[i * 3 + 1]) * arena.ts[i] / 2.0f;
+        output[i * 3 + 2] = (input[(i - 1) * 3 + 2] + input[i * 3 + 2]) * arena.ts[i] / 2.0f;
+    }
+
+    void Engine::RungeKuttaIntegration(size_t i, const std::vector<float>& input, std::vector<float>& output) {
+        const float dt = arena.ts[i];
+
+        for (int k = 0; k < 3; ++k) {
+            const float prev_acc = input[(i - 1) * 3 + k];
+            const float curr_acc = input[i * 3 + k];
+
+            float k1 = prev_acc * dt;
+            float k2 = (prev_acc + 0.5f * (curr_acc - prev_acc)) * dt;
+            float k3 = k2;
+            float k4 = curr_acc * dt;
+
+            output[i * 3 + k] = (k1 + 2.0f * k2 + 2.0f * k3 + k4) / 6.0f;
+        }
+    }
+#pragma endregion
+
+}
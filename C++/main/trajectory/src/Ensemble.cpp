@@ -0,0 +1,138 @@
+#include "Ensemble.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+//parallel tasks, each has its own buffers and running sums, added up in order
+#define ENSEMBLE_MAX_PARTS 32
+//buffers of all parts together, long recordings get fewer parts
+#define ENSEMBLE_MEMORY_BYTES (512ull * 1024 * 1024)
+//rows per task when the parts are combined
+#define COMBINE_GRAIN 4096
+
+namespace Trajectory {
+
+    //every member gets its own stream whatever group or part it lands in
+    static uint32_t MemberSeed(uint32_t seed, size_t member) {
+        uint64_t z = (static_cast<uint64_t>(seed) << 32) + member;
+        uint32_t state = static_cast<uint32_t>(LanePipeline::SplitMix64(z));
+        return state != 0 ? state : 1u;
+    }
+
+    bool Ensemble::Run(const Engine& source, const EnsembleSettings& newSettings) {
+        auto start = std::chrono::steady_clock::now();
+        rows = source.Rows();
+        if (rows < 2 || source.Positions().size() < rows * 3 || source.Rotations().size() < rows * R_SIZE) {
+            return false;
+        }
+        engine = &source;
+        settings = newSettings;
+        settings.members = std::max<size_t>(1, settings.members);
+
+        size_t groups = (settings.members + PIPELINE_LANES - 1) / PIPELINE_LANES;
+        size_t partBytes = LanePipeline::BytesFor(rows) + rows * 6 * sizeof(double);
+        size_t partCount = std::min<size_t>({ groups, ENSEMBLE_MAX_PARTS, std::max<size_t>(1, ENSEMBLE_MEMORY_BYTES / partBytes) });
+        parts.resize(partCount);
+        groupsDone.store(0);
+        groupsTotal.store(groups);
+
+        scheduler.ParallelFor(0, partCount, 1, [&](size_t begin, size_t end) {
+            for (size_t p = begin; p < end; p++) {
+                Part& part = parts[p];
+                part.sums.assign(rows * 3, 0.0);
+                part.squares.assign(rows * 3, 0.0);
+                for (size_t group = p * groups / partCount; group < (p + 1) * groups / partCount; group++) {
+                    RunGroup(part, group);
+                    groupsDone.fetch_add(1);
+                }
+            }
+        });
+
+        //parts are added up in order, the mean is kept around the nominal path
+        Span<float> nominal = source.Positions();
+        mean.resize(rows * 3);
+        spread.resize(rows * 3);
+        double members = static_cast<double>(settings.members);
+        scheduler.ParallelFor(0, rows * 3, COMBINE_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t j = begin; j < end; j++) {
+                double sum = 0.0, squares = 0.0;
+                for (const Part& part : parts) {
+                    sum += part.sums[j];
+                    squares += part.squares[j];
+                }
+                double offset = sum / members;
+                mean[j] = static_cast<float>(nominal[j] + offset);
+                spread[j] = static_cast<float>(std::sqrt(std::max(0.0, squares / members - offset * offset)));
+            }
+        });
+
+        stats.members = settings.members;
+        stats.rows = rows;
+        stats.maxSpread = 0.0f;
+        for (size_t i = 0; i < rows; i++) {
+            const float* s = &spread[i * 3];
+            float radial = std::sqrt(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+            stats.maxSpread = std::max(stats.maxSpread, radial);
+            if (i + 1 == rows) stats.endSpread = radial;
+        }
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        engine = nullptr;
+        return true;
+    }
+
+    void Ensemble::RunGroup(Part& part, size_t group) {
+        const size_t L = PIPELINE_LANES;
+        size_t firstMember = group * L;
+        size_t active = std::min<size_t>(L, settings.members - firstMember);
+        const Settings& pipeline = engine->GetSettings();
+
+        LanePipeline::Lanes lanes;
+        for (size_t l = 0; l < L; l++) {
+            for (int k = 0; k < 3; k++) {
+                lanes.bias[k][l] = pipeline.accelBias[k];
+                lanes.gravity[k][l] = pipeline.gravityVector[k];
+            }
+            lanes.cutoff[l] = pipeline.filterCutoff;
+            lanes.seeds[l] = MemberSeed(settings.seed, firstMember + l);
+        }
+        lanes.accelNoise = settings.accelNoise;
+        lanes.accelBias = settings.accelBias;
+        lanes.angleNoise = settings.quaternionNoise;
+        lanes.timeJitter = settings.timeJitter;
+        part.pipeline.Run(*engine, lanes);
+
+        //lanes past the last member are computed anyway and left out of the sums
+        double weight[L];
+        for (size_t l = 0; l < L; l++) weight[l] = l < active ? 1.0 : 0.0;
+        const float* nominal = engine->Positions().data();
+        for (size_t i = 0; i < rows; i++) {
+            const float* position = part.pipeline.Position(i);
+            for (size_t k = 0; k < 3; k++) {
+                const float center = nominal[i * 3 + k];
+                double deviation = 0.0, squares = 0.0;
+                for (size_t l = 0; l < L; l++) {
+                    double d = (position[k * L + l] - center) * weight[l];
+                    deviation += d;
+                    squares += d * d;
+                }
+                part.sums[i * 3 + k] += deviation;
+                part.squares[i * 3 + k] += squares;
+            }
+        }
+    }
+
+    void Ensemble::Clear() {
+        std::vector<Part>().swap(parts);
+        mean.clear();
+        spread.clear();
+        stats = Stats();
+        groupsDone.store(0);
+        groupsTotal.store(0);
+    }
+
+    float Ensemble::GetProgress() const {
+        size_t total = groupsTotal.load();
+        return total == 0 ? 0.0f : static_cast<float>(groupsDone.load()) / static_cast<float>(total);
+    }
+
+}
@@ -0,0 +1,66 @@
+#include "Fft.h"
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif // !M_PI
+
+namespace Trajectory {
+
+    Fft::Fft(size_t size) : size(size) {
+        twiddles.resize(size / 2);
+        for (size_t k = 0; k < size / 2; k++) {
+            double angle = -2.0 * M_PI * k / size;
+            twiddles[k] = std::complex<float>(static_cast<float>(std::cos(angle)), static_cast<float>(std::sin(angle)));
+        }
+        int bits = 0;
+        while ((size_t(1) << bits) < size) bits++;
+        for (size_t i = 0; i < size; i++) {
+            size_t j = 0;
+            for (int b = 0; b < bits; b++) {
+                if (i & (size_t(1) << b)) j |= size_t(1) << (bits - 1 - b);
+            }
+            if (i < j) {
+                reversal.push_back(i);
+                reversal.push_back(j);
+            }
+        }
+    }
+
+    void Fft::Forward(std::complex<float>* data) const {
+        for (size_t p = 0; p < reversal.size(); p += 2) {
+            std::swap(data[reversal[p]], data[reversal[p + 1]]);
+        }
+        //butterflies on plain floats, std::complex multiplication checks for infinities
+        float* d = reinterpret_cast<float*>(data);
+        const float* w = reinterpret_cast<const float*>(twiddles.data());
+        for (size_t half = 1; half < size; half *= 2) {
+            size_t step = size / (2 * half);
+            for (size_t start = 0; start < size; start += 2 * half) {
+                for (size_t k = 0; k < half; k++) {
+                    float wr = w[2 * k * step], wi = w[2 * k * step + 1];
+                    float* a = &d[2 * (start + k)];
+                    float* b = &d[2 * (start + k + half)];
+                    float br = b[0] * wr - b[1] * wi;
+                    float bi = b[0] * wi + b[1] * wr;
+                    b[0] = a[0] - br;
+                    b[1] = a[1] - bi;
+                    a[0] += br;
+                    a[1] += bi;
+                }
+            }
+        }
+    }
+
+    void Fft::SplitReal(const std::complex<float>* packed, std::complex<float>* x, std::complex<float>* y) const {
+        //X[k] = (Z[k] + conj(Z[N - k])) / 2, Y[k] = (Z[k] - conj(Z[N - k])) / 2i
+        for (size_t k = 0; k <= size / 2; k++) {
+            std::complex<float> z = packed[k];
+            std::complex<float> mirror = std::conj(packed[(size - k) % size]);
+            x[k] = 0.5f * (z + mirror);
+            std::complex<float> difference = z - mirror;
+            y[k] = std::complex<float>(0.5f * difference.imag(), -0.5f * difference.real());
+        }
+    }
+
+}
@@ -0,0 +1,170 @@
+#include "Fusion.h"
+#include <algorithm>
+#include <cmath>
+
+//added to every norm that is divided by, a lane below it gets 0 instead; no division is skipped, so the loops have no branches
+#define FUSION_MIN_NORM 1e-20f
+
+namespace Trajectory {
+
+    template<size_t Lanes>
+    FusionLanes<Lanes>::FusionLanes(const FusionSettings& settings) : settings(settings) {
+        Reset();
+    }
+
+    template<size_t Lanes>
+    void FusionLanes<Lanes>::Reset() {
+        for (size_t l = 0; l < Lanes; l++) {
+            q[0][l] = 1.0f;
+            q[1][l] = q[2][l] = q[3][l] = 0.0f;
+            integral[0][l] = integral[1][l] = integral[2][l] = 0.0f;
+        }
+    }
+
+    template<size_t Lanes>
+    void FusionLanes<Lanes>::Reset(size_t lane, const float newQ[Q_SIZE]) {
+        float norm = std::sqrt(newQ[0] * newQ[0] + newQ[1] * newQ[1] + newQ[2] * newQ[2] + newQ[3] * newQ[3]);
+        float inverse = norm > 0.0f ? 1.0f / norm : 0.0f;
+        for (int c = 0; c < Q_SIZE; c++) q[c][lane] = norm > 0.0f ? newQ[c] * inverse : (c == 0 ? 1.0f : 0.0f);
+        integral[0][lane] = integral[1][lane] = integral[2][lane] = 0.0f;
+    }
+
+    template<size_t Lanes>
+    void FusionLanes<Lanes>::Align(size_t lane, const float accel[A_SIZE]) {
+        //shortest turn of the measured direction onto world z: (1 + a.z, a x z)
+        float norm = std::sqrt(accel[0] * accel[0] + accel[1] * accel[1] + accel[2] * accel[2]);
+        if (norm == 0.0f) {
+            const float identity[Q_SIZE] = { 1.0f, 0.0f, 0.0f, 0.0f };
+            Reset(lane, identity);
+            return;
+        }
+        float ax = accel[0] / norm, ay = accel[1] / norm, az = accel[2] / norm;
+        float turn[Q_SIZE] = { 1.0f + az, ay, -ax, 0.0f };
+        //upside down, any horizontal axis does
+        if (turn[0] < 1e-6f) {
+            turn[0] = 0.0f;
+            turn[1] = 1.0f;
+            turn[2] = 0.0f;
+        }
+        Reset(lane, turn);
+    }
+
+    template<size_t Lanes>
+    void FusionLanes<Lanes>::Update(const float* gyro, const float* accel, const float* dt) {
+        if (settings.filter == FusionFilter::MAHONY) Step<FusionFilter::MAHONY>(gyro, accel, dt);
+        else Step<FusionFilter::MADGWICK>(gyro, accel, dt);
+    }
+
+    template<size_t Lanes>
+    void FusionLanes<Lanes>::Run(const float* ts, const float* gyro, const float* accel, size_t rows, float* qs) {
+        //the filter is chosen once, not per row
+        auto run = [&](auto step) {
+            for (size_t i = 0; i < rows; i++) {
+                (this->*step)(&gyro[i * 3 * Lanes], &accel[i * 3 * Lanes], &ts[i * Lanes]);
+                float* out = &qs[i * Q_SIZE * Lanes];
+                for (int c = 0; c < Q_SIZE; c++) {
+                    for (size_t l = 0; l < Lanes; l++) out[c * Lanes + l] = q[c][l];
+                }
+            }
+        };
+        if (settings.filter == FusionFilter::MAHONY) run(&FusionLanes::Step<FusionFilter::MAHONY>);
+        else run(&FusionLanes::Step<FusionFilter::MADGWICK>);
+    }
+
+    template<size_t Lanes>
+    void FusionLanes<Lanes>::Get(size_t lane, float out[Q_SIZE]) const {
+        for (int c = 0; c < Q_SIZE; c++) out[c] = q[c][lane];
+    }
+
+    //Madgwick and Mahony IMU updates as in their reference code, without their branches: a lane with no
+    //accelerometer input (or a Madgwick step of length 0) gets a correction of 0 instead
+    template<size_t Lanes>
+    template<FusionFilter Filter>
+    void FusionLanes<Lanes>::Step(const float* gyro, const float* accel, const float* dt) {
+        //locals, so the compiler knows the stores below do not change the input
+        const float beta = settings.beta, twoKp = 2.0f * settings.kp, twoKi = 2.0f * settings.ki;
+        float state[Q_SIZE][Lanes], feedback[3][Lanes];
+        std::copy_n(&q[0][0], Q_SIZE * Lanes, &state[0][0]);
+        std::copy_n(&integral[0][0], 3 * Lanes, &feedback[0][0]);
+        for (size_t l = 0; l < Lanes; l++) {
+            float q0 = state[0][l], q1 = state[1][l], q2 = state[2][l], q3 = state[3][l];
+            float gx = gyro[l], gy = gyro[Lanes + l], gz = gyro[2 * Lanes + l];
+            float ax = accel[l], ay = accel[Lanes + l], az = accel[2 * Lanes + l];
+            float h = dt[l];
+
+            float aNorm = ax * ax + ay * ay + az * az;
+            float aValid = aNorm > FUSION_MIN_NORM ? 1.0f : 0.0f;
+            float aInverse = aValid / std::sqrt(aNorm + FUSION_MIN_NORM);
+            ax *= aInverse;
+            ay *= aInverse;
+            az *= aInverse;
+
+            if constexpr (Filter == FusionFilter::MADGWICK) {
+                //rate of change from the gyroscope
+                float d0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+                float d1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+                float d2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+                float d3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+                //gradient of the gravity error, normalised
+                float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+                float s0 = 4.0f * q0 * q2q2 + 2.0f * q2 * ax + 4.0f * q0 * q1q1 - 2.0f * q1 * ay;
+                float s1 = 4.0f * q1 * q3q3 - 2.0f * q3 * ax + 4.0f * q0q0 * q1 - 2.0f * q0 * ay - 4.0f * q1
+                    + 8.0f * q1 * q1q1 + 8.0f * q1 * q2q2 + 4.0f * q1 * az;
+                float s2 = 4.0f * q0q0 * q2 + 2.0f * q0 * ax + 4.0f * q2 * q3q3 - 2.0f * q3 * ay - 4.0f * q2
+                    + 8.0f * q2 * q1q1 + 8.0f * q2 * q2q2 + 4.0f * q2 * az;
+                float s3 = 4.0f * q1q1 * q3 - 2.0f * q1 * ax + 4.0f * q2q2 * q3 - 2.0f * q2 * ay;
+                float sNorm = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+                float sValid = sNorm > FUSION_MIN_NORM ? aValid : 0.0f;
+                float sScale = beta * sValid / std::sqrt(sNorm + FUSION_MIN_NORM);
+
+                q0 += (d0 - sScale * s0) * h;
+                q1 += (d1 - sScale * s1) * h;
+                q2 += (d2 - sScale * s2) * h;
+                q3 += (d3 - sScale * s3) * h;
+            }
+            else {
+                //error between the measured and the estimated gravity, halved
+                float vx = q1 * q3 - q0 * q2;
+                float vy = q0 * q1 + q2 * q3;
+                float vz = q0 * q0 - 0.5f + q3 * q3;
+                float ex = ay * vz - az * vy;
+                float ey = az * vx - ax * vz;
+                float ez = ax * vy - ay * vx;
+
+                //integral feedback, 0 input leaves it as it is
+                float ix = feedback[0][l] + twoKi * ex * h;
+                float iy = feedback[1][l] + twoKi * ey * h;
+                float iz = feedback[2][l] + twoKi * ez * h;
+                feedback[0][l] = ix;
+                feedback[1][l] = iy;
+                feedback[2][l] = iz;
+                gx += ix + twoKp * ex;
+                gy += iy + twoKp * ey;
+                gz += iz + twoKp * ez;
+
+                float half = 0.5f * h;
+                gx *= half;
+                gy *= half;
+                gz *= half;
+                float p0 = q0, p1 = q1, p2 = q2;
+                q0 += -p1 * gx - p2 * gy - q3 * gz;
+                q1 += p0 * gx + p2 * gz - q3 * gy;
+                q2 += p0 * gy - p1 * gz + q3 * gx;
+                q3 += p0 * gz + p1 * gy - p2 * gx;
+            }
+
+            float qInverse = 1.0f / std::sqrt(q0 * q0 + q1 * q1 + q2 * q2 + q3 * q3);
+            state[0][l] = q0 * qInverse;
+            state[1][l] = q1 * qInverse;
+            state[2][l] = q2 * qInverse;
+            state[3][l] = q3 * qInverse;
+        }
+        std::copy_n(&state[0][0], Q_SIZE * Lanes, &q[0][0]);
+        std::copy_n(&feedback[0][0], 3 * Lanes, &integral[0][0]);
+    }
+
+    template class FusionLanes<1>;
+    template class FusionLanes<FUSION_LANES>;
+
+}
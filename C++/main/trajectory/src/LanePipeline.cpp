@@ -0,0 +1,262 @@
+#include "LanePipeline.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif // !M_PI
+
+//standard deviation of a sum of four uniform bytes, sqrt(4 * (256^2 - 1) / 12)
+#define BYTE_SUM_DEVIATION 147.8006f
+#define BYTE_SUM_MEAN 510
+
+namespace Trajectory {
+
+    float LanePipeline::Normal(uint32_t& state) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        int sum = static_cast<int>((state & 255u) + ((state >> 8) & 255u) + ((state >> 16) & 255u) + (state >> 24));
+        return (sum - BYTE_SUM_MEAN) * (1.0f / BYTE_SUM_DEVIATION);
+    }
+
+    uint64_t LanePipeline::SplitMix64(uint64_t& state) {
+        uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+    bool LanePipeline::Run(const Engine& engine, const Lanes& lanes) {
+        rows = engine.Rows();
+        if (rows < 2 || engine.Positions().size() < rows * 3 || engine.Rotations().size() < rows * R_SIZE) {
+            rows = 0;
+            return false;
+        }
+        ts.resize(rows * PIPELINE_LANES);
+        v.resize(rows * 3 * PIPELINE_LANES);
+        p.resize(rows * 3 * PIPELINE_LANES);
+
+        //the integration methods of Engine
+        bool noisy = lanes.accelNoise != 0.0f || lanes.accelBias != 0.0f || lanes.angleNoise != 0.0f || lanes.timeJitter != 0.0f;
+        auto squares = [](float /*previous*/, float current, float dt) {
+            return current * dt;
+        };
+        auto trapezoid = [](float previous, float current, float dt) {
+            return (previous + current) * dt / 2.0f;
+        };
+        auto rungeKutta = [](float previous, float current, float dt) {
+            float k1 = previous * dt;
+            float k2 = (previous + 0.5f * (current - previous)) * dt;
+            float k3 = k2;
+            float k4 = current * dt;
+            return (k1 + 2.0f * k2 + 2.0f * k3 + k4) / 6.0f;
+        };
+        switch (engine.GetSettings().method)
+        {
+        case IntegrationMethod::TRAPEZOID:
+            noisy ? RunLanes<true>(engine, lanes, trapezoid) : RunLanes<false>(engine, lanes, trapezoid);
+            break;
+        case IntegrationMethod::RUNGE_KUTTA:
+            noisy ? RunLanes<true>(engine, lanes, rungeKutta) : RunLanes<false>(engine, lanes, rungeKutta);
+            break;
+        default:
+            noisy ? RunLanes<true>(engine, lanes, squares) : RunLanes<false>(engine, lanes, squares);
+            break;
+        }
+        return true;
+    }
+
+    //Four sweeps over the rows, every one a flat loop over all axes and lanes:
+    //input, velocity and its forward filter pass / backward pass / position and its forward pass / backward pass.
+    //Forward results are kept as float, Engine::HighPass3DFilter() keeps them in double
+    template<bool Noisy, class Area>
+    void LanePipeline::RunLanes(const Engine& engine, const Lanes& lanes, const Area& area) {
+        const size_t L = PIPELINE_LANES, W = 3 * PIPELINE_LANES;
+        const float* deltas = engine.Times().data();
+        const float* raw = engine.RawAccelerations().data();
+        const float* Rs = engine.Rotations().data();
+
+        //locals, so the compiler knows the stores below do not change them
+        const float accelNoise = lanes.accelNoise, timeJitter = lanes.timeJitter, angleNoise = lanes.angleNoise;
+        const float g = engine.GetSettings().g;
+
+        //the high-pass of Engine::HighPass3DFilter() of every lane at the mean sample rate, passes input through if it is off
+        const bool highPass = engine.GetSettings().highPass;
+        double sampleRate = std::accumulate(deltas, deltas + rows, 0.0);
+        sampleRate = 1.0 / (sampleRate / rows);
+        double nyQuist = 0.5f * sampleRate;
+        double b0[W], b1[W], a1[W];
+        for (size_t l = 0; l < L; l++) {
+            float cutoff = static_cast<float>(lanes.cutoff[l] / nyQuist);
+            double tan_wc = std::tan(M_PI * cutoff);
+            for (size_t k = 0; k < 3; k++) {
+                b0[k * L + l] = highPass ? 1.0 / (1.0 + tan_wc) : 1.0;
+                b1[k * L + l] = highPass ? -b0[k * L + l] : 0.0;
+                a1[k * L + l] = highPass ? (tan_wc - 1.0) / (tan_wc + 1.0) : 0.0;
+            }
+        }
+
+        uint32_t state[L];
+        float bias[3][L], gravity[3][L], previousJitter[L];
+        for (size_t l = 0; l < L; l++) {
+            state[l] = lanes.seeds[l] != 0 ? lanes.seeds[l] : 1u;
+            for (int k = 0; k < 3; k++) {
+                bias[k][l] = -lanes.bias[k][l];
+                gravity[k][l] = lanes.gravity[k][l];
+            }
+            if (Noisy) {
+                for (int k = 0; k < 3; k++) bias[k][l] += Normal(state[l]) * lanes.accelBias;
+                previousJitter[l] = Normal(state[l]) * timeJitter;
+            }
+        }
+
+        float a[W], previous[W], sum[W], dt[W];
+        double filterInput[W], filterOutput[W];
+        auto resetFilter = [&]() {
+            std::fill(filterInput, filterInput + W, 0.0);
+            std::fill(filterOutput, filterOutput + W, 0.0);
+        };
+
+        //3.-6. input, tilt and gravity compensated, velocity, forward pass;
+        //the rotation and the input of a row are loaded once for all lanes
+        std::fill(sum, sum + W, 0.0f);
+        resetFilter();
+        for (size_t i = 0; i < rows; i++) {
+            float R[R_SIZE], in[A_SIZE];
+            std::copy_n(&Rs[i * R_SIZE], R_SIZE, R);
+            std::copy_n(&raw[i * A_SIZE], A_SIZE, in);
+            const float delta = deltas[i];
+            float* t = &ts[i * L];
+            for (size_t l = 0; l < L; l++) {
+                float x = in[0] + bias[0][l];
+                float y = in[1] + bias[1][l];
+                float z = in[2] + bias[2][l];
+                if (Noisy) {
+                    float jitter = Normal(state[l]) * timeJitter;
+                    float step = delta + jitter - previousJitter[l];
+                    t[l] = step > 0.0f ? step : 0.0f;
+                    previousJitter[l] = jitter;
+
+                    x += Normal(state[l]) * accelNoise;
+                    y += Normal(state[l]) * accelNoise;
+                    z += Normal(state[l]) * accelNoise;
+                    //orientation turned by a small angle: R (I + [theta]x) a = R (a + theta x a)
+                    float tx = Normal(state[l]) * angleNoise;
+                    float ty = Normal(state[l]) * angleNoise;
+                    float tz = Normal(state[l]) * angleNoise;
+                    float px = x + ty * z - tz * y;
+                    float py = y + tz * x - tx * z;
+                    float pz = z + tx * y - ty * x;
+                    x = px;
+                    y = py;
+                    z = pz;
+                }
+                else {
+                    t[l] = delta;
+                }
+
+                a[l] = (R[0] * x + R[1] * y + R[2] * z - gravity[0][l]) * g;
+                a[L + l] = (R[3] * x + R[4] * y + R[5] * z - gravity[1][l]) * g;
+                a[2 * L + l] = (R[6] * x + R[7] * y + R[8] * z - gravity[2][l]) * g;
+            }
+            if (i == 0) std::copy_n(a, W, previous);
+            for (size_t k = 0; k < 3; k++) std::copy_n(t, L, &dt[k * L]);
+
+            //the first row starts at zero, as in Engine::Integrate()
+            const float first = i == 0 ? 0.0f : 1.0f;
+            float* velocity = &v[i * W];
+            for (size_t j = 0; j < W; j++) {
+                sum[j] += area(previous[j], a[j], dt[j]) * first;
+                previous[j] = a[j];
+                double output = b0[j] * sum[j] + b1[j] * filterInput[j] - a1[j] * filterOutput[j];
+                filterInput[j] = sum[j];
+                filterOutput[j] = output;
+                velocity[j] = static_cast<float>(output);
+            }
+        }
+
+        //6. backward pass
+        resetFilter();
+        for (size_t i = rows; i-- > 0; ) {
+            float* velocity = &v[i * W];
+            for (size_t j = 0; j < W; j++) {
+                double input = velocity[j];
+                double output = b0[j] * input + b1[j] * filterInput[j] - a1[j] * filterOutput[j];
+                filterInput[j] = input;
+                filterOutput[j] = output;
+                velocity[j] = static_cast<float>(output);
+            }
+        }
+
+        //6. zero velocity updates at the stationary rows of engine, as in Engine::ZeroVelocity()
+        Span<uint8_t> still = engine.Stationary();
+        Span<size_t> spans = engine.MovingSpans();
+        if (engine.GetSettings().zeroVelocity && still.size() == rows) {
+            for (size_t s = 0; s * 2 < spans.size(); s++) {
+                size_t first = spans[s * 2], last = spans[s * 2 + 1];
+                float anchor[W], residual[W];
+                double scale[W], time[W];
+                std::fill(anchor, anchor + W, 0.0f);
+                std::fill(residual, residual + W, 0.0f);
+                std::fill(scale, scale + W, 0.0);
+                std::fill(time, time + W, 0.0);
+                if (first > 0) std::copy_n(&v[(first - 1) * W], W, anchor);
+                if (last < rows) {
+                    double duration[L] = {};
+                    for (size_t i = first; i <= last; i++) {
+                        for (size_t l = 0; l < L; l++) duration[l] += ts[i * L + l];
+                    }
+                    for (size_t j = 0; j < W; j++) {
+                        residual[j] = v[last * W + j] - anchor[j];
+                        scale[j] = duration[j % L] > 0.0 ? 1.0 / duration[j % L] : 0.0;
+                    }
+                }
+                for (size_t i = first; i < last; i++) {
+                    for (size_t k = 0; k < 3; k++) std::copy_n(&ts[i * L], L, &dt[k * L]);
+                    float* velocity = &v[i * W];
+                    for (size_t j = 0; j < W; j++) {
+                        time[j] += dt[j];
+                        velocity[j] = static_cast<float>(velocity[j] - anchor[j] - residual[j] * (time[j] * scale[j]));
+                    }
+                }
+            }
+            for (size_t i = 0; i < rows; i++) {
+                if (still[i]) std::fill(&v[i * W], &v[i * W] + W, 0.0f);
+            }
+        }
+
+        //7.-8. position, forward pass
+        std::fill(sum, sum + W, 0.0f);
+        resetFilter();
+        for (size_t i = 0; i < rows; i++) {
+            const float* velocity = &v[i * W];
+            const float* before = &v[(i > 0 ? i - 1 : 0) * W];
+            for (size_t k = 0; k < 3; k++) std::copy_n(&ts[i * L], L, &dt[k * L]);
+            const float first = i == 0 ? 0.0f : 1.0f;
+            float* position = &p[i * W];
+            for (size_t j = 0; j < W; j++) {
+                sum[j] += area(before[j], velocity[j], dt[j]) * first;
+                double output = b0[j] * sum[j] + b1[j] * filterInput[j] - a1[j] * filterOutput[j];
+                filterInput[j] = sum[j];
+                filterOutput[j] = output;
+                position[j] = static_cast<float>(output);
+            }
+        }
+
+        //8. backward pass
+        resetFilter();
+        for (size_t i = rows; i-- > 0; ) {
+            float* position = &p[i * W];
+            for (size_t j = 0; j < W; j++) {
+                double input = position[j];
+                double output = b0[j] * input + b1[j] * filterInput[j] - a1[j] * filterOutput[j];
+                filterInput[j] = input;
+                filterOutput[j] = output;
+                position[j] = static_cast<float>(output);
+            }
+        }
+    }
+
+}
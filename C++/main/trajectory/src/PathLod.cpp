@@ -0,0 +1,158 @@
+#include "PathLod.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <utility>
+
+//level 1 tolerance against the path extent when the caller gives none
+#define LOD_RELATIVE_TOLERANCE 1e-6f
+//a level is kept only if it drops at least a quarter of the samples below it
+#define LOD_MIN_REDUCTION 0.75f
+
+namespace Trajectory {
+
+    static float SegmentDistanceSquared(const float* p, const float* a, const float* b) {
+        float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+        float length = ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2];
+        float t = length > 0.0f ? (ap[0] * ab[0] + ap[1] * ab[1] + ap[2] * ab[2]) / length : 0.0f;
+        t = std::clamp(t, 0.0f, 1.0f);
+        float d[3] = { ap[0] - ab[0] * t, ap[1] - ab[1] * t, ap[2] - ab[2] * t };
+        return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    }
+
+    //Douglas-Peucker over the samples listed in source, ends are always kept
+    static void Simplify(const float* positions, const std::vector<uint32_t>& source, float tolerance,
+        std::vector<char>& keep, std::vector<std::pair<size_t, size_t>>& stack, std::vector<uint32_t>& result) {
+        size_t count = source.size();
+        keep.assign(count, 0);
+        keep[0] = 1;
+        keep[count - 1] = 1;
+        float toleranceSquared = tolerance * tolerance;
+
+        stack.clear();
+        stack.emplace_back(0, count - 1);
+        while (!stack.empty()) {
+            auto [first, last] = stack.back();
+            stack.pop_back();
+            const float* a = positions + source[first] * 3;
+            const float* b = positions + source[last] * 3;
+            float worst = 0.0f;
+            size_t worstIndex = first;
+            for (size_t i = first + 1; i < last; i++) {
+                float distance = SegmentDistanceSquared(positions + source[i] * 3, a, b);
+                if (distance > worst) {
+                    worst = distance;
+                    worstIndex = i;
+                }
+            }
+            if (worst > toleranceSquared) {
+                keep[worstIndex] = 1;
+                if (worstIndex - first > 1) stack.emplace_back(first, worstIndex);
+                if (last - worstIndex > 1) stack.emplace_back(worstIndex, last);
+            }
+        }
+
+        result.clear();
+        for (size_t i = 0; i < count; i++) {
+            if (keep[i]) result.push_back(source[i]);
+        }
+    }
+
+    void PathLod::Clear() {
+        chunks.clear();
+        indices.clear();
+        samples = 0;
+    }
+
+    void PathLod::Build(Span<float> positions, float baseTolerance) {
+        Clear();
+        samples = positions.size() / 3;
+        if (samples == 0) return;
+
+        if (baseTolerance <= 0.0f) {
+            float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+            float high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+            for (size_t i = 0; i < samples; i++) {
+                for (int axis = 0; axis < 3; axis++) {
+                    low[axis] = std::min(low[axis], positions[i * 3 + axis]);
+                    high[axis] = std::max(high[axis], positions[i * 3 + axis]);
+                }
+            }
+            float extent = std::sqrt((high[0] - low[0]) * (high[0] - low[0]) + (high[1] - low[1]) * (high[1] - low[1])
+                + (high[2] - low[2]) * (high[2] - low[2]));
+            baseTolerance = std::max(extent * LOD_RELATIVE_TOLERANCE, FLT_MIN);
+        }
+
+        //chunks overlap by one sample
+        size_t step = LOD_CHUNK_SAMPLES - 1;
+        size_t chunkCount = samples <= 1 ? 1 : (samples - 2) / step + 1;
+        chunks.resize(chunkCount);
+        std::vector<std::vector<uint32_t>> chunkIndices(chunkCount);
+
+        scheduler.ParallelFor(0, chunkCount, 1, [&](size_t begin, size_t end) {
+            for (size_t c = begin; c < end; c++) {
+                chunks[c].first = c * step;
+                size_t count = std::min<size_t>(LOD_CHUNK_SAMPLES, samples - chunks[c].first);
+                BuildChunk(positions.data(), chunks[c], count, baseTolerance, chunkIndices[c]);
+            }
+        });
+
+        size_t total = 0;
+        for (const auto& chunk : chunkIndices) total += chunk.size();
+        indices.reserve(total);
+        for (size_t c = 0; c < chunkCount; c++) {
+            for (size_t l = 1; l < chunks[c].levels.size(); l++) {
+                chunks[c].levels[l].offset += indices.size();
+            }
+            indices.insert(indices.end(), chunkIndices[c].begin(), chunkIndices[c].end());
+        }
+    }
+
+    void PathLod::BuildChunk(const float* positions, Chunk& chunk, size_t count, float baseTolerance, std::vector<uint32_t>& chunkIndices) {
+        const float* first = positions + chunk.first * 3;
+        float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (size_t i = 0; i < count; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                low[axis] = std::min(low[axis], first[i * 3 + axis]);
+                high[axis] = std::max(high[axis], first[i * 3 + axis]);
+            }
+        }
+        float radiusSquared = 0.0f;
+        for (int axis = 0; axis < 3; axis++) chunk.center[axis] = (low[axis] + high[axis]) * 0.5f;
+        for (size_t i = 0; i < count; i++) {
+            float d[3] = { first[i * 3] - chunk.center[0], first[i * 3 + 1] - chunk.center[1], first[i * 3 + 2] - chunk.center[2] };
+            radiusSquared = std::max(radiusSquared, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+        }
+        chunk.radius = std::sqrt(radiusSquared);
+
+        chunk.levels.clear();
+        chunk.levels.push_back({ 0.0f, 0, count });
+        if (count <= 2) return;
+
+        std::vector<uint32_t> current(count), next;
+        for (size_t i = 0; i < count; i++) current[i] = static_cast<uint32_t>(chunk.first + i);
+        std::vector<char> keep;
+        std::vector<std::pair<size_t, size_t>> stack;
+
+        //every level is simplified from the one below, so its error is the sum of the tolerances on the way
+        float tolerance = baseTolerance;
+        float error = 0.0f;
+        size_t storedCount = count;
+        while (chunk.levels.size() < LOD_MAX_LEVELS && current.size() > 2) {
+            Simplify(positions, current, tolerance, keep, stack, next);
+            if (next.size() < current.size()) {
+                error += tolerance;
+                current.swap(next);
+                if (current.size() <= storedCount * LOD_MIN_REDUCTION || current.size() == 2) {
+                    chunk.levels.push_back({ error, chunkIndices.size(), current.size() });
+                    chunkIndices.insert(chunkIndices.end(), current.begin(), current.end());
+                    storedCount = current.size();
+                }
+            }
+            tolerance *= 2.0f;
+        }
+    }
+
+}
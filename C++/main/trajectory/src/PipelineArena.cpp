@@ -0,0 +1,98 @@
+#include "PipelineArena.h"
+
+//Extra room so that a slightly longer recording does not reallocate everything again
+static size_t WithHeadroom(size_t n) {
+    return n + n / 4;
+}
+
+char* PipelineArena::PrepareText(size_t bytes) {
+    if (bytes > text.capacity()) {
+        text.reserve(WithHeadroom(bytes));
+        stats.growCount++;
+    }
+    text.resize(bytes);
+    if (bytes > stats.highWaterBytes) stats.highWaterBytes = bytes;
+    UpdateReservedBytes();
+    return text.data();
+}
+
+void PipelineArena::Prepare(size_t rows) {
+    if (rows > stats.capacityRows) {
+        size_t capacity = WithHeadroom(rows);
+        ts.reserve(capacity * T_SIZE);
+        qs.reserve(capacity * Q_SIZE);
+        raw.reserve(capacity * A_SIZE);
+        as.reserve(capacity * A_SIZE);
+        Rs.reserve(capacity * R_SIZE);
+        vs.reserve(capacity * INTEGRATION_SIZE);
+        pos.reserve(capacity * INTEGRATION_SIZE);
+        scratch.reserve(capacity * INTEGRATION_SIZE);
+        motion.reserve(capacity * MOTION_SIZE);
+        still.reserve(capacity);
+        //moving and still rows alternate at most, so at most one span per two rows
+        spans.reserve(capacity + 1);
+        stats.capacityRows = capacity;
+        stats.growCount++;
+    }
+
+    ts.clear();
+    qs.clear();
+    raw.clear();
+    as.clear();
+    Rs.clear();
+    vs.clear();
+    pos.clear();
+    scratch.clear();
+    gyro.clear();
+    recordedQs.clear();
+    motion.clear();
+    still.clear();
+    spans.clear();
+    sourceTs.clear();
+    sourceQs.clear();
+    sourceRaw.clear();
+    for (int m = 0; m < METHOD_COUNT; m++) {
+        methodVs[m].clear();
+        methodPos[m].clear();
+    }
+
+    if (rows > stats.highWaterRows) stats.highWaterRows = rows;
+    stats.runCount++;
+    UpdateReservedBytes();
+}
+
+void PipelineArena::Release() {
+    std::string().swap(text);
+    std::vector<float>().swap(ts);
+    std::vector<float>().swap(qs);
+    std::vector<float>().swap(raw);
+    std::vector<float>().swap(as);
+    std::vector<float>().swap(Rs);
+    std::vector<float>().swap(vs);
+    std::vector<float>().swap(pos);
+    std::vector<double>().swap(scratch);
+    std::vector<float>().swap(gyro);
+    std::vector<float>().swap(recordedQs);
+    std::vector<float>().swap(motion);
+    std::vector<uint8_t>().swap(still);
+    std::vector<size_t>().swap(spans);
+    std::vector<float>().swap(sourceTs);
+    std::vector<float>().swap(sourceQs);
+    std::vector<float>().swap(sourceRaw);
+    for (int m = 0; m < METHOD_COUNT; m++) {
+        std::vector<float>().swap(methodVs[m]);
+        std::vector<float>().swap(methodPos[m]);
+    }
+    stats.capacityRows = 0;
+    UpdateReservedBytes();
+}
+
+void PipelineArena::UpdateReservedBytes() {
+    stats.reservedBytes = text.capacity()
+        + (ts.capacity() + qs.capacity() + raw.capacity() + as.capacity() + Rs.capacity() + vs.capacity() + pos.capacity()
+        + gyro.capacity() + recordedQs.capacity() + motion.capacity() + sourceTs.capacity() + sourceQs.capacity() + sourceRaw.capacity()) * sizeof(float)
+        + scratch.capacity() * sizeof(double) + still.capacity() + spans.capacity() * sizeof(size_t);
+    for (int m = 0; m < METHOD_COUNT; m++) {
+        stats.reservedBytes += (methodVs[m].capacity() + methodPos[m].capacity()) * sizeof(float);
+    }
+}
@@ -0,0 +1,109 @@
+#include "PoseQuery.h"
+#include <algorithm>
+#include <cmath>
+
+//queries per parallel chunk
+#define POSE_QUERY_GRAIN 16384
+//queries located before the block is interpolated
+#define POSE_QUERY_BLOCK 256
+//above this cosine the rows are so close that normalized lerp equals slerp
+#define SLERP_LINEAR_COSINE 0.9995f
+
+namespace Trajectory {
+
+    static void Lerp3(const float* from, const float* to, float fraction, float* out) {
+        out[0] = from[0] + (to[0] - from[0]) * fraction;
+        out[1] = from[1] + (to[1] - from[1]) * fraction;
+        out[2] = from[2] + (to[2] - from[2]) * fraction;
+    }
+
+    void PoseQuery::Slerp(const float* from, const float* to, float fraction, float* out) {
+        float cosine = from[0] * to[0] + from[1] * to[1] + from[2] * to[2] + from[3] * to[3];
+        float sign = 1.0f;
+        if (cosine < 0.0f) {
+            cosine = -cosine;
+            sign = -1.0f;
+        }
+        float a = 1.0f - fraction, b = fraction;
+        if (cosine < SLERP_LINEAR_COSINE) {
+            float angle = std::acos(cosine);
+            float inverseSine = 1.0f / std::sin(angle);
+            a = std::sin(a * angle) * inverseSine;
+            b = std::sin(b * angle) * inverseSine;
+        }
+        b *= sign;
+        float q[4] = { a * from[0] + b * to[0], a * from[1] + b * to[1], a * from[2] + b * to[2], a * from[3] + b * to[3] };
+        float length = std::sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+        float scale = length > 0.0f ? 1.0f / length : 0.0f;
+        for (int k = 0; k < 4; k++) out[k] = q[k] * scale;
+    }
+
+    void PoseQuery::Build(const Engine& engine) {
+        index.Build(engine.Times());
+        positions = engine.Positions();
+        velocities = engine.Velocities();
+        quaternions = engine.Quaternions();
+    }
+
+    void PoseQuery::Clear() {
+        index.Clear();
+        positions = velocities = quaternions = Span<float>();
+    }
+
+    Pose PoseQuery::At(double time) const {
+        Pose pose;
+        if (Rows() == 0) return pose;
+        AtRange(&time, 1, pose.position, pose.velocity, pose.orientation);
+        pose.sample = index.Locate(time).index;
+        return pose;
+    }
+
+    void PoseQuery::At(Span<double> times, float* positionsOut, float* velocitiesOut, float* orientationsOut) const {
+        if (Rows() == 0 || times.empty()) return;
+        scheduler.ParallelFor(0, times.size(), POSE_QUERY_GRAIN, [&](size_t begin, size_t end) {
+            AtRange(times.data() + begin, end - begin,
+                positionsOut ? positionsOut + begin * INTEGRATION_SIZE : nullptr,
+                velocitiesOut ? velocitiesOut + begin * INTEGRATION_SIZE : nullptr,
+                orientationsOut ? orientationsOut + begin * Q_SIZE : nullptr);
+        });
+    }
+
+    void PoseQuery::AtRange(const double* times, size_t count, float* positionsOut, float* velocitiesOut, float* orientationsOut) const {
+        size_t rows[POSE_QUERY_BLOCK];
+        size_t nexts[POSE_QUERY_BLOCK];
+        float fractions[POSE_QUERY_BLOCK];
+        size_t last = Rows() - 1;
+        size_t hint = 0;
+
+        for (size_t first = 0; first < count; first += POSE_QUERY_BLOCK) {
+            size_t block = std::min<size_t>(POSE_QUERY_BLOCK, count - first);
+            for (size_t k = 0; k < block; k++) {
+                TimeIndex::Sample sample = index.LocateFrom(times[first + k], hint);
+                hint = sample.index;
+                rows[k] = sample.index;
+                nexts[k] = std::min(sample.index + 1, last);
+                fractions[k] = sample.fraction;
+            }
+
+            if (positionsOut) {
+                for (size_t k = 0; k < block; k++) {
+                    Lerp3(&positions[rows[k] * INTEGRATION_SIZE], &positions[nexts[k] * INTEGRATION_SIZE], fractions[k],
+                        positionsOut + (first + k) * INTEGRATION_SIZE);
+                }
+            }
+            if (velocitiesOut) {
+                for (size_t k = 0; k < block; k++) {
+                    Lerp3(&velocities[rows[k] * INTEGRATION_SIZE], &velocities[nexts[k] * INTEGRATION_SIZE], fractions[k],
+                        velocitiesOut + (first + k) * INTEGRATION_SIZE);
+                }
+            }
+            if (orientationsOut) {
+                for (size_t k = 0; k < block; k++) {
+                    Slerp(&quaternions[rows[k] * Q_SIZE], &quaternions[nexts[k] * Q_SIZE], fractions[k],
+                        orientationsOut + (first + k) * Q_SIZE);
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,210 @@
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+//top levels are split one node per task until there are this many, then every task builds a whole subtree
+#define SPATIAL_PARALLEL_SUBTREES 256
+//deeper than any tree of up to 2^64 samples
+#define SPATIAL_STACK_SIZE 128
+
+namespace Trajectory {
+
+    struct Range {
+        size_t node;
+        size_t begin;
+        size_t end;
+    };
+
+    //depth-first over the nodes whose box passes overlaps(), visit() gets every sample of them
+    //the child on the side of focus goes first, so the best distance shrinks early and prunes the other one
+    template<class P, class B, class Overlaps, class Visit>
+    static void Traverse(const std::vector<P>& points, const std::vector<uint8_t>& axes, const B& bounds, const float* focus,
+        const Overlaps& overlaps, const Visit& visit) {
+        struct Item {
+            size_t node, begin, end;
+            B box;
+        };
+        Item stack[SPATIAL_STACK_SIZE];
+        int top = 0;
+        stack[top++] = { 0, 0, points.size(), bounds };
+        while (top > 0) {
+            Item item = stack[--top];
+            if (!overlaps(item.box)) continue;
+            if (item.end - item.begin <= SPATIAL_LEAF_SAMPLES) {
+                for (size_t i = item.begin; i < item.end; i++) visit(points[i]);
+                continue;
+            }
+            size_t mid = item.begin + (item.end - item.begin) / 2;
+            visit(points[mid]);
+            int axis = axes[item.node];
+            float split = points[mid].position[axis];
+            Item left = { item.node * 2 + 1, item.begin, mid, item.box };
+            Item right = { item.node * 2 + 2, mid + 1, item.end, item.box };
+            left.box.high[axis] = split;
+            right.box.low[axis] = split;
+            if (focus != nullptr && focus[axis] > split) std::swap(left, right);
+            stack[top++] = right;
+            stack[top++] = left;
+        }
+    }
+
+    void SpatialIndex::Build(Span<float> positions) {
+        size_t count = positions.size() / 3;
+        points.resize(count);
+        for (int k = 0; k < 3; k++) {
+            bounds.low[k] = FLT_MAX;
+            bounds.high[k] = -FLT_MAX;
+        }
+        for (size_t i = 0; i < count; i++) {
+            for (int k = 0; k < 3; k++) {
+                float value = positions[i * 3 + k];
+                points[i].position[k] = value;
+                bounds.low[k] = std::min(bounds.low[k], value);
+                bounds.high[k] = std::max(bounds.high[k], value);
+            }
+            points[i].sample = static_cast<uint32_t>(i);
+        }
+
+        //a child has at most half the samples of its parent, so inner nodes stay under 2^levels - 1
+        size_t levels = 0;
+        for (size_t size = count; size > SPATIAL_LEAF_SAMPLES; size /= 2) levels++;
+        axes.assign((size_t(1) << levels) - 1, 0);
+
+        std::vector<Range> level = { { 0, 0, count } }, next;
+        while (!level.empty() && level.size() < SPATIAL_PARALLEL_SUBTREES) {
+            scheduler.ParallelFor(0, level.size(), 1, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) BuildNode(level[i].node, level[i].begin, level[i].end);
+            });
+            next.clear();
+            for (const Range& range : level) {
+                if (range.end - range.begin <= SPATIAL_LEAF_SAMPLES) continue;
+                size_t mid = range.begin + (range.end - range.begin) / 2;
+                next.push_back({ range.node * 2 + 1, range.begin, mid });
+                next.push_back({ range.node * 2 + 2, mid + 1, range.end });
+            }
+            level.swap(next);
+        }
+        scheduler.ParallelFor(0, level.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; i++) BuildSubtree(level[i].node, level[i].begin, level[i].end);
+        });
+    }
+
+    void SpatialIndex::BuildNode(size_t node, size_t begin, size_t end) {
+        if (end - begin <= SPATIAL_LEAF_SAMPLES) return;
+
+        //split across the widest extent of the node's samples
+        float low[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, high[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for (size_t i = begin; i < end; i++) {
+            for (int k = 0; k < 3; k++) {
+                low[k] = std::min(low[k], points[i].position[k]);
+                high[k] = std::max(high[k], points[i].position[k]);
+            }
+        }
+        int axis = 0;
+        for (int k = 1; k < 3; k++) {
+            if (high[k] - low[k] > high[axis] - low[axis]) axis = k;
+        }
+        axes[node] = static_cast<uint8_t>(axis);
+
+        size_t mid = begin + (end - begin) / 2;
+        std::nth_element(points.begin() + begin, points.begin() + mid, points.begin() + end,
+            [axis](const Point& a, const Point& b) { return a.position[axis] < b.position[axis]; });
+    }
+
+    void SpatialIndex::BuildSubtree(size_t node, size_t begin, size_t end) {
+        if (end - begin <= SPATIAL_LEAF_SAMPLES) return;
+        BuildNode(node, begin, end);
+        size_t mid = begin + (end - begin) / 2;
+        BuildSubtree(node * 2 + 1, begin, mid);
+        BuildSubtree(node * 2 + 2, mid + 1, end);
+    }
+
+    void SpatialIndex::Clear() {
+        points.clear();
+        axes.clear();
+    }
+
+    SpatialIndex::Hit SpatialIndex::PickRay(const float origin[3], const float direction[3], float radius) const {
+        Hit hit;
+        float lengthSquared = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+        if (points.empty() || lengthSquared <= 0.0f) return hit;
+        float best = radius;
+
+        //slab test against the box grown by the best distance so far, only in front of the origin
+        auto overlaps = [&](const Box& box) {
+            float enter = 0.0f, exit = FLT_MAX;
+            for (int k = 0; k < 3; k++) {
+                float low = box.low[k] - best, high = box.high[k] + best;
+                if (direction[k] == 0.0f) {
+                    if (origin[k] < low || origin[k] > high) return false;
+                    continue;
+                }
+                float inverse = 1.0f / direction[k];
+                float t0 = (low - origin[k]) * inverse, t1 = (high - origin[k]) * inverse;
+                if (t0 > t1) std::swap(t0, t1);
+                enter = std::max(enter, t0);
+                exit = std::min(exit, t1);
+                if (enter > exit) return false;
+            }
+            return true;
+        };
+        auto visit = [&](const Point& point) {
+            float offset[3] = { point.position[0] - origin[0], point.position[1] - origin[1], point.position[2] - origin[2] };
+            float along = std::max(0.0f, (offset[0] * direction[0] + offset[1] * direction[1] + offset[2] * direction[2]) / lengthSquared);
+            float d[3] = { offset[0] - direction[0] * along, offset[1] - direction[1] * along, offset[2] - direction[2] * along };
+            float distance = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            if (distance <= best && (!hit.found || distance < hit.distance)) {
+                hit = { true, point.sample, distance, along };
+                best = distance;
+            }
+        };
+        Traverse(points, axes, bounds, origin, overlaps, visit);
+        return hit;
+    }
+
+    SpatialIndex::Hit SpatialIndex::Nearest(const float point[3], float radius) const {
+        Hit hit;
+        if (points.empty()) return hit;
+        float bestSquared = radius * radius;
+
+        auto overlaps = [&](const Box& box) {
+            float squared = 0.0f;
+            for (int k = 0; k < 3; k++) {
+                float d = std::max({ box.low[k] - point[k], 0.0f, point[k] - box.high[k] });
+                squared += d * d;
+            }
+            return squared <= bestSquared;
+        };
+        auto visit = [&](const Point& candidate) {
+            float d[3] = { candidate.position[0] - point[0], candidate.position[1] - point[1], candidate.position[2] - point[2] };
+            float squared = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+            if (squared <= bestSquared && (!hit.found || squared < hit.distance * hit.distance)) {
+                hit = { true, candidate.sample, std::sqrt(squared), 0.0f };
+                bestSquared = squared;
+            }
+        };
+        Traverse(points, axes, bounds, point, overlaps, visit);
+        return hit;
+    }
+
+    void SpatialIndex::InBox(const float low[3], const float high[3], std::vector<uint32_t>& samples) const {
+        samples.clear();
+        if (points.empty()) return;
+
+        auto overlaps = [&](const Box& box) {
+            for (int k = 0; k < 3; k++) {
+                if (box.high[k] < low[k] || box.low[k] > high[k]) return false;
+            }
+            return true;
+        };
+        auto visit = [&](const Point& point) {
+            for (int k = 0; k < 3; k++) {
+                if (point.position[k] < low[k] || point.position[k] > high[k]) return;
+            }
+            samples.push_back(point.sample);
+        };
+        Traverse(points, axes, bounds, static_cast<const float*>(nullptr), overlaps, visit);
+    }
+
+}
@@ -0,0 +1,255 @@
+#include "Spectrum.h"
+#include "Fft.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif // !M_PI
+
+//parts of the Welch average, a fixed number whatever the worker count
+#define SPECTRUM_PARTS 64
+//samples per task of the resampling
+#define RESAMPLE_GRAIN 65536
+//added to the power before the logarithm, -200 dB
+#define SPECTRUM_FLOOR 1e-20
+
+namespace Trajectory {
+
+    bool Spectrum::Run(const Engine& engine, const SpectrumSettings& settings) {
+        auto start = std::chrono::steady_clock::now();
+        size_t rows = engine.Rows();
+        size_t N = settings.segment;
+        if (!Fft::IsPowerOfTwo(N) || N < SPECTRUM_MIN_SEGMENT || rows < SPECTRUM_MIN_SEGMENT || engine.Accelerations().size() < rows * A_SIZE) {
+            return false;
+        }
+        //short recordings get one segment as long as they are
+        while (N > rows) N /= 2;
+        stats = Stats();
+        stats.rows = rows;
+
+        //uniform samples: resampled copy, or the rows as they are at the mean sample time
+        const float* signal = engine.Accelerations().data();
+        size_t count = rows;
+        double sampleTime = 1.0 / engine.SampleRate();
+        if (settings.resample && !engine.IsResampled()) {
+            sampleTime = Resample(engine);
+            signal = samples.data();
+        }
+        else {
+            std::vector<float>().swap(samples);
+        }
+        if (!(sampleTime > 0.0)) return false;
+        double fs = 1.0 / sampleTime;
+        stats.samples = count;
+        stats.sampleRate = fs;
+
+        size_t hop = std::max<size_t>(1, static_cast<size_t>(std::lround(N * (1.0 - std::clamp(settings.overlap, 0.0f, 0.95f)))));
+        size_t segments = (count - N) / hop + 1;
+        size_t perColumn = (segments + std::max<size_t>(1, settings.maxColumns) - 1) / std::max<size_t>(1, settings.maxColumns);
+        size_t columns = (segments + perColumn - 1) / perColumn;
+        stats.segments = segments;
+        columnSeconds = perColumn * hop * sampleTime;
+
+        size_t bins = N / 2 + 1;
+        size_t parts = std::min<size_t>(SPECTRUM_PARTS, columns);
+        //same layout as the last run: parts whose input did not change keep their columns and sums
+        bool reuse = N == segmentSize && hop == segmentHop && perColumn == columnSegments && fs == analyzedRate &&
+            previous.size() == count * A_SIZE && spectrogram.size() == columns * bins && partials.size() == parts * bins * A_SIZE;
+        segmentSize = N;
+        segmentHop = hop;
+        columnSegments = perColumn;
+        analyzedRate = fs;
+
+        frequencies.resize(bins);
+        for (size_t k = 0; k < bins; k++) frequencies[k] = k * fs / N;
+
+        //periodic Hann, one-sided density: |X|^2 / (fs sum w^2), doubled except at DC and Nyquist
+        std::vector<float> window(N);
+        double windowPower = 0.0;
+        for (size_t n = 0; n < N; n++) {
+            window[n] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * M_PI * n / N));
+            windowPower += static_cast<double>(window[n]) * window[n];
+        }
+        std::vector<double> scale(bins, 2.0 / (fs * windowPower));
+        scale[0] = scale[bins - 1] = 1.0 / (fs * windowPower);
+
+        Fft fft(N);
+        spectrogram.resize(columns * bins);
+        partials.resize(parts * bins * A_SIZE);
+        std::vector<uint8_t> computed(parts, 0);
+        segmentsDone.store(0);
+        segmentsTotal.store(segments);
+
+        scheduler.ParallelFor(0, parts, 1, [&](size_t begin, size_t end) {
+            std::vector<std::complex<float>> xy(N), z(N), X(bins), Y(bins);
+            std::vector<double> column(bins * A_SIZE);
+            for (size_t part = begin; part < end; part++) {
+                size_t firstColumn = part * columns / parts, lastColumn = (part + 1) * columns / parts;
+                size_t firstSegment = firstColumn * perColumn, lastSegment = std::min(segments, lastColumn * perColumn);
+                size_t firstSample = firstSegment * hop, lastSample = (lastSegment - 1) * hop + N;
+                if (reuse && std::memcmp(signal + firstSample * A_SIZE, previous.data() + firstSample * A_SIZE,
+                    (lastSample - firstSample) * A_SIZE * sizeof(float)) == 0) {
+                    segmentsDone.fetch_add(lastSegment - firstSegment);
+                    continue;
+                }
+                computed[part] = 1;
+                double* welch = &partials[part * bins * A_SIZE];
+                std::fill(welch, welch + bins * A_SIZE, 0.0);
+                for (size_t c = firstColumn; c < lastColumn; c++) {
+                    std::fill(column.begin(), column.end(), 0.0);
+                    size_t last = std::min(segments, (c + 1) * perColumn);
+                    for (size_t s = c * perColumn; s < last; s++) {
+                        const float* a = signal + s * hop * A_SIZE;
+                        float mean[A_SIZE] = {};
+                        for (size_t n = 0; n < N; n++) {
+                            mean[0] += a[n * A_SIZE];
+                            mean[1] += a[n * A_SIZE + 1];
+                            mean[2] += a[n * A_SIZE + 2];
+                        }
+                        for (int k = 0; k < A_SIZE; k++) mean[k] /= N;
+                        for (size_t n = 0; n < N; n++) {
+                            xy[n] = std::complex<float>((a[n * A_SIZE] - mean[0]) * window[n], (a[n * A_SIZE + 1] - mean[1]) * window[n]);
+                            z[n] = std::complex<float>((a[n * A_SIZE + 2] - mean[2]) * window[n], 0.0f);
+                        }
+                        fft.Forward(xy.data());
+                        fft.Forward(z.data());
+                        fft.SplitReal(xy.data(), X.data(), Y.data());
+                        for (size_t k = 0; k < bins; k++) {
+                            column[k * A_SIZE] += std::norm(X[k]) * scale[k];
+                            column[k * A_SIZE + 1] += std::norm(Y[k]) * scale[k];
+                            column[k * A_SIZE + 2] += std::norm(z[k]) * scale[k];
+                        }
+                    }
+                    float* image = &spectrogram[c * bins];
+                    double segmentCount = static_cast<double>(last - c * perColumn);
+                    for (size_t k = 0; k < bins; k++) {
+                        double sum = column[k * A_SIZE] + column[k * A_SIZE + 1] + column[k * A_SIZE + 2];
+                        image[k] = static_cast<float>(10.0 * std::log10(sum / segmentCount + SPECTRUM_FLOOR));
+                    }
+                    for (size_t k = 0; k < bins * A_SIZE; k++) welch[k] += column[k];
+                    segmentsDone.fetch_add(last - c * perColumn);
+                }
+            }
+        });
+
+        //changed columns for the view, the input for the next run
+        changedBegin = columns;
+        changedEnd = 0;
+        for (size_t part = 0; part < parts; part++) {
+            if (!computed[part]) continue;
+            size_t firstColumn = part * columns / parts, lastColumn = (part + 1) * columns / parts;
+            changedBegin = std::min(changedBegin, firstColumn);
+            changedEnd = std::max(changedEnd, lastColumn);
+            stats.columnsComputed += lastColumn - firstColumn;
+        }
+        if (changedEnd == 0) changedBegin = 0;
+        previous.assign(signal, signal + count * A_SIZE);
+
+        density.assign(bins * A_SIZE, 0.0);
+        for (size_t part = 0; part < parts; part++) {
+            for (size_t k = 0; k < bins * A_SIZE; k++) density[k] += partials[part * bins * A_SIZE + k];
+        }
+        size_t peak = 1;
+        double peakPower = -1.0;
+        for (size_t k = 0; k < bins; k++) {
+            for (int axis = 0; axis < A_SIZE; axis++) density[k * A_SIZE + axis] /= segments;
+            double power = density[k * A_SIZE] + density[k * A_SIZE + 1] + density[k * A_SIZE + 2];
+            if (k > 0 && power > peakPower) {
+                peakPower = power;
+                peak = k;
+            }
+        }
+        stats.peakFrequency = frequencies[peak];
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    double Spectrum::Resample(const Engine& engine) {
+        size_t rows = engine.Rows();
+        Span<float> ts = engine.Times();
+        Span<float> as = engine.Accelerations();
+        //time of every row from the first one, ts holds the step before the row
+        times.resize(rows);
+        times[0] = 0.0;
+        for (size_t i = 1; i < rows; i++) times[i] = times[i - 1] + std::max(0.0f, ts[i]);
+        double duration = times[rows - 1];
+        if (duration <= 0.0) return 0.0;
+        double sampleTime = duration / (rows - 1);
+
+        //every block finds its first row, then walks the rows along with the grid
+        samples.resize(rows * A_SIZE);
+        scheduler.ParallelFor(0, rows, RESAMPLE_GRAIN, [&](size_t begin, size_t end) {
+            double t = begin * sampleTime;
+            size_t i = static_cast<size_t>(std::upper_bound(times.begin(), times.end(), t) - times.begin());
+            for (size_t n = begin; n < end; n++, t = n * sampleTime) {
+                while (i < rows && times[i] <= t) i++;
+                float* out = &samples[n * A_SIZE];
+                //i is the first row after t: before it, rows with the same time are skipped to the last one
+                if (i >= rows) {
+                    for (int k = 0; k < A_SIZE; k++) out[k] = as[(rows - 1) * A_SIZE + k];
+                    continue;
+                }
+                size_t previous = i - 1;
+                double step = times[i] - times[previous];
+                float u = static_cast<float>((t - times[previous]) / step);
+                for (int k = 0; k < A_SIZE; k++) {
+                    float a0 = as[previous * A_SIZE + k], a1 = as[i * A_SIZE + k];
+                    out[k] = a0 + (a1 - a0) * u;
+                }
+            }
+        });
+        return sampleTime;
+    }
+
+    double Spectrum::SegmentSeconds() const {
+        return stats.sampleRate > 0.0 ? segmentSize / stats.sampleRate : 0.0;
+    }
+
+    bool Spectrum::Save(const std::string& path) const {
+        std::ofstream file(path, std::ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "Error due file creating " << path << std::endl;
+            return false;
+        }
+        file << "frequency,psd_x,psd_y,psd_z\n";
+        char line[128];
+        for (size_t k = 0; k < frequencies.size(); k++) {
+            int length = std::snprintf(line, sizeof(line), "%.9g,%.9g,%.9g,%.9g\n", frequencies[k],
+                density[k * A_SIZE], density[k * A_SIZE + 1], density[k * A_SIZE + 2]);
+            file.write(line, length);
+        }
+        return file.good();
+    }
+
+    void Spectrum::Clear() {
+        std::vector<float>().swap(samples);
+        std::vector<float>().swap(previous);
+        std::vector<double>().swap(partials);
+        std::vector<double>().swap(times);
+        frequencies.clear();
+        density.clear();
+        std::vector<float>().swap(spectrogram);
+        columnSeconds = 0.0;
+        segmentSize = 0;
+        segmentHop = 0;
+        columnSegments = 0;
+        analyzedRate = 0.0;
+        changedBegin = changedEnd = 0;
+        stats = Stats();
+        segmentsDone.store(0);
+        segmentsTotal.store(0);
+    }
+
+    float Spectrum::GetProgress() const {
+        size_t total = segmentsTotal.load();
+        return total == 0 ? 0.0f : static_cast<float>(segmentsDone.load()) / static_cast<float>(total);
+    }
+
+}
@@ -0,0 +1,144 @@
+#include "StageExporter.h"
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+//text is flushed to the file every time this much is formatted
+#define EXPORT_BUFFER_SIZE (1 << 20)
+//longest float printed by to_chars plus separator
+#define MAX_FLOAT_CHARS 32
+
+StageExporter::~StageExporter() {
+    Wait();
+}
+
+void StageExporter::Begin(const std::string& folder, ExportFormat format) {
+    Wait();
+    this->folder = folder;
+    this->format = format;
+    usedJobs = 0;
+    countedJobs = 0;
+    stats = Stats();
+    start = std::chrono::steady_clock::now();
+}
+
+void StageExporter::Submit(const std::vector<float>& data, int stride, const char* header, const char* name) {
+    Submit(data.data(), data.size(), stride, header, name);
+}
+
+void StageExporter::Submit(const float* data, size_t count, int stride, const char* header, const char* name) {
+    if (usedJobs == jobs.size()) {
+        jobs.push_back(std::make_unique<Job>());
+    }
+    Job& job = *jobs[usedJobs++];
+
+    job.data.assign(data, data + count);
+    job.stride = stride;
+    job.header = header;
+    job.path = folder + "/" + name;
+    //drop .csv, extension is picked per format
+    size_t dot = job.path.rfind('.');
+    if (dot != std::string::npos) job.path.resize(dot);
+    job.bytes = 0;
+    job.failed = 0;
+
+    scheduler.Submit([this, &job]() { WriteJob(job); }, TaskPriority::LOW, &pending);
+}
+
+bool StageExporter::Wait() {
+    if (usedJobs == countedJobs) return stats.failed == 0;
+
+    scheduler.Wait(pending);
+    for (size_t i = countedJobs; i < usedJobs; i++) {
+        stats.files += format == ExportFormat::CSV_AND_NPY ? 2 : 1;
+        stats.failed += jobs[i]->failed;
+        stats.bytes += jobs[i]->bytes;
+    }
+    countedJobs = usedJobs;
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return stats.failed == 0;
+}
+
+void StageExporter::WriteJob(Job& job) {
+    if (format == ExportFormat::CSV || format == ExportFormat::CSV_AND_NPY) {
+        WriteCSV(job);
+    }
+    if (format == ExportFormat::NPY || format == ExportFormat::CSV_AND_NPY) {
+        WriteNPY(job);
+    }
+}
+
+void StageExporter::WriteCSV(Job& job) {
+    std::ofstream file(job.path + ".csv", std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error due file creating " << job.path << ".csv" << std::endl;
+        job.failed++;
+        return;
+    }
+
+    job.buffer.resize(EXPORT_BUFFER_SIZE);
+    char* const begin = job.buffer.data();
+    char* const flushAt = begin + EXPORT_BUFFER_SIZE - MAX_FLOAT_CHARS * job.stride;
+    char* out = begin;
+
+    file << job.header << "\n";
+    job.bytes += job.header.size() + 1;
+
+    const float* values = job.data.data();
+    const size_t count = job.data.size();
+    for (size_t i = 0; i + job.stride <= count; i += job.stride) {
+        for (int j = 0; j < job.stride; j++) {
+            out = std::to_chars(out, out + MAX_FLOAT_CHARS, values[i + j]).ptr;
+            *out++ = j != job.stride - 1 ? ',' : '\n';
+        }
+        if (out >= flushAt) {
+            file.write(begin, out - begin);
+            job.bytes += out - begin;
+            out = begin;
+        }
+    }
+    file.write(begin, out - begin);
+    job.bytes += out - begin;
+    //a full disk shows up on the last flush at the latest
+    file.close();
+    if (!file) {
+        std::cerr << "Error due file writing " << job.path << ".csv" << std::endl;
+        job.failed++;
+    }
+}
+
+void StageExporter::WriteNPY(Job& job) {
+    std::ofstream file(job.path + ".npy", std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Error due file creating " << job.path << ".npy" << std::endl;
+        job.failed++;
+        return;
+    }
+
+    //https://numpy.org/doc/stable/reference/generated/numpy.lib.format.html
+    //version 1.0: magic, version, little endian header length, python dict padded to 64 bytes
+    size_t rows = job.data.size() / job.stride;
+    std::string dict = "{'descr': '<f4', 'fortran_order': False, 'shape': ("
+        + std::to_string(rows) + ", " + std::to_string(job.stride) + "), }";
+    const size_t preamble = 10;
+    size_t total = preamble + dict.size() + 1;
+    dict.append((64 - total % 64) % 64, ' ');
+    dict.push_back('\n');
+
+    unsigned short headerSize = static_cast<unsigned short>(dict.size());
+    const char magic[8] = { '\x93', 'N', 'U', 'M', 'P', 'Y', 1, 0 };
+    const char headerLength[2] = { static_cast<char>(headerSize & 0xFF), static_cast<char>(headerSize >> 8) };
+    file.write(magic, sizeof(magic));
+    file.write(headerLength, sizeof(headerLength));
+    file.write(dict.data(), dict.size());
+    //x86 is little endian, floats go as they are
+    file.write(reinterpret_cast<const char*>(job.data.data()), rows * job.stride * sizeof(float));
+
+    job.bytes += preamble + dict.size() + rows * job.stride * sizeof(float);
+    file.close();
+    if (!file) {
+        std::cerr << "Error due file writing " << job.path << ".npy" << std::endl;
+        job.failed++;
+    }
+}
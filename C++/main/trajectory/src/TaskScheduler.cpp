@@ -0,0 +1,272 @@
+#include "TaskScheduler.h"
+#include <algorithm>
+#include <iostream>
+
+//ParallelFor makes this many chunks per worker so that stealing can even out the load
+#define CHUNKS_PER_WORKER 4
+//how long a waiting thread sleeps before looking for new tasks again
+#define WAIT_POLL_MICROSECONDS 500
+
+static thread_local TaskScheduler* currentScheduler = nullptr;
+static thread_local int currentWorker = -1;
+
+#pragma region TaskQueue
+void TaskScheduler::TaskQueue::PushBack(Task&& task) {
+    if (count == tasks.size()) {
+        //grow and unwrap, capacity is kept afterwards
+        std::vector<Task> grown(std::max<size_t>(16, tasks.size() * 2));
+        for (size_t i = 0; i < count; i++) {
+            grown[i] = std::move(tasks[(head + i) % tasks.size()]);
+        }
+        tasks.swap(grown);
+        head = 0;
+    }
+    tasks[(head + count) % tasks.size()] = std::move(task);
+    count++;
+}
+
+bool TaskScheduler::TaskQueue::PopBack(Task& task) {
+    if (count == 0) return false;
+    count--;
+    task = std::move(tasks[(head + count) % tasks.size()]);
+    return true;
+}
+
+bool TaskScheduler::TaskQueue::PopFront(Task& task) {
+    if (count == 0) return false;
+    task = std::move(tasks[head]);
+    head = (head + 1) % tasks.size();
+    count--;
+    return true;
+}
+
+bool TaskScheduler::TaskQueue::PopGroup(const TaskGroup* group, Task& task) {
+    for (size_t i = count; i-- > 0; ) {
+        if (tasks[(head + i) % tasks.size()].group != group) continue;
+        task = std::move(tasks[(head + i) % tasks.size()]);
+        for (size_t j = i + 1; j < count; j++) {
+            tasks[(head + j - 1) % tasks.size()] = std::move(tasks[(head + j) % tasks.size()]);
+        }
+        count--;
+        return true;
+    }
+    return false;
+}
+#pragma endregion
+
+TaskScheduler& TaskScheduler::Get() {
+    static TaskScheduler scheduler;
+    return scheduler;
+}
+
+TaskScheduler::TaskScheduler(unsigned workerCount) : startTime(std::chrono::steady_clock::now()) {
+    if (workerCount == 0) {
+        workerCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < workerCount; i++) {
+        workers.push_back(std::make_unique<Worker>());
+    }
+    //threads start after every worker exists, so they can steal from each other right away
+    for (unsigned i = 0; i < workerCount; i++) {
+        workers[i]->thread = std::thread(&TaskScheduler::WorkerLoop, this, static_cast<int>(i));
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    sleepCondition.notify_all();
+    for (auto& worker : workers) {
+        if (worker->thread.joinable()) worker->thread.join();
+    }
+}
+
+void TaskScheduler::Submit(std::function<void()> function, TaskPriority priority, TaskGroup* group) {
+    Task task;
+    task.function = std::move(function);
+    task.group = group;
+    if (group) group->pending.fetch_add(1, std::memory_order_relaxed);
+    Push(std::move(task), priority);
+}
+
+void TaskScheduler::ParallelFor(size_t begin, size_t end, size_t grain, RangeFunction range, const void* body, TaskPriority priority) {
+    if (end <= begin) return;
+    size_t count = end - begin;
+    size_t chunks = std::min(count / std::max<size_t>(grain, 1), static_cast<size_t>(WorkerCount()) * CHUNKS_PER_WORKER);
+    if (chunks <= 1) {
+        range(body, begin, end);
+        return;
+    }
+    size_t chunkSize = (count + chunks - 1) / chunks;
+
+    TaskGroup group;
+    for (size_t chunkBegin = begin + chunkSize; chunkBegin < end; chunkBegin += chunkSize) {
+        Task task;
+        task.range = range;
+        task.body = body;
+        task.begin = chunkBegin;
+        task.end = std::min(end, chunkBegin + chunkSize);
+        task.group = &group;
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        Push(std::move(task), priority);
+    }
+
+    //first chunk is ours, others must finish before body goes out of scope even if it throws
+    try {
+        range(body, begin, begin + chunkSize);
+    }
+    catch (...) {
+        std::lock_guard<std::mutex> lock(group.mutex);
+        if (!group.error) group.error = std::current_exception();
+    }
+    Wait(group);
+}
+
+void TaskScheduler::Wait(TaskGroup& group) {
+    //the wait must not get stuck in a long batch task of somebody else, only its own ones are worth running
+    int self = currentScheduler == this ? currentWorker : -1;
+    while (!group.IsDone()) {
+        if (TryRunOne(self, TaskPriority::HIGH, &group)) continue;
+        std::unique_lock<std::mutex> lock(group.mutex);
+        group.doneCondition.wait_for(lock, std::chrono::microseconds(WAIT_POLL_MICROSECONDS),
+            [&group]() { return group.pending.load(std::memory_order_acquire) == 0; });
+    }
+    //last task may still hold the mutex while notifying, the group must outlive that
+    std::lock_guard<std::mutex> lock(group.mutex);
+    if (group.error) {
+        std::exception_ptr error = group.error;
+        group.error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+TaskScheduler::Stats TaskScheduler::GetStats() const {
+    Stats stats;
+    double lifetime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+    for (const auto& worker : workers) {
+        WorkerStats workerStats;
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+            for (int p = 0; p < TASK_PRIORITY_COUNT; p++) {
+                workerStats.queued[p] = worker->queues[p].Size();
+            }
+        }
+        workerStats.executed = worker->executed.load();
+        workerStats.steals = worker->steals.load();
+        workerStats.utilization = lifetime > 0.0 ? worker->busyNanoseconds.load() * 1e-9 / lifetime : 0.0;
+        stats.executed += workerStats.executed;
+        stats.steals += workerStats.steals;
+        stats.workers.push_back(workerStats);
+    }
+    stats.helped = helped.load();
+    return stats;
+}
+
+void TaskScheduler::Push(Task&& task, TaskPriority priority) {
+    int self = currentScheduler == this ? currentWorker : -1;
+    size_t target = self >= 0 ? static_cast<size_t>(self) : nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+
+    //counted before it is visible, so the counter never goes below the real number of tasks
+    queuedCount.fetch_add(1, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(workers[target]->mutex);
+        workers[target]->queues[static_cast<int>(priority)].PushBack(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    sleepCondition.notify_one();
+}
+
+bool TaskScheduler::Pop(int self, TaskPriority lowest, const TaskGroup* group, Task& task) {
+    size_t workerCount = workers.size();
+    for (int p = 0; p < TASK_PRIORITY_COUNT; p++) {
+        bool any = p <= static_cast<int>(lowest);
+        if (!any && !group) break;
+        //own newest task first, it is likely still in cache
+        if (self >= 0) {
+            Worker& own = *workers[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (any ? own.queues[p].PopBack(task) : own.queues[p].PopGroup(group, task)) return true;
+        }
+        //steal the oldest task of somebody else
+        for (size_t offset = 1; offset <= workerCount; offset++) {
+            size_t victim = (static_cast<size_t>(self + 1) + offset) % workerCount;
+            if (static_cast<int>(victim) == self) continue;
+            Worker& other = *workers[victim];
+            std::lock_guard<std::mutex> lock(other.mutex);
+            if (any ? other.queues[p].PopFront(task) : other.queues[p].PopGroup(group, task)) {
+                if (self >= 0) workers[self]->steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool TaskScheduler::TryRunOne(int self, TaskPriority lowest, const TaskGroup* group) {
+    if (queuedCount.load(std::memory_order_acquire) == 0) return false;
+
+    Task task;
+    if (!Pop(self, lowest, group, task)) return false;
+    queuedCount.fetch_sub(1, std::memory_order_relaxed);
+
+    if (self >= 0) {
+        auto start = std::chrono::steady_clock::now();
+        Run(task);
+        auto busy = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        workers[self]->busyNanoseconds.fetch_add(busy, std::memory_order_relaxed);
+        workers[self]->executed.fetch_add(1, std::memory_order_relaxed);
+    }
+    else {
+        Run(task);
+        helped.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void TaskScheduler::Run(Task& task) {
+    try {
+        if (task.range) {
+            task.range(task.body, task.begin, task.end);
+        }
+        else {
+            task.function();
+        }
+    }
+    catch (...) {
+        if (task.group) {
+            std::lock_guard<std::mutex> lock(task.group->mutex);
+            if (!task.group->error) task.group->error = std::current_exception();
+        }
+        else {
+            std::cerr << "Unhandled exception in task\n";
+        }
+    }
+    //release captures before the group is signaled
+    task.function = nullptr;
+
+    if (task.group) {
+        std::lock_guard<std::mutex> lock(task.group->mutex);
+        if (task.group->pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            task.group->doneCondition.notify_all();
+        }
+    }
+}
+
+void TaskScheduler::WorkerLoop(int index) {
+    currentScheduler = this;
+    currentWorker = index;
+
+    while (true) {
+        if (TryRunOne(index, TaskPriority::LOW)) continue;
+
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleepCondition.wait(lock, [this]() {
+            return stopping.load() || queuedCount.load(std::memory_order_acquire) > 0;
+        });
+        if (stopping.load() && queuedCount.load() == 0) return;
+    }
+}
@@ -0,0 +1,81 @@
+#include "TimeIndex.h"
+#include <algorithm>
+#include <cmath>
+
+//a moment further ahead of the hint than this many rows is found through the buckets instead
+#define GALLOP_MAX_STEP 64
+
+namespace Trajectory {
+
+    void TimeIndex::Build(Span<float> deltaTimes) {
+        times.resize(deltaTimes.size() / T_SIZE);
+        //double, a float sum drifts by milliseconds over an hour of 100 Hz rows
+        double time = 0.0;
+        for (size_t i = 0; i < times.size(); i++) {
+            if (i > 0) time += std::max(0.0f, deltaTimes[i * T_SIZE]);
+            times[i] = time;
+        }
+
+        buckets.clear();
+        bucketScale = 0.0;
+        if (time <= 0.0) return;
+        bucketScale = times.size() / time;
+        buckets.resize(times.size() + 1);
+        size_t row = 0;
+        for (size_t bucket = 0; bucket < buckets.size(); bucket++) {
+            double start = bucket / bucketScale;
+            while (row + 1 < times.size() && times[row + 1] <= start) row++;
+            buckets[bucket] = row;
+        }
+    }
+
+    void TimeIndex::Clear() {
+        times.clear();
+        buckets.clear();
+        bucketScale = 0.0;
+    }
+
+    TimeIndex::Sample TimeIndex::Locate(double time) const {
+        Sample sample;
+        //NaN passes none of the comparisons below and would reach the bucket cast, it gets the first row
+        if (times.empty() || std::isnan(time) || time <= times.front()) return sample;
+        if (time >= times.back()) {
+            sample.index = times.size() - 1;
+            return sample;
+        }
+        //rows of the bucket and one past it, rounding at the bucket edges falls back to the whole search
+        size_t bucket = static_cast<size_t>(time * bucketScale);
+        if (bucket + 1 < buckets.size()) {
+            size_t low = buckets[bucket], high = std::min(buckets[bucket + 1] + 2, times.size());
+            if (times[low] <= time && (high == times.size() || times[high - 1] > time)) {
+                return Between(std::upper_bound(times.begin() + low + 1, times.begin() + high, time) - times.begin(), time);
+            }
+        }
+        //first row after time, rows with the same time are skipped over
+        return Between(std::upper_bound(times.begin(), times.end(), time) - times.begin(), time);
+    }
+
+    TimeIndex::Sample TimeIndex::LocateFrom(double time, size_t hint) const {
+        if (hint >= times.size() || std::isnan(time) || times[hint] > time || time >= times.back()) return Locate(time);
+
+        //galloping: doubling steps until a row is past time, then a binary search in the last step
+        size_t low = hint, step = 1, high = hint + 1;
+        while (high < times.size() && times[high] <= time) {
+            if (step > GALLOP_MAX_STEP) return Locate(time);
+            low = high;
+            step *= 2;
+            high = low + step;
+        }
+        high = std::min(high, times.size());
+        return Between(std::upper_bound(times.begin() + low + 1, times.begin() + high, time) - times.begin(), time);
+    }
+
+    TimeIndex::Sample TimeIndex::Between(size_t next, double time) const {
+        Sample sample;
+        sample.index = next - 1;
+        double span = times[next] - times[sample.index];
+        sample.fraction = span > 0.0 ? static_cast<float>((time - times[sample.index]) / span) : 0.0f;
+        return sample;
+    }
+
+}
@@ -0,0 +1,212 @@
+#include "Tuner.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+
+//parallel tasks, each has its own pipeline
+#define TUNER_MAX_PARTS 32
+//pipelines of all parts together, long recordings get fewer parts
+#define TUNER_MEMORY_BYTES (512ull * 1024 * 1024)
+//span of the search around the best candidate is multiplied by this every round
+#define TUNER_SHRINK 0.5
+//cutoffs kept under the Nyquist frequency
+#define TUNER_MAX_NORMAL_CUTOFF 0.45
+
+namespace Trajectory {
+
+    //[0, 1), the same on every compiler unlike the std distributions
+    static double Uniform(uint64_t& state) {
+        return (LanePipeline::SplitMix64(state) >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    bool Tuner::Run(const Engine& engine, const TuningSettings& newSettings) {
+        auto start = std::chrono::steady_clock::now();
+        size_t rows = engine.Rows();
+        if (rows < 2 || engine.Positions().size() < rows * 3 || engine.Rotations().size() < rows * R_SIZE) {
+            return false;
+        }
+        settings = newSettings;
+        settings.rounds = std::max(1, settings.rounds);
+        const Settings& base = engine.GetSettings();
+
+        Span<float> ts = engine.Times();
+        double duration = 0.0;
+        for (size_t i = 0; i < rows; i++) duration += ts[i];
+        if (duration <= 0.0) return false;
+        double maxCutoff = std::min(settings.maxCutoff, TUNER_MAX_NORMAL_CUTOFF * rows / duration);
+        double minCutoff = std::min(settings.minCutoff, maxCutoff);
+
+        //REST_AT_ENDS looks at the rows within restSeconds of either end
+        double time = 0.0;
+        for (restRows[0] = 1; restRows[0] < rows && time < settings.restSeconds; restRows[0]++) time += ts[restRows[0]];
+        time = 0.0;
+        for (restRows[1] = 1; restRows[1] < rows && time < settings.restSeconds; restRows[1]++) time += ts[rows - restRows[1]];
+
+        //the same divisor as Objectives() over the engine's own run
+        Span<float> motion = settings.objective == TuningObjective::RETURN_TO_START ? engine.Positions() : engine.Velocities();
+        referenceMotion = 0.0;
+        for (size_t i = 0; i < rows; i++) {
+            const float* current = &motion[i * INTEGRATION_SIZE];
+            if (settings.objective == TuningObjective::RETURN_TO_START) {
+                if (i == 0) continue;
+                const float* previous = current - INTEGRATION_SIZE;
+                float d[3] = { current[0] - previous[0], current[1] - previous[1], current[2] - previous[2] };
+                referenceMotion += std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            }
+            else {
+                referenceMotion += current[0] * current[0] + current[1] * current[1] + current[2] * current[2];
+            }
+        }
+        if (settings.objective == TuningObjective::REST_AT_ENDS) referenceMotion = std::sqrt(referenceMotion / rows);
+
+        //gravity keeps its direction, only the magnitude is searched
+        float magnitude = std::sqrt(base.gravityVector[0] * base.gravityVector[0] + base.gravityVector[1] * base.gravityVector[1] +
+            base.gravityVector[2] * base.gravityVector[2]);
+        for (int k = 0; k < 3; k++) {
+            gravityDirection[k] = magnitude > 0.0f ? base.gravityVector[k] / magnitude : (k == 2 ? 1.0f : 0.0f);
+        }
+
+        size_t groups = std::max<size_t>(1, (settings.candidates + PIPELINE_LANES - 1) / PIPELINE_LANES);
+        size_t partCount = std::min<size_t>({ groups, TUNER_MAX_PARTS, std::max<size_t>(1, TUNER_MEMORY_BYTES / LanePipeline::BytesFor(rows)) });
+        workspaces.resize(partCount);
+        groupsDone.store(0);
+        groupsTotal.store(groups * settings.rounds);
+
+        //first round: the engine settings, then the whole ranges; later ones around the best so far
+        std::vector<Candidate> candidates(groups * PIPELINE_LANES);
+        Candidate best = { base.filterCutoff, { base.accelBias[0], base.accelBias[1], base.accelBias[2] }, magnitude, DBL_MAX };
+        uint64_t random = settings.seed;
+        double logMin = std::log(minCutoff), logMax = std::log(maxCutoff);
+        double span = 1.0;
+        for (int round = 0; round < settings.rounds; round++) {
+            for (size_t c = 0; c < candidates.size(); c++) {
+                Candidate& candidate = candidates[c];
+                if (round == 0 && c == 0) {
+                    candidate = best;
+                    continue;
+                }
+                //uniform in [best - span/2, best + span/2] of every range, clamped to it; the first round covers all of it
+                auto around = [&](double center, double low, double high) {
+                    if (round == 0) center = 0.5 * (low + high);
+                    return std::clamp(center + (Uniform(random) - 0.5) * span * (high - low), low, high);
+                };
+                candidate.cutoff = std::exp(around(std::log(std::clamp(best.cutoff, minCutoff, maxCutoff)), logMin, logMax));
+                for (int k = 0; k < 3; k++) {
+                    candidate.bias[k] = static_cast<float>(around(best.bias[k], -settings.maxBias, settings.maxBias));
+                }
+                candidate.gravity = static_cast<float>(around(best.gravity, settings.minGravity, settings.maxGravity));
+            }
+
+            Evaluate(engine, candidates);
+            if (round == 0) result.initialObjective = candidates[0].objective;
+            //ties go to the earlier candidate, whichever part finished first
+            for (const Candidate& candidate : candidates) {
+                if (candidate.objective < best.objective) best = candidate;
+            }
+            span *= TUNER_SHRINK;
+        }
+
+        result.settings = base;
+        result.settings.filterCutoff = best.cutoff;
+        for (int k = 0; k < 3; k++) {
+            result.settings.accelBias[k] = best.bias[k];
+            result.settings.gravityVector[k] = gravityDirection[k] * best.gravity;
+        }
+        result.objective = best.objective;
+        result.evaluations = candidates.size() * settings.rounds;
+        result.rows = rows;
+        result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return true;
+    }
+
+    void Tuner::Evaluate(const Engine& engine, std::vector<Candidate>& candidates) {
+        const size_t L = PIPELINE_LANES;
+        size_t groups = candidates.size() / L;
+        size_t partCount = workspaces.size();
+        scheduler.ParallelFor(0, partCount, 1, [&](size_t begin, size_t end) {
+            for (size_t part = begin; part < end; part++) {
+                LanePipeline& pipeline = workspaces[part];
+                for (size_t group = part * groups / partCount; group < (part + 1) * groups / partCount; group++) {
+                    LanePipeline::Lanes lanes;
+                    for (size_t l = 0; l < L; l++) {
+                        const Candidate& candidate = candidates[group * L + l];
+                        for (int k = 0; k < 3; k++) {
+                            lanes.bias[k][l] = candidate.bias[k];
+                            lanes.gravity[k][l] = gravityDirection[k] * candidate.gravity;
+                        }
+                        lanes.cutoff[l] = candidate.cutoff;
+                    }
+                    pipeline.Run(engine, lanes);
+
+                    double objectives[L];
+                    Objectives(pipeline, objectives);
+                    for (size_t l = 0; l < L; l++) {
+                        candidates[group * L + l].objective = objectives[l];
+                    }
+                    groupsDone.fetch_add(1);
+                }
+            }
+        });
+    }
+
+    void Tuner::Objectives(const LanePipeline& pipeline, double objectives[PIPELINE_LANES]) const {
+        const size_t L = PIPELINE_LANES;
+        size_t rows = pipeline.Rows();
+        double numerator[L] = {}, denominator[L] = {};
+
+        if (settings.objective == TuningObjective::RETURN_TO_START) {
+            const float* first = pipeline.Position(0);
+            const float* last = pipeline.Position(rows - 1);
+            for (size_t i = 1; i < rows; i++) {
+                const float* previous = pipeline.Position(i - 1);
+                const float* current = pipeline.Position(i);
+                for (size_t l = 0; l < L; l++) {
+                    float d[3] = { current[l] - previous[l], current[L + l] - previous[L + l], current[2 * L + l] - previous[2 * L + l] };
+                    denominator[l] += std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+                }
+            }
+            for (size_t l = 0; l < L; l++) {
+                float d[3] = { last[l] - first[l], last[L + l] - first[L + l], last[2 * L + l] - first[2 * L + l] };
+                numerator[l] = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            }
+        }
+        else {
+            size_t restCount = 0;
+            for (size_t i = 0; i < rows; i++) {
+                bool rest = i < restRows[0] || i >= rows - restRows[1];
+                restCount += rest ? 1 : 0;
+                const float* v = pipeline.Velocity(i);
+                for (size_t l = 0; l < L; l++) {
+                    double squared = v[l] * v[l] + v[L + l] * v[L + l] + v[2 * L + l] * v[2 * L + l];
+                    denominator[l] += squared;
+                    if (rest) numerator[l] += squared;
+                }
+            }
+            //mean squares, then RMS ratio
+            for (size_t l = 0; l < L; l++) {
+                numerator[l] = std::sqrt(numerator[l] / std::max<size_t>(1, restCount));
+                denominator[l] = std::sqrt(denominator[l] / rows);
+            }
+        }
+
+        //nothing moved at all: no information, worst score
+        for (size_t l = 0; l < L; l++) {
+            denominator[l] = std::min(denominator[l], referenceMotion);
+            objectives[l] = denominator[l] > 0.0 ? numerator[l] / denominator[l] : DBL_MAX;
+        }
+    }
+
+    void Tuner::Clear() {
+        std::vector<LanePipeline>().swap(workspaces);
+        result = TuningResult();
+        groupsDone.store(0);
+        groupsTotal.store(0);
+    }
+
+    float Tuner::GetProgress() const {
+        size_t total = groupsTotal.load();
+        return total == 0 ? 0.0f : static_cast<float>(groupsDone.load()) / static_cast<float>(total);
+    }
+
+}
@@ -0,0 +1,150 @@
+//AllanVariance tests, run by ctest: the white noise curve and a naive overlapping estimate.
+//usage: trajectory_allan_variance_test
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "Check.h"
+#include "AllanVariance.h"
+#include "Engine.h"
+
+//100 Hz rows
+#define SAMPLE_MILLISECONDS 10
+#define NOISE_ROWS 100000
+//rows of the naive comparison, every cluster size is checked against a plain loop
+#define SHORT_ROWS 300
+//white noise per sample on the three axes
+#define NOISE_DEVIATION_X 0.01
+#define NOISE_DEVIATION_Y 0.02
+#define NOISE_DEVIATION_Z 0.005
+//cluster sizes up to rows / this take part in the slope, larger ones have too few independent clusters
+#define SLOPE_CLUSTERS 100
+
+static const double deviations[A_SIZE] = { NOISE_DEVIATION_X, NOISE_DEVIATION_Y, NOISE_DEVIATION_Z };
+
+//white noise around gravity on z, written as recorded
+static std::vector<float> MakeNoise(size_t rows, std::mt19937& random) {
+    std::normal_distribution<float> noise(0.0f, 1.0f);
+    std::vector<float> raw(rows * A_SIZE);
+    for (size_t i = 0; i < rows; i++) {
+        for (int axis = 0; axis < A_SIZE; axis++) {
+            float value = static_cast<float>(deviations[axis] * noise(random)) + (axis == 2 ? 1.0f : 0.0f);
+            char text[32];
+            std::snprintf(text, sizeof(text), "%.6f", value);
+            raw[i * A_SIZE + axis] = std::stof(text);
+        }
+    }
+    return raw;
+}
+
+static std::string MakeRecording(const std::vector<float>& raw) {
+    std::string text = "t,w,x,y,z,ax,ay,az\n";
+    char line[128];
+    for (size_t i = 0; i < raw.size() / A_SIZE; i++) {
+        int length = std::snprintf(line, sizeof(line), "%d,1.0,0.0,0.0,0.0,%.6f,%.6f,%.6f\n", SAMPLE_MILLISECONDS,
+            raw[i * A_SIZE], raw[i * A_SIZE + 1], raw[i * A_SIZE + 2]);
+        text.append(line, length);
+    }
+    return text;
+}
+
+//sigma^2(m) = <(mean of the next m samples - mean of m samples)^2> / 2 over every start, straight from the samples
+static double NaiveDeviation(const std::vector<float>& raw, int axis, size_t m) {
+    size_t rows = raw.size() / A_SIZE;
+    double sum = 0.0;
+    size_t count = 0;
+    for (size_t k = 0; k + 2 * m <= rows; k++, count++) {
+        double first = 0.0, second = 0.0;
+        for (size_t i = k; i < k + m; i++) first += raw[i * A_SIZE + axis];
+        for (size_t i = k + m; i < k + 2 * m; i++) second += raw[i * A_SIZE + axis];
+        double d = (second - first) / m;
+        sum += d * d;
+    }
+    return std::sqrt(sum / (2.0 * count));
+}
+
+static void TestWhiteNoise(std::mt19937& random) {
+    std::string text = MakeRecording(MakeNoise(NOISE_ROWS, random));
+    Trajectory::Engine engine;
+    CHECK(engine.LoadFromMemory(text.data(), text.size()));
+    Trajectory::AllanVariance allan;
+    CHECK(allan.Run(engine));
+    const Trajectory::AllanVariance::Stats& stats = allan.GetStats();
+    CHECK(stats.rows == NOISE_ROWS);
+    CHECK(std::fabs(stats.sampleTime - SAMPLE_MILLISECONDS / 1000.0) < 1e-6);
+    Trajectory::Span<double> taus = allan.Taus();
+    CHECK(taus.size() > 10 && taus[0] == stats.sampleTime);
+    CHECK(allan.Deviations().size() == taus.size() * A_SIZE);
+    if (taus.size() <= 10) return;
+
+    for (int axis = 0; axis < A_SIZE; axis++) {
+        //least squares slope of log sigma over log tau, -1/2 for white noise
+        double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+        size_t n = 0;
+        for (size_t t = 0; t < taus.size() && taus[t] <= stats.sampleTime * NOISE_ROWS / SLOPE_CLUSTERS; t++, n++) {
+            double x = std::log(taus[t]), y = std::log(allan.Deviations()[t * A_SIZE + axis]);
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+        double slope = (n * sxy - sx * sy) / (n * sxx - sx * sx);
+        //the noise density: sigma per sample times sqrt(sample time), and the deviation of one sample
+        double density = deviations[axis] * std::sqrt(stats.sampleTime);
+        if (std::fabs(slope + 0.5) > 0.02 || std::fabs(stats.randomWalk[axis] - density) > 0.05 * density) {
+            std::cerr << "axis " << axis << ": slope " << slope << ", random walk " << stats.randomWalk[axis] << " for " << density << std::endl;
+        }
+        CHECK(std::fabs(slope + 0.5) <= 0.02);
+        CHECK(std::fabs(stats.randomWalk[axis] - density) <= 0.05 * density);
+        CHECK(std::fabs(stats.sampleNoise[axis] - deviations[axis]) <= 0.02 * deviations[axis]);
+        //white noise has no flat bottom, the lowest point is one of the largest clusters
+        CHECK(stats.biasInstabilityTau[axis] >= taus[taus.size() / 2]);
+    }
+}
+
+static void TestNaive(std::mt19937& random) {
+    std::vector<float> raw = MakeNoise(SHORT_ROWS, random);
+    std::string text = MakeRecording(raw);
+    Trajectory::Engine engine;
+    CHECK(engine.LoadFromMemory(text.data(), text.size()));
+
+    //fully overlapping: every cluster size against the plain loop
+    Trajectory::AllanSettings settings;
+    settings.samplesPerCluster = 0;
+    Trajectory::AllanVariance allan;
+    CHECK(allan.Run(engine, settings));
+    Trajectory::Span<double> taus = allan.Taus();
+    size_t mismatches = 0, largest = 0;
+    for (size_t t = 0; t < taus.size(); t++) {
+        size_t m = static_cast<size_t>(std::llround(taus[t] / allan.GetStats().sampleTime));
+        largest = m;
+        for (int axis = 0; axis < A_SIZE; axis++) {
+            double naive = NaiveDeviation(raw, axis, m);
+            if (std::fabs(allan.Deviations()[t * A_SIZE + axis] - naive) > 1e-6 * naive) mismatches++;
+        }
+    }
+    if (mismatches != 0) std::cerr << mismatches << " deviations differ from the naive estimate" << std::endl;
+    CHECK(mismatches == 0);
+    CHECK(largest <= (SHORT_ROWS - 1) / 2 && largest * 10 > (SHORT_ROWS - 1) / 2);
+
+    //fewer clusters per size stay close to it, and the first sizes are still fully overlapping
+    Trajectory::AllanVariance sparse;
+    CHECK(sparse.Run(engine));
+    CHECK(sparse.Taus().size() == taus.size());
+    for (int axis = 0; axis < A_SIZE; axis++) CHECK(sparse.Deviations()[axis] == allan.Deviations()[axis]);
+
+    //too short
+    std::vector<float> two(2 * A_SIZE, 0.0f);
+    std::string shortText = MakeRecording(two);
+    Trajectory::Engine shortEngine;
+    CHECK(shortEngine.LoadFromMemory(shortText.data(), shortText.size()));
+    CHECK(!allan.Run(shortEngine, settings));
+}
+
+int main() {
+    std::mt19937 random(11);
+    TestWhiteNoise(random);
+    TestNaive(random);
+    return Finish();
+}
@@ -0,0 +1,133 @@
+//Steady state of the pipeline does not touch the heap: every operator new of the process is counted,
+//a Run() repeated with the same settings on the same recording must not call it.
+//usage: trajectory_allocation_test
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include "Check.h"
+#include "Engine.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif // !M_PI
+
+//more than a few PARALLEL_GRAIN, so the stages really go through the scheduler queues
+#define FIXTURE_ROWS 20000
+#define SAMPLE_MILLISECONDS 10
+//rows of every still and every moving part of the fixture
+#define FIXTURE_PHASE_ROWS 100
+
+static std::atomic<size_t> allocations{ 0 };
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) return memory;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+
+void operator delete(void* memory) noexcept { std::free(memory); }
+void operator delete[](void* memory) noexcept { std::free(memory); }
+void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void* memory, std::size_t) noexcept { std::free(memory); }
+
+//still and moving along x in turns, with gyroscope columns, so zero velocity updates find spans and fusion has input
+static std::string MakeRecording(size_t rows) {
+    std::string text = "t,w,x,y,z,ax,ay,az,gx,gy,gz\n";
+    char line[160];
+    for (size_t i = 0; i < rows; i++) {
+        bool moving = (i / FIXTURE_PHASE_ROWS) % 2 == 1;
+        double phase = 2.0 * M_PI * (i % FIXTURE_PHASE_ROWS) / FIXTURE_PHASE_ROWS;
+        double ax = moving ? 0.2 * std::sin(phase) : 0.0;
+        double gz = moving ? 0.3 * std::sin(phase) : 0.0;
+        int length = std::snprintf(line, sizeof(line), "%d,1.0,0.0,0.0,0.0,%.6f,0.0,1.0,0.0,0.0,%.6f\n", SAMPLE_MILLISECONDS, ax, gz);
+        text.append(line, length);
+    }
+    return text;
+}
+
+//runs warms up the buffers, then the same runs again are counted
+template<class F>
+static void ExpectNoAllocations(const char* name, const F& runs) {
+    if (!runs()) {
+        std::cerr << name << ": warm up run failed" << std::endl;
+        failures++;
+        return;
+    }
+    allocations.store(0);
+    bool ok = runs();
+    size_t count = allocations.load();
+    if (!ok || count != 0) {
+        std::cerr << name << ": " << (ok ? "" : "run failed, ") << count << " allocations in steady state" << std::endl;
+        failures++;
+        return;
+    }
+    std::cout << name << ": 0 allocations" << std::endl;
+}
+
+int main() {
+    std::string text = MakeRecording(FIXTURE_ROWS);
+
+    Trajectory::Settings plain, zupt, resample, fuse, everything;
+    zupt.zeroVelocity = true;
+    resample.resample = true;
+    resample.interpolation = Trajectory::Interpolation::CUBIC;
+    fuse.fuse = true;
+    everything.fuse = true;
+    everything.resample = true;
+    everything.zeroVelocity = true;
+
+    //the queues of the scheduler keep their capacity after the first use
+    Trajectory::Engine warmUp;
+    warmUp.LoadFromMemory(text.data(), text.size());
+    warmUp.Run();
+
+    //spans are reserved with the other buffers, the very first run after a load does not grow them
+    Trajectory::Engine engine;
+    engine.SetSettings(zupt);
+    engine.LoadFromMemory(text.data(), text.size());
+    allocations.store(0);
+    bool ran = engine.Run();
+    if (!ran || allocations.load() != 0 || engine.MovingSpans().empty()) {
+        std::cerr << "first zero velocity run: " << allocations.load() << " allocations, " << engine.MovingSpans().size() / 2 << " spans" << std::endl;
+        failures++;
+    }
+
+    auto runWith = [&engine](const Trajectory::Settings& settings) {
+        return [&engine, settings]() {
+            engine.SetSettings(settings);
+            return engine.Run();
+        };
+    };
+    ExpectNoAllocations("plain", runWith(plain));
+    ExpectNoAllocations("zero velocity", runWith(zupt));
+    ExpectNoAllocations("resample", runWith(resample));
+    ExpectNoAllocations("fuse", runWith(fuse));
+    ExpectNoAllocations("fuse + resample + zero velocity", runWith(everything));
+    ExpectNoAllocations("comparison", [&engine, &everything]() {
+        engine.SetSettings(everything);
+        return engine.RunComparison();
+    });
+    //the loaded, resampled, recorded and fused buffers are swapped back and forth, never given up
+    ExpectNoAllocations("switching", [&]() {
+        return runWith(everything)() && runWith(plain)() && runWith(fuse)() && runWith(resample)() && runWith(zupt)();
+    });
+
+    return Finish();
+}
@@ -0,0 +1,27 @@
+#pragma once
+#ifndef CHECK_H
+#define CHECK_H
+
+#include <iostream>
+
+//checks of the ctest executables: a failed one is printed and counted, the rest still run
+static int failures = 0;
+
+#define CHECK(condition) do { \
+    if (!(condition)) { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": failed: " #condition << std::endl; \
+        failures++; \
+    } \
+} while (0)
+
+//exit code of main
+static int Finish() {
+    if (failures != 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "all checks passed" << std::endl;
+    return 0;
+}
+
+#endif // CHECK_H
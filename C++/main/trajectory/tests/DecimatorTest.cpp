@@ -0,0 +1,135 @@
+//Decimator tests, run by ctest: gain of the filter and the rows of Engine::LoadDecimated().
+//usage: trajectory_decimator_test
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Check.h"
+#include "Decimator.h"
+#include "Engine.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif // !M_PI
+
+//frequencies the response is evaluated at between the output Nyquist frequency and the input one
+#define RESPONSE_POINTS 2000
+//in dB: the stop band of a Kaiser beta 8 window, a little lower for the float taps
+#define STOP_BAND_DB -78.0
+//in dB, up to half the output Nyquist frequency
+#define PASS_BAND_RIPPLE_DB 0.01
+#define SIGNAL_ROWS 20000
+//rows of the LoadDecimated() fixture, 1 ms each
+#define FULL_ROWS 300000
+
+//|H(f)| of the taps, f in cycles per input row
+static double Response(Trajectory::Span<float> taps, double f) {
+    double re = 0.0, im = 0.0;
+    for (size_t k = 0; k < taps.size(); k++) {
+        re += taps[k] * std::cos(2.0 * M_PI * f * k);
+        im -= taps[k] * std::sin(2.0 * M_PI * f * k);
+    }
+    return std::sqrt(re * re + im * im);
+}
+
+//amplitude of a unit sine on one axis after decimation, from the mean square of the rows away from the ends
+static float Amplitude(const Trajectory::Decimator& decimator, double f, int axis) {
+    std::vector<float> input(SIGNAL_ROWS * A_SIZE, 0.0f), output(decimator.OutputRows(SIGNAL_ROWS) * A_SIZE);
+    for (size_t i = 0; i < SIGNAL_ROWS; i++) input[i * A_SIZE + axis] = static_cast<float>(std::sin(2.0 * M_PI * f * i));
+    decimator.Run(input.data(), SIGNAL_ROWS, output.data());
+    size_t margin = decimator.Taps().size() / decimator.Factor();
+    double squares = 0.0;
+    size_t count = 0;
+    for (size_t n = margin; n + margin < decimator.OutputRows(SIGNAL_ROWS); n++, count++) squares += output[n * A_SIZE + axis] * output[n * A_SIZE + axis];
+    return static_cast<float>(std::sqrt(2.0 * squares / count));
+}
+
+static void TestFilter(size_t factor) {
+    Trajectory::Decimator decimator(factor);
+    CHECK(decimator.Factor() == factor);
+    Trajectory::Span<float> taps = decimator.Taps();
+
+    //unit gain at 0 Hz: gravity and constant offsets pass as they are, also at the ends where rows repeat
+    double sum = 0.0;
+    for (float tap : taps) sum += tap;
+    CHECK(std::fabs(sum - 1.0) < 1e-6);
+    const size_t rows = 1000;
+    std::vector<float> constant(rows * A_SIZE), output(decimator.OutputRows(rows) * A_SIZE);
+    for (size_t i = 0; i < rows; i++) {
+        constant[i * A_SIZE] = 0.25f;
+        constant[i * A_SIZE + 1] = -0.5f;
+        constant[i * A_SIZE + 2] = 1.0f;
+    }
+    decimator.Run(constant.data(), rows, output.data());
+    bool flat = true;
+    for (size_t n = 0; n < decimator.OutputRows(rows); n++) {
+        for (int axis = 0; axis < A_SIZE; axis++) flat = flat && std::fabs(output[n * A_SIZE + axis] - constant[axis]) < 1e-5f;
+    }
+    CHECK(flat);
+
+    //stop band from the output Nyquist frequency up, pass band flat below half of it
+    double nyquist = 0.5 / factor, stop = 0.0, ripple = 0.0;
+    for (int i = 0; i <= RESPONSE_POINTS; i++) {
+        stop = std::max(stop, Response(taps, nyquist + (0.5 - nyquist) * i / RESPONSE_POINTS));
+        ripple = std::max(ripple, std::fabs(20.0 * std::log10(Response(taps, 0.5 * nyquist * i / RESPONSE_POINTS))));
+    }
+    if (20.0 * std::log10(stop) > STOP_BAND_DB || ripple > PASS_BAND_RIPPLE_DB) {
+        std::cerr << "factor " << factor << ": stop band " << 20.0 * std::log10(stop) << " dB, pass band ripple " << ripple << " dB" << std::endl;
+    }
+    CHECK(20.0 * std::log10(stop) <= STOP_BAND_DB);
+    CHECK(ripple <= PASS_BAND_RIPPLE_DB);
+
+    //the same through Run(): a sine above the output Nyquist frequency is gone, one well below it stays
+    CHECK(Amplitude(decimator, 1.5 * nyquist, 0) < 2e-4f);
+    CHECK(Amplitude(decimator, 0.45, 1) < 2e-4f);
+    CHECK(std::fabs(Amplitude(decimator, 0.3 * nyquist, 2) - 1.0f) < 2e-3f);
+}
+
+static void TestLoadDecimated() {
+    std::string text = "t,w,x,y,z,ax,ay,az\n";
+    char line[128];
+    for (size_t i = 0; i < FULL_ROWS; i++) {
+        int length = std::snprintf(line, sizeof(line), "1,1.0,0.0,0.0,0.0,%.6f,0.0,1.0\n", 0.1 * std::sin(2.0 * M_PI * i / 5000.0));
+        text.append(line, length);
+    }
+    Trajectory::Engine full;
+    CHECK(full.LoadFromMemory(text.data(), text.size()));
+    double duration = 0.0;
+    for (float t : full.Times()) duration += t;
+
+    //factors up to DECIMATOR_MAX_FACTOR are one filter and give exactly rows / factor rounded up, larger ones are
+    //cascaded; factors that split evenly into stages (10 x 10, 32 x 32) do too, the others give a few rows less
+    //(1000 is 32 x 32, 5000 is 18 x 17 x 17)
+    const size_t factors[] = { 2, 32, 33, 100, 1000, 1024, 5000 };
+    for (size_t factor : factors) {
+        Trajectory::Engine preview;
+        CHECK(preview.LoadDecimated(full, factor));
+        size_t rows = preview.Rows(), exact = (FULL_ROWS + factor - 1) / factor;
+        bool even = factor <= DECIMATOR_MAX_FACTOR || factor == 100 || factor == 1024;
+        if (even ? rows != exact : rows > exact || rows * 5 < exact * 4) {
+            std::cerr << "factor " << factor << ": " << rows << " rows, " << exact << " at the exact factor" << std::endl;
+        }
+        CHECK(even ? rows == exact : rows <= exact && rows * 5 >= exact * 4);
+        CHECK(preview.Times().size() == rows * T_SIZE);
+        CHECK(preview.RawAccelerations().size() == rows * A_SIZE);
+        CHECK(preview.Quaternions().size() == rows * Q_SIZE);
+
+        //the steps add up to the whole recording, gravity passes every stage
+        double previewDuration = 0.0;
+        for (float t : preview.Times()) previewDuration += t;
+        CHECK(std::fabs(previewDuration - duration) < 1e-3 * duration);
+        bool gravity = true;
+        for (size_t i = 0; i < rows; i++) gravity = gravity && std::fabs(preview.RawAccelerations()[i * A_SIZE + 2] - 1.0f) < 1e-4f;
+        CHECK(gravity);
+        CHECK(preview.Run());
+    }
+}
+
+int main() {
+    TestFilter(2);
+    TestFilter(5);
+    TestFilter(DECIMATOR_MAX_FACTOR);
+    TestLoadDecimated();
+    return Finish();
+}
@@ -0,0 +1,400 @@
+//Engine tests without a window, run by ctest.
+//usage: trajectory_engine_test
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Check.h"
+#include "Engine.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif // !M_PI
+
+//10 ms between samples, like the recorder
+#define SAMPLE_MILLISECONDS 10
+#define FIXTURE_ROWS 200
+//x acceleration of the fixture in accelerometer units on top of gravity
+#define FIXTURE_ACCEL 0.1f
+
+//level board, constant acceleration along x, in the format of RecordScene
+static std::string MakeRecording(size_t rows) {
+    std::string text = "t,w,x,y,z,ax,ay,az\n";
+    char line[128];
+    for (size_t i = 0; i < rows; i++) {
+        int length = std::snprintf(line, sizeof(line), "%d,1.0,0.0,0.0,0.0,%.6f,0.0,1.0\n", SAMPLE_MILLISECONDS, FIXTURE_ACCEL);
+        text.append(line, length);
+    }
+    return text;
+}
+
+//level board, own step and x acceleration per row
+static std::string MakeRecording(const std::vector<int>& milliseconds, const std::vector<float>& ax) {
+    std::string text = "t,w,x,y,z,ax,ay,az\n";
+    char line[128];
+    for (size_t i = 0; i < milliseconds.size(); i++) {
+        int length = std::snprintf(line, sizeof(line), "%d,1.0,0.0,0.0,0.0,%.6f,0.0,1.0\n", milliseconds[i], ax[i]);
+        text.append(line, length);
+    }
+    return text;
+}
+
+//level board turning about z at rate rad/s, with gyroscope columns; the recorded quaternion stays the identity
+static std::string MakeTurningRecording(size_t rows, float rate) {
+    std::string text = "t,w,x,y,z,ax,ay,az,gx,gy,gz\n";
+    char line[160];
+    for (size_t i = 0; i < rows; i++) {
+        int length = std::snprintf(line, sizeof(line), "%d,1.0,0.0,0.0,0.0,0.0,0.0,1.0,0.0,0.0,%.6f\n", SAMPLE_MILLISECONDS, rate);
+        text.append(line, length);
+    }
+    return text;
+}
+
+static bool Near(float a, float b) {
+    return std::fabs(a - b) <= 1e-4f * std::max(1.0f, std::fabs(b));
+}
+
+static bool Same(Trajectory::Span<float> a, Trajectory::Span<float> b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i] != b[i]) return false;
+    }
+    return true;
+}
+
+static void TestLoad(const std::string& text) {
+    std::string path = "trajectory_engine_test.csv";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << text;
+    }
+    Trajectory::Engine fromFile, fromMemory;
+    CHECK(fromFile.Load(path));
+    CHECK(fromMemory.LoadFromMemory(text.data(), text.size()));
+    std::remove(path.c_str());
+
+    CHECK(fromFile.Rows() == FIXTURE_ROWS);
+    CHECK(fromMemory.Rows() == FIXTURE_ROWS);
+    CHECK(!fromFile.HasGyroscope());
+    CHECK(fromFile.Run());
+    CHECK(fromMemory.Run());
+    CHECK(Same(fromFile.Positions(), fromMemory.Positions()));
+
+    Trajectory::Engine missing;
+    CHECK(!missing.Load("trajectory_engine_test_missing.csv"));
+    CHECK(!missing.Run());
+}
+
+static void TestMethods(const std::string& text) {
+    const Trajectory::IntegrationMethod methods[METHOD_COUNT] = {
+        Trajectory::IntegrationMethod::SQUARES, Trajectory::IntegrationMethod::TRAPEZOID, Trajectory::IntegrationMethod::RUNGE_KUTTA };
+    Trajectory::Engine engine;
+    CHECK(engine.LoadFromMemory(text.data(), text.size()));
+    for (Trajectory::IntegrationMethod method : methods) {
+        Trajectory::Settings settings;
+        settings.method = method;
+        settings.highPass = false;
+        engine.SetSettings(settings);
+        CHECK(engine.Run());
+
+        size_t rows = engine.Rows();
+        CHECK(rows == FIXTURE_ROWS);
+        CHECK(engine.Times().size() == rows * T_SIZE);
+        CHECK(engine.Quaternions().size() == rows * Q_SIZE);
+        CHECK(engine.RawAccelerations().size() == rows * A_SIZE);
+        CHECK(engine.Rotations().size() == rows * R_SIZE);
+        CHECK(engine.Accelerations().size() == rows * A_SIZE);
+        CHECK(engine.Velocities().size() == rows * INTEGRATION_SIZE);
+        CHECK(engine.Positions().size() == rows * INTEGRATION_SIZE);
+
+        //constant acceleration: every method gives v = a t, positions grow and stay on x
+        float a = FIXTURE_ACCEL * settings.g;
+        float dt = SAMPLE_MILLISECONDS / 1000.0f;
+        Trajectory::Span<float> v = engine.Velocities(), p = engine.Positions();
+        size_t last = (rows - 1) * INTEGRATION_SIZE;
+        CHECK(Near(v[last], a * dt * (rows - 1)));
+        CHECK(Near(v[last + 1], 0.0f) && Near(v[last + 2], 0.0f));
+        CHECK(p[last] > p[last - INTEGRATION_SIZE] && p[last - INTEGRATION_SIZE] > 0.0f);
+        CHECK(Near(p[last + 1], 0.0f) && Near(p[last + 2], 0.0f));
+    }
+}
+
+static void TestRerun(const std::string& text) {
+    //second run with other settings on the loaded rows equals a fresh load with them
+    Trajectory::Settings changed;
+    changed.method = Trajectory::IntegrationMethod::TRAPEZOID;
+    changed.filterCutoff = 0.5;
+
+    Trajectory::Engine engine, fresh;
+    CHECK(engine.LoadFromMemory(text.data(), text.size()));
+    CHECK(engine.Run());
+    std::vector<float> first(engine.Positions().begin(), engine.Positions().end());
+    engine.SetSettings(changed);
+    CHECK(engine.Run());
+    CHECK(engine.Rows() == FIXTURE_ROWS);
+
+    fresh.SetSettings(changed);
+    CHECK(fresh.LoadFromMemory(text.data(), text.size()));
+    CHECK(fresh.Run());
+    CHECK(Same(engine.Positions(), fresh.Positions()));
+    CHECK(!Same(engine.Positions(), Trajectory::Span<float>(first.data(), first.size())));
+
+    //and back again without reloading
+    engine.SetSettings(Trajectory::Settings());
+    CHECK(engine.Run());
+    CHECK(Same(engine.Positions(), Trajectory::Span<float>(first.data(), first.size())));
+}
+
+static void TestResample() {
+    //the step is the time before its row; a 0 ms step stamps rows 2 and 3 with 20 ms,
+    //and they are spread between the stamps around them: row 2 goes to 15 ms
+    const std::vector<int> steps = { 10, 10, 10, 0, 20, 10, 10, 10 };
+    const double spread[] = { 0.0, 0.01, 0.015, 0.02, 0.04, 0.05, 0.06, 0.07 };
+    //a ramp in the spread times, both interpolations give it back exactly only if the rows were spread
+    std::vector<float> ramp(steps.size());
+    for (size_t i = 0; i < steps.size(); i++) ramp[i] = static_cast<float>(0.5 + 4.0 * spread[i]);
+    std::string text = MakeRecording(steps, ramp);
+
+    Trajectory::Engine engine;
+    CHECK(engine.LoadFromMemory(text.data(), text.size()));
+    CHECK(engine.Run());
+    std::vector<float> loadedTimes(engine.Times().begin(), engine.Times().end());
+    std::vector<float> loadedRaw(engine.RawAccelerations().begin(), engine.RawAccelerations().end());
+    std::vector<float> loadedPositions(engine.Positions().begin(), engine.Positions().end());
+
+    const Trajectory::Interpolation interpolations[] = { Trajectory::Interpolation::LINEAR, Trajectory::Interpolation::CUBIC };
+    for (Trajectory::Interpolation interpolation : interpolations) {
+        //mean rate: 7 steps over 70 ms, the grid has as many rows as the recording
+        Trajectory::Settings settings;
+        settings.resample = true;
+        settings.interpolation = interpolation;
+        engine.SetSettings(settings);
+        CHECK(engine.Run());
+        CHECK(engine.IsResampled());
+        CHECK(engine.Rows() == steps.size());
+        CHECK(engine.LoadedRows() == steps.size());
+
+        //given rate: 70 ms at 250 Hz is 17.5 steps, the grid stops at the last loaded row
+        settings.resampleRate = 250.0;
+        engine.SetSettings(settings);
+        CHECK(engine.Run());
+        size_t rows = engine.Rows();
+        CHECK(rows == 18);
+        CHECK(engine.LoadedRows() == steps.size());
+        CHECK(engine.Times().size() == rows * T_SIZE);
+        CHECK(engine.Quaternions().size() == rows * Q_SIZE);
+        CHECK(engine.Positions().size() == rows * INTEGRATION_SIZE);
+        bool uniform = true, exact = true, identity = true;
+        for (size_t i = 0; i < rows; i++) {
+            uniform = uniform && engine.Times()[i] == engine.Times()[0];
+            const float* a = &engine.RawAccelerations()[i * A_SIZE];
+            exact = exact && Near(a[0], static_cast<float>(0.5 + 4.0 * i / 250.0)) && Near(a[1], 0.0f) && Near(a[2], 1.0f);
+            identity = identity && Near(engine.Quaternions()[i * Q_SIZE], 1.0f);
+        }
+        CHECK(uniform);
+        CHECK(Near(engine.Times()[0], 1.0f / 250.0f));
+        CHECK(exact);
+        CHECK(identity);
+    }
+
+    //switched off, the loaded rows come back untouched
+    engine.SetSettings(Trajectory::Settings());
+    CHECK(engine.Run());
+    CHECK(!engine.IsResampled());
+    CHECK(engine.Rows() == steps.size());
+    CHECK(Same(engine.Times(), Trajectory::Span<float>(loadedTimes.data(), loadedTimes.size())));
+    CHECK(Same(engine.RawAccelerations(), Trajectory::Span<float>(loadedRaw.data(), loadedRaw.size())));
+    CHECK(Same(engine.Positions(), Trajectory::Span<float>(loadedPositions.data(), loadedPositions.size())));
+}
+
+static bool NearQuaternion(const float* q, const float* expected, float tolerance) {
+    //q and -q are the same turn
+    float dot = q[0] * expected[0] + q[1] * expected[1] + q[2] * expected[2] + q[3] * expected[3];
+    return std::fabs(std::fabs(dot) - 1.0f) <= tolerance;
+}
+
+static void TestFusion() {
+    const Trajectory::FusionFilter filters[] = { Trajectory::FusionFilter::MADGWICK, Trajectory::FusionFilter::MAHONY };
+    const float dt = SAMPLE_MILLISECONDS / 1000.0f;
+    for (Trajectory::FusionFilter filter : filters) {
+        Trajectory::FusionSettings settings;
+        settings.filter = filter;
+        settings.beta = 0.5f;
+        settings.kp = 2.0f;
+
+        //still board tilted 30 degrees about y: from the identity the filter pulls the gravity it expects
+        //in the sensor frame (third row of the rotation) onto the measured one
+        const float tilt = 30.0f * 3.14159265f / 180.0f;
+        const float accel[A_SIZE] = { std::sin(tilt), 0.0f, std::cos(tilt) };
+        const float still[3] = { 0.0f, 0.0f, 0.0f };
+        Trajectory::Fusion fusion(settings);
+        for (int i = 0; i < 3000; i++) fusion.Update(still, accel, &dt);
+        float q[Q_SIZE];
+        fusion.Get(0, q);
+        float gravity[3] = { 2.0f * (q[1] * q[3] - q[0] * q[2]), 2.0f * (q[0] * q[1] + q[2] * q[3]), 1.0f - 2.0f * (q[1] * q[1] + q[2] * q[2]) };
+        //a Madgwick step has the fixed length beta dt, so it keeps circling the tilt within about that
+        float tolerance = filter == Trajectory::FusionFilter::MADGWICK ? 2.0f * settings.beta * dt : 1e-4f;
+        CHECK(std::fabs(gravity[0] - accel[0]) < tolerance && std::fabs(gravity[1]) < tolerance && std::fabs(gravity[2] - accel[2]) < tolerance);
+
+        //level board at a constant z rate: the accelerometer agrees all the time, yaw is the integral of the rate
+        const float rate = 0.5f, level[A_SIZE] = { 0.0f, 0.0f, 1.0f }, turn[3] = { 0.0f, 0.0f, rate };
+        const int steps = 200;
+        fusion.Reset();
+        for (int i = 0; i < steps; i++) fusion.Update(turn, level, &dt);
+        fusion.Get(0, q);
+        float yaw = rate * dt * steps;
+        const float expected[Q_SIZE] = { std::cos(yaw / 2.0f), 0.0f, 0.0f, std::sin(yaw / 2.0f) };
+        CHECK(NearQuaternion(q, expected, 1e-5f));
+
+        //every lane of a bank follows its own sensor exactly like a single filter
+        Trajectory::FusionBank bank(settings);
+        Trajectory::Fusion lanes[FUSION_LANES];
+        float gyros[3][FUSION_LANES], accels[A_SIZE][FUSION_LANES], dts[FUSION_LANES];
+        for (size_t l = 0; l < FUSION_LANES; l++) {
+            lanes[l].SetSettings(settings);
+            const float start[A_SIZE] = { 0.1f * l, 0.05f, 1.0f };
+            bank.Align(l, start);
+            lanes[l].Align(0, start);
+            dts[l] = dt * (1.0f + 0.1f * l);
+        }
+        bool same = true;
+        for (int i = 0; i < 100; i++) {
+            for (size_t l = 0; l < FUSION_LANES; l++) {
+                float phase = 0.1f * i + l;
+                gyros[0][l] = 0.2f * std::sin(phase);
+                gyros[1][l] = 0.1f * l;
+                gyros[2][l] = -0.3f * std::cos(phase);
+                accels[0][l] = 0.1f * std::cos(phase);
+                accels[1][l] = 0.05f * l;
+                accels[2][l] = 1.0f;
+                //one lane without accelerometer input, gyroscope only
+                if (l == 3) accels[0][l] = accels[1][l] = accels[2][l] = 0.0f;
+                float gyro[3] = { gyros[0][l], gyros[1][l], gyros[2][l] };
+                float lane[A_SIZE] = { accels[0][l], accels[1][l], accels[2][l] };
+                lanes[l].Update(gyro, lane, &dts[l]);
+            }
+            bank.Update(&gyros[0][0], &accels[0][0], dts);
+        }
+        for (size_t l = 0; l < FUSION_LANES; l++) {
+            float fromBank[Q_SIZE], alone[Q_SIZE];
+            bank.Get(l, fromBank);
+            lanes[l].Get(0, alone);
+            for (int c = 0; c < Q_SIZE; c++) same = same && std::fabs(fromBank[c] - alone[c]) <= 1e-6f;
+        }
+        CHECK(same);
+    }
+
+    //Engine: fused quaternions replace the recorded ones, which come back when fusion is switched off
+    const float rate = 0.5f;
+    std::string text = MakeTurningRecording(FIXTURE_ROWS, rate);
+    Trajectory::Engine engine;
+    CHECK(engine.LoadFromMemory(text.data(), text.size()));
+    CHECK(engine.HasGyroscope());
+    CHECK(engine.Run());
+    CHECK(!engine.IsFused());
+    std::vector<float> recorded(engine.Quaternions().begin(), engine.Quaternions().end());
+
+    Trajectory::Settings settings;
+    settings.fuse = true;
+    engine.SetSettings(settings);
+    CHECK(engine.Run());
+    CHECK(engine.IsFused());
+    CHECK(engine.Quaternions().size() == recorded.size());
+    float yaw = rate * dt * FIXTURE_ROWS;
+    const float expected[Q_SIZE] = { std::cos(yaw / 2.0f), 0.0f, 0.0f, std::sin(yaw / 2.0f) };
+    CHECK(NearQuaternion(&engine.Quaternions()[(FIXTURE_ROWS - 1) * Q_SIZE], expected, 1e-5f));
+
+    engine.SetSettings(Trajectory::Settings());
+    CHECK(engine.Run());
+    CHECK(!engine.IsFused());
+    CHECK(Same(engine.Quaternions(), Trajectory::Span<float>(recorded.data(), recorded.size())));
+
+    //nothing to fuse without the gyroscope columns
+    std::string plain = MakeRecording(FIXTURE_ROWS);
+    Trajectory::Engine withoutGyroscope;
+    CHECK(withoutGyroscope.LoadFromMemory(plain.data(), plain.size()));
+    withoutGyroscope.SetSettings(settings);
+    CHECK(!withoutGyroscope.Run());
+}
+
+static void TestZeroVelocity() {
+    //still, one period of a sine along x, still again
+    const size_t stillRows = 150, movingRows = 100, rows = 2 * stillRows + movingRows;
+    std::vector<int> steps(rows, SAMPLE_MILLISECONDS);
+    std::vector<float> ax(rows, 0.0f);
+    for (size_t i = 0; i < movingRows; i++) ax[stillRows + i] = static_cast<float>(0.2 * std::sin(2.0 * M_PI * i / movingRows));
+    std::string text = MakeRecording(steps, ax);
+
+    const Trajectory::IntegrationMethod methods[METHOD_COUNT] = {
+        Trajectory::IntegrationMethod::SQUARES, Trajectory::IntegrationMethod::TRAPEZOID, Trajectory::IntegrationMethod::RUNGE_KUTTA };
+    Trajectory::Engine engine;
+    CHECK(engine.LoadFromMemory(text.data(), text.size()));
+    for (Trajectory::IntegrationMethod method : methods) {
+        Trajectory::Settings settings;
+        settings.method = method;
+        settings.zeroVelocity = true;
+        settings.highPass = false;
+        engine.SetSettings(settings);
+        CHECK(engine.Run());
+
+        //the window (0.2 s, 10 rows each side) blurs the edges of the move, the rest is exact
+        const size_t margin = 20;
+        Trajectory::Span<uint8_t> still = engine.Stationary();
+        Trajectory::Span<size_t> spans = engine.MovingSpans();
+        CHECK(still.size() == rows);
+        CHECK(spans.size() == 2);
+        if (still.size() != rows || spans.size() != 2) return;
+        CHECK(spans[0] + margin >= stillRows && spans[0] <= stillRows);
+        CHECK(spans[1] >= stillRows + movingRows && spans[1] <= stillRows + movingRows + margin);
+        CHECK(engine.StationaryRows() == rows - (spans[1] - spans[0]));
+        bool marked = true, stopped = true;
+        for (size_t i = 0; i < rows; i++) {
+            bool inside = i >= spans[0] && i < spans[1];
+            marked = marked && still[i] == (inside ? 0 : 1);
+            if (!inside) {
+                for (int k = 0; k < INTEGRATION_SIZE; k++) stopped = stopped && engine.Velocities()[i * INTEGRATION_SIZE + k] == 0.0f;
+            }
+        }
+        CHECK(marked);
+        CHECK(stopped);
+        std::vector<float> velocities(engine.Velocities().begin(), engine.Velocities().end());
+        std::vector<float> positions(engine.Positions().begin(), engine.Positions().end());
+
+        //the comparison of all methods gives every one of them as Run() does
+        CHECK(engine.RunComparison());
+        CHECK(Same(engine.MethodVelocities(method), Trajectory::Span<float>(velocities.data(), velocities.size())));
+        CHECK(Same(engine.MethodPositions(method), Trajectory::Span<float>(positions.data(), positions.size())));
+        CHECK(Same(engine.Velocities(), Trajectory::Span<float>(velocities.data(), velocities.size())));
+        CHECK(Same(engine.Positions(), Trajectory::Span<float>(positions.data(), positions.size())));
+    }
+}
+
+static void TestNotEnoughData() {
+    Trajectory::Engine engine;
+    std::string empty = "t,w,x,y,z,ax,ay,az\n";
+    CHECK(engine.LoadFromMemory(empty.data(), empty.size()));
+    CHECK(engine.Rows() == 0);
+    CHECK(!engine.Run());
+    CHECK(!engine.LoadFromMemory("", 0) || engine.Rows() == 0);
+    CHECK(!engine.Run());
+
+    std::string one = MakeRecording(1);
+    CHECK(engine.LoadFromMemory(one.data(), one.size()));
+    CHECK(engine.Rows() == 1);
+    CHECK(!engine.Run());
+}
+
+int main() {
+    std::string text = MakeRecording(FIXTURE_ROWS);
+    TestLoad(text);
+    TestMethods(text);
+    TestRerun(text);
+    TestResample();
+    TestFusion();
+    TestZeroVelocity();
+    TestNotEnoughData();
+    return Finish();
+}
@@ -0,0 +1,151 @@
+//PoseQuery and TimeIndex tests, run by ctest: batched and single lookups against a linear scan.
+//usage: trajectory_pose_query_test
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+#include "Check.h"
+#include "Engine.h"
+#include "PoseQuery.h"
+
+#define FIXTURE_ROWS 500
+//every this many rows the recorder stamped a row with the time of the one before it
+#define DUPLICATE_EVERY 17
+//more than one parallel chunk of PoseQuery
+#define QUERY_COUNT 40000
+
+//board turning about z with an uneven x acceleration and uneven steps, some of them 0 ms
+static std::string MakeRecording() {
+    std::string text = "t,w,x,y,z,ax,ay,az\n";
+    char line[160];
+    for (size_t i = 0; i < FIXTURE_ROWS; i++) {
+        int step = i % DUPLICATE_EVERY == DUPLICATE_EVERY - 1 ? 0 : 7 + static_cast<int>(i % 3) * 3;
+        double angle = 0.03 * i;
+        double ax = 0.1 * std::sin(0.05 * i);
+        int length = std::snprintf(line, sizeof(line), "%d,%.7f,0.0,0.0,%.7f,%.6f,0.0,1.0\n", step, std::cos(angle / 2.0), std::sin(angle / 2.0), ax);
+        text.append(line, length);
+    }
+    return text;
+}
+
+static bool Near(float a, float b) {
+    return std::fabs(a - b) <= 1e-5f * std::max(1.0f, std::fabs(b));
+}
+
+//pose by a linear scan over the rows: the last row at or before time and the one after it
+struct Reference {
+    std::vector<double> times;
+    Trajectory::Span<float> positions, velocities, quaternions;
+
+    explicit Reference(const Trajectory::Engine& engine)
+        : positions(engine.Positions()), velocities(engine.Velocities()), quaternions(engine.Quaternions()) {
+        Trajectory::Span<float> ts = engine.Times();
+        double time = 0.0;
+        for (size_t i = 0; i < engine.Rows(); i++) {
+            if (i > 0) time += std::max(0.0f, ts[i * T_SIZE]);
+            times.push_back(time);
+        }
+    }
+
+    void At(double time, float position[3], float velocity[3], float orientation[4]) const {
+        size_t row = 0, next = 0;
+        float fraction = 0.0f;
+        if (time >= times.back()) {
+            row = next = times.size() - 1;
+        }
+        else if (time > times.front()) {
+            while (times[row + 1] <= time) row++;
+            next = row + 1;
+            fraction = static_cast<float>((time - times[row]) / (times[next] - times[row]));
+        }
+        for (int k = 0; k < 3; k++) {
+            position[k] = positions[row * 3 + k] + (positions[next * 3 + k] - positions[row * 3 + k]) * fraction;
+            velocity[k] = velocities[row * 3 + k] + (velocities[next * 3 + k] - velocities[row * 3 + k]) * fraction;
+        }
+        Trajectory::PoseQuery::Slerp(&quaternions[row * Q_SIZE], &quaternions[next * Q_SIZE], fraction, orientation);
+    }
+};
+
+//batched At() against single At() (the same bits) and against the linear scan
+static void Compare(const char* name, const Trajectory::PoseQuery& query, const Reference& reference, const std::vector<double>& times) {
+    size_t count = times.size();
+    std::vector<float> positions(count * 3), velocities(count * 3), orientations(count * 4);
+    query.At(Trajectory::Span<double>(times.data(), count), positions.data(), velocities.data(), orientations.data());
+    size_t singleMismatches = 0, referenceMismatches = 0;
+    for (size_t i = 0; i < count; i++) {
+        Trajectory::Pose pose = query.At(times[i]);
+        float position[3], velocity[3], orientation[4];
+        reference.At(times[i], position, velocity, orientation);
+        for (int k = 0; k < 3; k++) {
+            if (pose.position[k] != positions[i * 3 + k] || pose.velocity[k] != velocities[i * 3 + k]) singleMismatches++;
+            if (!Near(positions[i * 3 + k], position[k]) || !Near(velocities[i * 3 + k], velocity[k])) referenceMismatches++;
+        }
+        for (int k = 0; k < 4; k++) {
+            if (pose.orientation[k] != orientations[i * 4 + k]) singleMismatches++;
+            if (!Near(orientations[i * 4 + k], orientation[k])) referenceMismatches++;
+        }
+    }
+    if (singleMismatches != 0 || referenceMismatches != 0) {
+        std::cerr << name << ": " << singleMismatches << " values differ from At(time), " << referenceMismatches << " from the scan" << std::endl;
+    }
+    CHECK(singleMismatches == 0);
+    CHECK(referenceMismatches == 0);
+}
+
+int main() {
+    std::string text = MakeRecording();
+    Trajectory::Engine engine;
+    CHECK(engine.LoadFromMemory(text.data(), text.size()));
+    CHECK(engine.Run());
+    Trajectory::PoseQuery query;
+    query.Build(engine);
+    Reference reference(engine);
+    CHECK(query.Rows() == FIXTURE_ROWS);
+    CHECK(query.Duration() == reference.times.back());
+    double duration = query.Duration();
+
+    //ascending, a little past both ends
+    std::vector<double> ascending(QUERY_COUNT);
+    for (size_t i = 0; i < QUERY_COUNT; i++) ascending[i] = -0.1 + (duration + 0.2) * i / (QUERY_COUNT - 1);
+    Compare("ascending", query, reference, ascending);
+
+    //scattered, every lookup far from the previous one
+    std::mt19937_64 random(42);
+    std::uniform_real_distribution<double> uniform(-0.1, duration + 0.1);
+    std::vector<double> scattered(QUERY_COUNT);
+    for (double& time : scattered) time = uniform(random);
+    Compare("scattered", query, reference, scattered);
+
+    //exactly on the rows, with the stamps shared by two rows, and just around them
+    std::vector<double> stamps;
+    for (double time : reference.times) {
+        stamps.push_back(time);
+        stamps.push_back(std::nextafter(time, -1.0));
+        stamps.push_back(std::nextafter(time, duration + 1.0));
+    }
+    Compare("row stamps", query, reference, stamps);
+    Trajectory::TimeIndex::Sample shared = query.Index().Locate(reference.times[DUPLICATE_EVERY - 1]);
+    CHECK(shared.index == DUPLICATE_EVERY - 1 && shared.fraction == 0.0f);
+
+    //times that are not numbers, or not finite, are out of the recording
+    const double infinity = std::numeric_limits<double>::infinity();
+    Trajectory::Pose nan = query.At(std::numeric_limits<double>::quiet_NaN());
+    CHECK(nan.sample == 0);
+    CHECK(nan.position[0] == engine.Positions()[0] && nan.orientation[0] == engine.Quaternions()[0]);
+    CHECK(query.At(-infinity).sample == 0);
+    CHECK(query.At(infinity).sample == FIXTURE_ROWS - 1);
+    CHECK(query.Index().LocateFrom(std::numeric_limits<double>::quiet_NaN(), FIXTURE_ROWS / 2).index == 0);
+    std::vector<double> special = { std::numeric_limits<double>::quiet_NaN(), infinity, -infinity, 0.5 * duration };
+    Compare("not finite", query, reference, std::vector<double>{ infinity, -infinity, 0.5 * duration });
+    std::vector<float> positions(special.size() * 3);
+    query.At(Trajectory::Span<double>(special.data(), special.size()), positions.data(), nullptr, nullptr);
+    CHECK(positions[0] == engine.Positions()[0]);
+
+    //an empty query answers with the default pose
+    Trajectory::PoseQuery empty;
+    CHECK(empty.At(1.0).sample == 0);
+    return Finish();
+}
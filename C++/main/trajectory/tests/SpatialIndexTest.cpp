@@ -0,0 +1,144 @@
+//SpatialIndex tests, run by ctest: every query against a scan over all samples.
+//usage: trajectory_spatial_index_test
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "Check.h"
+#include "SpatialIndex.h"
+
+//more than one level of subtree tasks
+#define PATH_SAMPLES 20000
+//fewer than SPATIAL_LEAF_SAMPLES, the whole tree is one leaf
+#define SHORT_PATH_SAMPLES 10
+#define QUERIES 500
+
+//a wobbly helix, like a board carried in loops; the first 10 of every 50 samples it stands still,
+//so there are equal points and ties
+static std::vector<float> MakePath(size_t samples, std::mt19937& random) {
+    std::normal_distribution<float> noise(0.0f, 0.01f);
+    std::vector<float> path(samples * 3);
+    for (size_t i = 0; i < samples; i++) {
+        if (i > 0 && i % 50 > 0 && i % 50 < 10) {
+            std::copy_n(&path[(i - 1) * 3], 3, &path[i * 3]);
+            continue;
+        }
+        float angle = 0.01f * i;
+        path[i * 3] = std::cos(angle) + noise(random);
+        path[i * 3 + 1] = std::sin(angle) + noise(random);
+        path[i * 3 + 2] = 0.0005f * i + noise(random);
+    }
+    return path;
+}
+
+//distances as SpatialIndex computes them, so a scan finds the same best value
+static float PointDistance(const float* p, const float point[3]) {
+    float d[3] = { p[0] - point[0], p[1] - point[1], p[2] - point[2] };
+    return std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+}
+
+static float RayDistance(const float* p, const float origin[3], const float direction[3]) {
+    float lengthSquared = direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2];
+    float offset[3] = { p[0] - origin[0], p[1] - origin[1], p[2] - origin[2] };
+    float along = std::max(0.0f, (offset[0] * direction[0] + offset[1] * direction[1] + offset[2] * direction[2]) / lengthSquared);
+    float d[3] = { offset[0] - direction[0] * along, offset[1] - direction[1] * along, offset[2] - direction[2] * along };
+    return std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+}
+
+//the hit must be the smallest distance within radius; on a tie any of the closest samples will do
+template<class Distance>
+static bool MatchesScan(const Trajectory::SpatialIndex::Hit& hit, const std::vector<float>& path, float radius, const Distance& distance) {
+    size_t samples = path.size() / 3;
+    bool found = false;
+    float best = radius;
+    for (size_t i = 0; i < samples; i++) {
+        float d = distance(&path[i * 3]);
+        if (d <= best) {
+            best = d;
+            found = true;
+        }
+    }
+    if (hit.found != found) return false;
+    if (!found) return true;
+    return hit.sample < samples && distance(&path[hit.sample * 3]) == best && hit.distance == best;
+}
+
+static void CheckQueries(const std::vector<float>& path, std::mt19937& random) {
+    Trajectory::SpatialIndex index;
+    index.Build(Trajectory::Span<float>(path.data(), path.size()));
+    size_t samples = path.size() / 3;
+    CHECK(index.Samples() == samples);
+
+    std::uniform_real_distribution<float> coordinate(-1.5f, 1.5f), height(-0.5f, 0.0005f * samples + 0.5f), radius(0.0f, 0.3f);
+    size_t nearest = 0, rays = 0, boxes = 0;
+    std::vector<uint32_t> found;
+    for (int q = 0; q < QUERIES; q++) {
+        const float point[3] = { coordinate(random), coordinate(random), height(random) };
+        float r = radius(random);
+        //a few searches without a limit
+        if (q % 10 == 0) r = 1e6f;
+
+        Trajectory::SpatialIndex::Hit hit = index.Nearest(point, r);
+        if (!MatchesScan(hit, path, r, [&](const float* p) { return PointDistance(p, point); })) nearest++;
+
+        //rays from outside towards the path, some along an axis
+        float direction[3] = { coordinate(random), coordinate(random), coordinate(random) };
+        if (q % 7 == 0) direction[0] = direction[1] = 0.0f;
+        if (direction[0] == 0.0f && direction[1] == 0.0f && direction[2] == 0.0f) direction[2] = 1.0f;
+        hit = index.PickRay(point, direction, r);
+        if (!MatchesScan(hit, path, r, [&](const float* p) { return RayDistance(p, point, direction); })) rays++;
+
+        float low[3], high[3];
+        for (int k = 0; k < 3; k++) {
+            float extent = radius(random) * (q % 5 == 0 ? 10.0f : 1.0f);
+            low[k] = point[k] - extent;
+            high[k] = point[k] + extent;
+        }
+        index.InBox(low, high, found);
+        std::vector<uint32_t> expected;
+        for (size_t i = 0; i < samples; i++) {
+            const float* p = &path[i * 3];
+            if (p[0] >= low[0] && p[0] <= high[0] && p[1] >= low[1] && p[1] <= high[1] && p[2] >= low[2] && p[2] <= high[2]) {
+                expected.push_back(static_cast<uint32_t>(i));
+            }
+        }
+        std::sort(found.begin(), found.end());
+        if (found != expected) boxes++;
+    }
+    if (nearest != 0 || rays != 0 || boxes != 0) {
+        std::cerr << samples << " samples: " << nearest << " Nearest, " << rays << " PickRay, " << boxes << " InBox queries differ from the scan" << std::endl;
+    }
+    CHECK(nearest == 0);
+    CHECK(rays == 0);
+    CHECK(boxes == 0);
+}
+
+int main() {
+    std::mt19937 random(7);
+    CheckQueries(MakePath(PATH_SAMPLES, random), random);
+    CheckQueries(MakePath(SHORT_PATH_SAMPLES, random), random);
+    CheckQueries(MakePath(1, random), random);
+
+    //nothing built, and an empty path: no hits, no samples
+    const float origin[3] = { 0.0f, 0.0f, 0.0f }, up[3] = { 0.0f, 0.0f, 1.0f };
+    const float low[3] = { -1e6f, -1e6f, -1e6f }, high[3] = { 1e6f, 1e6f, 1e6f };
+    std::vector<uint32_t> found = { 1 };
+    Trajectory::SpatialIndex index;
+    for (int built = 0; built < 2; built++) {
+        if (built) index.Build(Trajectory::Span<float>());
+        CHECK(index.Samples() == 0);
+        CHECK(!index.Nearest(origin, 1e6f).found);
+        CHECK(!index.PickRay(origin, up, 1e6f).found);
+        index.InBox(low, high, found);
+        CHECK(found.empty());
+    }
+
+    //a cleared index is empty again
+    std::vector<float> path = MakePath(SHORT_PATH_SAMPLES, random);
+    index.Build(Trajectory::Span<float>(path.data(), path.size()));
+    CHECK(index.Nearest(origin, 1e6f).found);
+    index.Clear();
+    CHECK(index.Samples() == 0 && !index.Nearest(origin, 1e6f).found);
+    return Finish();
+}
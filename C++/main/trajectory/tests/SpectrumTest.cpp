@@ -0,0 +1,133 @@
+//Spectrum tests, run by ctest: Welch density of known signals and the reuse of unchanged parts.
+//usage: trajectory_spectrum_test
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "Check.h"
+#include "Engine.h"
+#include "Spectrum.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif // !M_PI
+
+//100 Hz rows, level board, so world x and y are the recorded ax and ay times g
+#define SAMPLE_MILLISECONDS 10
+#define FIXTURE_ROWS 20000
+#define SEGMENT 256
+//on a bin of SEGMENT at 100 Hz: 32 * 100 / 256
+#define SINE_HZ 12.5
+#define SINE_AMPLITUDE 0.1
+#define NOISE_DEVIATION 0.02
+
+static std::string MakeRecording(const std::vector<float>& ax, const std::vector<float>& ay) {
+    std::string text = "t,w,x,y,z,ax,ay,az\n";
+    char line[128];
+    for (size_t i = 0; i < ax.size(); i++) {
+        int length = std::snprintf(line, sizeof(line), "%d,1.0,0.0,0.0,0.0,%.6f,%.6f,1.0\n", SAMPLE_MILLISECONDS, ax[i], ay[i]);
+        text.append(line, length);
+    }
+    return text;
+}
+
+//variance of one axis of the world frame acceleration
+static double Variance(const Trajectory::Engine& engine, int axis) {
+    Trajectory::Span<float> a = engine.Accelerations();
+    size_t rows = engine.Rows();
+    double mean = 0.0, squares = 0.0;
+    for (size_t i = 0; i < rows; i++) mean += a[i * A_SIZE + axis];
+    mean /= rows;
+    for (size_t i = 0; i < rows; i++) squares += (a[i * A_SIZE + axis] - mean) * (a[i * A_SIZE + axis] - mean);
+    return squares / rows;
+}
+
+static bool SameSpectrum(const Trajectory::Spectrum& a, const Trajectory::Spectrum& b) {
+    if (a.Density().size() != b.Density().size() || a.Spectrogram().size() != b.Spectrogram().size()) return false;
+    for (size_t i = 0; i < a.Density().size(); i++) {
+        if (a.Density()[i] != b.Density()[i]) return false;
+    }
+    for (size_t i = 0; i < a.Spectrogram().size(); i++) {
+        if (a.Spectrogram()[i] != b.Spectrogram()[i]) return false;
+    }
+    return true;
+}
+
+int main() {
+    //sine along x, white noise along y
+    std::mt19937 random(3);
+    std::normal_distribution<float> noise(0.0f, NOISE_DEVIATION);
+    std::vector<float> ax(FIXTURE_ROWS), ay(FIXTURE_ROWS);
+    for (size_t i = 0; i < FIXTURE_ROWS; i++) {
+        ax[i] = static_cast<float>(SINE_AMPLITUDE * std::sin(2.0 * M_PI * SINE_HZ * i * SAMPLE_MILLISECONDS / 1000.0));
+        ay[i] = noise(random);
+    }
+    std::string text = MakeRecording(ax, ay);
+    Trajectory::Engine engine;
+    CHECK(engine.LoadFromMemory(text.data(), text.size()));
+    CHECK(engine.Run());
+
+    Trajectory::SpectrumSettings settings;
+    settings.segment = SEGMENT;
+    Trajectory::Spectrum spectrum;
+    CHECK(spectrum.Run(engine, settings));
+    CHECK(spectrum.Bins() == SEGMENT / 2 + 1);
+    if (spectrum.Bins() != SEGMENT / 2 + 1) return Finish();
+
+    //the peak is the bin of the sine
+    double binWidth = spectrum.Frequencies()[1];
+    CHECK(std::fabs(spectrum.GetStats().peakFrequency - SINE_HZ) <= binWidth / 2.0);
+
+    //Parseval: the density integrates to the variance of every axis
+    for (int axis = 0; axis < A_SIZE; axis++) {
+        double integral = 0.0;
+        for (size_t k = 0; k < spectrum.Bins(); k++) integral += spectrum.Density()[k * A_SIZE + axis] * binWidth;
+        double variance = Variance(engine, axis);
+        CHECK(std::fabs(integral - variance) <= 0.03 * variance + 1e-9);
+    }
+
+    //unchanged input: nothing is computed again
+    std::vector<float> first(spectrum.Spectrogram().begin(), spectrum.Spectrogram().end());
+    CHECK(spectrum.GetStats().columnsComputed == spectrum.Columns());
+    CHECK(spectrum.Run(engine, settings));
+    size_t begin = 0, end = 0;
+    spectrum.ChangedColumns(begin, end);
+    CHECK(spectrum.GetStats().columnsComputed == 0);
+    CHECK(begin == end);
+    CHECK(std::vector<float>(spectrum.Spectrogram().begin(), spectrum.Spectrogram().end()) == first);
+
+    //one changed sample: only its part, and the result of a fresh Spectrum
+    size_t changed = FIXTURE_ROWS / 3;
+    ax[changed] += 0.5f;
+    std::string edited = MakeRecording(ax, ay);
+    Trajectory::Engine editedEngine;
+    CHECK(editedEngine.LoadFromMemory(edited.data(), edited.size()));
+    CHECK(editedEngine.Run());
+    CHECK(spectrum.Run(editedEngine, settings));
+    spectrum.ChangedColumns(begin, end);
+    size_t columns = spectrum.Columns();
+    size_t column = changed * columns / FIXTURE_ROWS;
+    CHECK(spectrum.GetStats().columnsComputed == end - begin);
+    CHECK(end - begin > 0 && end - begin < columns / 4);
+    CHECK(begin <= column && column < end);
+    Trajectory::Spectrum fresh;
+    CHECK(fresh.Run(editedEngine, settings));
+    CHECK(SameSpectrum(spectrum, fresh));
+
+    //segments shorter than SPECTRUM_MIN_SEGMENT, or not a power of two, are refused
+    Trajectory::SpectrumSettings shortSegment;
+    shortSegment.segment = SPECTRUM_MIN_SEGMENT / 2;
+    CHECK(!spectrum.Run(engine, shortSegment));
+    Trajectory::SpectrumSettings uneven;
+    uneven.segment = 3 * SPECTRUM_MIN_SEGMENT;
+    CHECK(!spectrum.Run(engine, uneven));
+    //so is a recording shorter than that
+    std::vector<float> few(SPECTRUM_MIN_SEGMENT - 1, 0.0f);
+    std::string shortText = MakeRecording(few, few);
+    Trajectory::Engine shortEngine;
+    CHECK(shortEngine.LoadFromMemory(shortText.data(), shortText.size()));
+    CHECK(shortEngine.Run());
+    CHECK(!spectrum.Run(shortEngine, settings));
+    return Finish();
+}
@@ -3,17 +3,24 @@ import numpy as np
 import matplotlib.pyplot as plt
 from pathlib import Path
 
+def load_stage(stage_file):
+    """Load stage file saved by visualizer: binary .npy (no parsing) or .csv with header"""
+    if stage_file.endswith('.npy'):
+        return np.load(stage_file), []
+    data = np.genfromtxt(stage_file, delimiter=',', skip_header=1)
+    with open(stage_file, 'r') as f:
+        headers = f.readline().strip().split(',')
+    return data, headers
+
 def plot_csv_columns(csv_file):
     try:
-        data = np.genfromtxt(csv_file, delimiter=',', skip_header=1)
+        data, headers = load_stage(csv_file)
         
         if data.size == 0:
             print(f"Файл {csv_file} пустой.")
             return
         if data.ndim == 1:
             data = data.reshape(-1, 1)
-        with open(csv_file, 'r') as f:
-            headers = f.readline().strip().split(',')
         plt.figure(figsize=(10, 6))
         colors = ['r', 'g', 'b', 'c', 'm', 'y', 'k']
         
@@ -37,5 +44,5 @@ def plot_csv_columns(csv_file):
         print(f"Ошибка при обработке файла {csv_file}: {str(e)}")
 
 for file in os.listdir():
-    if file.endswith('.csv'):
+    if file.endswith('.csv') or file.endswith('.npy'):
         plot_csv_columns(file)